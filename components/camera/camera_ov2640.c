@@ -12,9 +12,12 @@
 #include "esp_camera.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "img_converters.h"
+#include "jpeg_scan.h"
+#include "storage_io.h"
 
 void camera_ov2640_get_default_pins(camera_ov2640_pins_t *pins)
 {
@@ -42,13 +45,49 @@ void camera_ov2640_get_default_pins(camera_ov2640_pins_t *pins)
     };
 }
 
-#define VIDEO_FRAME_SIZE   FRAMESIZE_VGA
-#define VIDEO_JPEG_QUALITY 12
+#define VIDEO_PROFILE      "default"
 #define VIDEO_XCLK_HZ      10000000
-#define VIDEO_FLUSH_BYTES  (4 * 1024 * 1024)
+
+// Region of interest in UXGA (1600x1200) sensor pixels. A width of 0 records
+// the whole field at the frame size of the profile. An output size of 0 keeps the native
+// resolution of the window, otherwise the sensor scales the window down.
+#define VIDEO_ROI_X        0
+#define VIDEO_ROI_Y        0
+#define VIDEO_ROI_WIDTH    0
+#define VIDEO_ROI_HEIGHT   0
+#define VIDEO_ROI_OUT_W    0
+#define VIDEO_ROI_OUT_H    0
+#define CAMERA_NVS_KEY     "camera"
+// Share of recorded JPEG frames the frame buffers are resized to hold
+#define VIDEO_FB_PERCENTILE 99
+// Rejected frames listed one per line in the .TXT file next to the video,
+// the rest are only counted
+#define VIDEO_BAD_FRAME_LINES 100
+#define CAMERA_SETTLE_MS   2000
+// The record task encodes the black frame on a profile switch (fmt2jpg keeps
+// its ~1.1 KB encoder on the stack) and prints to the metadata file, newlib's
+// vfprintf needs another ~1.5 KB
+#define CAMERA_RECORD_TASK_STACK 8192
 
 static const char *TAG = "example";
 
+typedef struct {
+    const char *name;
+    framesize_t frame_size;
+    int jpeg_quality;
+    int fps;                // 0 records every frame the sensor delivers
+} camera_profile_t;
+
+// Capture profiles for camera_app_set_profile(). The frame buffers are
+// allocated once for the largest frame size here, so switching only
+// rewrites the sensor registers that differ.
+static const camera_profile_t s_profiles[] = {
+    { "default",   FRAMESIZE_VGA,  12, 0 },
+    { "detail",    FRAMESIZE_VGA,  8,  0 },
+    { "low",       FRAMESIZE_QVGA, 12, 15 },
+    { "timelapse", FRAMESIZE_QVGA, 10, 1 },
+};
+
 typedef struct {
     char path[64];
 } camera_task_args_t;
@@ -58,36 +97,62 @@ static bool s_camera_ready = false;
 static uint8_t *s_black_jpeg = NULL;
 static size_t s_black_jpeg_len = 0;
 static bool s_psram_ok = false;
+static const camera_profile_t *s_profile = NULL;
+static const camera_profile_t *volatile s_profile_request = NULL;
 
 // Returns the resolution for the selected camera frame size.
 static void s_frame_size_to_dim(framesize_t size, int *width, int *height)
 {
-    switch (size) {
-        case FRAMESIZE_QQVGA:
-            *width = 160;
-            *height = 120;
-            break;
-        case FRAMESIZE_QVGA:
-            *width = 320;
-            *height = 240;
-            break;
-        case FRAMESIZE_VGA:
-            *width = 640;
-            *height = 480;
-            break;
-        default:
-            *width = 640;
-            *height = 480;
-            break;
+    *width = resolution[size].width;
+    *height = resolution[size].height;
+}
+
+static const camera_profile_t *s_find_profile(const char *name)
+{
+    for (size_t i = 0; i < sizeof(s_profiles) / sizeof(s_profiles[0]); i++) {
+        if (strcmp(s_profiles[i].name, name) == 0) {
+            return &s_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+// DRAM frame buffers only hold QVGA frames.
+static framesize_t s_profile_frame_size(const camera_profile_t *profile)
+{
+    if (!s_psram_ok && resolution[profile->frame_size].width > resolution[FRAMESIZE_QVGA].width) {
+        return FRAMESIZE_QVGA;
+    }
+    return profile->frame_size;
+}
+
+// Largest frame size of all profiles, the frame buffers are sized for it.
+static framesize_t s_profile_frame_size_max(void)
+{
+    framesize_t max = FRAMESIZE_96X96;
+    for (size_t i = 0; i < sizeof(s_profiles) / sizeof(s_profiles[0]); i++) {
+        framesize_t size = s_profile_frame_size(&s_profiles[i]);
+        if (resolution[size].width * resolution[size].height > resolution[max].width * resolution[max].height) {
+            max = size;
+        }
+    }
+    return max;
+}
+
+// Returns the resolution the camera delivers, the ROI output when one is set.
+static void s_config_to_dim(const camera_config_t *config, int *width, int *height)
+{
+    if (config->roi.width) {
+        *width = config->roi.out_width ? config->roi.out_width : config->roi.width;
+        *height = config->roi.out_height ? config->roi.out_height : config->roi.height;
+    } else {
+        s_frame_size_to_dim(config->frame_size, width, height);
     }
 }
 
 // Builds a black JPEG frame that can be reused while paused.
-static esp_err_t s_prepare_black_frame(framesize_t size, int quality)
+static esp_err_t s_prepare_black_frame(int width, int height, int quality)
 {
-    int width = 0;
-    int height = 0;
-    s_frame_size_to_dim(size, &width, &height);
     if (width <= 0 || height <= 0) {
         return ESP_ERR_INVALID_SIZE;
     }
@@ -121,11 +186,153 @@ static esp_err_t s_prepare_black_frame(framesize_t size, int quality)
     return ESP_OK;
 }
 
-// Records MJPEG frames to a file while the main recorder is active.
+static bool s_jpeg_is_complete(const camera_fb_t *fb)
+{
+    return fb->len >= 4 && fb->buf[0] == 0xFF && fb->buf[1] == 0xD8 &&
+           fb->buf[fb->len - 2] == 0xFF && fb->buf[fb->len - 1] == 0xD9;
+}
+
+static bool s_ae_close(const camera_ae_state_t *a, const camera_ae_state_t *b)
+{
+    return abs((int)a->aec_value - (int)b->aec_value) <= b->aec_value / 16 &&
+           abs((int)a->agc_gain - (int)b->agc_gain) <= 1;
+}
+
+// Drops frames until one is complete and exposure has stopped moving, then
+// logs the time to the first usable frame. With a warm sensor the state it
+// already holds is the reference, so the first complete frame usually counts.
+static void s_wait_for_usable_frame(const char *what, bool warm)
+{
+    sensor_t *s = esp_camera_sensor_get();
+    camera_ae_state_t ref = {0};
+    camera_ae_state_t cur;
+    bool have_ref = false;
+    if (warm && s->get_ae_state && s->get_ae_state(s, &ref) == 0) {
+        have_ref = true;
+    }
+
+    int frames = 0;
+    TickType_t start = xTaskGetTickCount();
+    while (pdTICKS_TO_MS(xTaskGetTickCount() - start) < CAMERA_SETTLE_MS) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            continue;
+        }
+        frames++;
+        bool complete = s_jpeg_is_complete(fb);
+        esp_camera_fb_return(fb);
+        if (!complete) {
+            continue;
+        }
+        if (!s->get_ae_state || s->get_ae_state(s, &cur) != 0) {
+            break;
+        }
+        if (have_ref && s_ae_close(&cur, &ref)) {
+            ESP_LOGI(TAG, "%s: first usable frame after %lu ms (%d frames, %s start, aec=%u gain=0x%02x)",
+                     what, (unsigned long)pdTICKS_TO_MS(xTaskGetTickCount() - start), frames,
+                     warm ? "warm" : "cold", (unsigned)cur.aec_value, (unsigned)cur.agc_gain);
+            return;
+        }
+        ref = cur;
+        have_ref = true;
+    }
+    ESP_LOGW(TAG, "%s: exposure not settled after %lu ms (%d frames, %s start)",
+             what, (unsigned long)pdTICKS_TO_MS(xTaskGetTickCount() - start), frames, warm ? "warm" : "cold");
+}
+
+// Loads the sensor state saved by the last recording. Returns false on a
+// cold start.
+static bool s_restore_sensor_state(const camera_config_t *config)
+{
+    esp_err_t ret = esp_camera_load_from_nvs(CAMERA_NVS_KEY);
+    if (ret != ESP_OK) {
+        ESP_LOGI(TAG, "No saved camera state (%s)", esp_err_to_name(ret));
+        return false;
+    }
+
+    // The saved settings may come from a build with another configuration.
+    sensor_t *s = esp_camera_sensor_get();
+    if (s->pixformat != config->pixel_format) {
+        s->set_pixformat(s, config->pixel_format);
+    }
+    if (s->status.framesize != config->frame_size) {
+        s->set_framesize(s, config->frame_size);
+    }
+    if (s->status.quality != config->jpeg_quality) {
+        s->set_quality(s, config->jpeg_quality);
+    }
+    return true;
+}
+
+// Switches the running camera to a profile. Called while no frame is held.
+static esp_err_t s_apply_profile(const camera_profile_t *profile)
+{
+    sensor_t *s = esp_camera_sensor_get();
+    framesize_t size = s_profile_frame_size(profile);
+    bool resized = false;
+    int64_t start = esp_timer_get_time();
+
+    // a region of interest fixes the output size, only quality and rate apply
+    if (!VIDEO_ROI_WIDTH && s->status.framesize != size) {
+        esp_err_t ret = esp_camera_set_frame_size(size);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Profile %s: frame size switch failed (%s)", profile->name, esp_err_to_name(ret));
+            return ret;
+        }
+        resized = true;
+    }
+    bool requality = s->status.quality != profile->jpeg_quality;
+    if (requality) {
+        s->set_quality(s, profile->jpeg_quality);
+    }
+    int64_t switch_us = esp_timer_get_time() - start;
+
+    if (s_psram_ok && (resized || requality)) {
+        int width = 0;
+        int height = 0;
+        if (VIDEO_ROI_WIDTH) {
+            width = VIDEO_ROI_OUT_W ? VIDEO_ROI_OUT_W : VIDEO_ROI_WIDTH;
+            height = VIDEO_ROI_OUT_H ? VIDEO_ROI_OUT_H : VIDEO_ROI_HEIGHT;
+        } else {
+            s_frame_size_to_dim(size, &width, &height);
+        }
+        esp_err_t ret = s_prepare_black_frame(width, height, profile->jpeg_quality);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Black frame for profile %s failed (%s)", profile->name, esp_err_to_name(ret));
+        }
+    }
+
+    s_profile = profile;
+    ESP_LOGI(TAG, "Profile %s: %ux%u q=%d fps=%d, switched in %lld us", profile->name,
+             resolution[s->status.framesize].width, resolution[s->status.framesize].height,
+             profile->jpeg_quality, profile->fps, (long long)switch_us);
+    return ESP_OK;
+}
+
+// Opens the recording metadata file, VIDxxxx.MJP gets VIDxxxx.TXT.
+static FILE *s_open_metadata(const char *video_path)
+{
+    char path[sizeof(((camera_task_args_t *)0)->path)];
+    strlcpy(path, video_path, sizeof(path));
+    char *ext = strrchr(path, '.');
+    if (!ext || strlen(ext) != 4) {
+        return NULL;
+    }
+    strcpy(ext, ".TXT");
+    FILE *f = storage_io_fopen(path, STORAGE_IO_PRIO_LOW);
+    if (!f) {
+        int err = errno;
+        ESP_LOGW(TAG, "Failed to open metadata file %s (errno=%d: %s)", path, err, strerror(err));
+    }
+    return f;
+}
+
+// Records MJPEG frames to a file while the main recorder is active. The
+// storage task writes and syncs the file, behind any audio.
 static void s_camera_record_task(void *arg)
 {
     camera_task_args_t *args = (camera_task_args_t *)arg;
-    FILE *f = fopen(args->path, "wb");
+    FILE *f = storage_io_fopen(args->path, STORAGE_IO_PRIO_LOW);
     if (!f) {
         int err = errno;
         ESP_LOGE(TAG, "Failed to open video file %s (errno=%d: %s)", args->path, err, strerror(err));
@@ -134,11 +341,23 @@ static void s_camera_record_task(void *arg)
         vTaskDelete(NULL);
         return;
     }
+    FILE *meta = s_open_metadata(args->path);
+
+    // The sensor kept running since the last recording, so its live state is
+    // newer than anything saved; just skip stale and settling frames.
+    s_wait_for_usable_frame("record", true);
 
-    size_t bytes_since_flush = 0;
     uint32_t bad_jpeg_count = 0;
+    uint32_t bad_by_result[JPEG_SCAN_ERR_MAX] = {0};
     uint32_t good_frame_count = 0;
+    size_t file_offset = 0;
+    int64_t next_frame_us = 0;
     while (button_is_recording()) {
+        const camera_profile_t *request = __atomic_exchange_n(&s_profile_request, NULL, __ATOMIC_ACQ_REL);
+        if (request && s_apply_profile(request) == ESP_OK) {
+            next_frame_us = 0;
+        }
+
         camera_fb_t *fb = esp_camera_fb_get();
         if (!fb) {
             ESP_LOGE(TAG, "Camera capture failed");
@@ -146,22 +365,45 @@ static void s_camera_record_task(void *arg)
             continue;
         }
 
+        // thin out to the profile frame rate by capture time
+        if (s_profile->fps) {
+            int64_t period_us = 1000000 / s_profile->fps;
+            int64_t ts = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+            if (ts < next_frame_us) {
+                esp_camera_fb_return(fb);
+                continue;
+            }
+            // keep the cadence unless the camera fell more than a period behind
+            next_frame_us = ts - next_frame_us < period_us ? next_frame_us + period_us : ts + period_us;
+        }
+
         if (button_is_paused() && s_black_jpeg && s_black_jpeg_len > 0) {
             fwrite(s_black_jpeg, 1, s_black_jpeg_len, f);
-            bytes_since_flush += s_black_jpeg_len;
+            file_offset += s_black_jpeg_len;
         } else {
-            if (fb->len < 4 || fb->buf[0] != 0xFF || fb->buf[1] != 0xD8 ||
-                fb->buf[fb->len - 2] != 0xFF || fb->buf[fb->len - 1] != 0xD9) {
+            // a structurally broken frame would stop most players at that point
+            jpeg_scan_info_t info;
+            jpeg_scan_result_t result = jpeg_scan_validate(fb->buf, fb->len, &info);
+            if (result != JPEG_SCAN_OK) {
                 bad_jpeg_count++;
+                bad_by_result[result]++;
                 if ((bad_jpeg_count % 50) == 1) {
-                    ESP_LOGW(TAG, "Skipping bad JPEG frame (SOI/EOI), count=%u", (unsigned)bad_jpeg_count);
+                    ESP_LOGW(TAG, "Skipping bad JPEG frame (%s at %u of %u), count=%u", jpeg_scan_result_to_name(result),
+                             (unsigned)info.error_offset, (unsigned)fb->len, (unsigned)bad_jpeg_count);
+                }
+                if (meta && bad_jpeg_count <= VIDEO_BAD_FRAME_LINES) {
+                    fprintf(meta, "bad frame after %u at offset %u, time %lld.%06ld: %s at byte %u of %u\n",
+                            (unsigned)good_frame_count, (unsigned)file_offset, (long long)fb->timestamp.tv_sec,
+                            (long)fb->timestamp.tv_usec, jpeg_scan_result_to_name(result),
+                            (unsigned)info.error_offset, (unsigned)fb->len);
                 }
                 esp_camera_fb_return(fb);
                 vTaskDelay(pdMS_TO_TICKS(10));
                 continue;
             }
-            fwrite(fb->buf, 1, fb->len, f);
-            bytes_since_flush += fb->len;
+            // drop any padding the DMA left after EOI
+            fwrite(fb->buf, 1, info.length, f);
+            file_offset += info.length;
             good_frame_count++;
             if ((good_frame_count % 50) == 0) {
                 ESP_LOGI(TAG, "Wrote %u frames (%u bad)", (unsigned)good_frame_count, (unsigned)bad_jpeg_count);
@@ -169,17 +411,53 @@ static void s_camera_record_task(void *arg)
         }
 
         esp_camera_fb_return(fb);
+    }
 
-        if (bytes_since_flush >= VIDEO_FLUSH_BYTES) {
-            fflush(f);
-            fsync(fileno(f));
-            bytes_since_flush = 0;
+    if (fclose(f) != 0) {
+        int err = errno;
+        ESP_LOGE(TAG, "Writing video file %s failed (errno=%d: %s)", args->path, err, strerror(err));
+    }
+
+    if (bad_jpeg_count) {
+        ESP_LOGW(TAG, "Skipped %u bad JPEG frames of %u", (unsigned)bad_jpeg_count,
+                 (unsigned)(bad_jpeg_count + good_frame_count));
+    }
+    if (meta) {
+        fprintf(meta, "frames %u written, %u bad", (unsigned)good_frame_count, (unsigned)bad_jpeg_count);
+        for (int i = JPEG_SCAN_OK + 1; i < JPEG_SCAN_ERR_MAX; i++) {
+            if (bad_by_result[i]) {
+                fprintf(meta, ", %s %u", jpeg_scan_result_to_name(i), (unsigned)bad_by_result[i]);
+            }
         }
+        fprintf(meta, "\n");
+        fclose(meta);
     }
 
-    fflush(f);
-    fsync(fileno(f));
-    fclose(f);
+    if (good_frame_count > 0) {
+        esp_err_t ret = esp_camera_save_to_nvs(CAMERA_NVS_KEY);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Saving camera state failed (%s)", esp_err_to_name(ret));
+        }
+    }
+
+    esp_camera_stats_t stats;
+    if (esp_camera_get_stats(&stats) == ESP_OK) {
+        ESP_LOGI(TAG, "Camera stats: captured=%u returned=%u dropped=%u no-soi=%u no-eoi=%u ovf=%u gdma-reset=%u",
+                 (unsigned)stats.frames_captured, (unsigned)stats.frames_returned,
+                 (unsigned)stats.frames_dropped_full, (unsigned)stats.jpeg_no_soi,
+                 (unsigned)stats.jpeg_no_eoi, (unsigned)stats.fb_overflows,
+                 (unsigned)stats.gdma_resets);
+    }
+
+    // every frame has been returned, resize the buffers for the next recording
+    size_t fb_size;
+    esp_err_t ret = esp_camera_fb_adapt(VIDEO_FB_PERCENTILE, 0, &fb_size);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "JPEG frame buffers resized to %u bytes", (unsigned)fb_size);
+    } else if (ret != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Resizing frame buffers failed (%s)", esp_err_to_name(ret));
+    }
+    ESP_LOGI(TAG, "Record task stack: %u bytes never used", (unsigned)uxTaskGetStackHighWaterMark(NULL));
     s_camera_task = NULL;
     free(args);
     vTaskDelete(NULL);
@@ -229,6 +507,11 @@ esp_err_t camera_app_init(void)
     if (!psram_ok) {
         ESP_LOGW(TAG, "PSRAM not initialized; using DRAM framebuffer and smaller frame size");
     }
+    const camera_profile_t *profile = s_find_profile(VIDEO_PROFILE);
+    if (!profile) {
+        ESP_LOGE(TAG, "Unknown capture profile %s", VIDEO_PROFILE);
+        return ESP_ERR_NOT_FOUND;
+    }
 
     camera_config_t config = {
         .pin_pwdn = pins.pin_pwdn,
@@ -251,37 +534,44 @@ esp_err_t camera_app_init(void)
         .ledc_timer = LEDC_TIMER_1,
         .ledc_channel = LEDC_CHANNEL_1,
         .pixel_format = PIXFORMAT_JPEG,
-        .frame_size = psram_ok ? VIDEO_FRAME_SIZE : FRAMESIZE_QVGA,
-        .jpeg_quality = VIDEO_JPEG_QUALITY,
+        .frame_size = s_profile_frame_size(profile),
+        .jpeg_quality = profile->jpeg_quality,
         .fb_count = psram_ok ? 3 : 1,
         .fb_location = psram_ok ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM,
         .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
         .sccb_i2c_port = I2C_NUM_0,
+        .roi = {
+            .x = VIDEO_ROI_X,
+            .y = VIDEO_ROI_Y,
+            .width = VIDEO_ROI_WIDTH,
+            .height = VIDEO_ROI_HEIGHT,
+            .out_width = VIDEO_ROI_OUT_W,
+            .out_height = VIDEO_ROI_OUT_H,
+        },
+        .frame_size_max = s_profile_frame_size_max(),
     };
+    int width = 0;
+    int height = 0;
+    s_config_to_dim(&config, &width, &height);
+    if (config.roi.width) {
+        ESP_LOGI(TAG, "Recording %dx%d region of interest", width, height);
+    }
 
+    // esp_camera_init() already applies pixel format, frame size and quality
+    TickType_t init_start = xTaskGetTickCount();
     esp_err_t ret = esp_camera_init(&config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Camera init failed (%s)", esp_err_to_name(ret));
         return ret;
     }
-    sensor_t *sensor = esp_camera_sensor_get();
-    if (sensor) {
-        sensor->set_pixformat(sensor, PIXFORMAT_JPEG);
-        sensor->set_framesize(sensor, VIDEO_FRAME_SIZE);
-        sensor->set_quality(sensor, VIDEO_JPEG_QUALITY);
-    }
+    ESP_LOGI(TAG, "Camera init took %lu ms",
+             (unsigned long)pdTICKS_TO_MS(xTaskGetTickCount() - init_start));
 
-    // Warm-up: discard initial frames that are often corrupted.
-    for (int i = 0; i < 10; i++) {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (fb) {
-            esp_camera_fb_return(fb);
-        }
-        vTaskDelay(pdMS_TO_TICKS(30));
-    }
+    bool warm = s_restore_sensor_state(&config);
+    s_wait_for_usable_frame("init", warm);
 
     if (s_psram_ok) {
-        ret = s_prepare_black_frame(VIDEO_FRAME_SIZE, VIDEO_JPEG_QUALITY);
+        ret = s_prepare_black_frame(width, height, profile->jpeg_quality);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Black frame init failed (%s)", esp_err_to_name(ret));
             return ret;
@@ -290,6 +580,7 @@ esp_err_t camera_app_init(void)
         ESP_LOGW(TAG, "Skipping black frame without PSRAM");
     }
 
+    s_profile = profile;
     s_camera_ready = true;
     return ESP_OK;
 }
@@ -304,6 +595,28 @@ bool camera_app_is_recording(void)
     return s_camera_task != NULL;
 }
 
+esp_err_t camera_app_set_profile(const char *name)
+{
+    const camera_profile_t *profile = s_find_profile(name);
+    if (!profile) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!s_camera_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_camera_task != NULL) {
+        // the record task switches before its next frame
+        __atomic_store_n(&s_profile_request, profile, __ATOMIC_RELEASE);
+        return ESP_OK;
+    }
+    return s_apply_profile(profile);
+}
+
+const char *camera_app_get_profile(void)
+{
+    return s_profile ? s_profile->name : NULL;
+}
+
 esp_err_t camera_app_start_record(const char *path)
 {
     if (!s_camera_ready || s_camera_task != NULL) {
@@ -316,8 +629,9 @@ esp_err_t camera_app_start_record(const char *path)
     }
     strncpy(args->path, path, sizeof(args->path));
     args->path[sizeof(args->path) - 1] = '\0';
+    esp_camera_reset_stats();
 
-    if (xTaskCreate(s_camera_record_task, "camera_record", 4096, args, 5, &s_camera_task) != pdPASS) {
+    if (xTaskCreate(s_camera_record_task, "camera_record", CAMERA_RECORD_TASK_STACK, args, 5, &s_camera_task) != pdPASS) {
         free(args);
         s_camera_task = NULL;
         return ESP_FAIL;
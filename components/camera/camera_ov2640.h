@@ -35,6 +35,10 @@ esp_err_t camera_app_init(void);
 bool camera_app_is_ready(void);
 bool camera_app_is_recording(void);
 esp_err_t camera_app_start_record(const char *path);
+// Switches to a named capture profile ("default", "detail", "low",
+// "timelapse"). While recording the switch happens before the next frame.
+esp_err_t camera_app_set_profile(const char *name);
+const char *camera_app_get_profile(void);
 void camera_app_wait_for_stop(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,96 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "img_kernels.h"
+#include "esp_attr.h"
+
+/* Three byte pixels have no word layout worth the shifting, they take
+ * simple loops the compiler can unroll. */
+
+static inline void rgb565_to_3(uint8_t hb, uint8_t lb, uint8_t *out, int r, int b)
+{
+    out[r] = hb & 0xF8;
+    out[1] = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
+    out[b] = (lb & 0x1F) << 3;
+}
+
+/* r and b are the offsets of red and blue in the 3 byte pixels */
+static inline void rgb565_to_24(const uint8_t *src, uint8_t *dst, size_t pixels, int r, int b)
+{
+    size_t i = 0;
+    if (kernel_aligned(src, dst)) {
+        // two pixels per load
+        for (; i + 2 <= pixels; i += 2, src += 4, dst += 6) {
+            uint32_t w = kernel_load32(src);
+            rgb565_to_3(w, w >> 8, dst, r, b);
+            rgb565_to_3(w >> 16, w >> 24, dst + 3, r, b);
+        }
+    }
+    for (; i < pixels; i++, src += 2, dst += 3) {
+        rgb565_to_3(src[0], src[1], dst, r, b);
+    }
+}
+
+void IRAM_ATTR img_rgb565_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    rgb565_to_24(src, dst, pixels, 2, 0);
+}
+
+void IRAM_ATTR img_rgb565_to_rgb24(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    rgb565_to_24(src, dst, pixels, 0, 2);
+}
+
+void IRAM_ATTR img_rgb888_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3, dst += 2) {
+        // big endian in memory: high byte first
+        uint8_t hb = (src[2] & 0xF8) | (src[1] >> 5);
+        uint8_t lb = ((src[1] << 3) & 0xE0) | (src[0] >> 3);
+        dst[0] = hb;
+        dst[1] = lb;
+    }
+}
+
+void IRAM_ATTR img_rgb888_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3) {
+        *dst++ = (77 * src[2] + 150 * src[1] + 29 * src[0]) >> 8;
+    }
+}
+
+void IRAM_ATTR img_swap_rb(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3, dst += 3) {
+        uint8_t t = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = t;
+    }
+}
+
+void IRAM_ATTR img_swap_bytes16(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    size_t i = 0;
+    if (kernel_aligned(src, dst)) {
+        for (; i + 2 <= pixels; i += 2, src += 4, dst += 4) {
+            uint32_t w = kernel_load32(src);
+            kernel_store32(dst, ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF));
+        }
+    }
+    for (; i < pixels; i++, src += 2, dst += 2) {
+        uint8_t t = src[0];
+        dst[0] = src[1];
+        dst[1] = t;
+    }
+}
@@ -0,0 +1,354 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <string.h>
+#include "img_converters.h"
+#include "esp_attr.h"
+
+/*
+ * The scaler works on one byte per channel: GRAYSCALE for a gray destination,
+ * RGB888 for the others. Source rows are converted into that format, filtered
+ * horizontally into 16 bit rows holding the channel value times 256, and
+ * combined vertically into destination rows.
+ *
+ * Area filter: in units of 1 / (src * dst) pixel, source pixel i covers
+ * [i * dst, (i + 1) * dst) and destination pixel x covers [x * src, (x + 1) * src).
+ * A source pixel is never wider than a destination pixel, so it adds to at
+ * most two of them.
+ *
+ * Bilinear filter: destination pixel x samples the source at
+ * (x + 0.5) * src / dst - 0.5, kept as an index and an 8 bit fraction.
+ */
+
+#define SCALE_MAX_SIZE  0xFFFF
+#define ALIGN4(n)       (((n) + 3) & ~(size_t)3)
+
+static size_t scale_channels(pixformat_t format)
+{
+    switch (format) {
+    case PIXFORMAT_GRAYSCALE:
+        return 1;
+    case PIXFORMAT_RGB565:
+    case PIXFORMAT_RGB888:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+static pixformat_t scale_format(size_t channels)
+{
+    return channels == 1 ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB888;
+}
+
+size_t img_scale_work_size(size_t src_width, size_t dst_width, pixformat_t dst_format, img_scale_mode_t mode)
+{
+    size_t ch = scale_channels(dst_format);
+    if (!ch || src_width > SCALE_MAX_SIZE || dst_width > SCALE_MAX_SIZE) {
+        return 0;
+    }
+    // alignment slack, source row, destination row
+    size_t size = 3 + ALIGN4(src_width * ch) + ALIGN4(dst_width * ch);
+    if (mode == IMG_SCALE_AREA) {
+        size += ALIGN4(dst_width * ch * sizeof(uint16_t)) + dst_width * ch * sizeof(uint32_t);
+    } else {
+        size += dst_width * sizeof(uint32_t) + 2 * ALIGN4(dst_width * ch * sizeof(uint16_t));
+    }
+    return size;
+}
+
+/* Sample position of destination index i, in 1/256 source pixels */
+static void bilinear_pos(size_t i, size_t src, size_t dst, size_t *index, uint32_t *frac)
+{
+    int64_t pos = ((int64_t)(2 * i + 1) * (int64_t)src - (int64_t)dst) * 256 / (int64_t)(2 * dst);
+    if (pos < 0) {
+        pos = 0;
+    }
+    *index = pos >> 8;
+    *frac = pos & 0xFF;
+    if (*index >= src - 1) {
+        *index = src - 1;
+        *frac = 0;
+    }
+}
+
+esp_err_t img_scaler_init(img_scaler_t *scaler, size_t src_width, size_t src_height, pixformat_t src_format,
+                          const img_view_t *dst, img_scale_mode_t mode, void *work, size_t work_size)
+{
+    if (!scaler || !dst || !work || (mode != IMG_SCALE_AREA && mode != IMG_SCALE_BILINEAR)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t ch = scale_channels(dst->format);
+    if (!ch || !img_bytes_per_pixel(src_format)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!src_width || !src_height || !dst->width || !dst->height ||
+            (src_format == PIXFORMAT_YUV422 && (src_width & 1))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (src_width > SCALE_MAX_SIZE || src_height > SCALE_MAX_SIZE ||
+            dst->width > SCALE_MAX_SIZE || dst->height > SCALE_MAX_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (mode == IMG_SCALE_AREA && (dst->width > src_width || dst->height > src_height)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (work_size < img_scale_work_size(src_width, dst->width, dst->format, mode)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t dw = dst->width;
+    uint8_t *p = (uint8_t *)ALIGN4((uintptr_t)work);
+    *scaler = (img_scaler_t) {
+        .dst = *dst,
+        .src_width = src_width,
+        .src_height = src_height,
+        .src_format = src_format,
+        .mode = mode,
+        .channels = ch,
+        .h_row_index = { SIZE_MAX, SIZE_MAX },
+    };
+    scaler->in_row = p;
+    p += ALIGN4(src_width * ch);
+    scaler->out_row = p;
+    p += ALIGN4(dw * ch);
+    scaler->h_rows[0] = (uint16_t *)p;
+    p += ALIGN4(dw * ch * sizeof(uint16_t));
+    if (mode == IMG_SCALE_AREA) {
+        scaler->acc = (uint32_t *)p;
+        memset(scaler->acc, 0, dw * ch * sizeof(uint32_t));
+    } else {
+        scaler->h_rows[1] = (uint16_t *)p;
+        p += ALIGN4(dw * ch * sizeof(uint16_t));
+        scaler->x_map = (uint32_t *)p;
+        for (size_t x = 0; x < dw; x++) {
+            size_t index;
+            uint32_t frac;
+            bilinear_pos(x, src_width, dw, &index, &frac);
+            scaler->x_map[x] = (index << 8) | frac;
+        }
+    }
+    return ESP_OK;
+}
+
+/* Where the next destination row is built */
+static uint8_t *dst_line(img_scaler_t *s)
+{
+    if (s->dst.format == scale_format(s->channels)) {
+        return s->dst.data + s->dst_row * s->dst.stride;
+    }
+    return s->out_row;
+}
+
+static void dst_line_done(img_scaler_t *s)
+{
+    if (s->dst.format != scale_format(s->channels)) {
+        img_view_t from = {
+            .data = s->out_row,
+            .width = s->dst.width,
+            .height = 1,
+            .stride = s->dst.width * s->channels,
+            .format = scale_format(s->channels),
+        };
+        img_view_t to = from;
+        to.data = s->dst.data + s->dst_row * s->dst.stride;
+        to.stride = s->dst.stride;
+        to.format = s->dst.format;
+        img_convert(&from, &to);
+    }
+    s->dst_row++;
+}
+
+/* Area filter, one source row into a row of channel sums times 256 */
+static void IRAM_ATTR area_h(const img_scaler_t *s, const uint8_t *px, uint16_t *h)
+{
+    size_t sw = s->src_width;
+    size_t dw = s->dst.width;
+    size_t ch = s->channels;
+
+    if (sw % dw == 0) {
+        // whole source pixels per destination pixel, all with the same weight
+        size_t k = sw / dw;
+        uint64_t inv = ((uint64_t)256 << 32) / k;
+        for (size_t x = 0; x < dw; x++, px += k * ch) {
+            for (size_t c = 0; c < ch; c++) {
+                uint32_t sum = 0;
+                for (size_t i = 0; i < k; i++) {
+                    sum += px[i * ch + c];
+                }
+                *h++ = (sum * inv + (1u << 31)) >> 32;
+            }
+        }
+        return;
+    }
+
+    uint64_t inv = ((uint64_t)256 << 32) / sw;
+    uint32_t acc[3] = {0};
+    uint32_t pos = 0;
+    uint32_t boundary = sw;
+    for (size_t i = 0; i < sw; i++, px += ch, pos += dw) {
+        uint32_t hi = pos + dw;
+        if (hi < boundary) {
+            for (size_t c = 0; c < ch; c++) {
+                acc[c] += px[c] * dw;
+            }
+            continue;
+        }
+        uint32_t w0 = boundary - pos;
+        for (size_t c = 0; c < ch; c++) {
+            *h++ = ((acc[c] + px[c] * w0) * inv + (1u << 31)) >> 32;
+            acc[c] = px[c] * (dw - w0);
+        }
+        boundary += sw;
+    }
+}
+
+static void IRAM_ATTR area_row(img_scaler_t *s, const uint8_t *px)
+{
+    size_t n = s->dst.width * s->channels;
+    size_t sh = s->src_height;
+    size_t dh = s->dst.height;
+    uint16_t *h = s->h_rows[0];
+    uint32_t *acc = s->acc;
+
+    area_h(s, px, h);
+
+    uint32_t pos = s->src_row * dh;
+    uint32_t hi = pos + dh;
+    uint32_t boundary = (s->dst_row + 1) * sh;
+    if (hi < boundary) {
+        for (size_t i = 0; i < n; i++) {
+            acc[i] += h[i] * dh;
+        }
+        return;
+    }
+    uint32_t w0 = boundary - pos;
+    uint32_t rest = dh - w0;
+    uint64_t inv = ((uint64_t)1 << 32) / (256 * sh);
+    uint8_t *line = dst_line(s);
+    for (size_t i = 0; i < n; i++) {
+        line[i] = ((acc[i] + h[i] * w0) * inv + (1u << 31)) >> 32;
+        acc[i] = h[i] * rest;
+    }
+    dst_line_done(s);
+}
+
+/* Bilinear filter, one source row into a row of channel values times 256 */
+static void IRAM_ATTR bilinear_h(const img_scaler_t *s, const uint8_t *px, uint16_t *h)
+{
+    size_t ch = s->channels;
+    for (size_t x = 0; x < s->dst.width; x++) {
+        const uint8_t *p = px + (s->x_map[x] >> 8) * ch;
+        uint32_t f = s->x_map[x] & 0xFF;
+        if (f) {
+            for (size_t c = 0; c < ch; c++) {
+                *h++ = p[c] * (256 - f) + p[c + ch] * f;
+            }
+        } else {
+            for (size_t c = 0; c < ch; c++) {
+                *h++ = p[c] << 8;
+            }
+        }
+    }
+}
+
+static void IRAM_ATTR bilinear_row(img_scaler_t *s, const uint8_t *px)
+{
+    size_t r = s->src_row;
+    size_t n = s->dst.width * s->channels;
+    while (s->dst_row < s->dst.height) {
+        size_t y0;
+        uint32_t g;
+        bilinear_pos(s->dst_row, s->src_height, s->dst.height, &y0, &g);
+        if (r < y0) {
+            // between the samples of two destination rows, never needed
+            return;
+        }
+        if (s->h_row_index[r & 1] != r) {
+            bilinear_h(s, px, s->h_rows[r & 1]);
+            s->h_row_index[r & 1] = r;
+        }
+        if (r < y0 + (g ? 1 : 0)) {
+            return;
+        }
+        const uint16_t *a = s->h_rows[y0 & 1];
+        const uint16_t *b = s->h_rows[(y0 + 1) & 1];
+        uint8_t *line = dst_line(s);
+        if (g) {
+            for (size_t i = 0; i < n; i++) {
+                line[i] = (a[i] * (256 - g) + b[i] * g + 32768) >> 16;
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                line[i] = (a[i] + 128) >> 8;
+            }
+        }
+        dst_line_done(s);
+    }
+}
+
+esp_err_t img_scaler_push_rows(img_scaler_t *scaler, const uint8_t *rows, size_t stride, size_t count)
+{
+    if (!scaler || (!rows && count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (count > scaler->src_height - scaler->src_row) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pixformat_t format = scale_format(scaler->channels);
+    img_view_t from = {
+        .width = scaler->src_width,
+        .height = 1,
+        .stride = scaler->src_width * img_bytes_per_pixel(scaler->src_format),
+        .format = scaler->src_format,
+    };
+    img_view_t to = {
+        .data = scaler->in_row,
+        .width = scaler->src_width,
+        .height = 1,
+        .stride = scaler->src_width * scaler->channels,
+        .format = format,
+    };
+    for (size_t i = 0; i < count; i++, rows += stride) {
+        const uint8_t *px = rows;
+        if (scaler->src_format != format) {
+            from.data = (uint8_t *)rows;
+            esp_err_t ret = img_convert(&from, &to);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            px = scaler->in_row;
+        }
+        if (scaler->mode == IMG_SCALE_AREA) {
+            area_row(scaler, px);
+        } else {
+            bilinear_row(scaler, px);
+        }
+        scaler->src_row++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t img_scale(const img_view_t *src, const img_view_t *dst, img_scale_mode_t mode, void *work, size_t work_size)
+{
+    if (!src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    img_scaler_t scaler;
+    esp_err_t ret = img_scaler_init(&scaler, src->width, src->height, src->format, dst, mode, work, work_size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return img_scaler_push_rows(&scaler, src->data, src->stride, src->height);
+}
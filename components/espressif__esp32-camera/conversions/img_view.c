@@ -0,0 +1,206 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <string.h>
+#include "img_converters.h"
+#include "img_kernels.h"
+
+/*
+ * Pixel layouts, as the camera delivers them:
+ *   RGB565     two bytes, big endian: RRRRRGGG GGGBBBBB
+ *   RGB888     three bytes in B, G, R order, as in a BMP file
+ *   YUV422     four bytes for two pixels: Y0 U Y1 V
+ *   GRAYSCALE  one byte of luma
+ */
+
+size_t img_bytes_per_pixel(pixformat_t format)
+{
+    switch (format) {
+    case PIXFORMAT_RGB565:
+    case PIXFORMAT_YUV422:
+        return 2;
+    case PIXFORMAT_RGB888:
+        return 3;
+    case PIXFORMAT_GRAYSCALE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+size_t img_view_size(const img_view_t *view)
+{
+    if (!view->width || !view->height) {
+        return 0;
+    }
+    return (view->height - 1) * view->stride + view->width * img_bytes_per_pixel(view->format);
+}
+
+esp_err_t img_view_init(img_view_t *view, void *data, size_t size, size_t width, size_t height,
+                        size_t stride, pixformat_t format)
+{
+    size_t bpp = img_bytes_per_pixel(format);
+    if (!bpp) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!view || !data || !width || !height || (format == PIXFORMAT_YUV422 && (width & 1))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (width > SIZE_MAX / bpp) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t row = width * bpp;
+    if (!stride) {
+        stride = row;
+    } else if (stride < row) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // (height - 1) * stride + row <= size, without overflowing
+    if (row > size || (height - 1) > (size - row) / stride) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *view = (img_view_t) {
+        .data = data,
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .format = format,
+    };
+    return ESP_OK;
+}
+
+esp_err_t img_view_from_fb(const camera_fb_t *fb, img_view_t *view)
+{
+    if (!fb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return img_view_init(view, fb->buf, fb->len, fb->width, fb->height, 0, fb->format);
+}
+
+esp_err_t img_view_crop(const img_view_t *view, size_t x, size_t y, size_t width, size_t height,
+                        img_view_t *crop)
+{
+    if (!view || !crop || !width || !height ||
+            x > view->width || width > view->width - x ||
+            y > view->height || height > view->height - y) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (view->format == PIXFORMAT_YUV422 && ((x | width) & 1)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *crop = (img_view_t) {
+        .data = view->data + y * view->stride + x * img_bytes_per_pixel(view->format),
+        .width = width,
+        .height = height,
+        .stride = view->stride,
+        .format = view->format,
+    };
+    return ESP_OK;
+}
+
+static inline void put_rgb565(uint8_t *dst, uint8_t r, uint8_t g, uint8_t b)
+{
+    dst[0] = (r & 0xF8) | (g >> 5);
+    dst[1] = ((g << 3) & 0xE0) | (b >> 3);
+}
+
+static inline uint8_t luma(uint8_t r, uint8_t g, uint8_t b)
+{
+    return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+/* Converts one row. Each pixel is read completely before it is written, and
+ * written no further right than it was read, so rows convert in place. */
+static void convert_row(const uint8_t *src, pixformat_t src_format, uint8_t *dst, pixformat_t dst_format, size_t width)
+{
+    static const struct {
+        pixformat_t src;
+        pixformat_t dst;
+        void (*kernel)(const uint8_t *src, uint8_t *dst, size_t pixels);
+    } kernels[] = {
+        { PIXFORMAT_YUV422, PIXFORMAT_GRAYSCALE, img_yuyv_to_gray },
+        { PIXFORMAT_YUV422, PIXFORMAT_RGB565, img_yuyv_to_rgb565 },
+        { PIXFORMAT_YUV422, PIXFORMAT_RGB888, img_yuyv_to_rgb888 },
+        { PIXFORMAT_RGB565, PIXFORMAT_RGB888, img_rgb565_to_rgb888 },
+        { PIXFORMAT_RGB888, PIXFORMAT_RGB565, img_rgb888_to_rgb565 },
+        { PIXFORMAT_RGB888, PIXFORMAT_GRAYSCALE, img_rgb888_to_gray },
+    };
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i].src == src_format && kernels[i].dst == dst_format) {
+            kernels[i].kernel(src, dst, width);
+            return;
+        }
+    }
+
+    // The remaining pairs are rare enough for a pixel loop
+    uint8_t r, g, b;
+    size_t src_bpp = img_bytes_per_pixel(src_format);
+    size_t dst_bpp = img_bytes_per_pixel(dst_format);
+    for (size_t i = 0; i < width; i++, src += src_bpp, dst += dst_bpp) {
+        if (src_format == PIXFORMAT_RGB565) {
+            r = src[0] & 0xF8;
+            g = (src[0] & 0x07) << 5 | (src[1] & 0xE0) >> 3;
+            b = (src[1] & 0x1F) << 3;
+        } else if (src_format == PIXFORMAT_RGB888) {
+            b = src[0];
+            g = src[1];
+            r = src[2];
+        } else {
+            r = g = b = src[0];
+        }
+
+        if (dst_format == PIXFORMAT_RGB888) {
+            dst[0] = b;
+            dst[1] = g;
+            dst[2] = r;
+        } else if (dst_format == PIXFORMAT_RGB565) {
+            put_rgb565(dst, r, g, b);
+        } else {
+            dst[0] = src_format == PIXFORMAT_GRAYSCALE ? r : luma(r, g, b);
+        }
+    }
+}
+
+esp_err_t img_convert(const img_view_t *src, const img_view_t *dst)
+{
+    if (!src || !dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (src->width != dst->width || src->height != dst->height) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t src_bpp = img_bytes_per_pixel(src->format);
+    size_t dst_bpp = img_bytes_per_pixel(dst->format);
+    if (!src_bpp || !dst_bpp || (dst->format == PIXFORMAT_YUV422 && src->format != PIXFORMAT_YUV422)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    const uint8_t *src_end = src->data + img_view_size(src);
+    const uint8_t *dst_end = dst->data + img_view_size(dst);
+    bool overlap = dst->data < src_end && src->data < dst_end;
+    if (overlap && (dst->data > src->data || dst->stride > src->stride || dst_bpp > src_bpp)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint8_t *s = src->data;
+    uint8_t *d = dst->data;
+    for (size_t y = 0; y < src->height; y++, s += src->stride, d += dst->stride) {
+        if (src->format == dst->format) {
+            memmove(d, s, src->width * src_bpp);
+        } else {
+            convert_row(s, src->format, d, dst->format, src->width);
+        }
+    }
+    return ESP_OK;
+}
@@ -21,11 +21,256 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "esp_err.h"
 #include "esp_camera.h"
 #include "jpeg_decoder.h"
 
 typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t len);
 
+/*
+ * Image views
+ *
+ * A view describes pixels in memory the caller owns: a frame buffer, a
+ * rectangle inside one, or an output buffer. Rows may be padded, so a
+ * crop is just another view on the same memory. The img_* functions below
+ * take views and buffers with explicit sizes, check every access against
+ * them and never allocate; the fmt2* and frame2* functions further down
+ * are wrappers kept for existing code.
+ */
+
+/**
+ * @brief Pixels of an uncompressed image
+ */
+typedef struct {
+    uint8_t *data;          /*!< First pixel of the view */
+    size_t width;           /*!< Width in pixels */
+    size_t height;          /*!< Height in pixels */
+    size_t stride;          /*!< Bytes from the start of one row to the next */
+    pixformat_t format;     /*!< RGB565, RGB888, YUV422 or GRAYSCALE */
+} img_view_t;
+
+/**
+ * @brief Bytes per pixel of an uncompressed format
+ *
+ * @return 1 to 3, or 0 for compressed and unsupported formats
+ */
+size_t img_bytes_per_pixel(pixformat_t format);
+
+/**
+ * @brief Bytes from the first to the last pixel of a view
+ */
+size_t img_view_size(const img_view_t *view);
+
+/**
+ * @brief Describe an image in a buffer
+ *
+ * @param view      View to initialize
+ * @param data      First pixel
+ * @param size      Bytes available at data
+ * @param width     Width in pixels, even for YUV422
+ * @param height    Height in pixels
+ * @param stride    Bytes per row, 0 for tightly packed rows
+ * @param format    Pixel format
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_NOT_SUPPORTED for compressed formats
+ *     - ESP_ERR_INVALID_ARG if the stride is shorter than a row
+ *     - ESP_ERR_INVALID_SIZE if the image does not fit in size bytes
+ */
+esp_err_t img_view_init(img_view_t *view, void *data, size_t size, size_t width, size_t height,
+                        size_t stride, pixformat_t format);
+
+/**
+ * @brief View of an uncompressed camera frame buffer
+ */
+esp_err_t img_view_from_fb(const camera_fb_t *fb, img_view_t *view);
+
+/**
+ * @brief View of a rectangle inside another view, sharing its memory
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_ARG if the rectangle leaves the view or, for YUV422,
+ *       starts or ends between the two pixels of a pair
+ */
+esp_err_t img_view_crop(const img_view_t *view, size_t x, size_t y, size_t width, size_t height,
+                        img_view_t *crop);
+
+/**
+ * @brief Convert the pixels of one view into another of the same size
+ *
+ * Any of the formats can be read; RGB565, RGB888 and GRAYSCALE can be
+ * written, YUV422 only copied. The views may overlap when the conversion can
+ * run in place, that is when the destination starts no later than the
+ * source, rows are no longer and pixels no wider.
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_SIZE if the views differ in size
+ *     - ESP_ERR_NOT_SUPPORTED for an unsupported pair of formats
+ *     - ESP_ERR_INVALID_ARG if the views overlap in a way that is not in place
+ */
+esp_err_t img_convert(const img_view_t *src, const img_view_t *dst);
+
+/**
+ * @brief Filter of the image scaler
+ */
+typedef enum {
+    IMG_SCALE_AREA,         /*!< Average over the covered source area, downscaling only */
+    IMG_SCALE_BILINEAR,     /*!< Interpolate the four nearest source pixels, for ratios up to about 2:1 */
+} img_scale_mode_t;
+
+/**
+ * @brief State of a streaming scaler, set up by img_scaler_init()
+ *
+ * Source rows go in one band at a time and destination rows are written as
+ * soon as the source rows they need have arrived, so a frame can be scaled
+ * while it is captured or decoded without a full size copy. Apart from
+ * src_row and dst_row the members are private.
+ */
+typedef struct {
+    img_view_t dst;             /*!< Destination of the scaled image */
+    size_t src_width;           /*!< Width of the source rows */
+    size_t src_height;          /*!< Number of source rows expected */
+    pixformat_t src_format;     /*!< Format of the source rows */
+    img_scale_mode_t mode;      /*!< Filter */
+    size_t src_row;             /*!< Source rows pushed so far */
+    size_t dst_row;             /*!< Destination rows written so far */
+    size_t channels;
+    uint8_t *in_row;
+    uint8_t *out_row;
+    uint32_t *x_map;
+    uint16_t *h_rows[2];
+    size_t h_row_index[2];
+    uint32_t *acc;
+} img_scaler_t;
+
+/**
+ * @brief Size of the scaler work memory
+ *
+ * @param src_width     Width of the source image
+ * @param dst_width     Width of the destination image
+ * @param dst_format    Format of the destination image
+ * @param mode          Filter
+ */
+size_t img_scale_work_size(size_t src_width, size_t dst_width, pixformat_t dst_format, img_scale_mode_t mode);
+
+/**
+ * @brief Prepare to scale an image that arrives in rows
+ *
+ * The source may be in any format img_convert() reads, so YUV422 rows come
+ * straight from the camera and RGB565 or RGB888 rows from a JPEG decoder.
+ * Both dimensions are limited to 65535.
+ *
+ * @param scaler        Scaler state
+ * @param src_width     Width of the source image
+ * @param src_height    Height of the source image
+ * @param src_format    Format of the source rows
+ * @param dst           Destination, RGB565, RGB888 or GRAYSCALE
+ * @param mode          Filter
+ * @param work          Work memory of img_scale_work_size() bytes, in use until the last row is pushed
+ * @param work_size     Size of the work memory
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_SIZE if the work memory is too small or the sizes are out of range
+ *     - ESP_ERR_NOT_SUPPORTED for an unsupported format, or IMG_SCALE_AREA enlarging
+ */
+esp_err_t img_scaler_init(img_scaler_t *scaler, size_t src_width, size_t src_height, pixformat_t src_format,
+                          const img_view_t *dst, img_scale_mode_t mode, void *work, size_t work_size);
+
+/**
+ * @brief Feed source rows to a scaler
+ *
+ * @param scaler    Scaler state
+ * @param rows      First row of the band
+ * @param stride    Bytes from one row to the next
+ * @param count     Number of rows in the band
+ *
+ * @return
+ *     - ESP_OK on success, the image is complete when dst_row reaches the destination height
+ *     - ESP_ERR_INVALID_STATE if the band runs past the source height
+ */
+esp_err_t img_scaler_push_rows(img_scaler_t *scaler, const uint8_t *rows, size_t stride, size_t count);
+
+/**
+ * @brief Scale one view into another
+ *
+ * @return as img_scaler_init()
+ */
+esp_err_t img_scale(const img_view_t *src, const img_view_t *dst, img_scale_mode_t mode, void *work, size_t work_size);
+
+/**
+ * @brief Size of a JPEG image after decoding at a scale
+ */
+esp_err_t img_jpeg_info(const uint8_t *src, size_t src_len, esp_jpeg_image_scale_t scale,
+                        size_t *width, size_t *height);
+
+/**
+ * @brief Decode a JPEG image into a view
+ *
+ * The view must be RGB565 or RGB888 and have the size img_jpeg_info()
+ * reports. The decoder only writes packed rows, so for a view with padded
+ * rows it decodes into the start of the view and moves the rows into place:
+ * the padding between rows is overwritten. To place an image inside a larger
+ * one, decode it and img_convert() it into a crop.
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_SIZE if the view has another size than the image
+ *     - ESP_ERR_NOT_SUPPORTED for other view formats
+ *     - ESP_FAIL if decoding fails
+ */
+esp_err_t img_decode_jpeg(const uint8_t *src, size_t src_len, esp_jpeg_image_scale_t scale, const img_view_t *dst);
+
+/**
+ * @brief Size of img_encode_jpeg() work memory for an image width and format
+ */
+size_t img_jpeg_work_size(size_t width, pixformat_t format);
+
+/**
+ * @brief Encode a view as JPEG into a buffer
+ *
+ * @param src       Image to encode
+ * @param quality   JPEG quality, 1 to 100
+ * @param work      Work memory of img_jpeg_work_size() bytes
+ * @param work_size Size of the work memory
+ * @param out       Output buffer
+ * @param out_size  Size of the output buffer
+ * @param out_len   Receives the length of the JPEG image
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_SIZE if the work memory or output buffer is too small
+ *     - ESP_FAIL if the encoder fails
+ */
+esp_err_t img_encode_jpeg(const img_view_t *src, uint8_t quality, void *work, size_t work_size,
+                          uint8_t *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief Encode a view as JPEG, passing the output to a callback
+ *
+ * @return as img_encode_jpeg()
+ */
+esp_err_t img_encode_jpeg_cb(const img_view_t *src, uint8_t quality, void *work, size_t work_size,
+                             jpg_out_cb cb, void *arg);
+
+/**
+ * @brief Size of the BMP file img_encode_bmp() writes for an image
+ */
+size_t img_bmp_size(size_t width, size_t height, pixformat_t format);
+
+/**
+ * @brief Write a view as BMP file, 8 bit with a gray palette for GRAYSCALE, 24 bit otherwise
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_SIZE if the output buffer is too small
+ *     - ESP_ERR_NOT_SUPPORTED for an unsupported format
+ */
+esp_err_t img_encode_bmp(const img_view_t *src, uint8_t *out, size_t out_size, size_t *out_len);
+
 /**
  * @brief Convert image buffer to JPEG
  *
@@ -0,0 +1,82 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IMG_KERNELS_H_
+#define _IMG_KERNELS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Pixel row kernels.
+ *
+ * Byte orders follow the camera: RGB565 is big endian, RGB888 is B, G, R as
+ * in PIXFORMAT_RGB888 and BMP files, YUYV is Y0 U Y1 V. RGB24 is R, G, B,
+ * the order the JPEG encoder takes.
+ *
+ * When source and destination are 4 byte aligned the kernels with one or two
+ * byte pixels move whole words; other buffers take a byte loop. Results are
+ * the same either way. A kernel may run in place when the
+ * destination pixels are no wider than the source ones. YUYV kernels take an
+ * even number of pixels.
+ */
+
+/* YUYV kernels, in yuv.c next to the conversion table */
+void img_yuyv_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_yuyv_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_yuyv_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_yuyv_to_rgb24(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+void img_rgb565_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_rgb565_to_rgb24(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_rgb888_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pixels);
+void img_rgb888_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+/* RGB888 <-> RGB24 */
+void img_swap_rb(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+/* RGB565 big <-> little endian */
+void img_swap_bytes16(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the pixel kernels assume a little endian CPU"
+#endif
+
+/* Word access for the kernels, both buffers checked with kernel_aligned() */
+static inline int kernel_aligned(const void *a, const void *b)
+{
+    return (((uintptr_t)a | (uintptr_t)b) & 3) == 0;
+}
+
+static inline uint32_t kernel_load32(const uint8_t *p)
+{
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(p, 4), 4);
+    return w;
+}
+
+static inline void kernel_store32(uint8_t *p, uint32_t w)
+{
+    memcpy(__builtin_assume_aligned(p, 4), &w, 4);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IMG_KERNELS_H_ */
@@ -0,0 +1,139 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _JPEG_SCAN_H_
+#define _JPEG_SCAN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * JPEG marker scanning.
+ *
+ * Every marker starts with 0xFF, a byte that is rare in entropy coded data,
+ * so the scanners test a machine word at a time for 0xFF bytes and only
+ * look closer at the candidates. All functions accept unaligned buffers.
+ */
+
+/**
+ * @brief Find the first 0xFF byte
+ *
+ * @param buf   Buffer to scan
+ * @param len   Length of the buffer
+ *
+ * @return Offset of the byte, or len if there is none
+ */
+size_t jpeg_scan_ff(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the last 0xFF byte
+ *
+ * @return Offset of the byte, or -1 if there is none
+ */
+int jpeg_scan_ff_last(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the first start of image sequence FF D8 FF
+ *
+ * @return Offset of the SOI marker, or -1 if there is none
+ */
+int jpeg_scan_soi(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the first end of image marker FF D9
+ *
+ * @return Offset of the EOI marker, or -1 if there is none
+ */
+int jpeg_scan_eoi(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the last end of image marker FF D9
+ *
+ * @return Offset of the EOI marker, or -1 if there is none
+ */
+int jpeg_scan_eoi_last(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the next marker at or after an offset
+ *
+ * Stuffed 0xFF 0x00 pairs in entropy coded data and 0xFF fill bytes in
+ * front of a marker are skipped, restart markers are reported.
+ *
+ * @param buf     Buffer to scan
+ * @param len     Length of the buffer
+ * @param from    Offset to start at
+ * @param marker  Receives the marker code, the byte following 0xFF
+ *
+ * @return Offset of the 0xFF byte of the marker, or -1 if there is none
+ */
+int jpeg_scan_marker(const uint8_t *buf, size_t len, size_t from, uint8_t *marker);
+
+/**
+ * @brief Result of jpeg_scan_validate()
+ */
+typedef enum {
+    JPEG_SCAN_OK = 0,
+    JPEG_SCAN_ERR_NO_SOI,       /*!< Does not start with an SOI marker */
+    JPEG_SCAN_ERR_TRUNCATED,    /*!< Ends inside a segment or the entropy coded data */
+    JPEG_SCAN_ERR_SEGMENT,      /*!< Marker segment with an impossible length or content */
+    JPEG_SCAN_ERR_MISSING,      /*!< Scan without DQT or SOF, or EOI without a scan */
+    JPEG_SCAN_ERR_STUFFING,     /*!< 0xFF in entropy coded data that is neither stuffed nor a marker */
+    JPEG_SCAN_ERR_RESTART,      /*!< Restart marker out of sequence or without DRI */
+    JPEG_SCAN_ERR_UNSUPPORTED,  /*!< Lossless, hierarchical or arithmetic coded frame */
+    JPEG_SCAN_ERR_MAX,
+} jpeg_scan_result_t;
+
+/**
+ * @brief Frame properties found by jpeg_scan_validate()
+ */
+typedef struct {
+    uint16_t width;             /*!< Width from the SOF segment */
+    uint16_t height;            /*!< Height from the SOF segment */
+    uint8_t components;         /*!< Number of color components */
+    uint8_t scans;              /*!< Number of SOS segments */
+    size_t length;              /*!< Bytes up to and including EOI, trailing data is not counted */
+    size_t error_offset;        /*!< Offset of the marker or byte that failed, 0 when valid */
+} jpeg_scan_info_t;
+
+/**
+ * @brief Check the marker structure of a JPEG image
+ *
+ * Walks SOI, the DQT, DHT, SOF, DRI and SOS segments, the entropy coded data
+ * with its byte stuffing and restart markers, up to EOI. Segment lengths and
+ * table contents are checked against the buffer but nothing is Huffman
+ * decoded, so the cost is close to a single jpeg_scan_marker() pass and the
+ * check can run inline with capture. DHT is optional since some sensors rely
+ * on the standard tables.
+ *
+ * @param buf   Image data
+ * @param len   Length of the image data
+ * @param info  Optional, receives the frame properties and the error offset
+ *
+ * @return JPEG_SCAN_OK or the first problem found
+ */
+jpeg_scan_result_t jpeg_scan_validate(const uint8_t *buf, size_t len, jpeg_scan_info_t *info);
+
+/**
+ * @brief Short name of a validation result, for logs
+ */
+const char *jpeg_scan_result_to_name(jpeg_scan_result_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JPEG_SCAN_H_ */
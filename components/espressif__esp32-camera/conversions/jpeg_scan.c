@@ -0,0 +1,431 @@
+// Copyright 2015-2025 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <string.h>
+#include "jpeg_scan.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "jpeg_scan assumes a little endian CPU"
+#endif
+
+/* Native register width: 4 bytes on the Xtensa and RISC-V chips, 8 on hosts */
+typedef uintptr_t scan_word_t;
+
+#define SCAN_W      sizeof(scan_word_t)
+#define SCAN_ONES   ((scan_word_t)-1 / 0xFF)        /* 0x0101...01 */
+#define SCAN_LOW7   (SCAN_ONES * 0x7F)              /* 0x7F7F...7F */
+
+/* Exactly one 0x80 bit for every 0xFF byte of w. The sums stay within their
+ * byte, so unlike the usual zero byte trick there are no false positives
+ * above a match and the mask can be searched from either end. */
+static inline scan_word_t ff_bytes(scan_word_t w)
+{
+    scan_word_t x = ~w;
+    return ~(((x & SCAN_LOW7) + SCAN_LOW7) | x | SCAN_LOW7);
+}
+
+static inline scan_word_t load_word(const uint8_t *p)
+{
+    scan_word_t w;
+    memcpy(&w, p, SCAN_W);
+    return w;
+}
+
+static inline size_t first_byte(scan_word_t m)
+{
+    if (SCAN_W == 8) {
+        return __builtin_ctzll((unsigned long long)m) >> 3;
+    }
+    return __builtin_ctz((unsigned int)m) >> 3;
+}
+
+static inline size_t last_byte(scan_word_t m)
+{
+    if (SCAN_W == 8) {
+        return (63 - __builtin_clzll((unsigned long long)m)) >> 3;
+    }
+    return (31 - __builtin_clz((unsigned int)m)) >> 3;
+}
+
+size_t jpeg_scan_ff(const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+    while (i < len && ((uintptr_t)&buf[i] % SCAN_W)) {
+        if (buf[i] == 0xFF) {
+            return i;
+        }
+        i++;
+    }
+
+    /* 16 bytes or more per step, candidates are rare in entropy coded data */
+    while (i + 4 * SCAN_W <= len) {
+        scan_word_t m0 = ff_bytes(load_word(&buf[i]));
+        scan_word_t m1 = ff_bytes(load_word(&buf[i + SCAN_W]));
+        scan_word_t m2 = ff_bytes(load_word(&buf[i + 2 * SCAN_W]));
+        scan_word_t m3 = ff_bytes(load_word(&buf[i + 3 * SCAN_W]));
+        if (m0 | m1 | m2 | m3) {
+            if (m0) {
+                return i + first_byte(m0);
+            }
+            if (m1) {
+                return i + SCAN_W + first_byte(m1);
+            }
+            if (m2) {
+                return i + 2 * SCAN_W + first_byte(m2);
+            }
+            return i + 3 * SCAN_W + first_byte(m3);
+        }
+        i += 4 * SCAN_W;
+    }
+    while (i + SCAN_W <= len) {
+        scan_word_t m = ff_bytes(load_word(&buf[i]));
+        if (m) {
+            return i + first_byte(m);
+        }
+        i += SCAN_W;
+    }
+
+    while (i < len) {
+        if (buf[i] == 0xFF) {
+            return i;
+        }
+        i++;
+    }
+    return len;
+}
+
+int jpeg_scan_ff_last(const uint8_t *buf, size_t len)
+{
+    size_t i = len;
+    while (i > 0 && ((uintptr_t)&buf[i] % SCAN_W)) {
+        i--;
+        if (buf[i] == 0xFF) {
+            return i;
+        }
+    }
+
+    while (i >= 4 * SCAN_W) {
+        i -= 4 * SCAN_W;
+        scan_word_t m0 = ff_bytes(load_word(&buf[i]));
+        scan_word_t m1 = ff_bytes(load_word(&buf[i + SCAN_W]));
+        scan_word_t m2 = ff_bytes(load_word(&buf[i + 2 * SCAN_W]));
+        scan_word_t m3 = ff_bytes(load_word(&buf[i + 3 * SCAN_W]));
+        if (m0 | m1 | m2 | m3) {
+            if (m3) {
+                return i + 3 * SCAN_W + last_byte(m3);
+            }
+            if (m2) {
+                return i + 2 * SCAN_W + last_byte(m2);
+            }
+            if (m1) {
+                return i + SCAN_W + last_byte(m1);
+            }
+            return i + last_byte(m0);
+        }
+    }
+    while (i >= SCAN_W) {
+        i -= SCAN_W;
+        scan_word_t m = ff_bytes(load_word(&buf[i]));
+        if (m) {
+            return i + last_byte(m);
+        }
+    }
+
+    while (i > 0) {
+        i--;
+        if (buf[i] == 0xFF) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* First 0xFF at or after from that is followed by the given bytes */
+static int scan_ff_followed_by(const uint8_t *buf, size_t len, const uint8_t *next, size_t next_len)
+{
+    if (len <= next_len) {
+        return -1;
+    }
+    size_t end = len - next_len;   /* candidates must leave room for next */
+    size_t i = 0;
+    while (i < end) {
+        i += jpeg_scan_ff(&buf[i], end - i);
+        if (i >= end) {
+            break;
+        }
+        if (memcmp(&buf[i + 1], next, next_len) == 0) {
+            return i;
+        }
+        i++;
+    }
+    return -1;
+}
+
+int jpeg_scan_soi(const uint8_t *buf, size_t len)
+{
+    static const uint8_t soi_tail[] = {0xD8, 0xFF};
+    return scan_ff_followed_by(buf, len, soi_tail, sizeof(soi_tail));
+}
+
+int jpeg_scan_eoi(const uint8_t *buf, size_t len)
+{
+    static const uint8_t eoi_tail[] = {0xD9};
+    return scan_ff_followed_by(buf, len, eoi_tail, sizeof(eoi_tail));
+}
+
+int jpeg_scan_eoi_last(const uint8_t *buf, size_t len)
+{
+    if (len < 2) {
+        return -1;
+    }
+    size_t end = len - 1;
+    for (;;) {
+        int i = jpeg_scan_ff_last(buf, end);
+        if (i < 0 || buf[i + 1] == 0xD9) {
+            return i;
+        }
+        end = i;
+    }
+}
+
+int jpeg_scan_marker(const uint8_t *buf, size_t len, size_t from, uint8_t *marker)
+{
+    if (len < 2) {
+        return -1;
+    }
+    size_t end = len - 1;
+    size_t i = from;
+    while (i < end) {
+        i += jpeg_scan_ff(&buf[i], end - i);
+        if (i >= end) {
+            break;
+        }
+        uint8_t code = buf[i + 1];
+        if (code != 0x00 && code != 0xFF) {
+            *marker = code;
+            return i;
+        }
+        /* stuffed zero, or a fill byte in front of the real 0xFF */
+        i++;
+    }
+    return -1;
+}
+
+static inline uint16_t be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static bool check_dqt(const uint8_t *p, size_t n)
+{
+    while (n) {
+        uint8_t precision = p[0] >> 4;
+        if (precision > 1 || (p[0] & 0x0F) > 3) {
+            return false;
+        }
+        size_t size = 1 + 64 * (precision + 1);
+        if (size > n) {
+            return false;
+        }
+        p += size;
+        n -= size;
+    }
+    return true;
+}
+
+static bool check_dht(const uint8_t *p, size_t n)
+{
+    while (n) {
+        if (n < 17 || (p[0] >> 4) > 1 || (p[0] & 0x0F) > 3) {
+            return false;
+        }
+        size_t symbols = 0;
+        for (int i = 1; i <= 16; i++) {
+            symbols += p[i];
+        }
+        size_t size = 17 + symbols;
+        if (symbols > 256 || size > n) {
+            return false;
+        }
+        p += size;
+        n -= size;
+    }
+    return true;
+}
+
+static bool check_sof(const uint8_t *p, size_t n, jpeg_scan_info_t *info)
+{
+    if (n < 6 || (p[0] != 8 && p[0] != 12)) {
+        return false;
+    }
+    uint8_t components = p[5];
+    if (components < 1 || components > 4 || n != 6 + 3 * (size_t)components) {
+        return false;
+    }
+    for (int i = 0; i < components; i++) {
+        const uint8_t *c = &p[6 + 3 * i];
+        uint8_t h = c[1] >> 4;
+        uint8_t v = c[1] & 0x0F;
+        if (h < 1 || h > 4 || v < 1 || v > 4 || c[2] > 3) {
+            return false;
+        }
+    }
+    info->height = be16(&p[1]);
+    info->width = be16(&p[3]);
+    info->components = components;
+    return info->width != 0;
+}
+
+#define JPEG_FAIL(result, offset) do {  \
+        info->error_offset = (offset);  \
+        return (result);                \
+    } while (0)
+
+jpeg_scan_result_t jpeg_scan_validate(const uint8_t *buf, size_t len, jpeg_scan_info_t *info)
+{
+    jpeg_scan_info_t unused;
+    if (!info) {
+        info = &unused;
+    }
+    memset(info, 0, sizeof(*info));
+
+    if (len < 2 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        JPEG_FAIL(JPEG_SCAN_ERR_NO_SOI, 0);
+    }
+
+    bool have_dqt = false;
+    bool have_sof = false;
+    bool have_dri = false;
+    size_t pos = 2;
+    for (;;) {
+        if (pos >= len) {
+            JPEG_FAIL(JPEG_SCAN_ERR_TRUNCATED, pos);
+        }
+        if (buf[pos] != 0xFF) {
+            JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+        }
+        while (pos + 1 < len && buf[pos + 1] == 0xFF) {
+            pos++;  /* fill bytes */
+        }
+        if (pos + 1 >= len) {
+            JPEG_FAIL(JPEG_SCAN_ERR_TRUNCATED, pos);
+        }
+        uint8_t code = buf[pos + 1];
+        if (code == 0xD9) {
+            if (!info->scans) {
+                JPEG_FAIL(JPEG_SCAN_ERR_MISSING, pos);
+            }
+            info->length = pos + 2;
+            return JPEG_SCAN_OK;
+        }
+        /* standalone markers have no business outside the entropy coded data */
+        if (code == 0x00 || code == 0x01 || (code >= 0xD0 && code <= 0xD8)) {
+            JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+        }
+        if (pos + 4 > len) {
+            JPEG_FAIL(JPEG_SCAN_ERR_TRUNCATED, pos);
+        }
+        size_t seg_len = be16(&buf[pos + 2]);
+        if (seg_len < 2) {
+            JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+        }
+        if (pos + 2 + seg_len > len) {
+            JPEG_FAIL(JPEG_SCAN_ERR_TRUNCATED, pos);
+        }
+        const uint8_t *p = &buf[pos + 4];
+        size_t n = seg_len - 2;
+        size_t next = pos + 2 + seg_len;
+
+        switch (code) {
+        case 0xDB:
+            if (!check_dqt(p, n)) {
+                JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+            }
+            have_dqt = true;
+            break;
+        case 0xC4:
+            if (!check_dht(p, n)) {
+                JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+            }
+            break;
+        case 0xC0: case 0xC1: case 0xC2:
+            if (have_sof || !check_sof(p, n, info)) {
+                JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+            }
+            have_sof = true;
+            break;
+        case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCC:
+        case 0xCD: case 0xCE: case 0xCF:
+            JPEG_FAIL(JPEG_SCAN_ERR_UNSUPPORTED, pos);
+        case 0xDD:
+            if (n != 2) {
+                JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+            }
+            have_dri = be16(p) != 0;
+            break;
+        case 0xDA: {
+            if (!have_dqt || !have_sof) {
+                JPEG_FAIL(JPEG_SCAN_ERR_MISSING, pos);
+            }
+            if (n < 1 || p[0] < 1 || p[0] > 4 || n != 4 + 2 * (size_t)p[0]) {
+                JPEG_FAIL(JPEG_SCAN_ERR_SEGMENT, pos);
+            }
+            /* entropy coded data runs up to the next marker that is not RSTn */
+            uint8_t rst = 0;
+            for (;;) {
+                uint8_t m;
+                int at = jpeg_scan_marker(buf, len, next, &m);
+                if (at < 0) {
+                    JPEG_FAIL(JPEG_SCAN_ERR_TRUNCATED, len);
+                }
+                if (m >= 0xD0 && m <= 0xD7) {
+                    if (!have_dri || m != 0xD0 + rst) {
+                        JPEG_FAIL(JPEG_SCAN_ERR_RESTART, at);
+                    }
+                    rst = (rst + 1) & 7;
+                    next = at + 2;
+                    continue;
+                }
+                if (m < 0xC0) {
+                    JPEG_FAIL(JPEG_SCAN_ERR_STUFFING, at);
+                }
+                next = at;
+                break;
+            }
+            info->scans++;
+            break;
+        }
+        default:
+            /* APPn, COM and the like carry nothing to check */
+            break;
+        }
+        pos = next;
+    }
+}
+
+const char *jpeg_scan_result_to_name(jpeg_scan_result_t result)
+{
+    static const char *const names[JPEG_SCAN_ERR_MAX] = {
+        [JPEG_SCAN_OK] = "ok",
+        [JPEG_SCAN_ERR_NO_SOI] = "no-soi",
+        [JPEG_SCAN_ERR_TRUNCATED] = "truncated",
+        [JPEG_SCAN_ERR_SEGMENT] = "bad-segment",
+        [JPEG_SCAN_ERR_MISSING] = "missing-segment",
+        [JPEG_SCAN_ERR_STUFFING] = "bad-stuffing",
+        [JPEG_SCAN_ERR_RESTART] = "bad-restart",
+        [JPEG_SCAN_ERR_UNSUPPORTED] = "unsupported",
+    };
+    return result < JPEG_SCAN_ERR_MAX ? names[result] : "unknown";
+}
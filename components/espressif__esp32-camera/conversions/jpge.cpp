@@ -566,7 +566,7 @@ namespace jpge {
     }
 
     // Higher-level methods.
-    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
+    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels, void *work)
     {
         m_num_components = 3;
         switch (m_params.m_subsampling)
@@ -612,7 +612,10 @@ namespace jpge {
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+        m_owns_mcu_lines = !work;
+        if (work) {
+            m_mcu_lines[0] = static_cast<uint8*>(work);
+        } else if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
             return false;
         }
         for (int i = 1; i < m_mcu_y; i++)
@@ -679,6 +682,7 @@ namespace jpge {
     void jpeg_encoder::clear()
     {
         m_mcu_lines[0] = NULL;
+        m_owns_mcu_lines = false;
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
     }
@@ -693,18 +697,30 @@ namespace jpge {
         deinit();
     }
 
-    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    uint jpeg_encoder::mcu_buffer_size(int width, subsampling_t subsampling)
+    {
+        switch (subsampling) {
+            case Y_ONLY: return ((width + 7) & ~7) * 8;
+            case H1V1:   return ((width + 7) & ~7) * 3 * 8;
+            case H2V1:   return ((width + 15) & ~15) * 3 * 8;
+            default:     return ((width + 15) & ~15) * 3 * 16;
+        }
+    }
+
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, void *work)
     {
         deinit();
         if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
         m_pStream = pStream;
         m_params = comp_params;
-        return jpg_open(width, height, src_channels);
+        return jpg_open(width, height, src_channels, work);
     }
 
     void jpeg_encoder::deinit()
     {
-        jpge_free(m_mcu_lines[0]);
+        if (m_owns_mcu_lines) {
+            jpge_free(m_mcu_lines[0]);
+        }
         clear();
     }
 
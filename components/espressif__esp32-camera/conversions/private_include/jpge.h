@@ -4,6 +4,8 @@
 #ifndef JPEG_ENCODER_H
 #define JPEG_ENCODER_H
 
+#include <stddef.h>
+
 namespace jpge
 {
     typedef unsigned char  uint8;
@@ -61,8 +63,12 @@ namespace jpge
             // params - Compression parameters structure, defined above.
             // width, height  - Image dimensions.
             // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
+            // work - Optional buffer of at least mcu_buffer_size() bytes for the MCU rows, allocated when NULL.
             // Returns false on out of memory or if a stream write fails.
-            bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+            bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params(), void *work = NULL);
+
+            // Size of the MCU row buffer init() needs for an image width and subsampling.
+            static uint mcu_buffer_size(int width, subsampling_t subsampling);
 
             // Call this method with each source scanline.
             // width * src_channels bytes per scanline is expected (RGB or Y format).
@@ -90,6 +96,7 @@ namespace jpge
             int m_mcus_per_row;
             int m_mcu_x, m_mcu_y;
             uint8 *m_mcu_lines[16];
+            bool m_owns_mcu_lines;
             uint8 m_mcu_y_ofs;
             sample_array_t m_sample_array[64];
             int16 m_coefficient_array[64];
@@ -103,7 +110,7 @@ namespace jpge
             uint8 m_pass_num;
             bool m_all_stream_writes_succeeded;
 
-            bool jpg_open(int p_x_res, int p_y_res, int src_channels);
+            bool jpg_open(int p_x_res, int p_y_res, int src_channels, void *work);
 
             void flush_output_buffer();
             void put_bits(uint bits, uint len);
@@ -17,7 +17,6 @@
 #include "img_converters.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
-#include "yuv.h"
 #include "sdkconfig.h"
 #include "jpeg_decoder.h"
 
@@ -61,167 +60,236 @@ static void *_malloc(size_t size)
     return malloc(size);
 }
 
-static bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, esp_jpeg_image_scale_t scale)
+esp_err_t img_jpeg_info(const uint8_t *src, size_t src_len, esp_jpeg_image_scale_t scale,
+                        size_t *width, size_t *height)
 {
     esp_jpeg_image_cfg_t jpeg_cfg = {
         .indata = (uint8_t *)src,
         .indata_size = src_len,
-        .outbuf = out,
-        .outbuf_size = UINT32_MAX, // @todo: this is very bold assumption, keeping this like this for now, not to break existing code
         .out_format = JPEG_IMAGE_FORMAT_RGB888,
         .out_scale = scale,
-        .flags.swap_color_bytes = 0,
         .advanced.working_buffer = work,
         .advanced.working_buffer_size = sizeof(work),
     };
     esp_jpeg_image_output_t output_img = {};
-
-    if(esp_jpeg_decode(&jpeg_cfg, &output_img) != ESP_OK){
-        return false;
+    if (!src || !width || !height) {
+        return ESP_ERR_INVALID_ARG;
     }
-    return true;
+    if (esp_jpeg_get_image_info(&jpeg_cfg, &output_img) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    *width = output_img.width;
+    *height = output_img.height;
+    return ESP_OK;
 }
 
-bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, esp_jpeg_image_scale_t scale)
+esp_err_t img_decode_jpeg(const uint8_t *src, size_t src_len, esp_jpeg_image_scale_t scale, const img_view_t *dst)
 {
+    size_t width, height;
+    if (!dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (dst->format != PIXFORMAT_RGB565 && dst->format != PIXFORMAT_RGB888) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_err_t ret = img_jpeg_info(src, src_len, scale, &width, &height);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (width != dst->width || height != dst->height) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // The decoder writes packed rows. They take no more room than the view,
+    // so decode into its memory and spread the rows out from the bottom up,
+    // over the padding.
+    size_t row = width * img_bytes_per_pixel(dst->format);
     esp_jpeg_image_cfg_t jpeg_cfg = {
         .indata = (uint8_t *)src,
         .indata_size = src_len,
-        .outbuf = out,
-        .outbuf_size = UINT32_MAX, // @todo: this is very bold assumption, keeping this like this for now, not to break existing code
-        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .outbuf = dst->data,
+        .outbuf_size = row * height,
+        .out_format = dst->format == PIXFORMAT_RGB565 ? JPEG_IMAGE_FORMAT_RGB565 : JPEG_IMAGE_FORMAT_RGB888,
         .out_scale = scale,
         .flags.swap_color_bytes = 0,
         .advanced.working_buffer = work,
         .advanced.working_buffer_size = sizeof(work),
     };
-
     esp_jpeg_image_output_t output_img = {};
-
-    if(esp_jpeg_decode(&jpeg_cfg, &output_img) != ESP_OK){
-        return false;
+    if (esp_jpeg_decode(&jpeg_cfg, &output_img) != ESP_OK) {
+        return ESP_FAIL;
     }
-    return true;
+    if (dst->stride != row) {
+        for (size_t y = height; y-- > 1;) {
+            memmove(dst->data + y * dst->stride, dst->data + y * row, row);
+        }
+    }
+    return ESP_OK;
 }
 
-bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_len)
+static size_t bmp_row_size(size_t width, size_t bpp)
 {
-    esp_jpeg_image_cfg_t jpeg_cfg = {
-        .indata = (uint8_t *)src,
-        .indata_size = src_len,
-        .out_format = JPEG_IMAGE_FORMAT_RGB888,
-        .out_scale = JPEG_IMAGE_SCALE_0,
-        .flags.swap_color_bytes = 0,
-        .advanced.working_buffer = work,
-        .advanced.working_buffer_size = sizeof(work),
+    return (width * bpp + 3) & ~(size_t)3;
+}
+
+static void bmp_write_header(uint8_t *out, size_t width, size_t height, size_t bpp, size_t palette_size)
+{
+    size_t image_size = bmp_row_size(width, bpp) * height;
+    // the fields after "BM" are not aligned, build them aside and copy them over
+    bmp_header_t bitmap = {
+        .filesize = BMP_HEADER_LEN + palette_size + image_size,
+        .reserved = 0,
+        .fileoffset_to_pixelarray = BMP_HEADER_LEN + palette_size,
+        .dibheadersize = 40,
+        .width = width,
+        .height = -(int32_t)height, //set negative for top to bottom
+        .planes = 1,
+        .bitsperpixel = bpp * 8,
+        .compression = 0,
+        .imagesize = image_size,
+        .ypixelpermeter = 0x0B13, //2835 , 72 DPI
+        .xpixelpermeter = 0x0B13, //2835 , 72 DPI
+        .numcolorspallette = 0,
+        .mostimpcolor = 0,
     };
+    out[0] = 'B';
+    out[1] = 'M';
+    memcpy(&out[2], &bitmap, sizeof(bitmap));
+}
 
-    bool ret = false;
-    uint8_t *output = NULL;
-    esp_jpeg_image_output_t output_img = {};
-    if (esp_jpeg_get_image_info(&jpeg_cfg, &output_img) != ESP_OK) {
+size_t img_bmp_size(size_t width, size_t height, pixformat_t format)
+{
+    // With BMP, 8-bit greyscale requires a palette.
+    // For a 640x480 image though, that's a savings
+    // over going RGB-24.
+    if (format == PIXFORMAT_GRAYSCALE) {
+        return BMP_HEADER_LEN + 4 * 256 + bmp_row_size(width, 1) * height;
+    }
+    return BMP_HEADER_LEN + bmp_row_size(width, 3) * height;
+}
+
+esp_err_t img_encode_bmp(const img_view_t *src, uint8_t *out, size_t out_size, size_t *out_len)
+{
+    if (!src || !out || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!img_bytes_per_pixel(src->format)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    size_t size = img_bmp_size(src->width, src->height, src->format);
+    if (out_size < size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    bool gray = src->format == PIXFORMAT_GRAYSCALE;
+    size_t bpp = gray ? 1 : 3;
+    size_t palette_size = gray ? 4 * 256 : 0;
+    bmp_write_header(out, src->width, src->height, bpp, palette_size);
+
+    uint8_t * palette_buf = out + BMP_HEADER_LEN;
+    for (size_t i = 0; i < palette_size / 4; ++i) {
+        // Grayscale palette, reserved / alpha channel last
+        palette_buf[4 * i + 0] = i;
+        palette_buf[4 * i + 1] = i;
+        palette_buf[4 * i + 2] = i;
+        palette_buf[4 * i + 3] = 0;
+    }
+
+    img_view_t pixels;
+    size_t row = bmp_row_size(src->width, bpp);
+    esp_err_t ret = img_view_init(&pixels, out + BMP_HEADER_LEN + palette_size, row * src->height,
+                                  src->width, src->height, row, gray ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB888);
+    if (ret == ESP_OK) {
+        ret = img_convert(src, &pixels);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (size_t y = 0; y < src->height && row > src->width * bpp; y++) {
+        memset(pixels.data + y * row + src->width * bpp, 0, row - src->width * bpp);
+    }
+    *out_len = size;
+    return ESP_OK;
+}
+
+static bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, esp_jpeg_image_scale_t scale)
+{
+    size_t width, height;
+    img_view_t view;
+    // the caller vouches for the size of out
+    return img_jpeg_info(src, src_len, scale, &width, &height) == ESP_OK &&
+           img_view_init(&view, out, SIZE_MAX, width, height, 0, PIXFORMAT_RGB888) == ESP_OK &&
+           img_decode_jpeg(src, src_len, scale, &view) == ESP_OK;
+}
+
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, esp_jpeg_image_scale_t scale)
+{
+    size_t width, height;
+    img_view_t view;
+    return img_jpeg_info(src, src_len, scale, &width, &height) == ESP_OK &&
+           img_view_init(&view, out, SIZE_MAX, width, height, 0, PIXFORMAT_RGB565) == ESP_OK &&
+           img_decode_jpeg(src, src_len, scale, &view) == ESP_OK;
+}
+
+bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_len)
+{
+    size_t width, height;
+    if (img_jpeg_info(src, src_len, JPEG_IMAGE_SCALE_0, &width, &height) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get image info");
-        goto fail;
+        return false;
     }
 
     // @todo here we allocate memory and we assume that the user will free it
     // this is not the best way to do it, but we need to keep the API
     // compatible with the previous version
-    const size_t output_size = output_img.output_len + BMP_HEADER_LEN;
-    output = _malloc(output_size);
+    const size_t output_size = img_bmp_size(width, height, PIXFORMAT_RGB888);
+    uint8_t *output = _malloc(output_size);
     if (!output) {
         ESP_LOGE(TAG, "Failed to allocate output buffer");
-        goto fail;
+        return false;
     }
 
-    // Start writing decoded data after the BMP header
-    jpeg_cfg.outbuf = output + BMP_HEADER_LEN;
-    jpeg_cfg.outbuf_size = output_img.output_len;
-    if(esp_jpeg_decode(&jpeg_cfg, &output_img) != ESP_OK){
+    // decode straight into the padded BMP rows after the header
+    img_view_t view;
+    size_t row = bmp_row_size(width, 3);
+    if (img_view_init(&view, output + BMP_HEADER_LEN, output_size - BMP_HEADER_LEN, width, height, row,
+                      PIXFORMAT_RGB888) != ESP_OK ||
+            img_decode_jpeg(src, src_len, JPEG_IMAGE_SCALE_0, &view) != ESP_OK) {
         ESP_LOGE(TAG, "JPEG decode failed");
-        goto fail;
+        free(output);
+        return false;
     }
-
-    output[0] = 'B';
-    output[1] = 'M';
-    bmp_header_t * bitmap  = (bmp_header_t*)&output[2];
-    bitmap->reserved = 0;
-    bitmap->filesize = output_size;
-    bitmap->fileoffset_to_pixelarray = BMP_HEADER_LEN;
-    bitmap->dibheadersize = 40;
-    bitmap->width  =  output_img.width;
-    bitmap->height = -output_img.height; //set negative for top to bottom
-    bitmap->planes = 1;
-    bitmap->bitsperpixel = 24;
-    bitmap->compression = 0;
-    bitmap->imagesize = output_img.output_len;
-    bitmap->ypixelpermeter = 0x0B13 ; //2835 , 72 DPI
-    bitmap->xpixelpermeter = 0x0B13 ; //2835 , 72 DPI
-    bitmap->numcolorspallette = 0;
-    bitmap->mostimpcolor = 0;
+    for (size_t y = 0; y < height && row > width * 3; y++) {
+        memset(view.data + y * row + width * 3, 0, row - width * 3);
+    }
+    bmp_write_header(output, width, height, 3, 0);
 
     *out = output;
     *out_len = output_size;
-    ret = true;
-
-fail:
-    if (!ret && output) {
-        free(output);
-    }
-    return ret;
+    return true;
 }
 
 bool fmt2rgb888(const uint8_t *src_buf, size_t src_len, pixformat_t format, uint8_t * rgb_buf)
 {
-    int pix_count = 0;
     if(format == PIXFORMAT_JPEG) {
         return jpg2rgb888(src_buf, src_len, rgb_buf, JPEG_IMAGE_SCALE_0);
-    } else if(format == PIXFORMAT_RGB888) {
-        memcpy(rgb_buf, src_buf, src_len);
-    } else if(format == PIXFORMAT_RGB565) {
-        int i;
-        uint8_t hb, lb;
-        pix_count = src_len / 2;
-        for(i=0; i<pix_count; i++) {
-            hb = *src_buf++;
-            lb = *src_buf++;
-            *rgb_buf++ = (lb & 0x1F) << 3;
-            *rgb_buf++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
-            *rgb_buf++ = hb & 0xF8;
-        }
-    } else if(format == PIXFORMAT_GRAYSCALE) {
-        int i;
-        uint8_t b;
-        pix_count = src_len;
-        for(i=0; i<pix_count; i++) {
-            b = *src_buf++;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-        }
-    } else if(format == PIXFORMAT_YUV422) {
-        pix_count = src_len / 2;
-        int i, maxi = pix_count / 2;
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        for(i=0; i<maxi; i++) {
-            y0 = *src_buf++;
-            u = *src_buf++;
-            y1 = *src_buf++;
-            v = *src_buf++;
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-        }
     }
-    return true;
+    size_t bpp = img_bytes_per_pixel(format);
+    if (!bpp) {
+        return true;
+    }
+    // no dimensions given, convert as one row
+    size_t pix_count = src_len / bpp;
+    if (format == PIXFORMAT_YUV422) {
+        pix_count &= ~(size_t)1;
+    }
+    if (!pix_count) {
+        return true;
+    }
+    img_view_t src, dst;
+    return img_view_init(&src, (uint8_t *)src_buf, src_len, pix_count, 1, 0, format) == ESP_OK &&
+           img_view_init(&dst, rgb_buf, SIZE_MAX, pix_count, 1, 0, PIXFORMAT_RGB888) == ESP_OK &&
+           img_convert(&src, &dst) == ESP_OK;
 }
 
 bool fmt2bmp(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t ** out, size_t * out_len)
@@ -233,93 +301,25 @@ bool fmt2bmp(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
     *out = NULL;
     *out_len = 0;
 
-    int pix_count = width*height;
+    img_view_t view;
+    esp_err_t ret = img_view_init(&view, src, src_len, width, height, 0, format);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid %ux%u image (%s)", width, height, esp_err_to_name(ret));
+        return false;
+    }
 
-    // With BMP, 8-bit greyscale requires a palette.
-    // For a 640x480 image though, that's a savings
-    // over going RGB-24.
-    int bpp = (format == PIXFORMAT_GRAYSCALE) ? 1 : 3;
-    int palette_size = (format == PIXFORMAT_GRAYSCALE) ? 4 * 256 : 0;
-    size_t out_size = (pix_count * bpp) + BMP_HEADER_LEN + palette_size;
+    size_t out_size = img_bmp_size(width, height, format);
     uint8_t * out_buf = (uint8_t *)_malloc(out_size);
     if(!out_buf) {
-        ESP_LOGE(TAG, "_malloc failed! %u", out_size);
+        ESP_LOGE(TAG, "_malloc failed! %u", (unsigned)out_size);
         return false;
     }
-
-    out_buf[0] = 'B';
-    out_buf[1] = 'M';
-    bmp_header_t * bitmap  = (bmp_header_t*)&out_buf[2];
-    bitmap->reserved = 0;
-    bitmap->filesize = out_size;
-    bitmap->fileoffset_to_pixelarray = BMP_HEADER_LEN + palette_size;
-    bitmap->dibheadersize = 40;
-    bitmap->width = width;
-    bitmap->height = -height;//set negative for top to bottom
-    bitmap->planes = 1;
-    bitmap->bitsperpixel = bpp * 8;
-    bitmap->compression = 0;
-    bitmap->imagesize = pix_count * bpp;
-    bitmap->ypixelpermeter = 0x0B13 ; //2835 , 72 DPI
-    bitmap->xpixelpermeter = 0x0B13 ; //2835 , 72 DPI
-    bitmap->numcolorspallette = 0;
-    bitmap->mostimpcolor = 0;
-
-    uint8_t * palette_buf = out_buf + BMP_HEADER_LEN;
-    uint8_t * pix_buf = palette_buf + palette_size;
-    uint8_t * src_buf = src;
-
-    if (palette_size > 0) {
-        // Grayscale palette
-        for (int i = 0; i < 256; ++i) {
-            for (int j = 0; j < 3; ++j) {
-                *palette_buf = i;
-                palette_buf++;
-            }
-            // Reserved / alpha channel.
-            *palette_buf = 0;
-            palette_buf++;
-        }
-    }
-
-    //convert data to RGB888
-    if(format == PIXFORMAT_RGB888) {
-        memcpy(pix_buf, src_buf, pix_count*3);
-    } else if(format == PIXFORMAT_RGB565) {
-        int i;
-        uint8_t hb, lb;
-        for(i=0; i<pix_count; i++) {
-            hb = *src_buf++;
-            lb = *src_buf++;
-            *pix_buf++ = (lb & 0x1F) << 3;
-            *pix_buf++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
-            *pix_buf++ = hb & 0xF8;
-        }
-    } else if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(pix_buf, src_buf, pix_count);
-    } else if(format == PIXFORMAT_YUV422) {
-        int i, maxi = pix_count / 2;
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        for(i=0; i<maxi; i++) {
-            y0 = *src_buf++;
-            u = *src_buf++;
-            y1 = *src_buf++;
-            v = *src_buf++;
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            *pix_buf++ = b;
-            *pix_buf++ = g;
-            *pix_buf++ = r;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            *pix_buf++ = b;
-            *pix_buf++ = g;
-            *pix_buf++ = r;
-        }
+    if (img_encode_bmp(&view, out_buf, out_size, out_len) != ESP_OK) {
+        free(out_buf);
+        *out_len = 0;
+        return false;
     }
     *out = out_buf;
-    *out_len = out_size;
     return true;
 }
 
@@ -19,7 +19,7 @@
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
+#include "img_kernels.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -43,61 +43,50 @@ static void *_malloc(size_t size)
     return NULL;
 }
 
-static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
+// jpge takes R, G, B or Y rows
+static IRAM_ATTR void convert_line_format(const uint8_t * src, pixformat_t format, uint8_t * dst, size_t width)
 {
-    int i=0, o=0, l=0;
     if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
+        memcpy(dst, src, width);
     } else if(format == PIXFORMAT_RGB888) {
-        l = width * 3;
-        src += l * line;
-        for(i=0; i<l; i+=3) {
-            dst[o++] = src[i+2];
-            dst[o++] = src[i+1];
-            dst[o++] = src[i];
-        }
+        img_swap_rb(src, dst, width);
     } else if(format == PIXFORMAT_RGB565) {
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=2) {
-            dst[o++] = src[i] & 0xF8;
-            dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
-            dst[o++] = (src[i+1] & 0x1F) << 3;
-        }
+        img_rgb565_to_rgb24(src, dst, width);
     } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
+        img_yuyv_to_rgb24(src, dst, width);
     }
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+static size_t jpeg_channels(pixformat_t format)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    return format == PIXFORMAT_GRAYSCALE ? 1 : 3;
+}
 
-    if(format == PIXFORMAT_GRAYSCALE) {
-        num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+static jpge::subsampling_t jpeg_subsampling(pixformat_t format)
+{
+    return format == PIXFORMAT_GRAYSCALE ? jpge::Y_ONLY : jpge::H2V2;
+}
+
+size_t img_jpeg_work_size(size_t width, pixformat_t format)
+{
+    if (!img_bytes_per_pixel(format) || width > 0xFFFF) {
+        return 0;
+    }
+    // one converted scan line, then the MCU rows of the encoder
+    return width * jpeg_channels(format) + jpge::jpeg_encoder::mcu_buffer_size(width, jpeg_subsampling(format));
+}
+
+static esp_err_t convert_image(const img_view_t *src, uint8_t quality, void *work, size_t work_size, jpge::output_stream *dst_stream)
+{
+    if (!src || !work || !img_bytes_per_pixel(src->format)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t needed = img_jpeg_work_size(src->width, src->format);
+    if (!needed || src->height > 0xFFFF || work_size < needed) {
+        return ESP_ERR_INVALID_SIZE;
     }
 
+    int num_channels = jpeg_channels(src->format);
     if(!quality) {
         quality = 1;
     } else if(quality > 100) {
@@ -105,38 +94,53 @@ bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t fo
     }
 
     jpge::params comp_params = jpge::params();
-    comp_params.m_subsampling = subsampling;
+    comp_params.m_subsampling = jpeg_subsampling(src->format);
     comp_params.m_quality = quality;
 
     jpge::jpeg_encoder dst_image;
+    uint8_t *line = static_cast<uint8_t *>(work);
+    uint8_t *mcu_lines = line + src->width * num_channels;
 
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
+    if (!dst_image.init(dst_stream, src->width, src->height, num_channels, comp_params, mcu_lines)) {
         ESP_LOGE(TAG, "JPG encoder init failed");
-        return false;
+        return ESP_FAIL;
     }
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
-        return false;
-    }
-
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
+    const uint8_t *row = src->data;
+    for (size_t i = 0; i < src->height; i++, row += src->stride) {
+        convert_line_format(row, src->format, line, src->width);
         if (!dst_image.process_scanline(line)) {
-            ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
-            return false;
+            ESP_LOGE(TAG, "JPG process line %u failed", (unsigned)i);
+            return ESP_FAIL;
         }
     }
-    free(line);
 
     if (!dst_image.process_scanline(NULL)) {
         ESP_LOGE(TAG, "JPG image finish failed");
-        return false;
+        return ESP_FAIL;
     }
     dst_image.deinit();
-    return true;
+    return ESP_OK;
+}
+
+// Legacy entry points: work memory from the heap, the source packed
+static esp_err_t convert_buffer(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+{
+    img_view_t view;
+    esp_err_t ret = img_view_init(&view, src, src_len, width, height, 0, format);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid %ux%u image (%s)", width, height, esp_err_to_name(ret));
+        return ret;
+    }
+    size_t work_size = img_jpeg_work_size(width, format);
+    void *work = _malloc(work_size);
+    if (!work) {
+        ESP_LOGE(TAG, "Scan line malloc failed");
+        return ESP_ERR_NO_MEM;
+    }
+    ret = convert_image(&view, quality, work, work_size, dst_stream);
+    free(work);
+    return ret;
 }
 
 class callback_stream : public jpge::output_stream {
@@ -153,7 +157,7 @@ public:
         index += ocb(oarg, index, data, len);
         return true;
     }
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
@@ -162,7 +166,16 @@ public:
 bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
     callback_stream dst_stream(cb, arg);
-    return convert_image(src, width, height, format, quality, &dst_stream);
+    return convert_buffer(src, src_len, width, height, format, quality, &dst_stream) == ESP_OK;
+}
+
+esp_err_t img_encode_jpeg_cb(const img_view_t *src, uint8_t quality, void *work, size_t work_size, jpg_out_cb cb, void *arg)
+{
+    if (!cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    callback_stream dst_stream(cb, arg);
+    return convert_image(src, quality, work, work_size, &dst_stream);
 }
 
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
@@ -176,9 +189,10 @@ class memory_stream : public jpge::output_stream {
 protected:
     uint8_t *out_buf;
     size_t max_len, index;
+    bool overflow;
 
 public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
+    memory_stream(void *pBuf, size_t buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0), overflow(false) { }
 
     virtual ~memory_stream() { }
 
@@ -189,8 +203,9 @@ public:
             return true;
         }
         if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
+            // the rest of the image is lost, stop the encoder
+            overflow = true;
+            return false;
         }
         if (len) {
             memcpy(out_buf + index, pBuf, len);
@@ -199,12 +214,34 @@ public:
         return true;
     }
 
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
+
+    bool overflowed() const
+    {
+        return overflow;
+    }
 };
 
+esp_err_t img_encode_jpeg(const img_view_t *src, uint8_t quality, void *work, size_t work_size,
+                          uint8_t *out, size_t out_size, size_t *out_len)
+{
+    if (!out || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memory_stream dst_stream(out, out_size);
+    esp_err_t ret = convert_image(src, quality, work, work_size, &dst_stream);
+    if (dst_stream.overflowed()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        *out_len = dst_stream.get_size();
+    }
+    return ret;
+}
+
 bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
 {
     //todo: allocate proper buffer for holding JPEG data
@@ -219,7 +256,10 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
     }
     memory_stream dst_stream(jpg_buf, jpg_buf_len);
 
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
+    if(convert_buffer(src, src_len, width, height, format, quality, &dst_stream) != ESP_OK) {
+        if (dst_stream.overflowed()) {
+            ESP_LOGE(TAG, "JPG output larger than %d bytes", jpg_buf_len);
+        }
         free(jpg_buf);
         return false;
     }
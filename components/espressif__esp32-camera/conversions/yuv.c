@@ -11,7 +11,9 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdbool.h>
 #include "yuv.h"
+#include "img_kernels.h"
 #include "esp_attr.h"
 
 typedef struct {
@@ -296,3 +298,89 @@ void IRAM_ATTR yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g,
     *g = YUYV_CONSTRAIN(gi);
     *b = YUYV_CONSTRAIN(bi);
 }
+
+static inline uint8_t clamp8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* Both pixels of a YUYV pair share U and V, so their terms are looked up once.
+ * The results match yuv2rgb(). */
+static inline void yuyv_pair(uint8_t y0, uint8_t u, uint8_t y1, uint8_t v, uint8_t rgb[6])
+{
+    int vr = yuv_table[v].vVr;
+    int uvg = yuv_table[u].vUg + yuv_table[v].vVg;
+    int ub = yuv_table[u].vUb;
+    int l0 = yuv_table[y0].vY;
+    int l1 = yuv_table[y1].vY;
+    rgb[0] = clamp8(l0 + vr);
+    rgb[1] = clamp8(l0 + uvg);
+    rgb[2] = clamp8(l0 + ub);
+    rgb[3] = clamp8(l1 + vr);
+    rgb[4] = clamp8(l1 + uvg);
+    rgb[5] = clamp8(l1 + ub);
+}
+
+void IRAM_ATTR img_yuyv_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    size_t i = 0;
+    if (kernel_aligned(src, dst)) {
+        // Y0 U0 Y1 V0 Y2 U1 Y3 V1 -> Y0 Y1 Y2 Y3
+        for (; i + 4 <= pixels; i += 4, src += 8, dst += 4) {
+            uint32_t w0 = kernel_load32(src);
+            uint32_t w1 = kernel_load32(src + 4);
+            kernel_store32(dst, (w0 & 0xFF) | ((w0 >> 8) & 0xFF00) |
+                           ((w1 & 0xFF) << 16) | ((w1 << 8) & 0xFF000000));
+        }
+    }
+    for (; i < pixels; i++, src += 2) {
+        *dst++ = src[0];
+    }
+}
+
+void IRAM_ATTR img_yuyv_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    uint8_t rgb[6];
+    bool aligned = kernel_aligned(src, dst);
+    for (size_t i = 0; i < pixels; i += 2, src += 4, dst += 4) {
+        if (aligned) {
+            uint32_t w = kernel_load32(src);
+            yuyv_pair(w, w >> 8, w >> 16, w >> 24, rgb);
+        } else {
+            yuyv_pair(src[0], src[1], src[2], src[3], rgb);
+        }
+        uint8_t hb0 = (rgb[0] & 0xF8) | (rgb[1] >> 5);
+        uint8_t lb0 = ((rgb[1] << 3) & 0xE0) | (rgb[2] >> 3);
+        uint8_t hb1 = (rgb[3] & 0xF8) | (rgb[4] >> 5);
+        uint8_t lb1 = ((rgb[4] << 3) & 0xE0) | (rgb[5] >> 3);
+        if (aligned) {
+            kernel_store32(dst, hb0 | (lb0 << 8) | (hb1 << 16) | ((uint32_t)lb1 << 24));
+        } else {
+            dst[0] = hb0;
+            dst[1] = lb0;
+            dst[2] = hb1;
+            dst[3] = lb1;
+        }
+    }
+}
+
+void IRAM_ATTR img_yuyv_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    uint8_t rgb[6];
+    for (size_t i = 0; i < pixels; i += 2, src += 4, dst += 6) {
+        yuyv_pair(src[0], src[1], src[2], src[3], rgb);
+        dst[0] = rgb[2];
+        dst[1] = rgb[1];
+        dst[2] = rgb[0];
+        dst[3] = rgb[5];
+        dst[4] = rgb[4];
+        dst[5] = rgb[3];
+    }
+}
+
+void IRAM_ATTR img_yuyv_to_rgb24(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 2, src += 4, dst += 6) {
+        yuyv_pair(src[0], src[1], src[2], src[3], dst);
+    }
+}
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdalign.h>
 #include "esp_heap_caps.h"
@@ -20,9 +21,13 @@
 #include "freertos/task.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "jpeg_scan.h"
 
 #if (ESP_IDF_VERSION_MAJOR == 3) && (ESP_IDF_VERSION_MINOR == 3)
 #include "rom/ets_sys.h"
+#elif CONFIG_IDF_TARGET_LINUX
+#include "esp_timer.h"
+#include "esp_idf_version.h"
 #else
 #include "esp_timer.h"
 #include "esp_cache.h"
@@ -43,6 +48,8 @@
 
 #if CONFIG_LOG_DEFAULT_LEVEL_NONE
 #define ESP_CAMERA_ETS_PRINTF(f, ...)
+#elif CONFIG_IDF_TARGET_LINUX
+#define ESP_CAMERA_ETS_PRINTF(f, ...) printf(f, ##__VA_ARGS__)
 #else
 #define ESP_CAMERA_ETS_PRINTF(f, ...) ets_printf(f, ##__VA_ARGS__)
 #endif
@@ -82,7 +89,9 @@ static portMUX_TYPE g_psram_dma_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static inline size_t dcache_line_size(void)
 {
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#if CONFIG_IDF_TARGET_LINUX
+    return 32;
+#elif ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
     /* cache_hal_get_cache_line_size() added extra argument from IDF 5.2 */
     return cache_hal_get_cache_line_size(CACHE_LL_LEVEL_EXT_MEM, CACHE_TYPE_DATA);
 #else
@@ -100,6 +109,11 @@ static inline size_t dcache_line_size(void)
  */
 static inline void cam_drop_psram_cache(void *addr, size_t len)
 {
+#if CONFIG_IDF_TARGET_LINUX
+    /* host memory is coherent, PSRAM DMA mode is never enabled */
+    (void)addr;
+    (void)len;
+#else
     size_t line = dcache_line_size();
     if (line == 0) {
         line = 32; /* sane fallback */
@@ -108,6 +122,7 @@ static inline void cam_drop_psram_cache(void *addr, size_t len)
     size_t sync_len = (len + ((uintptr_t)addr - start) + line - 1) & ~(line - 1);
     esp_cache_msync((void *)start, sync_len,
                     ESP_CACHE_MSYNC_FLAG_DIR_M2C | ESP_CACHE_MSYNC_FLAG_INVALIDATE);
+#endif
 }
 
 /* Throttle repeated warnings printed from tight loops / ISRs.
@@ -129,11 +144,42 @@ static inline void cam_drop_psram_cache(void *addr, size_t len)
 #define CAM_WARN_THROTTLE(counter, first) do { (void)(counter); } while (0)
 #endif
 
-/* JPEG markers (byte-order independent). */
-static const uint8_t JPEG_SOI_MARKER[] = {0xFF, 0xD8, 0xFF}; /* SOI = FF D8 FF */
-#define JPEG_SOI_MARKER_LEN (3)
-static const uint8_t JPEG_EOI_BYTES[] = {0xFF, 0xD9};        /* EOI = FF D9 */
-#define JPEG_EOI_MARKER_LEN (2)
+/* Statistics are lock-free: every counter has a single writer context apart
+ * from the ISR overflow counter, so relaxed atomic adds are sufficient and
+ * cost a handful of cycles per frame. */
+#define CAM_STAT_INC(cam, field) __atomic_fetch_add(&(cam)->stats.field, 1, __ATOMIC_RELAXED)
+
+/* Add a latency sample to a log2 histogram, see ESP_CAMERA_LATENCY_BUCKETS. */
+static inline void cam_stat_latency(uint32_t *hist, int64_t us)
+{
+    uint32_t bucket = 0;
+    if (us >= 512) {
+        uint64_t v = (uint64_t)us >> 9;
+        bucket = 64 - __builtin_clzll(v);
+        if (bucket >= ESP_CAMERA_LATENCY_BUCKETS) {
+            bucket = ESP_CAMERA_LATENCY_BUCKETS - 1;
+        }
+    }
+    __atomic_fetch_add(&hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/* Add a JPEG frame length to the size histogram, see ESP_CAMERA_JPEG_SIZE_BUCKETS. */
+static inline void cam_stat_jpeg_size(size_t len)
+{
+    uint32_t bucket = len / cam_obj->jpeg_size_step;
+    if (bucket >= ESP_CAMERA_JPEG_SIZE_BUCKETS) {
+        bucket = ESP_CAMERA_JPEG_SIZE_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&cam_obj->stats.jpeg_size[bucket], 1, __ATOMIC_RELAXED);
+}
+
+static inline cam_frame_t *cam_frame_of(camera_fb_t *fb)
+{
+    return (cam_frame_t *)((uint8_t *)fb - offsetof(cam_frame_t, fb));
+}
+
+#define JPEG_SOI_MARKER_LEN (3) /* SOI = FF D8 FF */
+#define JPEG_EOI_MARKER_LEN (2) /* EOI = FF D9 */
 
 /* Compute the scan window for JPEG EOI detection in PSRAM. */
 static inline size_t eoi_probe_window(size_t half, size_t frame_len)
@@ -151,70 +197,23 @@ static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
         return -1;
     }
 
-    for (uint32_t i = 0; i <= length - JPEG_SOI_MARKER_LEN; i++) {
-        if (memcmp(&inbuf[i], JPEG_SOI_MARKER, JPEG_SOI_MARKER_LEN) == 0) {
-            //ESP_LOGW(TAG, "SOI: %d", (int) i);
-            return i;
-        }
+    int soi = jpeg_scan_soi(inbuf, length);
+    if (soi < 0) {
+        CAM_WARN_THROTTLE(warn_soi_miss_cnt,
+                          "NO-SOI - JPEG start marker missing");
     }
-
-    CAM_WARN_THROTTLE(warn_soi_miss_cnt,
-                      "NO-SOI - JPEG start marker missing");
-    return -1;
+    return soi;
 }
 
 static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length, bool search_forward)
 {
-    if (length < JPEG_EOI_MARKER_LEN) {
-        return -1;
-    }
-
+    /* Forward search honors the earliest marker in the buffer. This avoids
+     * returning an EOI that belongs to a larger previous frame when the tail
+     * of that frame still resides in PSRAM. */
     if (search_forward) {
-        /* Scan forward to honor the earliest marker in the buffer. This avoids
-         * returning an EOI that belongs to a larger previous frame when the tail
-         * of that frame still resides in PSRAM. JPEG data is pseudo random, so
-         * the first marker byte appears rarely; test four positions per load to
-         * reduce memory traffic. */
-        const uint8_t *pat = JPEG_EOI_BYTES;
-        const uint32_t A = pat[0] * 0x01010101u;
-        const uint32_t ONE = 0x01010101u;
-        const uint32_t HIGH = 0x80808080u;
-        uint32_t i = 0;
-        while (i + 4 <= length) {
-            uint32_t w;
-            memcpy(&w, inbuf + i, 4); /* unaligned load is allowed */
-            uint32_t x = w ^ A; /* identify bytes equal to first marker byte */
-            uint32_t m = (~x & (x - ONE)) & HIGH; /* mask has high bit set for candidate bytes */
-            while (m) { /* handle only candidates to avoid unnecessary memcmp calls */
-                unsigned off = __builtin_ctz(m) >> 3;
-                uint32_t pos = i + off;
-                if (pos + JPEG_EOI_MARKER_LEN <= length &&
-                    memcmp(inbuf + pos, pat, JPEG_EOI_MARKER_LEN) == 0) {
-                    return pos;
-                }
-                m &= m - 1; /* clear processed candidate */
-            }
-            i += 4;
-        }
-        for (; i + JPEG_EOI_MARKER_LEN <= length; i++) {
-            if (memcmp(inbuf + i, pat, JPEG_EOI_MARKER_LEN) == 0) {
-                return i;
-            }
-        }
-        return -1;
+        return jpeg_scan_eoi(inbuf, length);
     }
-
-    const uint8_t *dptr = inbuf + length - JPEG_EOI_MARKER_LEN;
-    while (dptr >= inbuf) {
-        if (memcmp(dptr, JPEG_EOI_BYTES, JPEG_EOI_MARKER_LEN) == 0) {
-            return dptr - inbuf;
-        }
-        if (dptr == inbuf) {
-            break;
-        }
-        dptr--;
-    }
-    return -1;
+    return jpeg_scan_eoi_last(inbuf, length);
 }
 
 static bool cam_get_next_frame(int * frame_pos)
@@ -239,6 +238,7 @@ static bool cam_start_frame(int * frame_pos)
             // Vsync the frame manually
             ll_cam_do_vsync(cam_obj);
             uint64_t us = (uint64_t)esp_timer_get_time();
+            cam_obj->frames[*frame_pos].start_us = us;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
             return true;
@@ -250,6 +250,7 @@ static bool cam_start_frame(int * frame_pos)
 void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType_t * HPTaskAwoken)
 {
     if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
+        CAM_STAT_INC(cam, event_overflows);
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
 #if CAM_LOG_SPAM_EVERY_FRAME
@@ -267,13 +268,17 @@ static void cam_task(void *arg)
 {
     int cnt = 0;
     int frame_pos = 0;
+    bool overflowed = false;
     cam_obj->state = CAM_STATE_IDLE;
     cam_event_t cam_event = 0;
 
-    xQueueReset(cam_obj->event_queue);
-
     while (1) {
         xQueueReceive(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
+        if (cam_event == CAM_STOP_TASK_EVENT) {
+            /* every event raised before capture stopped is handled, no
+             * finished frame is left on its way to frame_buffer_queue */
+            break;
+        }
         DBG_PIN_SET(1);
         switch (cam_obj->state) {
 
@@ -285,6 +290,7 @@ static void cam_task(void *arg)
                         cam_obj->state = CAM_STATE_READ_BUF;
                     }
                     cnt = 0;
+                    overflowed = false;
                 }
             }
             break;
@@ -296,7 +302,12 @@ static void cam_task(void *arg)
                 if (cam_event == CAM_IN_SUC_EOF_EVENT) {
                     if(!cam_obj->psram_mode){
                         if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
-                            ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                            // EOF events already queued keep arriving, count the frame once
+                            if (!overflowed) {
+                                ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                                CAM_STAT_INC(cam_obj, fb_overflows);
+                                overflowed = true;
+                            }
                             ll_cam_stop(cam_obj);
                             continue;
                         }
@@ -312,6 +323,7 @@ static void cam_task(void *arg)
                         // cam event will be a VSYNC
                         if (cnt + 1 >= cam_obj->frame_copy_cnt) {
                             ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: DMA overflow\r\n"));
+                            CAM_STAT_INC(cam_obj, fb_overflows);
                             ll_cam_stop(cam_obj);
                             cam_obj->state = CAM_STATE_IDLE;
                             continue;
@@ -342,6 +354,7 @@ static void cam_task(void *arg)
                                     CAM_WARN_THROTTLE(warn_psram_soi_cnt,
                                                       "NO-SOI - JPEG start marker missing (PSRAM)");
                                 }
+                                CAM_STAT_INC(cam_obj, jpeg_no_soi);
                                 ll_cam_stop(cam_obj);
                                 cam_obj->state = CAM_STATE_IDLE;
                                 continue;
@@ -357,6 +370,7 @@ static void cam_task(void *arg)
                                     CAM_WARN_THROTTLE(warn_soi_bad_cnt,
                                                       "NO-SOI - JPEG start marker missing");
                                 }
+                                CAM_STAT_INC(cam_obj, jpeg_no_soi);
                                 ll_cam_stop(cam_obj);
                                 cam_obj->state = CAM_STATE_IDLE;
                                 continue;
@@ -374,7 +388,10 @@ static void cam_task(void *arg)
                         if (cam_obj->jpeg_mode) {
                             if (!cam_obj->psram_mode) {
                                 if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
-                                    ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                                    if (!overflowed) {
+                                        ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-OVF\r\n"));
+                                        CAM_STAT_INC(cam_obj, fb_overflows);
+                                    }
                                     cnt--;
                                 } else {
                                     frame_buffer_event->len += ll_cam_memcpy(cam_obj,
@@ -400,6 +417,13 @@ static void cam_task(void *arg)
                                 ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FB-SIZE: %u != %u\r\n"), frame_buffer_event->len, (unsigned) cam_obj->fb_size);
                             }
                         }
+                        if (!cam_obj->frames[frame_pos].en) {
+                            int64_t now = esp_timer_get_time();
+                            frame_buffer_event->seq = cam_obj->frame_seq++;
+                            cam_obj->frames[frame_pos].queued_us = now;
+                            CAM_STAT_INC(cam_obj, frames_captured);
+                            cam_stat_latency(cam_obj->stats.vsync_to_queue, now - cam_obj->frames[frame_pos].start_us);
+                        }
                         //send frame
                         if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
                             //pop frame buffer from the queue
@@ -408,13 +432,16 @@ static void cam_task(void *arg)
                                 //push the new frame to the end of the queue
                                 if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
                                     cam_obj->frames[frame_pos].en = 1;
+                                    CAM_STAT_INC(cam_obj, frames_dropped_full);
                                     ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FBQ-SND\r\n"));
                                 }
                                 //free the popped buffer
+                                CAM_STAT_INC(cam_obj, frames_dropped_full);
                                 cam_give(fb2);
                             } else {
                                 //queue is full and we could not pop a frame from it
                                 cam_obj->frames[frame_pos].en = 1;
+                                CAM_STAT_INC(cam_obj, frames_dropped_full);
                                 ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: FBQ-RCV\r\n"));
                             }
                         }
@@ -426,12 +453,16 @@ static void cam_task(void *arg)
                         cam_obj->frames[frame_pos].fb.len = 0;
                     }
                     cnt = 0;
+                    overflowed = false;
                 }
             }
             break;
         }
         DBG_PIN_SET(0);
     }
+    cam_obj->state = CAM_STATE_IDLE;
+    xSemaphoreGive(cam_obj->task_stopped);
+    vTaskDelete(NULL);
 }
 
 static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_t * buffer)
@@ -533,6 +564,82 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
     return ESP_OK;
 }
 
+/* Frame buffers, DMA chains and the queues whose depth depends on them. */
+static esp_err_t cam_alloc_buffers(const camera_config_t *config)
+{
+    esp_err_t ret = cam_dma_config(config);
+    CAM_CHECK(ret == ESP_OK, "cam_dma_config failed", ret);
+
+    size_t queue_size = cam_obj->dma_half_buffer_cnt - 1;
+    if (queue_size == 0) {
+        queue_size = 1;
+    }
+    cam_obj->event_queue = xQueueCreate(queue_size, sizeof(cam_event_t));
+    CAM_CHECK(cam_obj->event_queue != NULL, "event_queue create failed", ESP_ERR_NO_MEM);
+
+    size_t frame_buffer_queue_len = cam_obj->frame_cnt;
+    if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
+        frame_buffer_queue_len = cam_obj->frame_cnt - 1;
+    }
+    cam_obj->frame_buffer_queue = xQueueCreate(frame_buffer_queue_len, sizeof(camera_fb_t*));
+    CAM_CHECK(cam_obj->frame_buffer_queue != NULL, "frame_buffer_queue create failed", ESP_ERR_NO_MEM);
+    return ESP_OK;
+}
+
+static void cam_free_buffers(cam_obj_t *cam)
+{
+    if (cam->event_queue) {
+        vQueueDelete(cam->event_queue);
+        cam->event_queue = NULL;
+    }
+    if (cam->frame_buffer_queue) {
+        vQueueDelete(cam->frame_buffer_queue);
+        cam->frame_buffer_queue = NULL;
+    }
+    if (cam->dma) {
+        free(cam->dma);
+        cam->dma = NULL;
+    }
+    if (cam->dma_buffer) {
+        free(cam->dma_buffer);
+        cam->dma_buffer = NULL;
+    }
+    if (cam->frames) {
+        for (int x = 0; x < cam->frame_cnt; x++) {
+            free(cam->frames[x].fb.buf - cam->frames[x].fb_offset);
+            if (cam->frames[x].dma) {
+                free(cam->frames[x].dma);
+            }
+        }
+        free(cam->frames);
+        cam->frames = NULL;
+    }
+}
+
+/* Let cam_task finish what it holds and end itself, capture must be stopped */
+static void cam_end_task(void)
+{
+    cam_event_t cam_event = CAM_STOP_TASK_EVENT;
+    xQueueSend(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
+    xSemaphoreTake(cam_obj->task_stopped, portMAX_DELAY);
+    cam_obj->task_handle = NULL;
+    /* a VSYNC still queued may have started the DMA again */
+    ll_cam_stop(cam_obj);
+}
+
+static void cam_create_task(void)
+{
+    /* here rather than in cam_task, a cam_pause() right after must not be lost */
+    xQueueReset(cam_obj->event_queue);
+#if CONFIG_CAMERA_CORE0
+    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
+#elif CONFIG_CAMERA_CORE1
+    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
+#else
+    xTaskCreate(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
+#endif
+}
+
 esp_err_t cam_init(const camera_config_t *config)
 {
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
@@ -545,6 +652,9 @@ esp_err_t cam_init(const camera_config_t *config)
     cam_obj->vsync_pin = config->pin_vsync;
     cam_obj->vsync_invert = true;
 
+    cam_obj->task_stopped = xSemaphoreCreateBinary();
+    CAM_CHECK_GOTO(cam_obj->task_stopped != NULL, "task_stopped create failed", err);
+
     ll_cam_set_pin(cam_obj, config);
     ret = ll_cam_config(cam_obj, config);
     CAM_CHECK_GOTO(ret == ESP_OK, "ll_cam initialize failed", err);
@@ -559,12 +669,15 @@ esp_err_t cam_init(const camera_config_t *config)
     return ESP_OK;
 
 err:
+    if (cam_obj->task_stopped) {
+        vSemaphoreDelete(cam_obj->task_stopped);
+    }
     free(cam_obj);
     cam_obj = NULL;
     return ESP_FAIL;
 }
 
-esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid)
+esp_err_t cam_config(const camera_config_t *config, uint16_t width, uint16_t height, uint16_t sensor_pid)
 {
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
     esp_err_t ret = ESP_OK;
@@ -580,8 +693,8 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
 #endif
     ESP_LOGI(TAG, "PSRAM DMA mode %s", cam_obj->psram_mode ? "enabled" : "disabled");
     cam_obj->frame_cnt = config->fb_count;
-    cam_obj->width = resolution[frame_size].width;
-    cam_obj->height = resolution[frame_size].height;
+    cam_obj->width = width;
+    cam_obj->height = height;
 
     if(cam_obj->jpeg_mode){
 #ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
@@ -595,34 +708,19 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
         cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
     }
 
-    ret = cam_dma_config(config);
-    CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
-
-    size_t queue_size = cam_obj->dma_half_buffer_cnt - 1;
-    if (queue_size == 0) {
-        queue_size = 1;
+    /* the histogram covers twice the initial worst case estimate */
+    cam_obj->jpeg_size_step = (cam_obj->recv_size / (ESP_CAMERA_JPEG_SIZE_BUCKETS / 2) + 1023) & ~1023;
+    if (cam_obj->jpeg_size_step == 0) {
+        cam_obj->jpeg_size_step = 1024;
     }
-    cam_obj->event_queue = xQueueCreate(queue_size, sizeof(cam_event_t));
-    CAM_CHECK_GOTO(cam_obj->event_queue != NULL, "event_queue create failed", err);
 
-    size_t frame_buffer_queue_len = cam_obj->frame_cnt;
-    if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
-        frame_buffer_queue_len = cam_obj->frame_cnt - 1;
-    }
-    cam_obj->frame_buffer_queue = xQueueCreate(frame_buffer_queue_len, sizeof(camera_fb_t*));
-    CAM_CHECK_GOTO(cam_obj->frame_buffer_queue != NULL, "frame_buffer_queue create failed", err);
+    ret = cam_alloc_buffers(config);
+    CAM_CHECK_GOTO(ret == ESP_OK, "cam buffer allocation failed", err);
 
     ret = ll_cam_init_isr(cam_obj);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam intr alloc failed", err);
 
-
-#if CONFIG_CAMERA_CORE0
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
-#elif CONFIG_CAMERA_CORE1
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
-#else
-    xTaskCreate(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
-#endif
+    cam_create_task();
 
     ESP_LOGI(TAG, "cam config ok");
     return ESP_OK;
@@ -640,32 +738,12 @@ esp_err_t cam_deinit(void)
 
     cam_stop();
     if (cam_obj->task_handle) {
-        vTaskDelete(cam_obj->task_handle);
-    }
-    if (cam_obj->event_queue) {
-        vQueueDelete(cam_obj->event_queue);
-    }
-    if (cam_obj->frame_buffer_queue) {
-        vQueueDelete(cam_obj->frame_buffer_queue);
+        cam_end_task();
     }
 
     ll_cam_deinit(cam_obj);
-
-    if (cam_obj->dma) {
-        free(cam_obj->dma);
-    }
-    if (cam_obj->dma_buffer) {
-        free(cam_obj->dma_buffer);
-    }
-    if (cam_obj->frames) {
-        for (int x = 0; x < cam_obj->frame_cnt; x++) {
-            free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
-            if (cam_obj->frames[x].dma) {
-                free(cam_obj->frames[x].dma);
-            }
-        }
-        free(cam_obj->frames);
-    }
+    cam_free_buffers(cam_obj);
+    vSemaphoreDelete(cam_obj->task_stopped);
 
     free(cam_obj);
     cam_obj = NULL;
@@ -683,6 +761,32 @@ void cam_start(void)
     ll_cam_vsync_intr_enable(cam_obj, true);
 }
 
+void cam_pause(void)
+{
+    cam_stop();
+    cam_end_task();
+
+    camera_fb_t *fb = NULL;
+    while (xQueueReceive(cam_obj->frame_buffer_queue, &fb, 0) == pdTRUE) {
+        cam_give(fb);
+    }
+}
+
+void cam_resume(void)
+{
+    cam_create_task();
+    cam_start();
+}
+
+/* Account a frame that is about to be handed to the application. */
+static camera_fb_t *cam_take_done(camera_fb_t *dma_buffer)
+{
+    CAM_STAT_INC(cam_obj, frames_returned);
+    cam_stat_latency(cam_obj->stats.queue_to_get,
+                     esp_timer_get_time() - cam_frame_of(dma_buffer)->queued_us);
+    return dma_buffer;
+}
+
 camera_fb_t *cam_take(TickType_t timeout)
 {
     camera_fb_t *dma_buffer = NULL;
@@ -716,6 +820,7 @@ camera_fb_t *cam_take(TickType_t timeout)
 #if CONFIG_IDF_TARGET_ESP32S3
             if (dma_reset_counter < MAX_GDMA_RESETS) {
                 ll_cam_dma_reset(cam_obj);
+                CAM_STAT_INC(cam_obj, gdma_resets);
                 dma_reset_counter++;
                 continue; /* retry with queue timeout */
             }
@@ -757,17 +862,19 @@ camera_fb_t *cam_take(TickType_t timeout)
 
             if (offset_e >= 0) {
                 dma_buffer->len = offset_e + JPEG_EOI_MARKER_LEN;
+                cam_stat_jpeg_size(dma_buffer->len);
                 if (cam_obj->psram_mode) {
                     /* DMA may bypass cache, ensure full frame is visible */
                     cam_drop_psram_cache(dma_buffer->buf, dma_buffer->len);
                 }
-                return dma_buffer;
+                return cam_take_done(dma_buffer);
             }
 
 skip_eoi_check:
 
             CAM_WARN_THROTTLE(warn_eoi_miss_cnt,
                               "NO-EOI - JPEG end marker missing");
+            CAM_STAT_INC(cam_obj, jpeg_no_eoi);
             cam_give(dma_buffer);
             continue; /* wait for another frame */
         } else if (cam_obj->psram_mode &&
@@ -781,7 +888,7 @@ skip_eoi_check:
             cam_drop_psram_cache(dma_buffer->buf, dma_buffer->len);
         }
 
-        return dma_buffer;
+        return cam_take_done(dma_buffer);
     }
 }
 
@@ -806,6 +913,67 @@ bool cam_get_available_frames(void)
     return 0 < uxQueueMessagesWaiting(cam_obj->frame_buffer_queue);
 }
 
+void cam_get_stats(esp_camera_stats_t *out)
+{
+    *out = cam_obj->stats;
+    out->queue_depth = uxQueueMessagesWaiting(cam_obj->frame_buffer_queue);
+    out->jpeg_size_step = cam_obj->jpeg_mode ? cam_obj->jpeg_size_step : 0;
+    out->fb_size = cam_obj->fb_size;
+    out->fb_count = cam_obj->frame_cnt;
+}
+
+esp_err_t cam_set_fb_size(const camera_config_t *config, size_t fb_size, size_t fb_count)
+{
+    CAM_CHECK(cam_obj->jpeg_mode, "frame buffer size only adapts in JPEG mode", ESP_ERR_NOT_SUPPORTED);
+    CAM_CHECK(fb_count > 0 && fb_size > 0, "invalid frame buffer size", ESP_ERR_INVALID_ARG);
+
+    /* A frame only fits when the last DMA copy still fits, see cam_task() */
+    size_t half = cam_obj->dma_half_buffer_size;
+    size_t recv_size = ((fb_size + half - 1) / half + 1) * half;
+
+    cam_pause();
+    for (int x = 0; x < cam_obj->frame_cnt; x++) {
+        if (!cam_obj->frames[x].en) {
+            ESP_LOGW(TAG, "frame buffer %d still held by the application", x);
+            cam_resume();
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    /* The new buffers are allocated next to the old ones, so a failure leaves
+     * the driver as it was. Nothing else touches cam_obj while paused. */
+    cam_obj_t old = *cam_obj;
+    cam_obj->event_queue = NULL;
+    cam_obj->frame_buffer_queue = NULL;
+    cam_obj->dma = NULL;
+    cam_obj->dma_buffer = NULL;
+    cam_obj->frames = NULL;
+    cam_obj->recv_size = cam_obj->fb_size = recv_size;
+    cam_obj->frame_cnt = fb_count;
+    esp_err_t ret = cam_alloc_buffers(config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "%u x %u byte frame buffers do not fit, keeping %u x %u",
+                 (unsigned) fb_count, (unsigned) recv_size, (unsigned) old.frame_cnt, (unsigned) old.recv_size);
+        cam_free_buffers(cam_obj);
+        *cam_obj = old;
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        ESP_LOGI(TAG, "frame buffers: %u x %u -> %u x %u bytes",
+                 (unsigned) old.frame_cnt, (unsigned) old.recv_size, (unsigned) fb_count, (unsigned) recv_size);
+        cam_free_buffers(&old);
+    }
+
+    cam_resume();
+    return ret;
+}
+
+void cam_reset_stats(void)
+{
+    /* Racing increments may survive the reset; the counters stay monotonic
+     * between resets which is all the consumers rely on. */
+    memset(&cam_obj->stats, 0, sizeof(cam_obj->stats));
+}
+
 void cam_set_psram_mode(bool enable)
 {
     portENTER_CRITICAL(&g_psram_dma_lock);
@@ -18,7 +18,9 @@
 #include "sys/time.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/gpio.h"
+#endif
 #include "esp_system.h"
 #include "nvs_flash.h"
 #include "nvs.h"
@@ -90,14 +92,19 @@ static const char *TAG = "camera";
 typedef struct {
     sensor_t sensor;
     camera_fb_t fb;
+    camera_roi_t roi;           // output size resolved, width is 0 when the whole frame is used
+    framesize_t max_size;       // largest frame size of the sensor
+    uint32_t fb_pixels;         // frame size the JPEG buffers were allocated for, in pixels
+    size_t fb_adapt_size;       // last size esp_camera_fb_adapt() applied, 0 before the first
 } camera_state_t;
 
 static const char *CAMERA_SENSOR_NVS_KEY = "sensor";
 static const char *CAMERA_PIXFORMAT_NVS_KEY = "pixformat";
+static const char *CAMERA_AE_STATE_NVS_KEY = "ae_state";
 static camera_state_t *s_state = NULL;
 static camera_config_t s_saved_config;
 
-#if CONFIG_IDF_TARGET_ESP32S3 // LCD_CAM module of ESP32-S3 will generate xclk
+#if CONFIG_IDF_TARGET_ESP32S3 || CONFIG_IDF_TARGET_LINUX // LCD_CAM module of ESP32-S3 will generate xclk, the simulator needs none
 #define CAMERA_ENABLE_OUT_CLOCK(v)
 #define CAMERA_DISABLE_OUT_CLOCK()
 #else
@@ -195,6 +202,7 @@ static esp_err_t camera_probe(const camera_config_t *config, camera_model_t *out
         goto err;
     }
 
+#if !CONFIG_IDF_TARGET_LINUX
     if (config->pin_pwdn >= 0) {
         ESP_LOGD(TAG, "Resetting camera by power down line");
         gpio_config_t conf = { 0 };
@@ -221,6 +229,7 @@ static esp_err_t camera_probe(const camera_config_t *config, camera_model_t *out
         gpio_set_level(config->pin_reset, 1);
         vTaskDelay(10 / portTICK_PERIOD_MS);
     }
+#endif
 
     ESP_LOGD(TAG, "Searching for camera address");
     vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -326,21 +335,67 @@ esp_err_t esp_camera_init(const camera_config_t *config)
         ESP_LOGW(TAG, "The frame size exceeds the maximum for this sensor, it will be forced to the maximum possible value");
         frame_size = camera_sensor[camera_model].max_size;
     }
+    s_state->max_size = camera_sensor[camera_model].max_size;
+
+    uint16_t width = resolution[frame_size].width;
+    uint16_t height = resolution[frame_size].height;
+    // JPEG buffers can hold a larger size to switch to later
+    framesize_t fb_frame_size = config->frame_size_max;
+    if (pix_format == PIXFORMAT_JPEG && !config->roi.width && fb_frame_size < FRAMESIZE_INVALID &&
+        fb_frame_size <= s_state->max_size &&
+        resolution[fb_frame_size].width * resolution[fb_frame_size].height > width * height) {
+        width = resolution[fb_frame_size].width;
+        height = resolution[fb_frame_size].height;
+    }
+    if (config->roi.width) {
+        if (!s_state->sensor.set_roi) {
+            ESP_LOGE(TAG, "Region of interest is not supported on this sensor");
+            err = ESP_ERR_NOT_SUPPORTED;
+            goto fail;
+        }
+        s_state->roi = config->roi;
+        if (!s_state->roi.out_width || !s_state->roi.out_height) {
+            s_state->roi.out_width = s_state->roi.width;
+            s_state->roi.out_height = s_state->roi.height;
+        }
+        width = s_state->roi.out_width;
+        height = s_state->roi.out_height;
+        if (pix_format == PIXFORMAT_JPEG && ((width % 16) || (height % 8))) {
+            ESP_LOGE(TAG, "JPEG region of interest output %ux%u is not a multiple of 16x8", width, height);
+            err = ESP_ERR_INVALID_ARG;
+            goto fail;
+        }
+    }
 
-    err = cam_config(config, frame_size, s_state->sensor.id.PID);
+    err = cam_config(config, width, height, s_state->sensor.id.PID);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera config failed with error 0x%x", err);
         goto fail;
     }
+    s_state->fb_pixels = (uint32_t)width * height;
+    if (!s_state->roi.width) {
+        width = resolution[frame_size].width;
+        height = resolution[frame_size].height;
+    }
 
     s_state->sensor.status.framesize = frame_size;
     s_state->sensor.pixformat = pix_format;
 
-    ESP_LOGD(TAG, "Setting frame size to %dx%d", resolution[frame_size].width, resolution[frame_size].height);
-    if (s_state->sensor.set_framesize(&s_state->sensor, frame_size) != 0) {
-        ESP_LOGE(TAG, "Failed to set frame size");
-        err = ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
-        goto fail;
+    if (s_state->roi.width) {
+        ESP_LOGD(TAG, "Setting region of interest %ux%u+%u+%u to %ux%u", s_state->roi.width, s_state->roi.height,
+                 s_state->roi.x, s_state->roi.y, width, height);
+        if (s_state->sensor.set_roi(&s_state->sensor, &s_state->roi) != 0) {
+            ESP_LOGE(TAG, "Failed to set region of interest");
+            err = ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
+            goto fail;
+        }
+    } else {
+        ESP_LOGD(TAG, "Setting frame size to %dx%d", width, height);
+        if (s_state->sensor.set_framesize(&s_state->sensor, frame_size) != 0) {
+            ESP_LOGE(TAG, "Failed to set frame size");
+            err = ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
+            goto fail;
+        }
     }
     s_state->sensor.set_pixformat(&s_state->sensor, pix_format);
 #if CONFIG_CAMERA_CONVERTER_ENABLED
@@ -394,8 +449,13 @@ camera_fb_t *esp_camera_fb_get()
     camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
     //set the frame properties
     if (fb) {
-        fb->width = resolution[s_state->sensor.status.framesize].width;
-        fb->height = resolution[s_state->sensor.status.framesize].height;
+        if (s_state->roi.width) {
+            fb->width = s_state->roi.out_width;
+            fb->height = s_state->roi.out_height;
+        } else {
+            fb->width = resolution[s_state->sensor.status.framesize].width;
+            fb->height = resolution[s_state->sensor.status.framesize].height;
+        }
         fb->format = s_state->sensor.pixformat;
     }
     return fb;
@@ -424,25 +484,31 @@ esp_err_t esp_camera_save_to_nvs(const char *key)
 #else
     nvs_handle handle;
 #endif
-    esp_err_t ret = nvs_open(key, NVS_READWRITE, &handle);
+    sensor_t *s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_CAMERA_NOT_DETECTED;
+    }
 
+    esp_err_t ret = nvs_open(key, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, CAMERA_SENSOR_NVS_KEY, &s->status, sizeof(camera_status_t));
     if (ret == ESP_OK) {
-        sensor_t *s = esp_camera_sensor_get();
-        if (s != NULL) {
-            ret = nvs_set_blob(handle, CAMERA_SENSOR_NVS_KEY, &s->status, sizeof(camera_status_t));
-            if (ret == ESP_OK) {
-                uint8_t pf = s->pixformat;
-                ret = nvs_set_u8(handle, CAMERA_PIXFORMAT_NVS_KEY, pf);
-            }
-            return ret;
-        } else {
-            return ESP_ERR_CAMERA_NOT_DETECTED;
+        uint8_t pf = s->pixformat;
+        ret = nvs_set_u8(handle, CAMERA_PIXFORMAT_NVS_KEY, pf);
+    }
+    if (ret == ESP_OK && s->get_ae_state) {
+        camera_ae_state_t ae;
+        if (s->get_ae_state(s, &ae) == 0) {
+            ret = nvs_set_blob(handle, CAMERA_AE_STATE_NVS_KEY, &ae, sizeof(ae));
         }
-        nvs_close(handle);
-        return ret;
-    } else {
-        return ret;
     }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
 }
 
 esp_err_t esp_camera_load_from_nvs(const char *key)
@@ -475,7 +541,11 @@ esp_err_t esp_camera_load_from_nvs(const char *key)
                 s->set_dcw(s, st.dcw);
                 s->set_denoise(s, st.denoise);
                 s->set_exposure_ctrl(s, st.aec);
-                s->set_framesize(s, st.framesize);
+                if (s_state->roi.width) {
+                    s->set_roi(s, &s_state->roi);
+                } else {
+                    s->set_framesize(s, st.framesize);
+                }
                 s->set_gain_ctrl(s, st.agc);
                 s->set_gainceiling(s, st.gainceiling);
                 s->set_hmirror(s, st.hmirror);
@@ -494,6 +564,13 @@ esp_err_t esp_camera_load_from_nvs(const char *key)
             if (ret == ESP_OK) {
                 s->set_pixformat(s, pf);
             }
+            // warm start the automatic exposure, last so nothing above overrides it
+            camera_ae_state_t ae;
+            size = sizeof(ae);
+            if (ret == ESP_OK && s->set_ae_state &&
+                nvs_get_blob(handle, CAMERA_AE_STATE_NVS_KEY, &ae, &size) == ESP_OK && size == sizeof(ae)) {
+                s->set_ae_state(s, &ae);
+            }
         } else {
             return ESP_ERR_CAMERA_NOT_DETECTED;
         }
@@ -520,6 +597,117 @@ bool esp_camera_available_frames(void)
     return cam_get_available_frames();
 }
 
+esp_err_t esp_camera_get_stats(esp_camera_stats_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_get_stats(out);
+    return ESP_OK;
+}
+
+void esp_camera_reset_stats(void)
+{
+    if (s_state == NULL) {
+        return;
+    }
+    cam_reset_stats();
+}
+
+esp_err_t esp_camera_set_fb_size(size_t fb_size, size_t fb_count)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (fb_count == 0) {
+        fb_count = s_saved_config.fb_count;
+    }
+    esp_err_t ret = cam_set_fb_size(&s_saved_config, fb_size, fb_count);
+    if (ret == ESP_OK) {
+        s_saved_config.fb_count = fb_count;
+    }
+    return ret;
+}
+
+esp_err_t esp_camera_fb_adapt(uint8_t percentile, size_t fb_count, size_t *fb_size)
+{
+    if (percentile == 0 || percentile > 100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_camera_stats_t stats;
+    cam_get_stats(&stats);
+    if (stats.jpeg_size_step == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint32_t total = stats.fb_overflows;
+    for (int i = 0; i < ESP_CAMERA_JPEG_SIZE_BUCKETS; i++) {
+        total += stats.jpeg_size[i];
+    }
+    // enough frames that a handful of them lie above the percentile
+    uint32_t min_frames = percentile < 100 ? 400 / (100 - percentile) : 400;
+    if (min_frames < 20) {
+        min_frames = 20;
+    }
+    if (total < min_frames) {
+        ESP_LOGW(TAG, "%u frames are too few for the p%u JPEG size", (unsigned) total, percentile);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t need = ((uint64_t)total * percentile + 99) / 100;
+    uint32_t seen = 0;
+    size_t size = 0;
+    for (int i = 0; i < ESP_CAMERA_JPEG_SIZE_BUCKETS - 1; i++) {
+        seen += stats.jpeg_size[i];
+        if (seen >= need) {
+            size = (size_t)(i + 1) * stats.jpeg_size_step;
+            break;
+        }
+    }
+    if (size == 0) {
+        // the percentile is in the open last bucket or among the overflows,
+        // double when overflows are more than twice the share it leaves out
+        if ((uint64_t)stats.fb_overflows * 100 > (uint64_t)total * (100 - percentile) * 2) {
+            size = stats.fb_size * 2;
+        } else {
+            size = stats.fb_size + stats.fb_size / 4;
+        }
+    }
+    size_t width = s_state->roi.width ? s_state->roi.out_width : resolution[s_state->sensor.status.framesize].width;
+    size_t height = s_state->roi.width ? s_state->roi.out_height : resolution[s_state->sensor.status.framesize].height;
+    if (width * height < s_state->fb_pixels) {
+        // keep room for the largest frame size esp_camera_set_frame_size() accepts
+        size = (uint64_t)size * s_state->fb_pixels / (width * height);
+    }
+    // shrink by at most a quarter per call, a quiet recording must not undo
+    // what the busier ones before it needed
+    size_t floor = s_state->fb_adapt_size - s_state->fb_adapt_size / 4;
+    if (size < floor) {
+        size = floor;
+    }
+    if (size > s_state->fb_pixels / 2) {
+        size = s_state->fb_pixels / 2;
+    }
+    ESP_LOGI(TAG, "p%u of %u JPEG frames (%u overflowed) fits in %u bytes",
+             percentile, (unsigned) total, (unsigned) stats.fb_overflows, (unsigned) size);
+
+    esp_err_t ret = esp_camera_set_fb_size(size, fb_count);
+    if (ret == ESP_OK) {
+        s_state->fb_adapt_size = size;
+        if (fb_size) {
+            cam_get_stats(&stats);
+            *fb_size = stats.fb_size;
+        }
+    }
+    return ret;
+}
+
 esp_err_t esp_camera_reconfigure(const camera_config_t *config)
 {
     if (!config) {
@@ -535,6 +723,39 @@ esp_err_t esp_camera_reconfigure(const camera_config_t *config)
     return esp_camera_init(&s_saved_config);
 }
 
+esp_err_t esp_camera_set_frame_size(framesize_t frame_size)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (frame_size >= FRAMESIZE_INVALID || frame_size > s_state->max_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state->sensor.pixformat != PIXFORMAT_JPEG || s_state->roi.width) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t pixels = (uint32_t)resolution[frame_size].width * resolution[frame_size].height;
+    if (pixels > s_state->fb_pixels) {
+        ESP_LOGE(TAG, "%ux%u exceeds the frame buffers, set frame_size_max", resolution[frame_size].width,
+                 resolution[frame_size].height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (frame_size == s_state->sensor.status.framesize) {
+        return ESP_OK;
+    }
+
+    // queued frames carry the old size, drop them with the frame in progress
+    cam_pause();
+    int ret = s_state->sensor.set_framesize(&s_state->sensor, frame_size);
+    cam_resume();
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to set frame size");
+        return ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
+    }
+    s_saved_config.frame_size = frame_size;
+    return ESP_OK;
+}
+
 esp_err_t esp_camera_set_psram_mode(bool enable)
 {
     cam_set_psram_mode(enable);
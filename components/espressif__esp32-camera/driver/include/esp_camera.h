@@ -67,16 +67,21 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+typedef int ledc_timer_t;           // XCLK is not generated by the simulated backend
+typedef int ledc_channel_t;
+#else
 #include "driver/ledc.h"
+#endif
 #include "sensor.h"
 #include "sys/time.h"
-#include "sdkconfig.h"
 
 /**
  * @brief define for if chip supports camera
  */
 #define ESP_CAMERA_SUPPORTED (CONFIG_IDF_TARGET_ESP32 | CONFIG_IDF_TARGET_ESP32S3 | \
-                             CONFIG_IDF_TARGET_ESP32S2)
+                             CONFIG_IDF_TARGET_ESP32S2 | CONFIG_IDF_TARGET_LINUX)
 
 #ifdef __cplusplus
 extern "C" {
@@ -155,6 +160,8 @@ typedef struct {
 #endif
 
     int sccb_i2c_port;              /*!< If pin_sccb_sda is -1, use the already configured I2C bus by number */
+    camera_roi_t roi;               /*!< Optional sensor window, overrides frame_size when roi.width is not 0. JPEG output must be a multiple of 16x8 */
+    framesize_t frame_size_max;     /*!< Largest size esp_camera_set_frame_size() switches to in JPEG mode, the buffers are sized for it. Ignored when smaller than frame_size */
 } camera_config_t;
 
 /**
@@ -167,8 +174,51 @@ typedef struct {
     size_t height;              /*!< Height of the buffer in pixels */
     pixformat_t format;         /*!< Format of the pixel data */
     struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
+    uint32_t seq;               /*!< Capture sequence number, gaps mean frames were dropped by the driver */
 } camera_fb_t;
 
+/**
+ * @brief Number of buckets in the driver latency histograms
+ *
+ * Bucket 0 counts samples below 512 us, bucket n counts samples below
+ * (512 << n) us and the last bucket collects everything slower.
+ */
+#define ESP_CAMERA_LATENCY_BUCKETS 8
+
+/**
+ * @brief Number of buckets in the JPEG frame size histogram
+ *
+ * Bucket n counts frames of n * jpeg_size_step up to (n + 1) * jpeg_size_step
+ * bytes and the last bucket collects everything larger. Frames that did not
+ * fit the frame buffer are only counted in fb_overflows.
+ */
+#define ESP_CAMERA_JPEG_SIZE_BUCKETS 32
+
+/**
+ * @brief Capture pipeline statistics
+ *
+ * Counters are updated without locks by the capture task, the camera ISRs
+ * and the caller of esp_camera_fb_get(). Each field is read atomically, but
+ * a snapshot taken while frames are flowing is not consistent across fields.
+ */
+typedef struct {
+    uint32_t frames_captured;       /*!< Frames completed by the capture task (one sequence number each) */
+    uint32_t frames_returned;       /*!< Frames handed out by esp_camera_fb_get() */
+    uint32_t frames_dropped_full;   /*!< Frames recycled because the frame buffer queue was full */
+    uint32_t jpeg_no_soi;           /*!< JPEG frames discarded for a missing or misplaced SOI marker */
+    uint32_t jpeg_no_eoi;           /*!< JPEG frames discarded for a missing EOI marker */
+    uint32_t fb_overflows;          /*!< Frames that did not fit into the frame buffer or DMA chain */
+    uint32_t event_overflows;       /*!< ISR events lost because the event queue was full */
+    uint32_t gdma_resets;           /*!< GDMA channel resets issued to recover a stalled capture (ESP32-S3) */
+    uint32_t queue_depth;           /*!< Frames waiting in the frame buffer queue at the time of the query */
+    uint32_t vsync_to_queue[ESP_CAMERA_LATENCY_BUCKETS];  /*!< Histogram of frame start VSYNC to frame queued */
+    uint32_t queue_to_get[ESP_CAMERA_LATENCY_BUCKETS];    /*!< Histogram of frame queued to frame handed out */
+    uint32_t jpeg_size[ESP_CAMERA_JPEG_SIZE_BUCKETS];     /*!< Histogram of JPEG frame sizes handed out */
+    uint32_t jpeg_size_step;        /*!< Bytes per jpeg_size bucket, 0 outside JPEG mode */
+    uint32_t fb_size;               /*!< Current size of each frame buffer */
+    uint32_t fb_count;              /*!< Current number of frame buffers */
+} esp_camera_stats_t;
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -224,6 +274,9 @@ sensor_t * esp_camera_sensor_get(void);
 /**
  * @brief Save camera settings to non-volatile-storage (NVS)
  *
+ * When the sensor can read back its converged exposure and gain, that
+ * state is saved as well.
+ *
  * @param key   A unique nvs key name for the camera settings
  */
 esp_err_t esp_camera_save_to_nvs(const char *key);
@@ -231,6 +284,10 @@ esp_err_t esp_camera_save_to_nvs(const char *key);
 /**
  * @brief Load camera settings from non-volatile-storage (NVS)
  *
+ * A saved exposure and gain state is loaded last to warm start the
+ * automatic loops, so the first frames do not have to converge from the
+ * sensor defaults.
+ *
  * @param key   A unique nvs key name for the camera settings
  */
 esp_err_t esp_camera_load_from_nvs(const char *key);
@@ -245,6 +302,86 @@ void esp_camera_return_all(void);
  */
 bool esp_camera_available_frames(void);
 
+/**
+ * @brief Read the capture pipeline statistics
+ *
+ * Cheap enough to call once per frame; nothing is locked or allocated.
+ *
+ * @param out   Destination for the statistics
+ * @return
+ * - ESP_OK on success
+ * - ESP_ERR_INVALID_ARG if out is NULL
+ * - ESP_ERR_INVALID_STATE if the camera is not initialized
+ */
+esp_err_t esp_camera_get_stats(esp_camera_stats_t *out);
+
+/**
+ * @brief Clear all statistics counters and histograms
+ *
+ * Sequence numbers keep counting so gaps stay detectable across a reset.
+ */
+void esp_camera_reset_stats(void);
+
+/**
+ * @brief Reallocate the JPEG frame buffers without reinitializing the sensor
+ *
+ * Capture pauses while the buffers are replaced and frames waiting in the
+ * queue are discarded. Call it at a safe point: every frame must have been
+ * returned and no other task may call esp_camera_fb_get() meanwhile.
+ *
+ * @param fb_size   Largest JPEG frame that has to fit
+ * @param fb_count  Number of frame buffers, 0 keeps the current number
+ * @return
+ * - ESP_OK on success
+ * - ESP_ERR_INVALID_STATE if the camera is not initialized or a frame is still held
+ * - ESP_ERR_NOT_SUPPORTED outside JPEG mode
+ * - ESP_ERR_NO_MEM if the new buffers do not fit, the previous ones are kept
+ */
+esp_err_t esp_camera_set_fb_size(size_t fb_size, size_t fb_count);
+
+/**
+ * @brief Resize the JPEG frame buffers to the observed frame sizes
+ *
+ * Picks the smallest size that covers the given percentile of the frames in
+ * the jpeg_size histogram since the last esp_camera_reset_stats(). When more
+ * frames than that overflowed, the buffers grow by a quarter instead, or
+ * double when over twice that many overflowed. They shrink by at most a
+ * quarter of the previously applied size per call, so one recording of
+ * small frames does not undo what earlier ones needed. The size is scaled up
+ * when the buffers were allocated for a larger frame_size_max. Memory freed
+ * this way can go to more frame buffers or back to the application.
+ *
+ * @param percentile  Share of frames that must fit, 1 - 100
+ * @param fb_count    Number of frame buffers, 0 keeps the current number
+ * @param fb_size     Optional, receives the new frame buffer size
+ * @return
+ * - ESP_OK on success
+ * - ESP_ERR_INVALID_ARG if percentile is out of range
+ * - ESP_ERR_NOT_FOUND if too few frames were seen for the percentile
+ * - Propagated error from esp_camera_set_fb_size()
+ */
+esp_err_t esp_camera_fb_adapt(uint8_t percentile, size_t fb_count, size_t *fb_size);
+
+/**
+ * @brief Change the JPEG frame size without reinitializing the camera
+ *
+ * Capture pauses while the sensor is switched and frames waiting in the
+ * queue are discarded, frames held by the application stay valid. Only the
+ * sensor registers that differ between the two sizes are written and the
+ * frame buffers are kept, so the new size must not exceed the one they were
+ * allocated for, see camera_config_t::frame_size_max.
+ *
+ * @param frame_size  New output size
+ * @return
+ * - ESP_OK on success
+ * - ESP_ERR_INVALID_STATE if the camera is not initialized
+ * - ESP_ERR_INVALID_ARG if the sensor does not support frame_size
+ * - ESP_ERR_NOT_SUPPORTED outside JPEG mode or with a region of interest
+ * - ESP_ERR_INVALID_SIZE if the frame buffers were sized for smaller frames
+ * - ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE if the sensor rejected the size
+ */
+esp_err_t esp_camera_set_frame_size(framesize_t frame_size);
+
 /**
  * @brief Enable or disable PSRAM DMA mode at runtime.
  *
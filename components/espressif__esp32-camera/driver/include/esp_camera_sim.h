@@ -0,0 +1,141 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*
+ * Host simulation backend, only available when building for IDF_TARGET=linux.
+ *
+ * The simulated backend replaces the LCD_CAM/I2S peripheral and its DMA with
+ * a task that replays recorded frames through the regular cam_hal state
+ * machine, producing VSYNC and EOF events with the configured timing. The
+ * SCCB bus is replaced by an emulated OV2640, so esp_camera_init(),
+ * esp_camera_fb_get() and esp_camera_fb_return() behave exactly as on target.
+ *
+ * Example:
+ *
+ *     esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+ *     sim.source = "test/pictures";
+ *     sim.truncate_pct = 5;
+ *     esp_camera_sim_set_config(&sim);
+ *     esp_camera_init(&camera_config);
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Simulation parameters
+ */
+typedef struct {
+    const char *source;         /*!< Directory of .jpg/.jpeg files, an .mjp/.mjpeg stream or a raw .yuv/.rgb sequence */
+    uint32_t fps;               /*!< Nominal frame rate */
+    uint32_t jitter_us;         /*!< Maximum random deviation of each frame period */
+    uint32_t vsync_us;          /*!< Vertical blanking between VSYNC and the first pixel data */
+    uint32_t byte_rate;         /*!< Pixel bus throughput in bytes per second, 0 = XCLK / 2 */
+    uint8_t corrupt_pct;        /*!< Percentage of frames with flipped bytes in the entropy data */
+    uint8_t truncate_pct;       /*!< Percentage of frames cut before the EOI marker */
+    uint8_t garbage_pct;        /*!< Percentage of frames preceded by garbage instead of SOI */
+    uint32_t seed;              /*!< Seed of the fault injection PRNG, runs are reproducible */
+    bool loop;                  /*!< Restart from the first frame when the source is exhausted */
+} esp_camera_sim_config_t;
+
+#define ESP_CAMERA_SIM_CONFIG_DEFAULT() { \
+    .source = NULL,                       \
+    .fps = 25,                            \
+    .jitter_us = 0,                       \
+    .vsync_us = 500,                      \
+    .byte_rate = 0,                       \
+    .corrupt_pct = 0,                     \
+    .truncate_pct = 0,                    \
+    .garbage_pct = 0,                     \
+    .seed = 1,                            \
+    .loop = true,                         \
+}
+
+/**
+ * @brief Set the simulation parameters used by the next esp_camera_init()
+ *
+ * The configuration is copied, but the source path string must stay valid
+ * until the camera is initialized.
+ *
+ * @param config  Simulation parameters
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_ERR_INVALID_ARG if config is NULL or fps is 0
+ */
+esp_err_t esp_camera_sim_set_config(const esp_camera_sim_config_t *config);
+
+/**
+ * @brief Number of frames the simulated sensor has emitted since init
+ *
+ * Compare with esp_camera_get_stats() to see how many frames were lost
+ * between the sensor and the application.
+ */
+uint32_t esp_camera_sim_frames_emitted(void);
+
+/**
+ * @brief Transactions seen by the emulated SCCB bus
+ */
+typedef struct {
+    uint32_t reads;             /*!< Register read transactions */
+    uint32_t writes;            /*!< Write transactions, a burst counts once */
+    uint32_t bytes_written;     /*!< Register values written */
+} esp_camera_sim_sccb_stats_t;
+
+/**
+ * @brief Get the emulated SCCB bus counters
+ *
+ * @param out  Destination for the counters
+ */
+void esp_camera_sim_get_sccb_stats(esp_camera_sim_sccb_stats_t *out);
+
+/**
+ * @brief Zero the emulated SCCB bus counters
+ */
+void esp_camera_sim_reset_sccb_stats(void);
+
+/**
+ * @brief Make the next register reads fail as if the sensor did not answer
+ *
+ * @param count  Number of read transactions that fail, 0 to stop
+ */
+void esp_camera_sim_fail_sccb_reads(uint32_t count);
+
+/**
+ * @brief Read a register of the emulated OV2640 without a bus transaction
+ *
+ * @param bank  0 for the DSP bank, 1 for the sensor bank
+ * @param reg   Register address
+ */
+uint8_t esp_camera_sim_peek_reg(uint8_t bank, uint8_t reg);
+
+/**
+ * @brief Change a register of the emulated OV2640 behind the driver's back,
+ *        like the sensor does for its AEC/AGC results
+ *
+ * @param bank   0 for the DSP bank, 1 for the sensor bank
+ * @param reg    Register address
+ * @param value  New register value
+ */
+void esp_camera_sim_poke_reg(uint8_t bank, uint8_t reg, uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -215,6 +215,22 @@ typedef struct {
     uint8_t colorbar;
 } camera_status_t;
 
+// Region of interest, replaces the frame size when width is not 0
+typedef struct {
+    uint16_t x;                 // left edge in full sensor resolution pixels
+    uint16_t y;                 // top edge in full sensor resolution pixels
+    uint16_t width;             // window width in full sensor resolution pixels
+    uint16_t height;            // window height in full sensor resolution pixels
+    uint16_t out_width;         // output width, 0 keeps the native window width
+    uint16_t out_height;        // output height, 0 keeps the native window height
+} camera_roi_t;
+
+// Converged automatic exposure and gain state, read back from the sensor
+typedef struct {
+    uint16_t aec_value;         // exposure in sensor specific units
+    uint8_t agc_gain;           // raw analog gain register
+} camera_ae_state_t;
+
 typedef struct _sensor sensor_t;
 typedef struct _sensor {
     sensor_id_t id;             // Sensor ID.
@@ -263,6 +279,12 @@ typedef struct _sensor {
     int  (*set_res_raw)         (sensor_t *sensor, int startX, int startY, int endX, int endY, int offsetX, int offsetY, int totalX, int totalY, int outputX, int outputY, bool scale, bool binning);
     int  (*set_pll)             (sensor_t *sensor, int bypass, int mul, int sys, int root, int pre, int seld5, int pclken, int pclk);
     int  (*set_xclk)            (sensor_t *sensor, int timer, int xclk);
+
+    // Optional, NULL when the sensor can not read back its AEC/AGC state
+    int  (*get_ae_state)        (sensor_t *sensor, camera_ae_state_t *state);
+    int  (*set_ae_state)        (sensor_t *sensor, const camera_ae_state_t *state);
+    // Optional, NULL when the sensor can not window and scale its output
+    int  (*set_roi)             (sensor_t *sensor, const camera_roi_t *roi);
 } sensor_t;
 
 camera_sensor_info_t *esp_camera_sensor_get_info(sensor_id_t *id);
@@ -45,12 +45,34 @@ esp_err_t cam_deinit(void);
  */
 esp_err_t cam_init(const camera_config_t *config);
 
-esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid);
+/**
+ * @brief Size the frame buffers and start the capture task
+ *
+ * @param config     Configurations - see camera_config_t struct
+ * @param width      Width of the frames delivered by the sensor
+ * @param height     Height of the frames delivered by the sensor
+ * @param sensor_pid Sensor product ID
+ */
+esp_err_t cam_config(const camera_config_t *config, uint16_t width, uint16_t height, uint16_t sensor_pid);
 
 void cam_stop(void);
 
 void cam_start(void);
 
+/**
+ * @brief Stop capturing and end the capture task
+ *
+ * The capture task handles the events still queued and ends itself. Frames
+ * waiting in the queue are released, the frame in progress is dropped.
+ * Frames held by the application are not touched.
+ */
+void cam_pause(void);
+
+/**
+ * @brief Restart the capture task and capturing after cam_pause()
+ */
+void cam_resume(void);
+
 camera_fb_t *cam_take(TickType_t timeout);
 
 void cam_give(camera_fb_t *dma_buffer);
@@ -59,6 +81,24 @@ void cam_give_all(void);
 
 bool cam_get_available_frames(void);
 
+void cam_get_stats(esp_camera_stats_t *out);
+
+void cam_reset_stats(void);
+
+/**
+ * @brief Reallocate the JPEG frame buffers
+ *
+ * Capture is stopped while the buffers are replaced. The new buffers are
+ * allocated before the old ones are freed, so both sets have to fit for a
+ * moment. On allocation failure the previous buffers stay in use and
+ * ESP_ERR_NO_MEM is returned.
+ *
+ * @param config   Configuration the camera was initialized with
+ * @param fb_size  Largest JPEG frame that has to fit
+ * @param fb_count Number of frame buffers
+ */
+esp_err_t cam_set_fb_size(const camera_config_t *config, size_t fb_size, size_t fb_count);
+
 void cam_set_psram_mode(bool enable);
 bool cam_get_psram_mode(void);
 
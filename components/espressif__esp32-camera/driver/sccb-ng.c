@@ -221,6 +221,13 @@ int SCCB_Probe(uint8_t slv_addr)
 }
 
 uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
+{
+    uint8_t data = 0;
+    SCCB_Read_Checked(slv_addr, reg, &data);
+    return data;
+}
+
+int SCCB_Read_Checked(uint8_t slv_addr, uint8_t reg, uint8_t *value)
 {
     i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
 
@@ -236,7 +243,8 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
         ESP_LOGE(TAG, "SCCB_Read Failed addr:0x%02x, reg:0x%02x, data:0x%02x, ret:%d", slv_addr, reg, rx_buffer[0], ret);
     }
 
-    return rx_buffer[0];
+    *value = rx_buffer[0];
+    return ret == ESP_OK ? 0 : -1;
 }
 
 int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
@@ -257,6 +265,28 @@ int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+int SCCB_Write_Burst(uint8_t slv_addr, uint8_t reg, const uint8_t *data, size_t len)
+{
+    i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
+
+    uint8_t tx_buffer[1 + 32];
+    if (len > sizeof(tx_buffer) - 1)
+    {
+        return -1;
+    }
+    tx_buffer[0] = reg;
+    memcpy(&tx_buffer[1], data, len);
+
+    esp_err_t ret = i2c_master_transmit(dev_handle, tx_buffer, len + 1, TIMEOUT_MS);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SCCB_Write_Burst Failed addr:0x%02x, reg:0x%02x, len:%u, ret:%d", slv_addr, reg, (unsigned) len, ret);
+    }
+
+    return ret == ESP_OK ? 0 : -1;
+}
+
 uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 {
     i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
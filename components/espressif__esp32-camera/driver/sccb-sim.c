@@ -0,0 +1,190 @@
+/*
+ * SCCB driver for the host (linux target) simulation backend.
+ *
+ * There is no bus on the host, so this file emulates an OV2640 register
+ * file at its usual address. All the sensor code runs unchanged against it,
+ * the only difference being that register writes have no side effects apart
+ * from the bank select register (0xFF) which switches between the DSP and
+ * sensor register pages, exactly like the real part.
+ *
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include "sccb.h"
+#include "sensor.h"
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_camera_sim.h"
+
+static const char *TAG = "sccb-sim";
+
+#define SIM_BANK_SEL    0xFF
+#define SIM_BANK_DSP    0
+#define SIM_BANK_SENSOR 1
+
+#define SIM_REG_COM7    0x12
+#define SIM_COM7_SRST   0x80
+
+static uint8_t sim_regs[2][256];
+static uint8_t sim_bank = SIM_BANK_DSP;
+static bool sim_ready = false;
+static esp_camera_sim_sccb_stats_t sim_stats;
+static uint32_t sim_failing_reads;
+
+static void sim_reset_regs(void)
+{
+    memset(sim_regs, 0, sizeof(sim_regs));
+    sim_regs[SIM_BANK_SENSOR][0x0A] = OV2640_PID; // PIDH
+    sim_regs[SIM_BANK_SENSOR][0x0B] = 0x42;       // VER
+    sim_regs[SIM_BANK_SENSOR][0x1C] = 0x7F;       // MIDH
+    sim_regs[SIM_BANK_SENSOR][0x1D] = 0xA2;       // MIDL
+    sim_bank = SIM_BANK_DSP;
+    sim_ready = true;
+}
+
+static void sim_write_reg(uint8_t reg, uint8_t data)
+{
+    if (reg == SIM_BANK_SEL) {
+        sim_bank = data & 0x01;
+    } else if (sim_bank == SIM_BANK_SENSOR && reg == SIM_REG_COM7 && (data & SIM_COM7_SRST)) {
+        // soft reset restores the defaults, the reset bit clears itself
+        sim_reset_regs();
+    } else {
+        sim_regs[sim_bank][reg] = data;
+    }
+}
+
+void esp_camera_sim_get_sccb_stats(esp_camera_sim_sccb_stats_t *out)
+{
+    *out = sim_stats;
+}
+
+void esp_camera_sim_reset_sccb_stats(void)
+{
+    memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+void esp_camera_sim_fail_sccb_reads(uint32_t count)
+{
+    sim_failing_reads = count;
+}
+
+uint8_t esp_camera_sim_peek_reg(uint8_t bank, uint8_t reg)
+{
+    return sim_regs[bank & 0x01][reg];
+}
+
+void esp_camera_sim_poke_reg(uint8_t bank, uint8_t reg, uint8_t value)
+{
+    sim_regs[bank & 0x01][reg] = value;
+}
+
+int SCCB_Init(int pin_sda, int pin_scl)
+{
+    ESP_LOGI(TAG, "simulated OV2640 at 0x%02x (pins %d/%d ignored)", OV2640_SCCB_ADDR, pin_sda, pin_scl);
+    sim_reset_regs();
+    return ESP_OK;
+}
+
+int SCCB_Use_Port(int i2c_num)
+{
+    (void)i2c_num;
+    sim_reset_regs();
+    return ESP_OK;
+}
+
+int SCCB_Deinit(void)
+{
+    sim_ready = false;
+    return ESP_OK;
+}
+
+int SCCB_Probe(uint8_t slv_addr)
+{
+    if (!sim_ready || slv_addr != OV2640_SCCB_ADDR) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
+{
+    uint8_t data = 0;
+    SCCB_Read_Checked(slv_addr, reg, &data);
+    return data;
+}
+
+int SCCB_Read_Checked(uint8_t slv_addr, uint8_t reg, uint8_t *value)
+{
+    if (SCCB_Probe(slv_addr) != ESP_OK) {
+        *value = 0;
+        return -1;
+    }
+    sim_stats.reads++;
+    if (sim_failing_reads > 0) {
+        // a read the sensor does not answer leaves the bus high
+        sim_failing_reads--;
+        *value = 0xFF;
+        return -1;
+    }
+    *value = reg == SIM_BANK_SEL ? sim_bank : sim_regs[sim_bank][reg];
+    return 0;
+}
+
+int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
+{
+    if (SCCB_Probe(slv_addr) != ESP_OK) {
+        return -1;
+    }
+    sim_stats.writes++;
+    sim_stats.bytes_written++;
+    sim_write_reg(reg, data);
+    return 0;
+}
+
+int SCCB_Write_Burst(uint8_t slv_addr, uint8_t reg, const uint8_t *data, size_t len)
+{
+    if (SCCB_Probe(slv_addr) != ESP_OK) {
+        return -1;
+    }
+    sim_stats.writes++;
+    sim_stats.bytes_written += len;
+    // the register address auto-increments after every data byte
+    for (size_t i = 0; i < len; i++) {
+        sim_write_reg(reg + i, data[i]);
+    }
+    return 0;
+}
+
+// The emulated sensor uses 8-bit register addresses only
+uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
+{
+    (void)slv_addr;
+    (void)reg;
+    return 0;
+}
+
+int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
+{
+    (void)slv_addr;
+    (void)reg;
+    (void)data;
+    return -1;
+}
+
+uint16_t SCCB_Read_Addr16_Val16(uint8_t slv_addr, uint16_t reg)
+{
+    (void)slv_addr;
+    (void)reg;
+    return 0;
+}
+
+int SCCB_Write_Addr16_Val16(uint8_t slv_addr, uint16_t reg, uint16_t data)
+{
+    (void)slv_addr;
+    (void)reg;
+    (void)data;
+    return -1;
+}
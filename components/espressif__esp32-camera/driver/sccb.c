@@ -107,6 +107,13 @@ int SCCB_Probe(uint8_t slv_addr)
 }
 
 uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
+{
+    uint8_t data = 0;
+    SCCB_Read_Checked(slv_addr, reg, &data);
+    return data;
+}
+
+int SCCB_Read_Checked(uint8_t slv_addr, uint8_t reg, uint8_t *value)
 {
     uint8_t data=0;
     esp_err_t ret = ESP_FAIL;
@@ -118,7 +125,8 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
     ret = i2c_master_cmd_begin(sccb_i2c_port, cmd, 1000 / portTICK_RATE_MS);
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
-        return (uint8_t)-1;
+        *value = (uint8_t)-1;
+        return -1;
     }
     cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
@@ -130,7 +138,8 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "SCCB_Read Failed addr:0x%02x, reg:0x%02x, data:0x%02x, ret:%d", slv_addr, reg, data, ret);
     }
-    return data;
+    *value = data;
+    return ret == ESP_OK ? 0 : -1;
 }
 
 int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
@@ -150,6 +159,23 @@ int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+int SCCB_Write_Burst(uint8_t slv_addr, uint8_t reg, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_FAIL;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);
+    i2c_master_write(cmd, data, len, ACK_CHECK_EN);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(sccb_i2c_port, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "SCCB_Write_Burst Failed addr:0x%02x, reg:0x%02x, len:%u, ret:%d", slv_addr, reg, (unsigned) len, ret);
+    }
+    return ret == ESP_OK ? 0 : -1;
+}
+
 uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 {
     uint8_t data=0;
@@ -0,0 +1,117 @@
+/**
+ * This example runs the camera driver on the host (idf.py --preview set-target linux).
+ *
+ * Frames are replayed from the test pictures, or from the directory / MJPEG
+ * file named by the CAMERA_SIM_SOURCE environment variable, through the
+ * regular cam_hal state machine. The frames are checked for SOI/EOI the same
+ * way the recorder does it, appended to CAMERA_SIM_OUT and the driver
+ * statistics are printed at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+static const char *TAG = "example:camera_sim";
+
+#define SIM_FRAMES_TO_RECORD 250
+
+static camera_config_t camera_config = {
+    .pin_pwdn = -1,
+    .pin_reset = -1,
+    .pin_xclk = -1,
+    .pin_sccb_sda = 0,
+    .pin_sccb_scl = 0,
+
+    .xclk_freq_hz = 20000000,
+
+    .pixel_format = PIXFORMAT_JPEG,
+    .frame_size = FRAMESIZE_SVGA,
+
+    .jpeg_quality = 12,
+    .fb_count = 2,
+    .fb_location = CAMERA_FB_IN_DRAM,
+    .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+};
+
+static const char *env_or(const char *name, const char *def)
+{
+    const char *v = getenv(name);
+    return v ? v : def;
+}
+
+static bool frame_is_complete(const camera_fb_t *fb)
+{
+    return fb->len > 4 && fb->buf[0] == 0xFF && fb->buf[1] == 0xD8 &&
+           fb->buf[fb->len - 2] == 0xFF && fb->buf[fb->len - 1] == 0xD9;
+}
+
+void app_main(void)
+{
+    nvs_flash_init();
+
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = env_or("CAMERA_SIM_SOURCE", "../../test/pictures");
+    sim.fps = 25;
+    sim.jitter_us = 2000;
+    sim.corrupt_pct = 2;
+    sim.truncate_pct = 2;
+    sim.garbage_pct = 2;
+    ESP_ERROR_CHECK(esp_camera_sim_set_config(&sim));
+
+    esp_err_t err = esp_camera_init(&camera_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Camera Init Failed");
+        exit(1);
+    }
+
+    const char *out_path = env_or("CAMERA_SIM_OUT", "camera_sim.mjp");
+    FILE *out = fopen(out_path, "wb");
+    if (out == NULL) {
+        ESP_LOGE(TAG, "Can not open %s", out_path);
+        exit(1);
+    }
+
+    uint32_t written = 0, rejected = 0;
+    size_t bytes = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < SIM_FRAMES_TO_RECORD; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            continue;
+        }
+        if (frame_is_complete(fb)) {
+            fwrite(fb->buf, 1, fb->len, out);
+            bytes += fb->len;
+            written++;
+        } else {
+            rejected++;
+        }
+        esp_camera_fb_return(fb);
+    }
+    int64_t elapsed = esp_timer_get_time() - t0;
+    fclose(out);
+
+    ESP_LOGI(TAG, "%u frames (%u rejected) in %lld ms, %.1f fps, %.1f KB/s -> %s",
+             (unsigned) written, (unsigned) rejected, (long long) elapsed / 1000,
+             written * 1e6 / elapsed, bytes * 1e3 / 1024 / elapsed, out_path);
+
+    esp_camera_stats_t stats;
+    if (esp_camera_get_stats(&stats) == ESP_OK) {
+        ESP_LOGI(TAG, "sensor %u, captured %u, returned %u, dropped %u, no-soi %u, no-eoi %u, fb-ovf %u",
+                 (unsigned) esp_camera_sim_frames_emitted(), (unsigned) stats.frames_captured,
+                 (unsigned) stats.frames_returned, (unsigned) stats.frames_dropped_full,
+                 (unsigned) stats.jpeg_no_soi, (unsigned) stats.jpeg_no_eoi, (unsigned) stats.fb_overflows);
+    }
+
+    esp_camera_deinit();
+    exit(0);
+}
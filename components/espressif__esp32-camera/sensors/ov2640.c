@@ -16,6 +16,7 @@
 #include "ov2640_settings.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -25,16 +26,158 @@ static const char* TAG = "ov2640";
 #endif
 
 static volatile ov2640_bank_t reg_bank = BANK_MAX;
+
+/*
+ * Shadow copy of both register banks. Reads are served locally once a
+ * register is known and writes that would not change it are dropped, which
+ * removes most of the SCCB traffic of mode switches and read-modify-write
+ * updates. Registers the sensor changes on its own (AEC/AGC results, self
+ * clearing reset) and the indirect address/data ports are never cached.
+ */
+#if CONFIG_OV2640_REG_CACHE
+typedef struct {
+    uint8_t val[256];
+    uint32_t valid[256 / 32];
+} ov2640_shadow_t;
+
+static ov2640_shadow_t reg_shadow[BANK_MAX];
+#endif
+
+#if CONFIG_OV2640_SCCB_BURST
+#define OV2640_BURST_MAX 16
+#endif
+
+static struct {
+    uint32_t bus_writes;
+    uint32_t skipped_writes;
+    uint32_t bus_reads;
+    uint32_t cached_reads;
+} reg_stats;
+
+#if CONFIG_OV2640_REG_CACHE
+static bool reg_cacheable(uint8_t bank, uint8_t reg)
+{
+    if (bank == BANK_SENSOR) {
+        switch (reg) {
+        case GAIN:                          // AGC gain
+        case REG04: case AEC: case REG45:   // AEC exposure bits
+        case COM7:                          // SRST clears itself
+        case YAVG:
+            return false;
+        }
+    } else {
+        switch (reg) {
+        case BPADDR: case BPDATA:           // SDE indirect registers
+        case 0x92: case 0x93:               // gamma indirect registers
+        case 0x96: case 0x97:               // AWB indirect registers
+        case RESET:
+        case MC_BIST: case MC_AL: case MC_AH: case MC_D: case P_CMD: case P_STATUS:
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static void shadow_invalidate(void)
+{
+    reg_bank = BANK_MAX;
+#if CONFIG_OV2640_REG_CACHE
+    memset(reg_shadow, 0, sizeof(reg_shadow));
+#endif
+}
+
+static bool shadow_get(uint8_t bank, uint8_t reg, uint8_t *value)
+{
+#if CONFIG_OV2640_REG_CACHE
+    if (bank < BANK_MAX && (reg_shadow[bank].valid[reg >> 5] & (1UL << (reg & 31)))) {
+        *value = reg_shadow[bank].val[reg];
+        return true;
+    }
+#endif
+    return false;
+}
+
+static void shadow_set(uint8_t bank, uint8_t reg, uint8_t value)
+{
+#if CONFIG_OV2640_REG_CACHE
+    if (bank < BANK_MAX && reg_cacheable(bank, reg)) {
+        reg_shadow[bank].val[reg] = value;
+        reg_shadow[bank].valid[reg >> 5] |= 1UL << (reg & 31);
+    }
+#endif
+}
+
 static int set_bank(sensor_t *sensor, ov2640_bank_t bank)
 {
     int res = 0;
     if (bank != reg_bank) {
         reg_bank = bank;
         res = SCCB_Write(sensor->slv_addr, BANK_SEL, bank);
+        reg_stats.bus_writes++;
+        if (res) {
+            reg_bank = BANK_MAX;
+        }
     }
     return res;
 }
 
+/* Write to the currently selected bank, skipping writes the shadow proves redundant */
+static int bank_write(sensor_t *sensor, uint8_t reg, uint8_t value)
+{
+    uint8_t cur;
+    if (shadow_get(reg_bank, reg, &cur) && cur == value) {
+        reg_stats.skipped_writes++;
+        return 0;
+    }
+    int ret = SCCB_Write(sensor->slv_addr, reg, value);
+    reg_stats.bus_writes++;
+    if (ret) {
+        // the register state is unknown now
+        shadow_invalidate();
+    } else {
+        shadow_set(reg_bank, reg, value);
+    }
+    return ret;
+}
+
+/* Read from the currently selected bank; only a successful bus read is cached */
+static int bank_read(sensor_t *sensor, uint8_t reg, uint8_t *value)
+{
+    if (shadow_get(reg_bank, reg, value)) {
+        reg_stats.cached_reads++;
+        return 0;
+    }
+    int ret = SCCB_Read_Checked(sensor->slv_addr, reg, value);
+    reg_stats.bus_reads++;
+    if (ret) {
+        // the bank select may have been lost along with the value
+        shadow_invalidate();
+    } else {
+        shadow_set(reg_bank, reg, *value);
+    }
+    return ret;
+}
+
+#if CONFIG_OV2640_SCCB_BURST
+/*
+ * Length of the run of table entries starting at regs[0] that target
+ * consecutive registers and all need to go out, so they can be sent as one
+ * auto-incrementing transaction.
+ */
+static int burst_run(const uint8_t (*regs)[2])
+{
+    int n = 0;
+    uint8_t cur;
+    while (n < OV2640_BURST_MAX && regs[n][0] && regs[n][0] != BANK_SEL
+           && (n == 0 || regs[n][0] == regs[n - 1][0] + 1)
+           && !(shadow_get(reg_bank, regs[n][0], &cur) && cur == regs[n][1])) {
+        n++;
+    }
+    return n;
+}
+#endif
+
 static int write_regs(sensor_t *sensor, const uint8_t (*regs)[2])
 {
     int i=0, res = 0;
@@ -42,7 +185,27 @@ static int write_regs(sensor_t *sensor, const uint8_t (*regs)[2])
         if (regs[i][0] == BANK_SEL) {
             res = set_bank(sensor, regs[i][1]);
         } else {
-            res = SCCB_Write(sensor->slv_addr, regs[i][0], regs[i][1]);
+#if CONFIG_OV2640_SCCB_BURST
+            int n = burst_run(&regs[i]);
+            if (n > 1) {
+                uint8_t data[OV2640_BURST_MAX];
+                for (int j = 0; j < n; j++) {
+                    data[j] = regs[i + j][1];
+                }
+                res = SCCB_Write_Burst(sensor->slv_addr, regs[i][0], data, n);
+                reg_stats.bus_writes++;
+                if (res) {
+                    shadow_invalidate();
+                    return res;
+                }
+                for (int j = 0; j < n; j++) {
+                    shadow_set(reg_bank, regs[i + j][0], data[j]);
+                }
+                i += n;
+                continue;
+            }
+#endif
+            res = bank_write(sensor, regs[i][0], regs[i][1]);
         }
         if (res) {
             return res;
@@ -56,7 +219,7 @@ static int write_reg(sensor_t *sensor, ov2640_bank_t bank, uint8_t reg, uint8_t
 {
     int ret = set_bank(sensor, bank);
     if(!ret) {
-        ret = SCCB_Write(sensor->slv_addr, reg, value);
+        ret = bank_write(sensor, reg, value);
     }
     return ret;
 }
@@ -70,18 +233,25 @@ static int set_reg_bits(sensor_t *sensor, uint8_t bank, uint8_t reg, uint8_t off
     if(ret) {
         return ret;
     }
-    c_value = SCCB_Read(sensor->slv_addr, reg);
+    ret = bank_read(sensor, reg, &c_value);
+    if(ret) {
+        return ret;
+    }
     new_value = (c_value & ~(mask << offset)) | ((value & mask) << offset);
-    ret = SCCB_Write(sensor->slv_addr, reg, new_value);
+    ret = bank_write(sensor, reg, new_value);
     return ret;
 }
 
 static int read_reg(sensor_t *sensor, ov2640_bank_t bank, uint8_t reg)
 {
+    uint8_t value;
     if(set_bank(sensor, bank)){
         return 0;
     }
-    return SCCB_Read(sensor->slv_addr, reg);
+    if(bank_read(sensor, reg, &value)){
+        return -1;
+    }
+    return value;
 }
 
 static uint8_t get_reg_bits(sensor_t *sensor, uint8_t bank, uint8_t reg, uint8_t offset, uint8_t mask)
@@ -98,12 +268,26 @@ static int write_reg_bits(sensor_t *sensor, uint8_t bank, uint8_t reg, uint8_t m
 #define WRITE_REG_OR_RETURN(bank, reg, val) ret = write_reg(sensor, bank, reg, val); if(ret){return ret;}
 #define SET_REG_BITS_OR_RETURN(bank, reg, offset, mask, val) ret = set_reg_bits(sensor, bank, reg, offset, mask, val); if(ret){return ret;}
 
+static void log_reg_stats(const char *what, int64_t start_us)
+{
+    ESP_LOGI(TAG, "%s: %u ms, %u bus writes, %u skipped, %u bus reads, %u cached",
+             what, (unsigned)((esp_timer_get_time() - start_us) / 1000),
+             (unsigned) reg_stats.bus_writes, (unsigned) reg_stats.skipped_writes,
+             (unsigned) reg_stats.bus_reads, (unsigned) reg_stats.cached_reads);
+    memset(&reg_stats, 0, sizeof(reg_stats));
+}
+
 static int reset(sensor_t *sensor)
 {
     int ret = 0;
+    int64_t start_us = esp_timer_get_time();
+    memset(&reg_stats, 0, sizeof(reg_stats));
     WRITE_REG_OR_RETURN(BANK_SENSOR, COM7, COM7_SRST);
+    // every register, the bank select included, is back to its default
+    shadow_invalidate();
     vTaskDelay(10 / portTICK_PERIOD_MS);
     WRITE_REGS_OR_RETURN(ov2640_settings_cif);
+    log_reg_stats("reset", start_us);
     return ret;
 }
 
@@ -139,6 +323,8 @@ static int set_window(sensor_t *sensor, ov2640_sensor_mode_t mode, int offset_x,
     const uint8_t (*regs)[2];
     ov2640_clk_t c;
     c.reserved = 0;
+    int64_t start_us = esp_timer_get_time();
+    memset(&reg_stats, 0, sizeof(reg_stats));
 
     max_x /= 4;
     max_y /= 4;
@@ -204,6 +390,7 @@ static int set_window(sensor_t *sensor, ov2640_sensor_mode_t mode, int offset_x,
     vTaskDelay(10 / portTICK_PERIOD_MS);
     //required when changing resolution
     set_pixformat(sensor, sensor->pixformat);
+    log_reg_stats("set_window", start_us);
 
     return ret;
 }
@@ -245,6 +432,43 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     return ret;
 }
 
+/*
+ * Crop a region of interest given in UXGA pixels and scale it to the output
+ * size. The sensor runs in the smallest mode (CIF and SVGA subsample the
+ * whole field by 4 and 2) that still has enough pixels for the output, so a
+ * downscaled ROI also gets the faster frame timing of that mode.
+ */
+static int set_roi(sensor_t *sensor, const camera_roi_t *roi)
+{
+    uint16_t out_w = roi->out_width ? roi->out_width : roi->width;
+    uint16_t out_h = roi->out_height ? roi->out_height : roi->height;
+    if (!roi->width || !roi->height || (out_w % 4) || (out_h % 4)
+        || roi->x + roi->width > 1600 || roi->y + roi->height > 1200) {
+        ESP_LOGE(TAG, "Invalid ROI %ux%u+%u+%u -> %ux%u", roi->width, roi->height, roi->x, roi->y, out_w, out_h);
+        return -1;
+    }
+
+    ov2640_sensor_mode_t mode = OV2640_MODE_UXGA;
+    int div = 1;
+    if (out_w * 4 <= roi->width && out_h * 4 <= roi->height && (roi->y + roi->height) / 4 <= 296) {
+        mode = OV2640_MODE_CIF;
+        div = 4;
+    } else if (out_w * 2 <= roi->width && out_h * 2 <= roi->height) {
+        mode = OV2640_MODE_SVGA;
+        div = 2;
+    }
+    // the window is programmed in units of 4 pixels of the selected mode
+    int max_x = (roi->width / div) & ~3;
+    int max_y = (roi->height / div) & ~3;
+    if (out_w > max_x || out_h > max_y) {
+        ESP_LOGE(TAG, "ROI output %ux%u is larger than the %dx%d window", out_w, out_h, max_x, max_y);
+        return -1;
+    }
+    ESP_LOGI(TAG, "ROI %ux%u+%u+%u -> %ux%u in %s mode", roi->width, roi->height, roi->x, roi->y, out_w, out_h,
+             mode == OV2640_MODE_CIF ? "CIF" : (mode == OV2640_MODE_SVGA ? "SVGA" : "UXGA"));
+    return set_window(sensor, mode, roi->x / div, roi->y / div, max_x, max_y, out_w, out_h);
+}
+
 static int set_contrast(sensor_t *sensor, int level)
 {
     int ret=0;
@@ -373,6 +597,43 @@ static int set_aec_value(sensor_t *sensor, int value)
            || set_reg_bits(sensor, BANK_SENSOR, REG45, 0, 0x3F, value >> 10);
 }
 
+static int get_ae_state(sensor_t *sensor, camera_ae_state_t *state)
+{
+    int reg45 = read_reg(sensor, BANK_SENSOR, REG45);
+    int aec = read_reg(sensor, BANK_SENSOR, AEC);
+    int reg04 = read_reg(sensor, BANK_SENSOR, REG04);
+    int gain = read_reg(sensor, BANK_SENSOR, GAIN);
+    if (reg45 < 0 || aec < 0 || reg04 < 0 || gain < 0) {
+        return -1;
+    }
+    state->aec_value = ((uint16_t)(reg45 & 0x3F) << 10) | ((uint16_t)aec << 2) | (reg04 & 3);
+    state->agc_gain = gain;
+    return 0;
+}
+
+/*
+ * Warm start: the automatic loops continue from whatever the exposure and
+ * gain registers hold, so load them with AEC/AGC paused and hand control
+ * back. The first frame is then already close to converged.
+ */
+static int set_ae_state(sensor_t *sensor, const camera_ae_state_t *state)
+{
+    int ret = 0;
+    uint8_t auto_mask = (sensor->status.aec ? COM8_AEC_EN : 0) | (sensor->status.agc ? COM8_AGC_EN : 0);
+    if (auto_mask) {
+        SET_REG_BITS_OR_RETURN(BANK_SENSOR, COM8, 0, auto_mask, 0);
+    }
+    ret = set_reg_bits(sensor, BANK_SENSOR, REG04, 0, 3, state->aec_value & 0x3)
+          || write_reg(sensor, BANK_SENSOR, AEC, (state->aec_value >> 2) & 0xFF)
+          || set_reg_bits(sensor, BANK_SENSOR, REG45, 0, 0x3F, state->aec_value >> 10)
+          || write_reg(sensor, BANK_SENSOR, GAIN, state->agc_gain);
+    // restore the automatic loops even if loading the state failed
+    if (auto_mask) {
+        ret |= set_reg_bits(sensor, BANK_SENSOR, COM8, 0, auto_mask, auto_mask);
+    }
+    return ret;
+}
+
 static int set_aec2(sensor_t *sensor, int enable)
 {
     sensor->status.aec2 = enable;
@@ -548,6 +809,8 @@ static int init_status(sensor_t *sensor){
 int esp32_camera_ov2640_detect(int slv_addr, sensor_id_t *id)
 {
     if (OV2640_SCCB_ADDR == slv_addr) {
+        // the sensor may have been power cycled since it was last seen
+        shadow_invalidate();
         SCCB_Write(slv_addr, 0xFF, 0x01);//bank sensor
         uint16_t PID = SCCB_Read(slv_addr, 0x0A);
         if (OV2640_PID == PID) {
@@ -607,6 +870,9 @@ int esp32_camera_ov2640_init(sensor_t *sensor)
     sensor->set_res_raw = set_res_raw;
     sensor->set_pll = _set_pll;
     sensor->set_xclk = set_xclk;
+    sensor->get_ae_state = get_ae_state;
+    sensor->set_ae_state = set_ae_state;
+    sensor->set_roi = set_roi;
     ESP_LOGD(TAG, "OV2640 Attached");
     return 0;
 }
@@ -23,6 +23,7 @@
 #include "esp_private/gdma.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "img_kernels.h"
 #include "esp_rom_gpio.h"
 
 #if (ESP_IDF_VERSION_MAJOR >= 5)
@@ -553,15 +554,7 @@ size_t IRAM_ATTR ll_cam_memcpy(cam_obj_t *cam, uint8_t *out, const uint8_t *in,
 {
     // YUV to Grayscale
     if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
-        size_t end = len / 8;
-        for (size_t i = 0; i < end; ++i) {
-            out[0] = in[0];
-            out[1] = in[2];
-            out[2] = in[4];
-            out[3] = in[6];
-            out += 4;
-            in += 8;
-        }
+        img_yuyv_to_gray(in, out, (len / 8) * 4);
         return len / 2;
     }
 
@@ -0,0 +1,518 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Simulated camera peripheral for the linux target.
+ *
+ * A feeder task plays the role of the sensor, the LCD_CAM block and its DMA:
+ * it raises VSYNC, writes the frame into cam->dma_buffer one half buffer at a
+ * time and raises an EOF event for every completed half buffer, paced at the
+ * configured pixel bus byte rate. The tail of a frame is left in the DMA
+ * buffer without EOF, as the hardware does, and is picked up by cam_task on
+ * the next VSYNC. Only the non-PSRAM DMA mode is simulated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include "esp_timer.h"
+#include "ll_cam.h"
+#include "cam_hal.h"
+#include "img_kernels.h"
+#include "xclk.h"
+#include "esp_camera_sim.h"
+
+static const char *TAG = "sim ll_cam";
+
+#define SIM_TASK_STACK      (4 * 1024)
+#define SIM_GARBAGE_BYTES   64
+#define SIM_MAX_FRAMES      1024
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} sim_frame_t;
+
+static esp_camera_sim_config_t s_sim_config = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+static sim_frame_t *s_sim_frames = NULL;
+static size_t s_sim_frame_cnt = 0;
+static size_t s_sim_frame_max = 0;
+static uint8_t *s_sim_scratch = NULL;
+static uint32_t s_sim_xclk_freq_hz = 20000000;
+static uint32_t s_sim_rng = 1;
+static uint32_t s_sim_emitted = 0;
+
+static TaskHandle_t s_sim_task = NULL;
+static SemaphoreHandle_t s_sim_lock = NULL;
+static SemaphoreHandle_t s_sim_done = NULL;
+static volatile bool s_sim_exit = false;
+static volatile bool s_sim_vsync_en = false;
+static volatile bool s_sim_dma_run = false;
+
+esp_err_t esp_camera_sim_set_config(const esp_camera_sim_config_t *config)
+{
+    if (config == NULL || config->fps == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_sim_config = *config;
+    return ESP_OK;
+}
+
+uint32_t esp_camera_sim_frames_emitted(void)
+{
+    return __atomic_load_n(&s_sim_emitted, __ATOMIC_RELAXED);
+}
+
+/* xorshift32, deterministic for a given seed */
+static uint32_t sim_rand(void)
+{
+    uint32_t x = s_sim_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_sim_rng = x;
+    return x;
+}
+
+static bool sim_roll(uint8_t pct)
+{
+    return pct && (sim_rand() % 100) < pct;
+}
+
+static bool sim_add_frame(const uint8_t *data, size_t len)
+{
+    if (len == 0 || s_sim_frame_cnt >= SIM_MAX_FRAMES) {
+        return false;
+    }
+    if (s_sim_frames == NULL) {
+        s_sim_frames = (sim_frame_t *)calloc(SIM_MAX_FRAMES, sizeof(sim_frame_t));
+        if (s_sim_frames == NULL) {
+            return false;
+        }
+    }
+    uint8_t *buf = (uint8_t *)malloc(len);
+    if (buf == NULL) {
+        return false;
+    }
+    memcpy(buf, data, len);
+    s_sim_frames[s_sim_frame_cnt].buf = buf;
+    s_sim_frames[s_sim_frame_cnt].len = len;
+    s_sim_frame_cnt++;
+    if (len > s_sim_frame_max) {
+        s_sim_frame_max = len;
+    }
+    return true;
+}
+
+static uint8_t *sim_read_file(const char *path, size_t *out_len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = NULL;
+    if (len > 0) {
+        buf = (uint8_t *)malloc(len);
+        if (buf && fread(buf, 1, len, f) != (size_t)len) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(f);
+    *out_len = buf ? (size_t)len : 0;
+    return buf;
+}
+
+static bool sim_has_ext(const char *name, const char *ext)
+{
+    size_t n = strlen(name), e = strlen(ext);
+    return n > e && strcasecmp(name + n - e, ext) == 0;
+}
+
+/* Split a concatenated MJPEG stream on SOI/EOI boundaries */
+static void sim_load_mjpeg(const uint8_t *data, size_t len)
+{
+    size_t start = SIZE_MAX;
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (data[i] != 0xFF) {
+            continue;
+        }
+        if (data[i + 1] == 0xD8 && start == SIZE_MAX) {
+            start = i;
+        } else if (data[i + 1] == 0xD9 && start != SIZE_MAX) {
+            sim_add_frame(&data[start], i + 2 - start);
+            start = SIZE_MAX;
+        }
+    }
+}
+
+static int sim_name_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void sim_load_dir(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    char **names = (char **)calloc(SIM_MAX_FRAMES, sizeof(char *));
+    if (names == NULL) {
+        closedir(dir);
+        return;
+    }
+    size_t cnt = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL && cnt < SIM_MAX_FRAMES) {
+        if (sim_has_ext(de->d_name, ".jpg") || sim_has_ext(de->d_name, ".jpeg")) {
+            names[cnt] = strdup(de->d_name);
+            if (names[cnt]) {
+                cnt++;
+            }
+        }
+    }
+    closedir(dir);
+    qsort(names, cnt, sizeof(char *), sim_name_cmp);
+
+    for (size_t i = 0; i < cnt; i++) {
+        char file[512];
+        snprintf(file, sizeof(file), "%s/%s", path, names[i]);
+        size_t len = 0;
+        uint8_t *data = sim_read_file(file, &len);
+        if (data) {
+            sim_add_frame(data, len);
+            free(data);
+        }
+        free(names[i]);
+    }
+    free(names);
+}
+
+static esp_err_t sim_load_source(cam_obj_t *cam)
+{
+    const char *src = s_sim_config.source;
+    CAM_CHECK(src != NULL, "no simulation source set, see esp_camera_sim_set_config()", ESP_ERR_INVALID_ARG);
+
+    DIR *dir = opendir(src);
+    if (dir != NULL) {
+        closedir(dir);
+        sim_load_dir(src);
+    } else {
+        size_t len = 0;
+        uint8_t *data = sim_read_file(src, &len);
+        CAM_CHECK(data != NULL, "simulation source can not be read", ESP_ERR_NOT_FOUND);
+        if (cam->jpeg_mode) {
+            sim_load_mjpeg(data, len);
+        } else {
+            // raw sequences are split by the frame size the sensor would send
+            for (size_t off = 0; off + cam->recv_size <= len; off += cam->recv_size) {
+                sim_add_frame(&data[off], cam->recv_size);
+            }
+        }
+        free(data);
+    }
+    CAM_CHECK(s_sim_frame_cnt > 0, "simulation source holds no usable frames", ESP_ERR_NOT_FOUND);
+
+    s_sim_scratch = (uint8_t *)malloc(s_sim_frame_max + SIM_GARBAGE_BYTES);
+    CAM_CHECK(s_sim_scratch != NULL, "simulation scratch malloc failed", ESP_ERR_NO_MEM);
+
+    ESP_LOGI(TAG, "Loaded %u frames from %s, largest %u bytes",
+             (unsigned) s_sim_frame_cnt, src, (unsigned) s_sim_frame_max);
+    return ESP_OK;
+}
+
+static void sim_free_source(void)
+{
+    for (size_t i = 0; i < s_sim_frame_cnt; i++) {
+        free(s_sim_frames[i].buf);
+    }
+    free(s_sim_frames);
+    free(s_sim_scratch);
+    s_sim_frames = NULL;
+    s_sim_scratch = NULL;
+    s_sim_frame_cnt = 0;
+    s_sim_frame_max = 0;
+}
+
+/* Apply the configured faults to a copy of the frame */
+static size_t sim_prepare_frame(cam_obj_t *cam, const sim_frame_t *src, uint8_t **out)
+{
+    uint8_t *dst = s_sim_scratch;
+    size_t len = 0;
+
+    if (cam->jpeg_mode && sim_roll(s_sim_config.garbage_pct)) {
+        for (int i = 0; i < SIM_GARBAGE_BYTES; i++) {
+            dst[len++] = sim_rand() & 0x7F;
+        }
+    }
+    memcpy(&dst[len], src->buf, src->len);
+    size_t body = len;
+    len += src->len;
+
+    if (sim_roll(s_sim_config.corrupt_pct)) {
+        // flip bytes in the middle half, clear of headers and the EOI
+        for (int i = 0; i < 8; i++) {
+            size_t pos = body + src->len / 4 + sim_rand() % (src->len / 2 + 1);
+            dst[pos] ^= 1 << (sim_rand() % 8);
+        }
+    }
+    if (cam->jpeg_mode && src->len > 4 && sim_roll(s_sim_config.truncate_pct)) {
+        len = body + src->len / 2 + sim_rand() % (src->len / 2 - 1);
+    }
+    *out = dst;
+    return len;
+}
+
+static void sim_sleep_until(int64_t deadline_us)
+{
+    int64_t wait_us = deadline_us - esp_timer_get_time();
+    // TickType_t is unsigned, a missed deadline must not turn into a huge delay
+    if (wait_us >= portTICK_PERIOD_MS * 1000) {
+        vTaskDelay(wait_us / (portTICK_PERIOD_MS * 1000));
+    }
+}
+
+/* Raise an event as the peripheral ISR would, unless capture was disabled */
+static bool sim_raise(cam_obj_t *cam, cam_event_t event)
+{
+    BaseType_t woken = pdFALSE;
+    bool sent = false;
+    xSemaphoreTake(s_sim_lock, portMAX_DELAY);
+    if (s_sim_vsync_en && !s_sim_exit) {
+        ll_cam_send_event(cam, event, &woken);
+        sent = true;
+    }
+    xSemaphoreGive(s_sim_lock);
+    if (woken == pdTRUE) {
+        taskYIELD();
+    }
+    return sent;
+}
+
+static void sim_task(void *arg)
+{
+    cam_obj_t *cam = (cam_obj_t *)arg;
+    uint32_t byte_rate = s_sim_config.byte_rate ? s_sim_config.byte_rate : s_sim_xclk_freq_hz / 2;
+    int64_t period_us = 1000000 / s_sim_config.fps;
+    int64_t next_vsync = esp_timer_get_time() + period_us;
+    size_t pos = 0;
+
+    while (!s_sim_exit) {
+        int64_t jitter = 0;
+        if (s_sim_config.jitter_us) {
+            jitter = (int64_t)(sim_rand() % (2 * s_sim_config.jitter_us + 1)) - s_sim_config.jitter_us;
+        }
+        sim_sleep_until(next_vsync + jitter);
+        next_vsync += period_us;
+
+        if (!sim_raise(cam, CAM_VSYNC_EVENT)) {
+            continue;
+        }
+        if (pos >= s_sim_frame_cnt) {
+            if (!s_sim_config.loop) {
+                continue;
+            }
+            pos = 0;
+        }
+        uint8_t *data;
+        size_t len = sim_prepare_frame(cam, &s_sim_frames[pos++], &data);
+        __atomic_fetch_add(&s_sim_emitted, 1, __ATOMIC_RELAXED);
+
+        int64_t t = esp_timer_get_time() + s_sim_config.vsync_us;
+        sim_sleep_until(t);
+
+        // stream the frame through the ping-pong DMA buffer
+        size_t half = cam->dma_half_buffer_size;
+        size_t off = 0;
+        for (int i = 0; off < len && !s_sim_exit; i++) {
+            if (!s_sim_dma_run) {
+                break; // DMA stopped by cam_task, drop the rest of the frame
+            }
+            uint8_t *slot = &cam->dma_buffer[(i % cam->dma_half_buffer_cnt) * half];
+            size_t n = len - off < half ? len - off : half;
+            memcpy(slot, &data[off], n);
+            off += n;
+            t += (int64_t)n * 1000000 / byte_rate;
+            sim_sleep_until(t);
+            if (n < half) {
+                // the tail is collected by cam_task on the next VSYNC
+                memset(slot + n, 0, half - n);
+                break;
+            }
+            sim_raise(cam, CAM_IN_SUC_EOF_EVENT);
+        }
+    }
+    xSemaphoreGive(s_sim_done);
+    vTaskDelete(NULL);
+}
+
+bool ll_cam_stop(cam_obj_t *cam)
+{
+    s_sim_dma_run = false;
+    return true;
+}
+
+bool ll_cam_start(cam_obj_t *cam, int frame_pos)
+{
+    s_sim_dma_run = true;
+    return true;
+}
+
+esp_err_t ll_cam_deinit(cam_obj_t *cam)
+{
+    if (s_sim_task) {
+        s_sim_exit = true;
+        xSemaphoreTake(s_sim_done, portMAX_DELAY);
+        s_sim_task = NULL;
+    }
+    if (s_sim_done) {
+        vSemaphoreDelete(s_sim_done);
+        s_sim_done = NULL;
+    }
+    if (s_sim_lock) {
+        vSemaphoreDelete(s_sim_lock);
+        s_sim_lock = NULL;
+    }
+    sim_free_source();
+    s_sim_vsync_en = false;
+    s_sim_dma_run = false;
+    return ESP_OK;
+}
+
+esp_err_t ll_cam_config(cam_obj_t *cam, const camera_config_t *config)
+{
+    s_sim_xclk_freq_hz = config->xclk_freq_hz;
+    s_sim_rng = s_sim_config.seed ? s_sim_config.seed : 1;
+    s_sim_emitted = 0;
+    s_sim_exit = false;
+    return ESP_OK;
+}
+
+void ll_cam_vsync_intr_enable(cam_obj_t *cam, bool en)
+{
+    s_sim_vsync_en = en;
+    if (!en && s_sim_lock) {
+        // wait for an event being raised right now, so cam_deinit can
+        // safely delete the event queue afterwards
+        xSemaphoreTake(s_sim_lock, portMAX_DELAY);
+        xSemaphoreGive(s_sim_lock);
+    }
+}
+
+esp_err_t ll_cam_set_pin(cam_obj_t *cam, const camera_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ll_cam_init_isr(cam_obj_t *cam)
+{
+    CAM_CHECK(!cam->psram_mode, "PSRAM DMA mode is not simulated", ESP_ERR_NOT_SUPPORTED);
+
+    esp_err_t ret = sim_load_source(cam);
+    if (ret != ESP_OK) {
+        sim_free_source();
+        return ret;
+    }
+
+    s_sim_lock = xSemaphoreCreateMutex();
+    s_sim_done = xSemaphoreCreateBinary();
+    CAM_CHECK(s_sim_lock != NULL && s_sim_done != NULL, "simulation semaphore create failed", ESP_ERR_NO_MEM);
+
+    // below cam_task, like an ISR feeding a higher priority consumer
+    if (xTaskCreate(sim_task, "cam_sim", SIM_TASK_STACK, cam, configMAX_PRIORITIES - 3, &s_sim_task) != pdPASS) {
+        s_sim_task = NULL;
+        ESP_LOGE(TAG, "simulation task create failed");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ll_cam_do_vsync(cam_obj_t *cam)
+{
+}
+
+uint8_t ll_cam_get_dma_align(cam_obj_t *cam)
+{
+    return 16;
+}
+
+bool ll_cam_dma_sizes(cam_obj_t *cam)
+{
+    cam->dma_bytes_per_item = 1;
+    if (cam->jpeg_mode) {
+        cam->dma_half_buffer_cnt = 16;
+        cam->dma_buffer_size = cam->dma_half_buffer_cnt * 1024;
+        cam->dma_half_buffer_size = cam->dma_buffer_size / cam->dma_half_buffer_cnt;
+        cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+    } else {
+        // whole lines per EOF so the tail of a frame is always a full half buffer
+        size_t line_width = cam->width * cam->in_bytes_per_pixel;
+        size_t half_max = CONFIG_CAMERA_DMA_BUFFER_SIZE_MAX / 2;
+        CAM_CHECK(line_width <= half_max, "Resolution too high", false);
+        size_t lines = half_max / line_width;
+        while (cam->height % lines) {
+            lines--;
+        }
+        cam->dma_half_buffer_size = lines * line_width;
+        cam->dma_half_buffer_cnt = 2;
+        cam->dma_buffer_size = cam->dma_half_buffer_cnt * cam->dma_half_buffer_size;
+        cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+    }
+    return true;
+}
+
+size_t ll_cam_memcpy(cam_obj_t *cam, uint8_t *out, const uint8_t *in, size_t len)
+{
+    // YUV to Grayscale
+    if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
+        img_yuyv_to_gray(in, out, (len / 8) * 4);
+        return len / 2;
+    }
+
+    // just memcpy
+    memcpy(out, in, len);
+    return len;
+}
+
+esp_err_t ll_cam_set_sample_mode(cam_obj_t *cam, pixformat_t pix_format, uint32_t xclk_freq_hz, uint16_t sensor_pid)
+{
+    if (pix_format == PIXFORMAT_GRAYSCALE) {
+        cam->in_bytes_per_pixel = 2;       // emulated OV2640 sends YU/YV
+        cam->fb_bytes_per_pixel = 1;       // frame buffer stores Y8
+    } else if (pix_format == PIXFORMAT_YUV422 || pix_format == PIXFORMAT_RGB565) {
+        cam->in_bytes_per_pixel = 2;       // for DMA receive
+        cam->fb_bytes_per_pixel = 2;       // frame buffer stores YU/YV/RGB565
+    } else if (pix_format == PIXFORMAT_JPEG) {
+        cam->in_bytes_per_pixel = 1;
+        cam->fb_bytes_per_pixel = 1;
+    } else {
+        ESP_LOGE(TAG, "Requested format is not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_sim_xclk_freq_hz = xclk_freq_hz;
+    return ESP_OK;
+}
+
+// implements function from xclk.c to allow dynamic XCLK change
+esp_err_t xclk_timer_conf(int ledc_timer, int xclk_freq_hz)
+{
+    s_sim_xclk_freq_hz = xclk_freq_hz;
+    return ESP_OK;
+}
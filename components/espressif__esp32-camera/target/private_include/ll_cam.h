@@ -27,6 +27,22 @@
 #include "esp32s2/rom/lldesc.h"
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/rom/lldesc.h"
+#elif CONFIG_IDF_TARGET_LINUX
+// The simulated backend only uses descriptors as plain bookkeeping
+typedef struct lldesc_s {
+    volatile uint32_t size  : 12,
+                      length: 12,
+                      offset: 5,
+                      sosf  : 1,
+                      eof   : 1,
+                      owner : 1;
+    volatile const uint8_t *buf;
+    union {
+        volatile uint32_t empty;
+        struct lldesc_s *qe;
+    };
+} lldesc_t;
+typedef void *intr_handle_t;
 #endif
 #include "esp_log.h"
 #include "esp_camera.h"
@@ -77,7 +93,8 @@
 
 typedef enum {
     CAM_IN_SUC_EOF_EVENT = 0,
-    CAM_VSYNC_EVENT
+    CAM_VSYNC_EVENT,
+    CAM_STOP_TASK_EVENT,    // sent by cam_pause(), not by the peripheral
 } cam_event_t;
 
 typedef enum {
@@ -91,6 +108,8 @@ typedef struct {
     //for RGB/YUV modes
     lldesc_t *dma;
     size_t fb_offset;
+    int64_t start_us;   // frame start VSYNC, for stats
+    int64_t queued_us;  // frame pushed to frame_buffer_queue, for stats
 } cam_frame_t;
 
 typedef struct {
@@ -111,6 +130,7 @@ typedef struct {
     QueueHandle_t event_queue;
     QueueHandle_t frame_buffer_queue;
     TaskHandle_t task_handle;
+    SemaphoreHandle_t task_stopped;
     intr_handle_t cam_intr_handle;
 
     uint8_t dma_num;//ESP32-S3
@@ -141,6 +161,10 @@ typedef struct {
     uint32_t fb_size;
 
     cam_state_t state;
+
+    uint32_t frame_seq;
+    uint32_t jpeg_size_step;
+    esp_camera_stats_t stats;
 } cam_obj_t;
 
 
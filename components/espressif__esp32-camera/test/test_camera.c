@@ -340,6 +340,39 @@ TEST_CASE("Camera driver take JPEG picture test", "[camera]")
     TEST_ASSERT_NOT_NULL(pic);
 }
 
+TEST_CASE("Camera driver statistics test", "[camera]")
+{
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 2, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    esp_camera_reset_stats();
+
+    uint32_t last_seq = 0;
+    for (int i = 0; i < 16; i++) {
+        camera_fb_t *pic = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(pic);
+        if (i > 0) {
+            TEST_ASSERT_GREATER_THAN_UINT32(last_seq, pic->seq);
+        }
+        last_seq = pic->seq;
+        esp_camera_fb_return(pic);
+    }
+
+    esp_camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    ESP_LOGI(TAG, "captured %u, returned %u, dropped %u, no-soi %u, no-eoi %u",
+             stats.frames_captured, stats.frames_returned, stats.frames_dropped_full,
+             stats.jpeg_no_soi, stats.jpeg_no_eoi);
+    TEST_ASSERT_EQUAL_UINT32(16, stats.frames_returned);
+    uint32_t samples = 0;
+    for (int i = 0; i < ESP_CAMERA_LATENCY_BUCKETS; i++) {
+        samples += stats.queue_to_get[i];
+    }
+    TEST_ASSERT_EQUAL_UINT32(stats.frames_returned, samples);
+
+    TEST_ESP_OK(esp_camera_deinit());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_get_stats(&stats));
+}
+
 TEST_CASE("Camera driver performance test", "[camera]")
 {
     camera_performance_test(20 * 1000000, 16);
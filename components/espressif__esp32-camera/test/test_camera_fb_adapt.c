@@ -0,0 +1,158 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+#define SIM_FB_SIZE     61440   // VGA JPEG default, test_outside.jpeg overflows it
+
+static void sim_camera_init(void)
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    sim.fps = 100;
+    TEST_ESP_OK(esp_camera_sim_set_config(&sim));
+
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .pin_xclk = -1,
+        .pin_sccb_sda = 0,
+        .pin_sccb_scl = 0,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_VGA,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    };
+    TEST_ESP_OK(esp_camera_init(&config));
+}
+
+static void capture_frames(int count)
+{
+    for (int i = 0; i < count; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        esp_camera_fb_return(fb);
+    }
+}
+
+TEST_CASE("JPEG frame size histogram", "[camera][sim]")
+{
+    sim_camera_init();
+    capture_frames(30);
+
+    esp_camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    TEST_ASSERT_NOT_EQUAL(0, stats.jpeg_size_step);
+    TEST_ASSERT_EQUAL(SIM_FB_SIZE, stats.fb_size);
+    TEST_ASSERT_EQUAL(2, stats.fb_count);
+
+    uint32_t sized = 0;
+    for (int i = 0; i < ESP_CAMERA_JPEG_SIZE_BUCKETS; i++) {
+        sized += stats.jpeg_size[i];
+    }
+    TEST_ASSERT_EQUAL(stats.frames_returned, sized);
+    // testimg.jpeg, 5764 bytes
+    TEST_ASSERT_NOT_EQUAL(0, stats.jpeg_size[5764 / stats.jpeg_size_step]);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("JPEG frame buffers adapt to the frame sizes", "[camera][sim]")
+{
+    sim_camera_init();
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_camera_fb_adapt(50, 0, NULL));
+    capture_frames(60);
+
+    // a held frame can not be reallocated
+    camera_fb_t *held = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(held);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_set_fb_size(32768, 0));
+    esp_camera_fb_return(held);
+
+    size_t fb_size = 0;
+    TEST_ESP_OK(esp_camera_fb_adapt(50, 3, &fb_size));
+    printf("p50 frame buffer: %u -> %u bytes\n", SIM_FB_SIZE, (unsigned) fb_size);
+    TEST_ASSERT_LESS_THAN(SIM_FB_SIZE, fb_size);
+
+    esp_camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    TEST_ASSERT_EQUAL(fb_size, stats.fb_size);
+    TEST_ASSERT_EQUAL(3, stats.fb_count);
+
+    // capture resumes without a sensor reset
+    for (int i = 0; i < 10; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_LESS_OR_EQUAL(fb_size, fb->len);
+        esp_camera_fb_return(fb);
+    }
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("JPEG frame buffers reallocate while frames are in flight", "[camera][sim]")
+{
+    sim_camera_init();
+    // every pause lands somewhere in a frame, none of them may be lost
+    for (int i = 0; i < 40; i++) {
+        capture_frames(1);
+        TEST_ESP_OK(esp_camera_set_fb_size(i & 1 ? 32768 : 40960, 0));
+    }
+    capture_frames(5);
+    esp_camera_deinit();
+}
+
+TEST_CASE("JPEG frame buffers survive a failed reallocation", "[camera][sim]")
+{
+    sim_camera_init();
+    capture_frames(5);
+
+    // the frame table alone is beyond any heap, the old buffers have to stay
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_camera_set_fb_size(SIM_FB_SIZE, UINT32_MAX));
+
+    esp_camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    TEST_ASSERT_EQUAL(SIM_FB_SIZE, stats.fb_size);
+    TEST_ASSERT_EQUAL(2, stats.fb_count);
+    capture_frames(5);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("JPEG frame buffers grow fast and shrink slowly", "[camera][sim]")
+{
+    sim_camera_init();
+    capture_frames(90);
+
+    // test_outside.jpeg is a third of the frames, far more than 5% overflow
+    size_t grown = 0;
+    TEST_ESP_OK(esp_camera_fb_adapt(95, 0, &grown));
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * SIM_FB_SIZE, grown);
+
+    // p50 alone fits in a fraction of that, each step may only take a quarter
+    size_t last = grown;
+    for (int i = 0; i < 3; i++) {
+        esp_camera_reset_stats();
+        capture_frames(30);
+        size_t fb_size = 0;
+        TEST_ESP_OK(esp_camera_fb_adapt(50, 0, &fb_size));
+        printf("p50 after p95: %u -> %u bytes\n", (unsigned) last, (unsigned) fb_size);
+        TEST_ASSERT_LESS_THAN(last, fb_size);
+        TEST_ASSERT_GREATER_OR_EQUAL(last - last / 4 - 2048, fb_size);
+        last = fb_size;
+    }
+
+    esp_camera_deinit();
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,105 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+static camera_config_t sim_camera_config(void)
+{
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .pin_xclk = -1,
+        .pin_sccb_sda = 0,
+        .pin_sccb_scl = 0,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_QVGA,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+        .frame_size_max = FRAMESIZE_SVGA,
+    };
+    return config;
+}
+
+static void sim_camera_init(void)
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    sim.fps = 100;
+    TEST_ESP_OK(esp_camera_sim_set_config(&sim));
+
+    camera_config_t config = sim_camera_config();
+    TEST_ESP_OK(esp_camera_init(&config));
+}
+
+/* Time until the first frame of the given width arrives */
+static int64_t first_frame_us(int64_t start, int width)
+{
+    for (;;) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        bool match = fb->width == width;
+        esp_camera_fb_return(fb);
+        if (match) {
+            return esp_timer_get_time() - start;
+        }
+    }
+}
+
+TEST_CASE("Camera switches frame size without reinit", "[camera][sim]")
+{
+    sim_camera_init();
+    camera_fb_t *fb = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(fb);
+    TEST_ASSERT_EQUAL(320, fb->width);
+
+    // a held frame keeps its buffer and size across the switch
+    TEST_ESP_OK(esp_camera_set_frame_size(FRAMESIZE_SVGA));
+    TEST_ASSERT_EQUAL(320, fb->width);
+    esp_camera_fb_return(fb);
+
+    fb = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(fb);
+    TEST_ASSERT_EQUAL(800, fb->width);
+    TEST_ASSERT_EQUAL(600, fb->height);
+    esp_camera_fb_return(fb);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_camera_set_frame_size(FRAMESIZE_XGA));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_camera_set_frame_size(FRAMESIZE_INVALID));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("Camera frame size switch latency", "[camera][sim]")
+{
+    sim_camera_init();
+    first_frame_us(esp_timer_get_time(), 320);
+
+    int64_t start = esp_timer_get_time();
+    TEST_ESP_OK(esp_camera_set_frame_size(FRAMESIZE_VGA));
+    int64_t set_us = esp_timer_get_time() - start;
+    int64_t switch_us = first_frame_us(start, 640);
+
+    camera_config_t config = sim_camera_config();
+    config.frame_size = FRAMESIZE_QVGA;
+    start = esp_timer_get_time();
+    TEST_ESP_OK(esp_camera_reconfigure(&config));
+    int64_t reinit_us = first_frame_us(start, 320);
+
+    printf("frame size switch: %lld us to apply, %lld us to the first frame; reinit: %lld us\n",
+           (long long) set_us, (long long) switch_us, (long long) reinit_us);
+    TEST_ASSERT_LESS_THAN(reinit_us, switch_us);
+
+    esp_camera_deinit();
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
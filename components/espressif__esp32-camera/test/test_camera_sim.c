@@ -0,0 +1,146 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+#define SIM_BIG_FB_SIZE (96 * 1024)  // test_outside.jpeg, the largest picture, fits
+
+static void sim_camera_init(const esp_camera_sim_config_t *sim)
+{
+    TEST_ESP_OK(esp_camera_sim_set_config(sim));
+
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .pin_xclk = -1,
+        .pin_sccb_sda = 0,
+        .pin_sccb_scl = 0,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_VGA,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    };
+    TEST_ESP_OK(esp_camera_init(&config));
+    TEST_ESP_OK(esp_camera_set_fb_size(SIM_BIG_FB_SIZE, 0));
+}
+
+static int64_t fb_time_us(const camera_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+TEST_CASE("Simulated sensor paces frames at the configured rate", "[camera][sim]")
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    sim.fps = 50;
+    sim.vsync_us = 3000;    // room for host scheduling latency before the DMA restarts
+    sim_camera_init(&sim);
+
+    // frame starts fall on the 20 ms grid, a frame the host scheduler made
+    // the driver miss would leave a whole period out
+    camera_fb_t *fb = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(fb);
+    int64_t first = fb_time_us(fb);
+    int64_t last = first;
+    esp_camera_fb_return(fb);
+    int periods = 0;
+    for (int i = 0; i < 25; i++) {
+        fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        int64_t gap = fb_time_us(fb) - last;
+        last = fb_time_us(fb);
+        esp_camera_fb_return(fb);
+        int k = (gap + 10000) / 20000;
+        TEST_ASSERT_GREATER_OR_EQUAL(1, k);
+        periods += k;
+    }
+    printf("25 frames over %d periods in %lld us\n", periods, (long long)(last - first));
+    // deadlines are absolute, wake-up latency does not add up
+    TEST_ASSERT_INT_WITHIN(10000, periods * 20000, last - first);
+    TEST_ASSERT_LESS_OR_EQUAL(28, periods);
+
+    // the sensor keeps its own clock whatever the application does
+    uint32_t emitted = esp_camera_sim_frames_emitted();
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_INT_WITHIN(3, 50, esp_camera_sim_frames_emitted() - emitted);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("Simulated sensor keeps going after missed frame deadlines", "[camera][sim]")
+{
+    // every frame takes longer on the bus than the frame period
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    sim.fps = 1000;
+    sim.byte_rate = 4000000;
+    sim_camera_init(&sim);
+
+    for (int i = 0; i < 10; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        esp_camera_fb_return(fb);
+    }
+    // behind schedule by now, the next frames must follow back to back
+    uint32_t emitted = esp_camera_sim_frames_emitted();
+    vTaskDelay(pdMS_TO_TICKS(300));
+    uint32_t more = esp_camera_sim_frames_emitted() - emitted;
+    printf("%u frames in 300 ms behind schedule\n", (unsigned) more);
+    TEST_ASSERT_GREATER_OR_EQUAL(10, more);
+
+    for (int i = 0; i < 10; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        esp_camera_fb_return(fb);
+    }
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("Simulated faults reach the driver statistics", "[camera][sim]")
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    sim.fps = 100;
+    sim.garbage_pct = 25;
+    sim.truncate_pct = 25;
+    sim.seed = 7;
+    sim_camera_init(&sim);
+
+    // damaged frames are dropped in the driver, the rest arrive intact
+    for (int i = 0; i < 40; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_GREATER_THAN(4, fb->len);
+        TEST_ASSERT_EQUAL_HEX8(0xFF, fb->buf[0]);
+        TEST_ASSERT_EQUAL_HEX8(0xD8, fb->buf[1]);
+        TEST_ASSERT_EQUAL_HEX8(0xFF, fb->buf[fb->len - 2]);
+        TEST_ASSERT_EQUAL_HEX8(0xD9, fb->buf[fb->len - 1]);
+        esp_camera_fb_return(fb);
+    }
+
+    esp_camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    printf("emitted %u, returned %u, no-soi %u, no-eoi %u\n", (unsigned) esp_camera_sim_frames_emitted(),
+           (unsigned) stats.frames_returned, (unsigned) stats.jpeg_no_soi, (unsigned) stats.jpeg_no_eoi);
+    TEST_ASSERT_EQUAL(40, stats.frames_returned);
+    TEST_ASSERT_NOT_EQUAL(0, stats.jpeg_no_soi);
+    TEST_ASSERT_NOT_EQUAL(0, stats.jpeg_no_eoi);
+    TEST_ASSERT_GREATER_OR_EQUAL(40 + stats.jpeg_no_soi + stats.jpeg_no_eoi, esp_camera_sim_frames_emitted());
+
+    esp_camera_deinit();
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
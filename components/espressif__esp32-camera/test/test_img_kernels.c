@@ -0,0 +1,248 @@
+#include "sdkconfig.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "img_kernels.h"
+
+typedef void (*kernel_fn)(const uint8_t *src, uint8_t *dst, size_t pixels);
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static void fill_random(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = rng();
+    }
+}
+
+/* Per pixel references, written the way the converters used to be */
+static void ref_rgb565_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 2, dst += 3) {
+        dst[2] = src[0] & 0xF8;
+        dst[1] = (src[0] & 0x07) << 5 | (src[1] & 0xE0) >> 3;
+        dst[0] = (src[1] & 0x1F) << 3;
+    }
+}
+
+static void ref_rgb565_to_rgb24(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 2, dst += 3) {
+        dst[0] = src[0] & 0xF8;
+        dst[1] = (src[0] & 0x07) << 5 | (src[1] & 0xE0) >> 3;
+        dst[2] = (src[1] & 0x1F) << 3;
+    }
+}
+
+static void ref_rgb888_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3, dst += 2) {
+        dst[0] = (src[2] & 0xF8) | (src[1] >> 5);
+        dst[1] = ((src[1] << 3) & 0xE0) | (src[0] >> 3);
+    }
+}
+
+static void ref_rgb888_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3) {
+        *dst++ = (77 * src[2] + 150 * src[1] + 29 * src[0]) >> 8;
+    }
+}
+
+static void ref_swap_rb(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 3, dst += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+
+static void ref_swap_bytes16(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 2, dst += 2) {
+        dst[0] = src[1];
+        dst[1] = src[0];
+    }
+}
+
+static void ref_yuyv_to_gray(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, src += 2) {
+        *dst++ = src[0];
+    }
+}
+
+static const struct {
+    const char *name;
+    kernel_fn kernel;
+    kernel_fn ref;
+    size_t in_bpp;
+    size_t out_bpp;
+} kernels[] = {
+    { "yuyv->gray", img_yuyv_to_gray, ref_yuyv_to_gray, 2, 1 },
+    { "rgb565->rgb888", img_rgb565_to_rgb888, ref_rgb565_to_rgb888, 2, 3 },
+    { "rgb565->rgb24", img_rgb565_to_rgb24, ref_rgb565_to_rgb24, 2, 3 },
+    { "rgb888->rgb565", img_rgb888_to_rgb565, ref_rgb888_to_rgb565, 3, 2 },
+    { "rgb888->gray", img_rgb888_to_gray, ref_rgb888_to_gray, 3, 1 },
+    { "swap rb", img_swap_rb, ref_swap_rb, 3, 3 },
+    { "swap bytes16", img_swap_bytes16, ref_swap_bytes16, 2, 2 },
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+TEST_CASE("Pixel kernels match the per pixel references", "[camera][conversions]")
+{
+    const size_t max_pixels = 70;
+    uint8_t src[4 + 70 * 3];
+    uint8_t out[4 + 70 * 3 + 1];
+    uint8_t ref[70 * 3];
+
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        for (size_t pixels = 0; pixels <= max_pixels; pixels += 2) {
+            // every source and destination alignment, word and byte paths
+            for (size_t so = 0; so < 4; so++) {
+                for (size_t doff = 0; doff < 4; doff++) {
+                    fill_random(src, sizeof(src));
+                    memset(out, 0xA5, sizeof(out));
+                    kernels[k].ref(src + so, ref, pixels);
+                    kernels[k].kernel(src + so, out + doff, pixels);
+                    size_t len = pixels * kernels[k].out_bpp;
+                    TEST_ASSERT_EQUAL_MESSAGE(0, memcmp(ref, out + doff, len), kernels[k].name);
+                    TEST_ASSERT_EQUAL_MESSAGE(0xA5, out[doff + len], kernels[k].name);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Pixel kernels convert in place", "[camera][conversions]")
+{
+    uint8_t buf[64 * 3];
+    uint8_t ref[64 * 3];
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        if (kernels[k].out_bpp > kernels[k].in_bpp) {
+            continue;
+        }
+        fill_random(buf, sizeof(buf));
+        kernels[k].ref(buf, ref, 64);
+        kernels[k].kernel(buf, buf, 64);
+        TEST_ASSERT_EQUAL_MESSAGE(0, memcmp(ref, buf, 64 * kernels[k].out_bpp), kernels[k].name);
+    }
+}
+
+TEST_CASE("YUYV kernels agree with each other", "[camera][conversions]")
+{
+    const size_t pixels = 128;
+    uint8_t yuyv[4 + 128 * 2];
+    uint8_t bgr[128 * 3];
+    uint8_t rgb[4 + 128 * 3];
+    uint8_t rgb565[4 + 128 * 2];
+    uint8_t tmp[128 * 3];
+    fill_random(yuyv, sizeof(yuyv));
+
+    img_yuyv_to_rgb888(yuyv, bgr, pixels);
+    for (size_t off = 0; off < 4; off++) {
+        // RGB24 is RGB888 with red and blue swapped
+        img_yuyv_to_rgb24(yuyv + off, rgb + off, pixels);
+        img_yuyv_to_rgb888(yuyv + off, tmp, pixels);
+        img_swap_rb(tmp, tmp, pixels);
+        TEST_ASSERT_EQUAL(0, memcmp(tmp, rgb + off, pixels * 3));
+
+        // the direct RGB565 kernel rounds like going through RGB888
+        img_yuyv_to_rgb565(yuyv + off, rgb565 + off, pixels);
+        img_yuyv_to_rgb888(yuyv + off, tmp, pixels);
+        img_rgb888_to_rgb565(tmp, tmp, pixels);
+        TEST_ASSERT_EQUAL(0, memcmp(tmp, rgb565 + off, pixels * 2));
+    }
+
+    // neutral chroma keeps the pixel gray, brighter luma is brighter
+    const uint8_t flat[] = {16, 128, 235, 128};
+    img_yuyv_to_rgb888(flat, tmp, 2);
+    TEST_ASSERT_EQUAL(tmp[0], tmp[1]);
+    TEST_ASSERT_EQUAL(tmp[1], tmp[2]);
+    TEST_ASSERT_EQUAL(tmp[3], tmp[4]);
+    TEST_ASSERT_EQUAL(tmp[4], tmp[5]);
+    TEST_ASSERT_LESS_THAN(tmp[3], tmp[0]);
+    // strong V is red, strong U is blue
+    const uint8_t red[] = {128, 128, 128, 255};
+    img_yuyv_to_rgb24(red, tmp, 2);
+    TEST_ASSERT_GREATER_THAN(tmp[2], tmp[0]);
+    const uint8_t blue[] = {128, 255, 128, 128};
+    img_yuyv_to_rgb24(blue, tmp, 2);
+    TEST_ASSERT_GREATER_THAN(tmp[0], tmp[2]);
+}
+
+static double mpixels_per_s(kernel_fn fn, const uint8_t *src, uint8_t *dst, size_t pixels, int rounds)
+{
+    int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        fn(src, dst, pixels);
+    }
+    int64_t t1 = esp_timer_get_time();
+    return (double)pixels * rounds / (t1 - t0 ? t1 - t0 : 1);
+}
+
+TEST_CASE("Pixel kernel performance", "[camera][conversions]")
+{
+    // one VGA frame worth of pixels, converted a row at a time in the drivers
+    const size_t pixels = 640 * 48;
+    const int rounds = 10;
+    uint8_t *src = malloc(pixels * 3);
+    uint8_t *dst = malloc(pixels * 3);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(dst);
+    fill_random(src, pixels * 3);
+
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        double ref = mpixels_per_s(kernels[k].ref, src, dst, pixels, rounds);
+        double fast = mpixels_per_s(kernels[k].kernel, src, dst, pixels, rounds);
+        printf("%-16s %7.1f Mpixel/s, per pixel reference %7.1f Mpixel/s\n", kernels[k].name, fast, ref);
+    }
+    const struct {
+        const char *name;
+        kernel_fn kernel;
+    } yuyv[] = {
+        { "yuyv->rgb565", img_yuyv_to_rgb565 },
+        { "yuyv->rgb888", img_yuyv_to_rgb888 },
+        { "yuyv->rgb24", img_yuyv_to_rgb24 },
+    };
+    for (size_t k = 0; k < sizeof(yuyv) / sizeof(yuyv[0]); k++) {
+        printf("%-16s %7.1f Mpixel/s\n", yuyv[k].name, mpixels_per_s(yuyv[k].kernel, src, dst, pixels, rounds));
+    }
+
+    // the capture path word loop against the byte loop it replaced
+    int64_t ref_us = INT64_MAX, fast_us = INT64_MAX;
+    for (int i = 0; i < 5; i++) {
+        int64_t t0 = esp_timer_get_time();
+        for (int r = 0; r < 100; r++) {
+            ref_yuyv_to_gray(src, dst, pixels);
+        }
+        int64_t t1 = esp_timer_get_time();
+        for (int r = 0; r < 100; r++) {
+            img_yuyv_to_gray(src, dst, pixels);
+        }
+        int64_t t2 = esp_timer_get_time();
+        ref_us = t1 - t0 < ref_us ? t1 - t0 : ref_us;
+        fast_us = t2 - t1 < fast_us ? t2 - t1 : fast_us;
+    }
+    printf("yuyv->gray x100: %lld us word loop, %lld us byte loop\n", (long long)fast_us, (long long)ref_us);
+#if !CONFIG_IDF_TARGET_LINUX
+    // host compilers vectorize the byte loop, the target compiler does not
+    TEST_ASSERT_LESS_THAN((int)(ref_us * 5 / 4), (int)fast_us);
+#endif
+
+    free(src);
+    free(dst);
+}
@@ -0,0 +1,280 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "img_converters.h"
+
+static uint32_t rng_state = 7;
+
+static uint32_t rng(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static void *scale_work(size_t src_width, size_t dst_width, pixformat_t format, img_scale_mode_t mode, size_t *size)
+{
+    *size = img_scale_work_size(src_width, dst_width, format, mode);
+    TEST_ASSERT_GREATER_THAN(0, *size);
+    void *work = malloc(*size);
+    TEST_ASSERT_NOT_NULL(work);
+    return work;
+}
+
+static void scale(const img_view_t *src, const img_view_t *dst, img_scale_mode_t mode)
+{
+    size_t size;
+    void *work = scale_work(src->width, dst->width, dst->format, mode, &size);
+    TEST_ASSERT_EQUAL(ESP_OK, img_scale(src, dst, mode, work, size));
+    free(work);
+}
+
+/* Floating point references on a gray image */
+static double overlap(size_t i, size_t o, size_t src, size_t dst)
+{
+    double lo = i * dst > o * src ? i * dst : o * src;
+    double hi = (i + 1) * dst < (o + 1) * src ? (i + 1) * dst : (o + 1) * src;
+    return hi > lo ? hi - lo : 0;
+}
+
+static double ref_area(const uint8_t *src, size_t sw, size_t sh, size_t dw, size_t dh, size_t x, size_t y)
+{
+    double sum = 0;
+    for (size_t j = 0; j < sh; j++) {
+        double wy = overlap(j, y, sh, dh);
+        for (size_t i = 0; wy && i < sw; i++) {
+            sum += src[j * sw + i] * wy * overlap(i, x, sw, dw);
+        }
+    }
+    return sum / ((double)sw * sh);
+}
+
+static void ref_pos(size_t o, size_t src, size_t dst, size_t *i, double *f)
+{
+    double pos = (o + 0.5) * src / dst - 0.5;
+    if (pos < 0) {
+        pos = 0;
+    }
+    *i = (size_t)pos;
+    *f = pos - *i;
+    if (*i >= src - 1) {
+        *i = src - 1;
+        *f = 0;
+    }
+}
+
+static double ref_bilinear(const uint8_t *src, size_t sw, size_t sh, size_t dw, size_t dh, size_t x, size_t y)
+{
+    size_t i, j;
+    double fx, fy;
+    ref_pos(x, sw, dw, &i, &fx);
+    ref_pos(y, sh, dh, &j, &fy);
+    const uint8_t *p = src + j * sw + i;
+    double top = p[0] * (1 - fx) + (fx ? p[1] * fx : 0);
+    if (!fy) {
+        return top;
+    }
+    double bottom = p[sw] * (1 - fx) + (fx ? p[sw + 1] * fx : 0);
+    return top * (1 - fy) + bottom * fy;
+}
+
+TEST_CASE("Image scaler keeps flat colors", "[camera][conversions]")
+{
+    const size_t sw = 640, sh = 480;
+    uint8_t *src = malloc(sw * sh * 2);
+    TEST_ASSERT_NOT_NULL(src);
+    for (size_t i = 0; i < sw * sh; i++) {
+        src[2 * i] = 0xA3;          // 565 with every channel odd
+        src[2 * i + 1] = 0x5D;
+    }
+    img_view_t in;
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&in, src, sw * sh * 2, sw, sh, 0, PIXFORMAT_RGB565));
+
+    const size_t sizes[][2] = {{160, 120}, {123, 77}, {640, 480}, {1, 1}, {639, 1}};
+    for (int mode = IMG_SCALE_AREA; mode <= IMG_SCALE_BILINEAR; mode++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            size_t dw = sizes[s][0], dh = sizes[s][1];
+            uint8_t *dst = malloc(dw * dh * 2);
+            TEST_ASSERT_NOT_NULL(dst);
+            img_view_t out;
+            TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&out, dst, dw * dh * 2, dw, dh, 0, PIXFORMAT_RGB565));
+            scale(&in, &out, mode);
+            for (size_t i = 0; i < dw * dh; i++) {
+                TEST_ASSERT_EQUAL(0xA3, dst[2 * i]);
+                TEST_ASSERT_EQUAL(0x5D, dst[2 * i + 1]);
+            }
+            free(dst);
+        }
+    }
+    free(src);
+}
+
+TEST_CASE("Image scaler matches the area and bilinear references", "[camera][conversions]")
+{
+    const size_t sizes[][4] = {
+        {97, 61, 30, 17},       // arbitrary ratio
+        {64, 48, 16, 12},       // whole ratio
+        {100, 100, 99, 51},     // barely smaller
+        {40, 30, 40, 30},       // same size
+    };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t sw = sizes[s][0], sh = sizes[s][1], dw = sizes[s][2], dh = sizes[s][3];
+        uint8_t *src = malloc(sw * sh);
+        uint8_t *dst = malloc(dw * dh);
+        TEST_ASSERT_NOT_NULL(src);
+        TEST_ASSERT_NOT_NULL(dst);
+        for (size_t i = 0; i < sw * sh; i++) {
+            src[i] = rng();
+        }
+        img_view_t in, out;
+        TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&in, src, sw * sh, sw, sh, 0, PIXFORMAT_GRAYSCALE));
+        TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&out, dst, dw * dh, dw, dh, 0, PIXFORMAT_GRAYSCALE));
+
+        scale(&in, &out, IMG_SCALE_AREA);
+        for (size_t y = 0; y < dh; y++) {
+            for (size_t x = 0; x < dw; x++) {
+                double ref = ref_area(src, sw, sh, dw, dh, x, y);
+                TEST_ASSERT_LESS_THAN(0.51 * 256, (int)(256 * fabs(dst[y * dw + x] - ref)));
+            }
+        }
+
+        scale(&in, &out, IMG_SCALE_BILINEAR);
+        for (size_t y = 0; y < dh; y++) {
+            for (size_t x = 0; x < dw; x++) {
+                double ref = ref_bilinear(src, sw, sh, dw, dh, x, y);
+                // 8 bit sample positions
+                TEST_ASSERT_LESS_THAN(2 * 256, (int)(256 * fabs(dst[y * dw + x] - ref)));
+            }
+        }
+        free(src);
+        free(dst);
+    }
+}
+
+TEST_CASE("Image scaler streams bands and YUV422 rows", "[camera][conversions]")
+{
+    const size_t sw = 320, sh = 240, dw = 106, dh = 80;
+    uint8_t *yuv = malloc(sw * sh * 2);
+    uint8_t *bgr = malloc(sw * sh * 3);
+    uint8_t *ref = malloc(dw * dh * 2);
+    uint8_t *dst = malloc(dw * dh * 2);
+    TEST_ASSERT_NOT_NULL(yuv);
+    TEST_ASSERT_NOT_NULL(bgr);
+    TEST_ASSERT_NOT_NULL(ref);
+    TEST_ASSERT_NOT_NULL(dst);
+    for (size_t i = 0; i < sw * sh * 2; i++) {
+        yuv[i] = rng();
+    }
+    img_view_t in_yuv, in_bgr, out_ref, out;
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&in_yuv, yuv, sw * sh * 2, sw, sh, 0, PIXFORMAT_YUV422));
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&in_bgr, bgr, sw * sh * 3, sw, sh, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&out_ref, ref, dw * dh * 2, dw, dh, 0, PIXFORMAT_RGB565));
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&out, dst, dw * dh * 2, dw, dh, 0, PIXFORMAT_RGB565));
+    TEST_ASSERT_EQUAL(ESP_OK, img_convert(&in_yuv, &in_bgr));
+
+    for (int mode = IMG_SCALE_AREA; mode <= IMG_SCALE_BILINEAR; mode++) {
+        // whole frame, already converted
+        scale(&in_bgr, &out_ref, mode);
+
+        // camera rows in bands of random height, as DMA or a decoder delivers them
+        size_t size;
+        void *work = scale_work(sw, dw, PIXFORMAT_RGB565, mode, &size);
+        img_scaler_t scaler;
+        memset(dst, 0, dw * dh * 2);
+        TEST_ASSERT_EQUAL(ESP_OK, img_scaler_init(&scaler, sw, sh, PIXFORMAT_YUV422, &out, mode, work, size));
+        size_t row = 0;
+        while (row < sh) {
+            size_t band = 1 + rng() % 16;
+            band = band > sh - row ? sh - row : band;
+            TEST_ASSERT_EQUAL(ESP_OK, img_scaler_push_rows(&scaler, yuv + row * sw * 2, sw * 2, band));
+            row += band;
+            // destination rows come out while the frame streams in
+            TEST_ASSERT_TRUE(scaler.dst_row + 2 >= row * dh / sh);
+        }
+        TEST_ASSERT_EQUAL(dh, scaler.dst_row);
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, img_scaler_push_rows(&scaler, yuv, sw * 2, 1));
+        TEST_ASSERT_EQUAL(0, memcmp(ref, dst, dw * dh * 2));
+        free(work);
+    }
+    free(yuv);
+    free(bgr);
+    free(ref);
+    free(dst);
+}
+
+TEST_CASE("Image scaler checks its arguments", "[camera][conversions]")
+{
+    uint8_t buf[64 * 64 * 3];
+    img_view_t small, big, yuv;
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&small, buf, sizeof(buf), 16, 16, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&big, buf, sizeof(buf), 64, 64, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&yuv, buf, sizeof(buf), 16, 16, 0, PIXFORMAT_YUV422));
+
+    size_t size;
+    void *work = scale_work(64, 64, PIXFORMAT_RGB888, IMG_SCALE_BILINEAR, &size);
+    img_scaler_t scaler;
+    // area averaging only shrinks, bilinear also enlarges
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, img_scale(&small, &big, IMG_SCALE_AREA, work, size));
+    TEST_ASSERT_EQUAL(ESP_OK, img_scaler_init(&scaler, 16, 16, PIXFORMAT_RGB888, &big, IMG_SCALE_BILINEAR, work, size));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_scale(&big, &small, IMG_SCALE_AREA, work, 16));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, img_scale(&big, &yuv, IMG_SCALE_AREA, work, size));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_scaler_init(&scaler, 15, 16, PIXFORMAT_YUV422, &small,
+                                                           IMG_SCALE_AREA, work, size));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_scaler_init(&scaler, 70000, 16, PIXFORMAT_RGB888, &small,
+                                                            IMG_SCALE_AREA, work, size));
+    free(work);
+}
+
+TEST_CASE("Image scaler performance", "[camera][conversions]")
+{
+    const size_t sw = 640, sh = 480;
+    const struct {
+        pixformat_t src_format;
+        pixformat_t dst_format;
+        size_t dw, dh;
+        img_scale_mode_t mode;
+        const char *name;
+    } cases[] = {
+        { PIXFORMAT_GRAYSCALE, PIXFORMAT_GRAYSCALE, 160, 120, IMG_SCALE_AREA, "gray area 1/4" },
+        { PIXFORMAT_GRAYSCALE, PIXFORMAT_GRAYSCALE, 213, 160, IMG_SCALE_AREA, "gray area 1/3.004" },
+        { PIXFORMAT_GRAYSCALE, PIXFORMAT_GRAYSCALE, 213, 160, IMG_SCALE_BILINEAR, "gray bilinear" },
+        { PIXFORMAT_RGB565, PIXFORMAT_RGB565, 160, 120, IMG_SCALE_AREA, "rgb565 area 1/4" },
+        { PIXFORMAT_RGB565, PIXFORMAT_RGB565, 213, 160, IMG_SCALE_AREA, "rgb565 area 1/3.004" },
+        { PIXFORMAT_RGB565, PIXFORMAT_RGB565, 320, 240, IMG_SCALE_BILINEAR, "rgb565 bilinear" },
+        { PIXFORMAT_YUV422, PIXFORMAT_RGB565, 160, 120, IMG_SCALE_AREA, "yuv422 area 1/4" },
+        { PIXFORMAT_RGB888, PIXFORMAT_RGB888, 213, 160, IMG_SCALE_AREA, "rgb888 area 1/3.004" },
+    };
+    uint8_t *src = malloc(sw * sh * 3);
+    uint8_t *dst = malloc(320 * 240 * 3);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(dst);
+    for (size_t i = 0; i < sw * sh * 3; i++) {
+        src[i] = rng();
+    }
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        img_view_t in, out;
+        size_t in_len = sw * sh * img_bytes_per_pixel(cases[c].src_format);
+        size_t out_len = cases[c].dw * cases[c].dh * img_bytes_per_pixel(cases[c].dst_format);
+        TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&in, src, in_len, sw, sh, 0, cases[c].src_format));
+        TEST_ASSERT_EQUAL(ESP_OK, img_view_init(&out, dst, out_len, cases[c].dw, cases[c].dh, 0, cases[c].dst_format));
+        size_t size;
+        void *work = scale_work(sw, cases[c].dw, cases[c].dst_format, cases[c].mode, &size);
+        int64_t t0 = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, img_scale(&in, &out, cases[c].mode, work, size));
+        int64_t t1 = esp_timer_get_time();
+        free(work);
+        int64_t us = t1 - t0 ? t1 - t0 : 1;
+        printf("VGA to %ux%u %-20s %6lld us, %6.1f source Mpixel/s\n", (unsigned)cases[c].dw, (unsigned)cases[c].dh,
+               cases[c].name, (long long)us, (double)sw * sh / us);
+        if (c == 0) {
+            // a gray preview keeps up with 30 fps capture
+            TEST_ASSERT_LESS_THAN(33333, (int)us);
+        }
+    }
+    free(src);
+    free(dst);
+}
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+
+#include "img_converters.h"
+#include "jpeg_scan.h"
+
+#define GUARD 0xA5
+
+static void fill_rgb888(uint8_t *buf, size_t width, size_t height, size_t stride)
+{
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t *p = &buf[y * stride + x * 3];
+            p[0] = x * 4;           // B
+            p[1] = y * 4;           // G
+            p[2] = (x + y) * 2;     // R
+        }
+    }
+}
+
+static bool all_bytes(const uint8_t *buf, size_t len, uint8_t value)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Image views check their bounds", "[camera][conversions]")
+{
+    uint8_t buf[64 * 3];
+    img_view_t view, crop;
+
+    TEST_ESP_OK(img_view_init(&view, buf, sizeof(buf), 8, 8, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(8 * 3, view.stride);
+    TEST_ASSERT_EQUAL(sizeof(buf), img_view_size(&view));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_view_init(&view, buf, sizeof(buf) - 1, 8, 8, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_view_init(&view, buf, sizeof(buf), 8, 8, 8 * 3 - 1, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_view_init(&view, buf, sizeof(buf), 7, 2, 0, PIXFORMAT_YUV422));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, img_view_init(&view, buf, sizeof(buf), 8, 8, 0, PIXFORMAT_JPEG));
+    // the last row needs no padding
+    TEST_ESP_OK(img_view_init(&view, buf, 3 * 40 + 8 * 3, 8, 4, 40, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_view_init(&view, buf, 3 * 40 + 8 * 3 - 1, 8, 4, 40, PIXFORMAT_RGB888));
+
+    TEST_ESP_OK(img_view_init(&view, buf, sizeof(buf), 8, 8, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_view_crop(&view, 2, 3, 6, 5, &crop));
+    TEST_ASSERT_EQUAL_PTR(&buf[3 * 24 + 2 * 3], crop.data);
+    TEST_ASSERT_EQUAL(view.stride, crop.stride);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_view_crop(&view, 2, 3, 7, 5, &crop));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_view_crop(&view, 0, 8, 1, 1, &crop));
+
+    TEST_ESP_OK(img_view_init(&view, buf, sizeof(buf), 8, 8, 0, PIXFORMAT_YUV422));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_view_crop(&view, 1, 0, 4, 1, &crop));
+    TEST_ESP_OK(img_view_crop(&view, 2, 0, 4, 1, &crop));
+}
+
+TEST_CASE("Image views convert crops and match the legacy converter", "[camera][conversions]")
+{
+    const size_t w = 32, h = 24;
+    uint8_t *rgb = malloc(w * h * 3);
+    uint8_t *rgb565 = malloc(w * h * 2);
+    uint8_t *legacy = malloc(w * h * 3);
+    uint8_t *back = malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(rgb565);
+    TEST_ASSERT_NOT_NULL(legacy);
+    TEST_ASSERT_NOT_NULL(back);
+    fill_rgb888(rgb, w, h, w * 3);
+
+    img_view_t src, mid, dst;
+    TEST_ESP_OK(img_view_init(&src, rgb, w * h * 3, w, h, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_view_init(&mid, rgb565, w * h * 2, w, h, 0, PIXFORMAT_RGB565));
+    TEST_ESP_OK(img_convert(&src, &mid));
+    TEST_ASSERT_TRUE(fmt2rgb888(rgb565, w * h * 2, PIXFORMAT_RGB565, legacy));
+    TEST_ESP_OK(img_view_init(&dst, back, w * h * 3, w, h, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_convert(&mid, &dst));
+    TEST_ASSERT_EQUAL_MEMORY(legacy, back, w * h * 3);
+
+    // a crop lands in the middle of a padded canvas, the rest stays untouched
+    memset(back, GUARD, w * h * 3);
+    img_view_t canvas, src_crop, dst_crop;
+    TEST_ESP_OK(img_view_init(&canvas, back, w * h * 3, w, h, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_view_crop(&mid, 4, 2, 10, 6, &src_crop));
+    TEST_ESP_OK(img_view_crop(&canvas, 20, 10, 10, 6, &dst_crop));
+    TEST_ESP_OK(img_convert(&src_crop, &dst_crop));
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+            const uint8_t *p = &back[(y * w + x) * 3];
+            if (x >= 20 && x < 30 && y >= 10 && y < 16) {
+                TEST_ASSERT_EQUAL_MEMORY(&legacy[((y - 8) * w + x - 16) * 3], p, 3);
+            } else {
+                TEST_ASSERT_TRUE(all_bytes(p, 3, GUARD));
+            }
+        }
+    }
+
+    TEST_ESP_OK(img_view_init(&dst, back, w * h * 3, w, h - 1, 0, PIXFORMAT_RGB888));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_convert(&src, &dst));
+
+    free(back);
+    free(legacy);
+    free(rgb565);
+    free(rgb);
+}
+
+TEST_CASE("Image views convert in place", "[camera][conversions]")
+{
+    const size_t w = 16, h = 8;
+    uint8_t buf[16 * 8 * 3];
+    uint8_t ref[16 * 8];
+    fill_rgb888(buf, w, h, w * 3);
+
+    img_view_t rgb, gray, ref_view;
+    TEST_ESP_OK(img_view_init(&rgb, buf, sizeof(buf), w, h, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_view_init(&ref_view, ref, sizeof(ref), w, h, 0, PIXFORMAT_GRAYSCALE));
+    TEST_ESP_OK(img_convert(&rgb, &ref_view));
+
+    // growing pixels would overwrite what is still to be read
+    TEST_ESP_OK(img_view_init(&gray, buf, sizeof(buf), w, h, 0, PIXFORMAT_GRAYSCALE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, img_convert(&gray, &rgb));
+
+    // same memory, keeping the stride, then packed
+    TEST_ESP_OK(img_view_init(&gray, buf, sizeof(buf), w, h, w * 3, PIXFORMAT_GRAYSCALE));
+    TEST_ESP_OK(img_convert(&rgb, &gray));
+    for (size_t y = 0; y < h; y++) {
+        TEST_ASSERT_EQUAL_MEMORY(&ref[y * w], &buf[y * w * 3], w);
+    }
+    img_view_t packed;
+    TEST_ESP_OK(img_view_init(&packed, buf, sizeof(buf), w, h, 0, PIXFORMAT_GRAYSCALE));
+    TEST_ESP_OK(img_convert(&gray, &packed));
+    TEST_ASSERT_EQUAL_MEMORY(ref, buf, w * h);
+}
+
+TEST_CASE("Image views encode JPEG into bounded buffers", "[camera][conversions]")
+{
+    const size_t w = 64, h = 48;
+    uint8_t *rgb = malloc(w * h * 3);
+    uint8_t *out = malloc(16 * 1024);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(out);
+    fill_rgb888(rgb, w, h, w * 3);
+
+    img_view_t view, crop;
+    TEST_ESP_OK(img_view_init(&view, rgb, w * h * 3, w, h, 0, PIXFORMAT_RGB888));
+    TEST_ESP_OK(img_view_crop(&view, 8, 8, 40, 24, &crop));
+
+    size_t work_size = img_jpeg_work_size(crop.width, crop.format);
+    TEST_ASSERT_GREATER_THAN(0, work_size);
+    uint8_t *work = malloc(work_size);
+    TEST_ASSERT_NOT_NULL(work);
+
+    size_t len = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_encode_jpeg(&crop, 80, work, work_size - 1, out, 16 * 1024, &len));
+    TEST_ESP_OK(img_encode_jpeg(&crop, 80, work, work_size, out, 16 * 1024, &len));
+
+    jpeg_scan_info_t info;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_OK, jpeg_scan_validate(out, len, &info));
+    TEST_ASSERT_EQUAL(40, info.width);
+    TEST_ASSERT_EQUAL(24, info.height);
+
+    // an output buffer one byte short fails instead of truncating the image
+    memset(out + len - 1, GUARD, 2);
+    size_t short_len = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_encode_jpeg(&crop, 80, work, work_size, out, len - 1, &short_len));
+    TEST_ASSERT_EQUAL(GUARD, out[len - 1]);
+
+    free(work);
+    free(out);
+    free(rgb);
+}
+
+TEST_CASE("Image views decode JPEG into padded rows", "[camera][conversions]")
+{
+    const size_t w = 32, h = 16;
+    uint8_t gray[32 * 16];
+    for (size_t i = 0; i < sizeof(gray); i++) {
+        gray[i] = 128;
+    }
+    img_view_t src;
+    TEST_ESP_OK(img_view_init(&src, gray, sizeof(gray), w, h, 0, PIXFORMAT_GRAYSCALE));
+    uint8_t *work = malloc(img_jpeg_work_size(w, src.format));
+    uint8_t jpeg[4096];
+    size_t len = 0;
+    TEST_ASSERT_NOT_NULL(work);
+    TEST_ESP_OK(img_encode_jpeg(&src, 90, work, img_jpeg_work_size(w, src.format), jpeg, sizeof(jpeg), &len));
+    free(work);
+
+    size_t jw, jh;
+    TEST_ESP_OK(img_jpeg_info(jpeg, len, JPEG_IMAGE_SCALE_0, &jw, &jh));
+    TEST_ASSERT_EQUAL(w, jw);
+    TEST_ASSERT_EQUAL(h, jh);
+
+    // decode into padded rows, then place the image at (8, 4) of a 48x24 canvas
+    uint16_t padded[40 * 16];
+    img_view_t decoded;
+    TEST_ESP_OK(img_view_init(&decoded, padded, sizeof(padded), w, h, 40 * 2, PIXFORMAT_RGB565));
+    TEST_ESP_OK(img_decode_jpeg(jpeg, len, JPEG_IMAGE_SCALE_0, &decoded));
+
+    const size_t cw = 48, ch = 24;
+    uint16_t canvas[48 * 24];
+    memset(canvas, GUARD, sizeof(canvas));
+    img_view_t full, dst;
+    TEST_ESP_OK(img_view_init(&full, canvas, sizeof(canvas), cw, ch, 0, PIXFORMAT_RGB565));
+    TEST_ESP_OK(img_view_crop(&full, 8, 4, w, h, &dst));
+    TEST_ESP_OK(img_convert(&decoded, &dst));
+
+    for (size_t y = 0; y < ch; y++) {
+        for (size_t x = 0; x < cw; x++) {
+            const uint8_t *p = (const uint8_t *)&canvas[y * cw + x];
+            if (x >= 8 && x < 8 + w && y >= 4 && y < 4 + h) {
+                // mid gray, whatever the byte order
+                TEST_ASSERT_FALSE(all_bytes(p, 2, GUARD));
+                uint8_t g6 = (p[0] & 0x07) << 3 | p[1] >> 5;
+                uint8_t g6_swapped = (p[1] & 0x07) << 3 | p[0] >> 5;
+                TEST_ASSERT_TRUE(abs(g6 - 32) <= 2 || abs(g6_swapped - 32) <= 2);
+            } else {
+                TEST_ASSERT_TRUE(all_bytes(p, 2, GUARD));
+            }
+        }
+    }
+
+    img_view_t small;
+    TEST_ESP_OK(img_view_crop(&full, 0, 0, w - 2, h, &small));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_decode_jpeg(jpeg, len, JPEG_IMAGE_SCALE_0, &small));
+}
+
+TEST_CASE("Image views encode BMP with padded rows", "[camera][conversions]")
+{
+    const size_t w = 5, h = 3;
+    uint8_t rgb[5 * 3 * 3];
+    fill_rgb888(rgb, w, h, w * 3);
+    img_view_t view;
+    TEST_ESP_OK(img_view_init(&view, rgb, sizeof(rgb), w, h, 0, PIXFORMAT_RGB888));
+
+    size_t size = img_bmp_size(w, h, PIXFORMAT_RGB888);
+    TEST_ASSERT_EQUAL(54 + 16 * 3, size);
+    uint8_t out[54 + 16 * 3];
+    size_t len = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, img_encode_bmp(&view, out, size - 1, &len));
+    TEST_ESP_OK(img_encode_bmp(&view, out, sizeof(out), &len));
+    TEST_ASSERT_EQUAL(size, len);
+    TEST_ASSERT_EQUAL('B', out[0]);
+    TEST_ASSERT_EQUAL('M', out[1]);
+    for (size_t y = 0; y < h; y++) {
+        TEST_ASSERT_EQUAL_MEMORY(&rgb[y * w * 3], &out[54 + y * 16], w * 3);
+        TEST_ASSERT_TRUE(all_bytes(&out[54 + y * 16 + w * 3], 1, 0));
+    }
+
+    // the legacy wrapper produces the same file
+    uint8_t *legacy = NULL;
+    size_t legacy_len = 0;
+    TEST_ASSERT_TRUE(fmt2bmp(rgb, sizeof(rgb), w, h, PIXFORMAT_RGB888, &legacy, &legacy_len));
+    TEST_ASSERT_EQUAL(len, legacy_len);
+    TEST_ASSERT_EQUAL_MEMORY(out, legacy, len);
+    free(legacy);
+}
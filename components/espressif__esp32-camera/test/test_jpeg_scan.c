@@ -0,0 +1,376 @@
+#include "sdkconfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "jpeg_scan.h"
+
+/* Byte-wise scanners the driver used before, kept as the reference */
+static int ref_soi(const uint8_t *buf, size_t len)
+{
+    static const uint8_t soi[] = {0xFF, 0xD8, 0xFF};
+    for (size_t i = 0; i + sizeof(soi) <= len; i++) {
+        if (memcmp(&buf[i], soi, sizeof(soi)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int ref_eoi(const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i + 2 <= len; i++) {
+        if (buf[i] == 0xFF && buf[i + 1] == 0xD9) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int ref_eoi_last(const uint8_t *buf, size_t len)
+{
+    for (size_t i = len; i >= 2; i--) {
+        if (buf[i - 2] == 0xFF && buf[i - 1] == 0xD9) {
+            return i - 2;
+        }
+    }
+    return -1;
+}
+
+static int ref_marker(const uint8_t *buf, size_t len, size_t from, uint8_t *marker)
+{
+    for (size_t i = from; i + 1 < len; i++) {
+        if (buf[i] == 0xFF && buf[i + 1] != 0x00 && buf[i + 1] != 0xFF) {
+            *marker = buf[i + 1];
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Random bytes with markers and runs of 0xFF planted at random places */
+static void fill_random(uint8_t *buf, size_t len)
+{
+    static const uint8_t codes[] = {0x00, 0xD8, 0xD9, 0xFF, 0xC4, 0xDA, 0xD0};
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = rng() & 0xFF;
+    }
+    size_t plants = len / 16 + 1;
+    for (size_t n = 0; n < plants && len >= 2; n++) {
+        size_t pos = rng() % (len - 1);
+        buf[pos] = 0xFF;
+        buf[pos + 1] = codes[rng() % sizeof(codes)];
+    }
+}
+
+TEST_CASE("JPEG marker scanners match the byte-wise reference", "[camera][jpeg]")
+{
+    const size_t max_len = 300;
+    uint8_t *mem = malloc(max_len + 16);
+    TEST_ASSERT_NOT_NULL(mem);
+
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t len = rng() % max_len;
+        uint8_t *buf = mem + rng() % 16;    // every alignment
+        fill_random(buf, len);
+
+        TEST_ASSERT_EQUAL(ref_soi(buf, len), jpeg_scan_soi(buf, len));
+        TEST_ASSERT_EQUAL(ref_eoi(buf, len), jpeg_scan_eoi(buf, len));
+        TEST_ASSERT_EQUAL(ref_eoi_last(buf, len), jpeg_scan_eoi_last(buf, len));
+
+        size_t from = len ? rng() % len : 0;
+        uint8_t ref_code = 0, code = 0;
+        int ref_pos = ref_marker(buf, len, from, &ref_code);
+        TEST_ASSERT_EQUAL(ref_pos, jpeg_scan_marker(buf, len, from, &code));
+        if (ref_pos >= 0) {
+            TEST_ASSERT_EQUAL(ref_code, code);
+        }
+    }
+    free(mem);
+}
+
+TEST_CASE("JPEG marker scanners handle edges", "[camera][jpeg]")
+{
+    const uint8_t soi[] = {0xFF, 0xD8, 0xFF};
+    TEST_ASSERT_EQUAL(0, jpeg_scan_soi(soi, 3));
+    TEST_ASSERT_EQUAL(-1, jpeg_scan_soi(soi, 2));
+
+    const uint8_t eoi[] = {0x12, 0xFF, 0xD9};
+    TEST_ASSERT_EQUAL(1, jpeg_scan_eoi(eoi, 3));
+    TEST_ASSERT_EQUAL(1, jpeg_scan_eoi_last(eoi, 3));
+    TEST_ASSERT_EQUAL(-1, jpeg_scan_eoi(eoi, 2));
+    TEST_ASSERT_EQUAL(-1, jpeg_scan_eoi_last(NULL, 0));
+
+    // stuffing and fill bytes are not markers, the last fill byte starts one
+    const uint8_t walk[] = {0xFF, 0x00, 0x11, 0xFF, 0xFF, 0xFF, 0xD0, 0x22};
+    uint8_t code = 0;
+    TEST_ASSERT_EQUAL(5, jpeg_scan_marker(walk, sizeof(walk), 0, &code));
+    TEST_ASSERT_EQUAL(0xD0, code);
+    TEST_ASSERT_EQUAL(-1, jpeg_scan_marker(walk, sizeof(walk), 6, &code));
+}
+
+TEST_CASE("JPEG marker scanner performance", "[camera][jpeg]")
+{
+    const size_t len = 64 * 1024;
+    const int rounds = 20;
+    uint8_t *buf = malloc(len);
+    TEST_ASSERT_NOT_NULL(buf);
+    // entropy coded data: 0xFF is always stuffed, the EOI sits at the end
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = rng() & 0xFF;
+        if (buf[i] == 0xFF) {
+            buf[i] = 0x7F;
+        }
+    }
+    buf[len - 2] = 0xFF;
+    buf[len - 1] = 0xD9;
+    buf[len / 2] = 0xFF;
+    buf[len / 2 + 1] = 0x00;
+
+    volatile int sink = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        sink += ref_eoi(buf, len) + ref_soi(buf, len);
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        sink += jpeg_scan_eoi(buf, len) + jpeg_scan_soi(buf, len);
+    }
+    int64_t t2 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        sink += ref_eoi_last(buf + 1, len - 2);
+    }
+    int64_t t3 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        sink += jpeg_scan_eoi_last(buf + 1, len - 2);
+    }
+    int64_t t4 = esp_timer_get_time();
+    (void)sink;
+
+    double mb = (double)len * 2 * rounds / (1024 * 1024);
+    double mb_last = (double)len * rounds / (1024 * 1024);
+    printf("forward SOI+EOI: %.1f MB/s byte-wise, %.1f MB/s word-wise\n",
+           mb * 1e6 / (t1 - t0), mb * 1e6 / (t2 - t1));
+    printf("backward EOI: %.1f MB/s byte-wise, %.1f MB/s word-wise\n",
+           mb_last * 1e6 / (t3 - t2), mb_last * 1e6 / (t4 - t3));
+    TEST_ASSERT_LESS_THAN(t1 - t0, t2 - t1);
+    TEST_ASSERT_LESS_THAN(t3 - t2, t4 - t3);
+    free(buf);
+}
+
+/* Baseline JPEG skeleton: tables and headers are well formed, the entropy
+ * coded data is random with every 0xFF stuffed and restart markers every
+ * 1 KiB. Returns the length. */
+static size_t build_jpeg(uint8_t *buf, size_t data_len)
+{
+    size_t n = 0;
+    const uint8_t soi[] = {0xFF, 0xD8};
+    memcpy(&buf[n], soi, sizeof(soi));
+    n += sizeof(soi);
+
+    const uint8_t app0[] = {0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    memcpy(&buf[n], app0, sizeof(app0));
+    n += sizeof(app0);
+
+    for (int t = 0; t < 2; t++) {
+        const uint8_t dqt[] = {0xFF, 0xDB, 0x00, 0x43, t};
+        memcpy(&buf[n], dqt, sizeof(dqt));
+        n += sizeof(dqt);
+        memset(&buf[n], 16, 64);
+        n += 64;
+    }
+
+    const uint8_t sof[] = {0xFF, 0xC0, 0x00, 0x11, 8, 0x01, 0xE0, 0x02, 0x80, 3,
+                           1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1
+                          };
+    memcpy(&buf[n], sof, sizeof(sof));
+    n += sizeof(sof);
+
+    const uint8_t dri[] = {0xFF, 0xDD, 0x00, 0x04, 0x00, 0x10};
+    memcpy(&buf[n], dri, sizeof(dri));
+    n += sizeof(dri);
+
+    // one DC table with 12 symbols of length 9
+    const uint8_t dht[] = {0xFF, 0xC4, 0x00, 0x1F, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 12, 0, 0, 0, 0, 0, 0, 0,
+                           0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+                          };
+    memcpy(&buf[n], dht, sizeof(dht));
+    n += sizeof(dht);
+
+    const uint8_t sos[] = {0xFF, 0xDA, 0x00, 0x0C, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    memcpy(&buf[n], sos, sizeof(sos));
+    n += sizeof(sos);
+
+    int rst = 0;
+    for (size_t i = 0; i < data_len; i++) {
+        uint8_t b = rng() & 0xFF;
+        buf[n++] = b;
+        if (b == 0xFF) {
+            buf[n++] = 0x00;
+        }
+        if (i % 1024 == 1023) {
+            buf[n++] = 0xFF;
+            buf[n++] = 0xD0 + rst;
+            rst = (rst + 1) & 7;
+        }
+    }
+    buf[n++] = 0xFF;
+    buf[n++] = 0xD9;
+    return n;
+}
+
+TEST_CASE("JPEG validator accepts well formed frames", "[camera][jpeg]")
+{
+    uint8_t *buf = malloc(24 * 1024);
+    TEST_ASSERT_NOT_NULL(buf);
+    size_t len = build_jpeg(buf, 16 * 1024);
+
+    jpeg_scan_info_t info;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_OK, jpeg_scan_validate(buf, len, &info));
+    TEST_ASSERT_EQUAL(640, info.width);
+    TEST_ASSERT_EQUAL(480, info.height);
+    TEST_ASSERT_EQUAL(3, info.components);
+    TEST_ASSERT_EQUAL(1, info.scans);
+    TEST_ASSERT_EQUAL(len, info.length);
+
+    // DMA padding after EOI is not part of the image
+    memset(&buf[len], 0, 32);
+    TEST_ASSERT_EQUAL(JPEG_SCAN_OK, jpeg_scan_validate(buf, len + 32, &info));
+    TEST_ASSERT_EQUAL(len, info.length);
+    free(buf);
+}
+
+TEST_CASE("JPEG validator flags broken frames", "[camera][jpeg]")
+{
+    uint8_t *buf = malloc(24 * 1024);
+    uint8_t *bad = malloc(24 * 1024);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_NOT_NULL(bad);
+    size_t len = build_jpeg(buf, 4 * 1024);
+    uint8_t code;
+    int sos = jpeg_scan_marker(buf, len, 2, &code);
+    while (code != 0xDA) {
+        sos = jpeg_scan_marker(buf, len, sos + 2, &code);
+    }
+    size_t data = sos + 14;
+    jpeg_scan_info_t info;
+
+    memcpy(bad, buf, len);
+    bad[0] = 0x00;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_NO_SOI, jpeg_scan_validate(bad, len, NULL));
+
+    // cut anywhere: inside a header, inside the data, or before EOI
+    size_t cuts[] = {3, 10, sos + 5, data + 100, len - 1};
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_TRUNCATED, jpeg_scan_validate(buf, cuts[i], NULL));
+    }
+
+    // 0xFF followed by a reserved code in the entropy coded data
+    memcpy(bad, buf, len);
+    bad[data + 200] = 0xFF;
+    bad[data + 201] = 0x23;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_STUFFING, jpeg_scan_validate(bad, len, &info));
+    TEST_ASSERT_EQUAL(data + 200, info.error_offset);
+
+    // a lost restart marker
+    memcpy(bad, buf, len);
+    int rst = jpeg_scan_marker(bad, len, data, &code);
+    TEST_ASSERT_EQUAL(0xD0, code);
+    bad[rst + 1] = 0xD3;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_RESTART, jpeg_scan_validate(bad, len, NULL));
+
+    // quantization table length off by one
+    memcpy(bad, buf, len);
+    int dqt = jpeg_scan_marker(bad, len, 2, &code);
+    while (code != 0xDB) {
+        dqt = jpeg_scan_marker(bad, len, dqt + 2, &code);
+    }
+    bad[dqt + 3] = 0x42;
+    TEST_ASSERT_NOT_EQUAL(JPEG_SCAN_OK, jpeg_scan_validate(bad, len, NULL));
+
+    // no frame header before the scan
+    memcpy(bad, buf, len);
+    int sof = jpeg_scan_marker(bad, len, 2, &code);
+    while (code != 0xC0) {
+        sof = jpeg_scan_marker(bad, len, sof + 2, &code);
+    }
+    bad[sof + 1] = 0xFE;    // now a comment
+    TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_MISSING, jpeg_scan_validate(bad, len, NULL));
+
+    // arithmetic coding is not produced by any supported sensor
+    bad[sof + 1] = 0xC9;
+    TEST_ASSERT_EQUAL(JPEG_SCAN_ERR_UNSUPPORTED, jpeg_scan_validate(bad, len, NULL));
+
+    // random damage must never read past the buffer or pass as valid EOI-less data
+    for (int iter = 0; iter < 2000; iter++) {
+        memcpy(bad, buf, len);
+        size_t cut = 1 + rng() % (len - 1);
+        for (int k = 0; k < 4; k++) {
+            bad[rng() % cut] = rng() & 0xFF;
+        }
+        jpeg_scan_result_t result = jpeg_scan_validate(bad, cut, &info);
+        TEST_ASSERT_LESS_THAN(JPEG_SCAN_ERR_MAX, result);
+        if (result == JPEG_SCAN_OK) {
+            TEST_ASSERT_LESS_OR_EQUAL(cut, info.length);
+        }
+    }
+    free(bad);
+    free(buf);
+}
+
+TEST_CASE("JPEG validator performance", "[camera][jpeg]")
+{
+    const int rounds = 50;
+    uint8_t *buf = malloc(80 * 1024);
+    TEST_ASSERT_NOT_NULL(buf);
+    size_t len = build_jpeg(buf, 60 * 1024);
+
+    volatile int sink = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < rounds; r++) {
+        sink += jpeg_scan_validate(buf, len, NULL);
+    }
+    int64_t t1 = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, sink);
+
+    double us = (double)(t1 - t0) / rounds;
+    printf("validate %u byte frame: %.0f us, %.1f MB/s, %.0f frames/s\n",
+           (unsigned)len, us, len / us, 1e6 / us);
+    // inline in the capture path, far below a 30 fps frame period
+    TEST_ASSERT_LESS_THAN(33333 / 4, (int)us);
+    free(buf);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+TEST_CASE("JPEG validator accepts the sensor test pictures", "[camera][jpeg]")
+{
+    static const char *const names[] = {"testimg.jpeg", "test_inside.jpeg", "test_outside.jpeg"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", SIM_PICTURES_DIR, names[i]);
+        FILE *f = fopen(path, "rb");
+        TEST_ASSERT_NOT_NULL(f);
+        static uint8_t buf[128 * 1024];
+        size_t len = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+
+        jpeg_scan_info_t info;
+        TEST_ASSERT_EQUAL_MESSAGE(JPEG_SCAN_OK, jpeg_scan_validate(buf, len, &info), names[i]);
+        TEST_ASSERT_GREATER_THAN(0, info.width);
+        printf("%s: %ux%u, %u components\n", names[i], info.width, info.height, info.components);
+    }
+}
+#endif // CONFIG_IDF_TARGET_LINUX
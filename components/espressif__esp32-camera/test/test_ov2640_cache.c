@@ -0,0 +1,196 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+/* OV2640 registers used below, see sensors/private_include/ov2640_regs.h */
+#define SIM_BANK_DSP    0
+#define SIM_BANK_SENSOR 1
+#define REG_QS          0x44
+#define REG_ZMOW        0x5A
+#define REG_GAIN        0x00
+#define REG_AEC         0x10
+#define REG_UNUSED      0x20    /* DSP bank, not written by the driver */
+
+static sensor_t *sim_camera_init(void)
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    TEST_ESP_OK(esp_camera_sim_set_config(&sim));
+
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .pin_xclk = -1,
+        .pin_sccb_sda = 0,
+        .pin_sccb_scl = 0,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_QVGA,
+        .jpeg_quality = 12,
+        .fb_count = 1,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    };
+    TEST_ESP_OK(esp_camera_init(&config));
+    sensor_t *s = esp_camera_sensor_get();
+    TEST_ASSERT_NOT_NULL(s);
+    return s;
+}
+
+static esp_camera_sim_sccb_stats_t sccb_stats(void)
+{
+    esp_camera_sim_sccb_stats_t stats;
+    esp_camera_sim_get_sccb_stats(&stats);
+    return stats;
+}
+
+TEST_CASE("OV2640 register cache skips redundant writes", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0, s->set_quality(s, 20));
+    TEST_ASSERT_GREATER_OR_EQUAL(1, sccb_stats().writes);
+    TEST_ASSERT_EQUAL(20, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_QS));
+
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0, s->set_quality(s, 20));
+    TEST_ASSERT_EQUAL(0, sccb_stats().writes);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 register cache serves reads locally", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+
+    TEST_ASSERT_EQUAL(0, s->set_quality(s, 30));
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(30, s->get_reg(s, (SIM_BANK_DSP << 8) | REG_QS, 0xFF));
+    TEST_ASSERT_EQUAL(30, s->get_reg(s, (SIM_BANK_DSP << 8) | REG_QS, 0xFF));
+    TEST_ASSERT_EQUAL(0, sccb_stats().reads);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 register cache bypasses sensor updated registers", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+
+    // AGC writes the gain register on its own
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, REG_GAIN, 0x33);
+    TEST_ASSERT_EQUAL(0x33, s->get_reg(s, (SIM_BANK_SENSOR << 8) | REG_GAIN, 0xFF));
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, REG_GAIN, 0x44);
+    TEST_ASSERT_EQUAL(0x44, s->get_reg(s, (SIM_BANK_SENSOR << 8) | REG_GAIN, 0xFF));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 register cache keeps nothing from a failed read", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+    const int reg = (SIM_BANK_DSP << 8) | REG_UNUSED;
+
+    esp_camera_sim_poke_reg(SIM_BANK_DSP, REG_UNUSED, 0x5A);
+    esp_camera_sim_fail_sccb_reads(1);
+    TEST_ASSERT_LESS_THAN(0, s->get_reg(s, reg, 0xFF));
+
+    // the next read goes to the bus again instead of returning 0xFF
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0x5A, s->get_reg(s, reg, 0xFF));
+    TEST_ASSERT_EQUAL(1, sccb_stats().reads);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 read-modify-write stops on a failed read", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+    const int reg = (SIM_BANK_DSP << 8) | REG_UNUSED;
+
+    esp_camera_sim_poke_reg(SIM_BANK_DSP, REG_UNUSED, 0x50);
+    esp_camera_sim_fail_sccb_reads(1);
+    TEST_ASSERT_NOT_EQUAL(0, s->set_reg(s, reg, 0x0F, 0x05));
+    TEST_ASSERT_EQUAL(0x50, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_UNUSED));
+
+    TEST_ASSERT_EQUAL(0, s->set_reg(s, reg, 0x0F, 0x05));
+    TEST_ASSERT_EQUAL(0x55, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_UNUSED));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 register cache is dropped on sensor reset", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+
+    TEST_ASSERT_EQUAL(0, s->set_quality(s, 20));
+    TEST_ASSERT_EQUAL(0, s->reset(s));
+    TEST_ASSERT_NOT_EQUAL(20, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_QS));
+
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0, s->set_quality(s, 20));
+    TEST_ASSERT_GREATER_OR_EQUAL(1, sccb_stats().writes);
+    TEST_ASSERT_EQUAL(20, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_QS));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 AE state round trip touches only exposure and gain", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+    TEST_ASSERT_NOT_NULL(s->get_ae_state);
+
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, REG_GAIN, 0x21);
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, REG_AEC, 0x80);
+    camera_ae_state_t ae;
+    TEST_ASSERT_EQUAL(0, s->get_ae_state(s, &ae));
+    TEST_ASSERT_EQUAL(0x21, ae.agc_gain);
+    TEST_ASSERT_EQUAL(0x80 << 2, ae.aec_value & 0x3FC);
+
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, REG_GAIN, 0x00);
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, 0x01, 0x11);
+    esp_camera_sim_poke_reg(SIM_BANK_SENSOR, 0x02, 0x22);
+    TEST_ASSERT_EQUAL(0, s->set_ae_state(s, &ae));
+    TEST_ASSERT_EQUAL(0x21, esp_camera_sim_peek_reg(SIM_BANK_SENSOR, REG_GAIN));
+    TEST_ASSERT_EQUAL(0x11, esp_camera_sim_peek_reg(SIM_BANK_SENSOR, 0x01));
+    TEST_ASSERT_EQUAL(0x22, esp_camera_sim_peek_reg(SIM_BANK_SENSOR, 0x02));
+
+    // a read the sensor does not answer is an error, not a state
+    esp_camera_sim_fail_sccb_reads(1);
+    TEST_ASSERT_NOT_EQUAL(0, s->get_ae_state(s, &ae));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 mode switch SCCB traffic", "[camera][sim]")
+{
+    sensor_t *s = sim_camera_init();
+
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0, s->set_framesize(s, FRAMESIZE_VGA));
+    esp_camera_sim_sccb_stats_t to_vga = sccb_stats();
+    TEST_ASSERT_EQUAL((640 / 4) & 0xFF, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOW));
+
+    TEST_ASSERT_EQUAL(0, s->set_framesize(s, FRAMESIZE_QVGA));
+    esp_camera_sim_reset_sccb_stats();
+    TEST_ASSERT_EQUAL(0, s->set_framesize(s, FRAMESIZE_QVGA));
+    esp_camera_sim_sccb_stats_t same = sccb_stats();
+    TEST_ASSERT_EQUAL((320 / 4) & 0xFF, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOW));
+
+    printf("mode switch: %u writes (%u values), %u reads; repeated: %u writes, %u reads\n",
+           (unsigned) to_vga.writes, (unsigned) to_vga.bytes_written, (unsigned) to_vga.reads,
+           (unsigned) same.writes, (unsigned) same.reads);
+    TEST_ASSERT_LESS_THAN(to_vga.writes, same.writes);
+    TEST_ASSERT_EQUAL(0, same.reads);
+
+    esp_camera_deinit();
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
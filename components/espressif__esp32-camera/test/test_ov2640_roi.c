@@ -0,0 +1,86 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+/* OV2640 DSP registers used below, see sensors/private_include/ov2640_regs.h */
+#define SIM_BANK_DSP    0
+#define REG_HSIZE       0x51
+#define REG_VSIZE       0x52
+#define REG_ZMOW        0x5A
+#define REG_ZMOH        0x5B
+
+static esp_err_t sim_camera_init_roi(const camera_roi_t *roi)
+{
+    esp_camera_sim_config_t sim = ESP_CAMERA_SIM_CONFIG_DEFAULT();
+    sim.source = SIM_PICTURES_DIR;
+    TEST_ESP_OK(esp_camera_sim_set_config(&sim));
+
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .pin_xclk = -1,
+        .pin_sccb_sda = 0,
+        .pin_sccb_scl = 0,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_VGA,
+        .jpeg_quality = 12,
+        .fb_count = 1,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+        .roi = *roi,
+    };
+    return esp_camera_init(&config);
+}
+
+TEST_CASE("OV2640 native region of interest", "[camera][sim]")
+{
+    camera_roi_t roi = { .x = 640, .y = 480, .width = 320, .height = 240 };
+    TEST_ESP_OK(sim_camera_init_roi(&roi));
+
+    // UXGA mode, the window is cropped without scaling
+    TEST_ASSERT_EQUAL(320 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_HSIZE));
+    TEST_ASSERT_EQUAL(240 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_VSIZE));
+    TEST_ASSERT_EQUAL(320 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOW));
+    TEST_ASSERT_EQUAL(240 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOH));
+
+    camera_fb_t *fb = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(fb);
+    TEST_ASSERT_EQUAL(320, fb->width);
+    TEST_ASSERT_EQUAL(240, fb->height);
+    esp_camera_fb_return(fb);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 downscaled region of interest", "[camera][sim]")
+{
+    camera_roi_t roi = { .x = 0, .y = 0, .width = 640, .height = 480, .out_width = 160, .out_height = 120 };
+    TEST_ESP_OK(sim_camera_init_roi(&roi));
+
+    // 4x smaller output runs the sensor in CIF mode, a quarter of the window
+    TEST_ASSERT_EQUAL(640 / 4 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_HSIZE));
+    TEST_ASSERT_EQUAL(480 / 4 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_VSIZE));
+    TEST_ASSERT_EQUAL(160 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOW));
+    TEST_ASSERT_EQUAL(120 / 4, esp_camera_sim_peek_reg(SIM_BANK_DSP, REG_ZMOH));
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("OV2640 rejects unaligned JPEG region of interest", "[camera][sim]")
+{
+    camera_roi_t roi = { .x = 0, .y = 0, .width = 400, .height = 300, .out_width = 100, .out_height = 100 };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sim_camera_init_roi(&roi));
+
+    roi = (camera_roi_t) { .x = 1500, .y = 0, .width = 320, .height = 240 };
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, sim_camera_init_roi(&roi));
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
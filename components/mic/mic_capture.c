@@ -1,55 +1,141 @@
 #include "mic_capture.h"
+#include "mic_filter.h"
+#include "mic_flac.h"
+#include "mic_onset.h"
+#include "mic_pcm.h"
+#include "mic_resample.h"
+#include "mic_silence.h"
+#include "mic_spectrum.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <strings.h>
 #include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "button.h"
 #include "driver/i2s_std.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 #include "oled_ssd1306.h"
+#include "storage_io.h"
 
-#define I2S_SAMPLE_RATE_HZ 16000 // Sample rate
+#define I2S_SAMPLE_RATE_HZ 48000 // Capture rate; recordings store it or an integer fraction of it
 #define I2S_BCLK_IO        38 // Bit clock
 #define I2S_WS_IO          39 // Also known as LRCK
 #define I2S_DIN_IO         40 // Microphone data input
+#define MIC_CHANNELS       2  // 1: ICS-43434 (left slot) only, 2: plus the contact mic (right slot)
 #define MIC_GAIN_MULT      4  // Microphone gain multiplier
+#define MIC_CONTACT_GAIN_MULT 4 // Contact mic gain multiplier
+#define MIC_OUTPUT_BITS    24 // Bits per stored sample: 16 (dithered), 24 or 32 (raw I2S slot)
+#define MIC_FILTER_DC_HZ   5  // DC blocker corner; 0 disables
+#define MIC_FILTER_HIGHPASS_HZ 20 // Rumble high-pass, 2nd-order Butterworth; 0 disables
+#define MIC_FILTER_LOWPASS_HZ 0 // Optional low-pass; 0 disables
+#define MIC_FILTER_NOTCH_HZ 0   // Optional notch, e.g. 50 or 60 Hz mains hum; 0 disables
+#define MIC_FILTER_NOTCH_Q 8
+#define MIC_SPECTRUM_FFT_SIZE 0 // 512 or 1024: band energy sidecar (.SPC) per recording; 0 disables
+#define MIC_SPECTRUM_CHANNEL (MIC_CHANNELS - 1) // Analysed channel; the contact mic in stereo
+#define MIC_SILENCE_ELIDE  0  // 1: silent spans are left out of the audio and listed in a .SIL sidecar
+#define MIC_SILENCE_DBFS   -60  // 20 ms RMS, on any channel, that counts as activity
+#define MIC_SILENCE_HANG_MS 700 // Kept after activity
+#define MIC_SILENCE_PRE_MS 300  // Kept ahead of activity, so onsets are not clipped
+#define MIC_ONSET_TRIGGER  0  // 1: an event on MIC_ONSET_CHANNEL starts a recording like a long press
+#define MIC_ONSET_CHANNEL  (MIC_CHANNELS - 1) // Watched channel; the contact mic in stereo
+#define MIC_ONSET_RISE_DB  15   // 10 ms RMS over the noise floor that fires
+#define MIC_ONSET_MIN_DBFS -60  // Never fires below this RMS
+#define MIC_ONSET_HYSTERESIS_DB 6
+#define MIC_ONSET_BAND_LOW_HZ 0 // Optional detector band, e.g. 100-2000 Hz for knocks; 0 disables
+#define MIC_ONSET_BAND_HIGH_HZ 0
+#define MIC_PREROLL_MS     2000 // Audio kept while idle and written ahead of each recording
+#define MIC_BLOCK_SAMPLES  4096 // Samples per channel per pool block and file write; one FLAC frame
+#define MIC_BLOCK_SLOTS    (MIC_BLOCK_SAMPLES * MIC_CHANNELS)
+#define MIC_POOL_SPARE_BLOCKS 12 // Pool blocks beyond the pre-roll, absorbing storage stalls (1 s)
+#define MIC_POOL_MIN_BLOCKS 4   // Whole pool without PSRAM
+#define MIC_DMA_DESC_NUM   8    // I2S DMA buffers
+#define MIC_DMA_FRAME_NUM  480  // Frames per I2S DMA buffer (10 ms); stereo stays under 4092 bytes
+#define MIC_PREROLL_BLOCKS ((I2S_SAMPLE_RATE_HZ * MIC_PREROLL_MS / 1000 + MIC_BLOCK_SAMPLES - 1) / MIC_BLOCK_SAMPLES)
+// The record task holds the writer with its filter state, runs the FLAC
+// encoder (~700 B of frames) and the sidecars, and logs floats through
+// newlib's vfprintf (~1.5 KB)
+#define MIC_RECORD_TASK_STACK 8192
+
+#define WAV_HEADER_BYTES   44
+#define WAV_SIZE_UNKNOWN   0xFFFFFFFFu // Streaming sizes until the recording is closed
 
 static const char *TAG = "mic";
 
 typedef struct {
     char path[128];
     int seconds;
+    uint32_t sample_rate_hz;
 } mic_capture_args_t;
 
+// Raw I2S slots, interleaved for stereo, filled by the receive callback and
+// handed to the mic task by reference; converted in place and written
+// straight from the block.
+typedef struct {
+    int32_t *samples;
+    size_t count;   // Slots
+} mic_block_t;
+
+typedef struct {
+    FILE *f;
+    mic_flac_t *flac;
+    mic_resample_t *resample;  // NULL when storing the capture rate
+    mic_filter_t filter;
+    mic_spectrum_t *spectrum;  // NULL without a sidecar
+    FILE *spectrum_f;
+    mic_silence_t *silence;    // NULL unless eliding silence
+    FILE *silence_f;
+    bool paused;
+    size_t frames;             // Stored frames
+    uint32_t dither_state;
+    mic_pcm_level_t levels[MIC_CHANNELS];
+    int64_t process_us;
+    int64_t filter_us;
+    uint32_t filter_us_max;
+    uint32_t filter_blocks;
+} mic_writer_t;
+
 static TaskHandle_t s_mic_task = NULL;
+static mic_capture_args_t *s_mic_request = NULL;
 static volatile bool s_mic_running = false;
 static volatile int s_mic_last_seconds = 0;
 static volatile esp_err_t s_mic_last_result = ESP_OK;
-
-// Applies software gain with clipping.
-static int32_t s_apply_gain(int32_t sample)
-{
-#if MIC_GAIN_MULT > 1
-    int64_t v = (int64_t)sample * MIC_GAIN_MULT;
-    if (v > INT32_MAX) {
-        return INT32_MAX;
-    }
-    if (v < INT32_MIN) {
-        return INT32_MIN;
-    }
-    return (int32_t)v;
-#else
-    return sample;
+static i2s_chan_handle_t s_rx_handle = NULL;
+static QueueHandle_t s_free_blocks = NULL;
+static QueueHandle_t s_full_blocks = NULL;
+static mic_block_t *s_isr_block = NULL;  // Being filled by the receive callback
+static portMUX_TYPE s_isr_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t s_overrun_samples = 0;
+static volatile uint32_t s_free_blocks_min = UINT32_MAX;
+static mic_block_t *s_preroll[MIC_PREROLL_BLOCKS > 0 ? MIC_PREROLL_BLOCKS : 1];
+static size_t s_preroll_count = 0;
+static size_t s_preroll_max = 0;
+static const int s_gains[2] = {MIC_GAIN_MULT, MIC_CONTACT_GAIN_MULT};
+static float s_peak_dbfs[MIC_CHANNELS];
+static float s_rms_dbfs[MIC_CHANNELS];
+static uint32_t s_filter_us_avg = 0;
+static uint32_t s_filter_us_max = 0;
+static uint32_t s_silence_elided_ms = 0;
+static mic_onset_t *s_onset = NULL;  // Idle-audio trigger, when enabled
+
+#if MIC_OUTPUT_BITS != 32 && (MIC_GAIN_MULT > MIC_PCM_MAX_GAIN || MIC_CONTACT_GAIN_MULT > MIC_PCM_MAX_GAIN)
+#error "MIC_GAIN_MULT too large for 16/24-bit output"
+#endif
+#if MIC_CHANNELS != 1 && MIC_CHANNELS != 2
+#error "MIC_CHANNELS must be 1 or 2"
 #endif
-}
 
 // Logs an info message (and optionally OLED if enabled).
 static void s_log_info(const char *fmt, ...)
@@ -75,24 +161,308 @@ static void s_log_error(const char *fmt, ...)
     oled_ssd1306_display_text(buf);
 }
 
+// Runs in the I2S ISR for every completed DMA buffer: copies it into the
+// current pool block and queues full blocks. With no free block the audio is
+// counted as overrun and dropped.
+static bool s_on_recv(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+    const int32_t *src = (const int32_t *)event->dma_buf;
+    size_t n = event->size / sizeof(int32_t);
+
+    portENTER_CRITICAL_ISR(&s_isr_lock);
+    while (n > 0) {
+        if (s_isr_block == NULL) {
+            if (xQueueReceiveFromISR(s_free_blocks, &s_isr_block, &woken) != pdTRUE) {
+                s_isr_block = NULL;
+                s_overrun_samples += n;
+                break;
+            }
+            const uint32_t free_left = uxQueueMessagesWaitingFromISR(s_free_blocks);
+            if (free_left < s_free_blocks_min) {
+                s_free_blocks_min = free_left;
+            }
+        }
+        mic_block_t *b = s_isr_block;
+        size_t take = MIC_BLOCK_SLOTS - b->count;
+        if (take > n) {
+            take = n;
+        }
+        memcpy(b->samples + b->count, src, take * sizeof(int32_t));
+        b->count += take;
+        src += take;
+        n -= take;
+        if (b->count == MIC_BLOCK_SLOTS) {
+            xQueueSendFromISR(s_full_blocks, &b, &woken);
+            s_isr_block = NULL;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&s_isr_lock);
+    return woken == pdTRUE;
+}
+
+// Allocates the block pool, in PSRAM when there is some; without it there
+// is no pre-roll.
+static esp_err_t s_pool_init(void)
+{
+    size_t pool = MIC_PREROLL_BLOCKS + MIC_POOL_SPARE_BLOCKS;
+    uint32_t caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    s_preroll_max = MIC_PREROLL_BLOCKS;
+    int32_t *mem = (int32_t *)heap_caps_malloc(pool * MIC_BLOCK_SLOTS * sizeof(int32_t), caps);
+    if (mem == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for %d ms pre-roll", MIC_PREROLL_MS);
+        pool = MIC_POOL_MIN_BLOCKS;
+        s_preroll_max = 0;
+        mem = (int32_t *)malloc(pool * MIC_BLOCK_SLOTS * sizeof(int32_t));
+    }
+    mic_block_t *blocks = (mic_block_t *)calloc(pool, sizeof(mic_block_t));
+    s_free_blocks = xQueueCreate(pool, sizeof(mic_block_t *));
+    s_full_blocks = xQueueCreate(pool, sizeof(mic_block_t *));
+    if (mem == NULL || blocks == NULL || s_free_blocks == NULL || s_full_blocks == NULL) {
+        s_log_error("Audio pool alloc failed");
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < pool; ++i) {
+        mic_block_t *b = &blocks[i];
+        b->samples = mem + i * MIC_BLOCK_SLOTS;
+        xQueueSend(s_free_blocks, &b, 0);
+    }
+    return ESP_OK;
+}
+
+// Sets up the onset trigger on the capture rate; without it, recordings
+// still start from the button or BLE.
+static void s_onset_init(void)
+{
+    const mic_onset_config_t cfg = {
+        .sample_rate_hz = I2S_SAMPLE_RATE_HZ,
+        .channels = MIC_CHANNELS,
+        .channel = MIC_ONSET_CHANNEL,
+        .window_ms = 10,
+        .rise_db = MIC_ONSET_RISE_DB,
+        .min_dbfs = MIC_ONSET_MIN_DBFS,
+        .hysteresis_db = MIC_ONSET_HYSTERESIS_DB,
+        .floor_tau_ms = 2000,
+        .band_low_hz = MIC_ONSET_BAND_LOW_HZ,
+        .band_high_hz = MIC_ONSET_BAND_HIGH_HZ,
+    };
+    s_onset = (mic_onset_t *)malloc(sizeof(*s_onset));
+    esp_err_t ret = s_onset != NULL ? mic_onset_init(s_onset, &cfg) : ESP_ERR_NO_MEM;
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Onset trigger off (%s)", esp_err_to_name(ret));
+        free(s_onset);
+        s_onset = NULL;
+    }
+}
+
+// Creates and enables the I2S channel once; it then runs for good, so the
+// microphone stays powered and settled between recordings.
+static esp_err_t s_channel_open(void)
+{
+    if (s_rx_handle != NULL) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = s_pool_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    i2s_chan_handle_t rx_handle = NULL;
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = MIC_DMA_DESC_NUM;
+    chan_cfg.dma_frame_num = MIC_DMA_FRAME_NUM;
+
+    if (MIC_ONSET_TRIGGER) {
+        s_onset_init();
+    }
+
+    ret = i2s_new_channel(&chan_cfg, NULL, &rx_handle);
+    if (ret != ESP_OK) {
+        s_log_error("I2S channel create (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(I2S_SAMPLE_RATE_HZ),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
+                                                        MIC_CHANNELS == 2 ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = I2S_BCLK_IO,
+            .ws = I2S_WS_IO,
+            .dout = I2S_GPIO_UNUSED,
+            .din = I2S_DIN_IO,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false,
+            },
+        },
+    };
+    // Both slots share one frame clock, so stereo stays sample-synchronous.
+    std_cfg.slot_cfg.slot_mask = MIC_CHANNELS == 2 ? I2S_STD_SLOT_BOTH : I2S_STD_SLOT_LEFT;
+
+    ret = i2s_channel_init_std_mode(rx_handle, &std_cfg);
+    if (ret != ESP_OK) {
+        s_log_error("I2S init std mode (%s)", esp_err_to_name(ret));
+        i2s_del_channel(rx_handle);
+        return ret;
+    }
+
+    const i2s_event_callbacks_t cbs = {
+        .on_recv = s_on_recv,
+    };
+    ret = i2s_channel_register_event_callback(rx_handle, &cbs, NULL);
+    if (ret != ESP_OK) {
+        s_log_error("I2S callback (%s)", esp_err_to_name(ret));
+        i2s_del_channel(rx_handle);
+        return ret;
+    }
+
+    ret = i2s_channel_enable(rx_handle);
+    if (ret != ESP_OK) {
+        s_log_error("I2S enable (%s)", esp_err_to_name(ret));
+        i2s_del_channel(rx_handle);
+        return ret;
+    }
+    s_rx_handle = rx_handle;
+    return ESP_OK;
+}
+
+static void s_block_release(mic_block_t *b)
+{
+    b->count = 0;
+    xQueueSend(s_free_blocks, &b, 0);
+}
+
+// Takes the block the callback is filling, if it holds any samples.
+static mic_block_t *s_take_partial_block(void)
+{
+    portENTER_CRITICAL(&s_isr_lock);
+    mic_block_t *b = s_isr_block;
+    if (b != NULL && b->count > 0) {
+        s_isr_block = NULL;
+    } else {
+        b = NULL;
+    }
+    portEXIT_CRITICAL(&s_isr_lock);
+    return b;
+}
+
+// Runs the onset detector over an idle block and, when it fires, starts a
+// recording the way a long press does. The pre-roll already holds the onset.
+static void s_onset_check(const mic_block_t *b)
+{
+    const int64_t start = esp_timer_get_time();
+    size_t at_frame = 0;
+    if (!mic_onset_process(s_onset, b->samples, b->count, &at_frame) || button_is_recording()) {
+        return;
+    }
+    button_trigger_long_press();
+    // The block arrives with its last frame, so frames after the firing
+    // window add to the delay.
+    const int64_t delay_us = (int64_t)(b->count / MIC_CHANNELS - at_frame) * 1000000 / I2S_SAMPLE_RATE_HZ +
+                             (esp_timer_get_time() - start);
+    const int64_t load = s_onset->frames > 0 ? s_onset->busy_us * I2S_SAMPLE_RATE_HZ / (int64_t)s_onset->frames : 0;
+    ESP_LOGI(TAG, "Onset at %.1f dBFS (floor %.1f), triggered %lld ms later, detector %lld us per s",
+             s_onset->level_db, s_onset->floor_db, (long long)(delay_us / 1000), (long long)load);
+}
+
+// Waits for a full block and keeps it as pre-roll, releasing the oldest.
+static void s_preroll_step(TickType_t wait)
+{
+    mic_block_t *b = NULL;
+    if (xQueueReceive(s_full_blocks, &b, wait) != pdTRUE) {
+        return;
+    }
+    if (s_onset != NULL) {
+        s_onset_check(b);
+    }
+    if (s_preroll_max == 0) {
+        s_block_release(b);
+        return;
+    }
+    if (s_preroll_count == s_preroll_max) {
+        s_block_release(s_preroll[0]);
+        memmove(s_preroll, s_preroll + 1, (s_preroll_count - 1) * sizeof(s_preroll[0]));
+        s_preroll_count--;
+    }
+    s_preroll[s_preroll_count++] = b;
+}
+
 static void s_mic_task_entry(void *arg)
 {
-    mic_capture_args_t *args = (mic_capture_args_t *)arg;
-    int captured_seconds = 0;
-    esp_err_t result = mic_capture_to_file(args->path, args->seconds, &captured_seconds);
-    s_mic_last_seconds = captured_seconds;
-    s_mic_last_result = result;
-    s_mic_running = false;
-    s_mic_task = NULL;
-    free(args);
-    vTaskDelete(NULL);
+    (void)arg;
+    while (true) {
+        mic_capture_args_t *args = __atomic_exchange_n(&s_mic_request, NULL, __ATOMIC_ACQ_REL);
+        if (args == NULL) {
+            // Idle: the pre-roll keeps the latest blocks.
+            s_preroll_step(pdMS_TO_TICKS(50));
+            continue;
+        }
+        int captured_seconds = 0;
+        esp_err_t result = mic_capture_to_file(args->path, args->seconds, args->sample_rate_hz, &captured_seconds);
+        s_mic_last_seconds = captured_seconds;
+        s_mic_last_result = result;
+        free(args);
+        ESP_LOGI(TAG, "Record task stack: %u bytes never used", (unsigned)uxTaskGetStackHighWaterMark(NULL));
+        if (s_onset != NULL) {
+            // The room may have changed while recording; relearn the floor.
+            mic_onset_reset(s_onset);
+        }
+        s_mic_running = false;
+    }
+}
+
+esp_err_t mic_capture_init(void)
+{
+    if (s_mic_task != NULL) {
+        return ESP_OK;
+    }
+    esp_err_t ret = s_channel_open();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (xTaskCreate(s_mic_task_entry, "mic_record", MIC_RECORD_TASK_STACK, NULL, 5, &s_mic_task) != pdPASS) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
-esp_err_t mic_capture_start(const char *path, int seconds)
+void mic_capture_get_stats(mic_capture_stats_t *stats)
+{
+    stats->overrun_samples = s_overrun_samples;
+    stats->free_blocks_min = s_free_blocks_min == UINT32_MAX ? 0 : s_free_blocks_min;
+    stats->channels = MIC_CHANNELS;
+    for (int c = 0; c < MIC_CHANNELS; ++c) {
+        stats->peak_dbfs[c] = s_peak_dbfs[c];
+        stats->rms_dbfs[c] = s_rms_dbfs[c];
+    }
+    stats->filter_us_avg = s_filter_us_avg;
+    stats->filter_us_max = s_filter_us_max;
+    stats->silence_elided_ms = s_silence_elided_ms;
+}
+
+// Stored rates are the capture rate or an integer fraction the decimator takes.
+static bool s_rate_supported(uint32_t sample_rate_hz)
+{
+    return sample_rate_hz > 0 && I2S_SAMPLE_RATE_HZ % sample_rate_hz == 0 &&
+           I2S_SAMPLE_RATE_HZ / sample_rate_hz <= MIC_RESAMPLE_MAX_FACTOR;
+}
+
+esp_err_t mic_capture_start(const char *path, int seconds, uint32_t sample_rate_hz)
 {
     if (s_mic_running) {
         return ESP_ERR_INVALID_STATE;
     }
+    if (!s_rate_supported(sample_rate_hz)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = mic_capture_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     mic_capture_args_t *args = (mic_capture_args_t *)calloc(1, sizeof(*args));
     if (args == NULL) {
@@ -101,15 +471,11 @@ esp_err_t mic_capture_start(const char *path, int seconds)
 
     strlcpy(args->path, path, sizeof(args->path));
     args->seconds = seconds;
+    args->sample_rate_hz = sample_rate_hz;
     s_mic_running = true;
     s_mic_last_seconds = 0;
     s_mic_last_result = ESP_OK;
-
-    if (xTaskCreate(s_mic_task_entry, "mic_record", 4096, args, 5, &s_mic_task) != pdPASS) {
-        s_mic_running = false;
-        free(args);
-        return ESP_FAIL;
-    }
+    __atomic_store_n(&s_mic_request, args, __ATOMIC_RELEASE);
     return ESP_OK;
 }
 
@@ -152,28 +518,25 @@ static void s_write_le32(FILE *f, uint32_t value)
     fwrite(b, 1, sizeof(b), f);
 }
 
-// Checks if the path ends with .wav.
-static bool s_has_wav_extension(const char *path)
+// Checks if the path ends with .ext (case-insensitive).
+static bool s_has_extension(const char *path, const char *ext)
 {
     const char *dot = strrchr(path, '.');
-    if (dot == NULL) {
-        return false;
-    }
-    if (strlen(dot) != 4) {
-        return false;
-    }
-    return (tolower((unsigned char)dot[1]) == 'w' &&
-            tolower((unsigned char)dot[2]) == 'a' &&
-            tolower((unsigned char)dot[3]) == 'v');
+    return dot != NULL && strcasecmp(dot + 1, ext) == 0;
 }
 
-// Writes/updates a PCM WAV header.
+static uint32_t s_read_le32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+// Writes/updates a PCM WAV header; WAV_SIZE_UNKNOWN marks a recording in progress.
 static void s_write_wav_header(FILE *f, uint32_t sample_rate_hz, uint16_t bits_per_sample,
                                uint16_t channels, uint32_t data_bytes)
 {
     const uint32_t byte_rate = sample_rate_hz * channels * (bits_per_sample / 8);
     const uint16_t block_align = channels * (bits_per_sample / 8);
-    const uint32_t riff_size = 36 + data_bytes;
+    const uint32_t riff_size = data_bytes == WAV_SIZE_UNKNOWN ? WAV_SIZE_UNKNOWN : 36 + data_bytes;
 
     fwrite("RIFF", 1, 4, f);
     s_write_le32(f, riff_size);
@@ -190,147 +553,464 @@ static void s_write_wav_header(FILE *f, uint32_t sample_rate_hz, uint16_t bits_p
     s_write_le32(f, data_bytes);
 }
 
-// Captures I2S audio to a file; stops on button or after N seconds.
-esp_err_t mic_capture_to_file(const char *path, int seconds, int *out_seconds)
+// Converts count filtered slots in place and writes them to the file.
+static esp_err_t s_store_samples(mic_writer_t *w, int32_t *samples, size_t count)
+{
+    w->frames += count / MIC_CHANNELS;
+    if (w->flac != NULL) {
+        if (!w->paused) {
+            mic_pcm_scale(samples, count, MIC_CHANNELS, s_gains, MIC_OUTPUT_BITS, &w->dither_state, samples);
+        }
+        if (mic_flac_write(w->flac, samples, count) != ESP_OK) {
+            s_log_error("FLAC write failed");
+            return ESP_FAIL;
+        }
+        return ESP_OK;
+    }
+
+    uint8_t *out = (uint8_t *)samples;
+    size_t out_bytes = count * (MIC_OUTPUT_BITS / 8);
+    if (!w->paused) {
+        // Packs in place; output samples are never wider than the slots.
+        out_bytes = mic_pcm_pack(samples, count, MIC_CHANNELS, s_gains, MIC_OUTPUT_BITS, &w->dither_state, out);
+    }
+    // Storage time is left out of the processing time.
+    const int64_t write_start = esp_timer_get_time();
+    const size_t written = fwrite(out, 1, out_bytes, w->f);
+    w->process_us -= esp_timer_get_time() - write_start;
+    if (written != out_bytes) {
+        s_log_error("Audio write failed (%d)", errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Store for the silence gate, which passes frames up to MIC_SILENCE_PRE_MS
+// late; paused audio is already zero by then, so everything is converted.
+static esp_err_t s_store_gated(void *ctx, int32_t *samples, size_t count)
 {
+    mic_writer_t *w = (mic_writer_t *)ctx;
+    w->paused = false;
+    return s_store_samples(w, samples, count);
+}
+
+// Decimates, filters and converts count raw slots in place and writes them out.
+static esp_err_t s_write_samples(mic_writer_t *w, int32_t *samples, size_t count)
+{
+    const bool paused = button_is_paused();
+    const int64_t start = esp_timer_get_time();
+    if (w->resample != NULL) {
+        // Runs while paused too, so the filter history stays continuous.
+        count = mic_resample_process(w->resample, samples, count);
+        if (count == 0) {
+            w->process_us += esp_timer_get_time() - start;
+            return ESP_OK;
+        }
+    }
+    if (w->filter.stages > 0) {
+        // Also while paused, so the filters are settled when audio resumes.
+        const int64_t filter_start = esp_timer_get_time();
+        mic_filter_process(&w->filter, samples, count);
+        const uint32_t filter_us = (uint32_t)(esp_timer_get_time() - filter_start);
+        w->filter_us += filter_us;
+        w->filter_blocks++;
+        if (filter_us > w->filter_us_max) {
+            w->filter_us_max = filter_us;
+        }
+    }
+    if (paused) {
+        memset(samples, 0, count * sizeof(int32_t));
+    } else {
+        mic_pcm_levels(samples, count, MIC_CHANNELS, w->levels);
+    }
+    if (w->spectrum != NULL && mic_spectrum_write(w->spectrum, samples, count) != ESP_OK) {
+        // The sidecar is optional; the recording carries on without it.
+        ESP_LOGW(TAG, "Spectrum write failed (%d); sidecar stopped", errno);
+        mic_spectrum_end(w->spectrum, NULL);
+        w->spectrum = NULL;
+    }
     esp_err_t ret;
-    i2s_chan_handle_t rx_handle = NULL;
-    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    if (w->silence != NULL) {
+        ret = mic_silence_process(w->silence, samples, count, s_store_gated, w);
+        if (ret != ESP_OK && ferror(w->silence_f)) {
+            s_log_error("Silence marker write failed (%d)", errno);
+        }
+    } else {
+        w->paused = paused;
+        ret = s_store_samples(w, samples, count);
+    }
+    w->process_us += esp_timer_get_time() - start;
+    return ret;
+}
 
-    ret = i2s_new_channel(&chan_cfg, NULL, &rx_handle);
-    if (ret != ESP_OK) {
-        s_log_error("I2S channel create (%s)", esp_err_to_name(ret));
-        return ret;
+// Opens a sidecar next to the audio file: same name, extension ext. High
+// priority like the audio: this task writes both, so a sidecar waiting for a
+// chunk behind the video would hold up the audio too.
+static FILE *s_sidecar_open(const char *path, const char *ext)
+{
+    char sidecar_path[128];
+    const char *dot = strrchr(path, '.');
+    const int base_len = dot != NULL ? (int)(dot - path) : (int)strlen(path);
+    if (snprintf(sidecar_path, sizeof(sidecar_path), "%.*s.%s", base_len, path, ext) >= (int)sizeof(sidecar_path)) {
+        ESP_LOGW(TAG, "Sidecar path too long");
+        return NULL;
     }
+    FILE *f = storage_io_fopen(sidecar_path, STORAGE_IO_PRIO_HIGH);
+    if (f == NULL) {
+        ESP_LOGW(TAG, "Open failed %s (%d)", sidecar_path, errno);
+    }
+    return f;
+}
 
-    i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(I2S_SAMPLE_RATE_HZ),
-        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_MONO),
-        .gpio_cfg = {
-            .mclk = I2S_GPIO_UNUSED,
-            .bclk = I2S_BCLK_IO,
-            .ws = I2S_WS_IO,
-            .dout = I2S_GPIO_UNUSED,
-            .din = I2S_DIN_IO,
-            .invert_flags = {
-                .mclk_inv = false,
-                .bclk_inv = false,
-                .ws_inv = false,
-            },
-        },
+// Opens the spectrum sidecar (.SPC). Failures only cost the sidecar.
+static void s_spectrum_open(mic_writer_t *w, const char *path, uint32_t sample_rate_hz)
+{
+    w->spectrum_f = s_sidecar_open(path, "SPC");
+    if (w->spectrum_f == NULL) {
+        return;
+    }
+    w->spectrum = mic_spectrum_begin(w->spectrum_f, sample_rate_hz, MIC_SPECTRUM_FFT_SIZE, MIC_CHANNELS,
+                                     MIC_SPECTRUM_CHANNEL);
+    if (w->spectrum == NULL) {
+        ESP_LOGW(TAG, "Spectrum alloc failed");
+        fclose(w->spectrum_f);
+        w->spectrum_f = NULL;
+    }
+}
+
+// Opens the silence markers (.SIL) and the gate writing them. Without them
+// the recording keeps every frame.
+static void s_silence_open(mic_writer_t *w, const char *path, uint32_t sample_rate_hz)
+{
+    w->silence_f = s_sidecar_open(path, "SIL");
+    if (w->silence_f == NULL) {
+        return;
+    }
+    const mic_silence_config_t cfg = {
+        .threshold_dbfs = MIC_SILENCE_DBFS,
+        .window_ms = 20,
+        .hang_ms = MIC_SILENCE_HANG_MS,
+        .pre_ms = MIC_SILENCE_PRE_MS,
     };
-    std_cfg.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+    w->silence = mic_silence_begin(w->silence_f, sample_rate_hz, MIC_CHANNELS, &cfg);
+    if (w->silence == NULL) {
+        ESP_LOGW(TAG, "Silence gate alloc failed");
+        fclose(w->silence_f);
+        w->silence_f = NULL;
+    }
+}
 
-    ret = i2s_channel_init_std_mode(rx_handle, &std_cfg);
+// Adds one filter stage unless disabled; a corner the stored rate cannot
+// carry is skipped with a warning.
+static void s_filter_add(mic_filter_t *f, mic_filter_type_t type, float freq_hz, float q, uint32_t sample_rate_hz)
+{
+    if (freq_hz <= 0.0f) {
+        return;
+    }
+    esp_err_t ret = mic_filter_add(f, type, freq_hz, q, sample_rate_hz);
     if (ret != ESP_OK) {
-        s_log_error("I2S init std mode (%s)", esp_err_to_name(ret));
-        i2s_del_channel(rx_handle);
-        return ret;
+        ESP_LOGW(TAG, "Filter at %.0f Hz skipped (%s)", freq_hz, esp_err_to_name(ret));
     }
+}
 
-    ret = i2s_channel_enable(rx_handle);
+static void s_filter_setup(mic_filter_t *f, uint32_t sample_rate_hz)
+{
+    mic_filter_init(f, MIC_CHANNELS);
+    s_filter_add(f, MIC_FILTER_DC_BLOCK, MIC_FILTER_DC_HZ, 0.0f, sample_rate_hz);
+    s_filter_add(f, MIC_FILTER_HIGHPASS, MIC_FILTER_HIGHPASS_HZ, 0.7071f, sample_rate_hz);
+    s_filter_add(f, MIC_FILTER_LOWPASS, MIC_FILTER_LOWPASS_HZ, 0.7071f, sample_rate_hz);
+    s_filter_add(f, MIC_FILTER_NOTCH, MIC_FILTER_NOTCH_HZ, MIC_FILTER_NOTCH_Q, sample_rate_hz);
+}
+
+// Writes a block, up to limit samples per channel in total, and returns it
+// to the pool.
+static esp_err_t s_write_block(mic_writer_t *w, mic_block_t *b, size_t *captured, size_t limit)
+{
+    size_t frames = b->count / MIC_CHANNELS;
+    if (frames > limit - *captured) {
+        frames = limit - *captured;
+    }
+    esp_err_t ret = frames > 0 ? s_write_samples(w, b->samples, frames * MIC_CHANNELS) : ESP_OK;
+    *captured += frames;
+    s_block_release(b);
+    return ret;
+}
+
+// Captures I2S audio to a file; stops on button or after N seconds. The file
+// starts with the pre-roll, up to MIC_PREROLL_MS read before the call.
+esp_err_t mic_capture_to_file(const char *path, int seconds, uint32_t sample_rate_hz, int *out_seconds)
+{
+    if (s_mic_task != NULL && xTaskGetCurrentTaskHandle() != s_mic_task) {
+        return ESP_ERR_INVALID_STATE; // The mic task owns the channel; use mic_capture_start()
+    }
+    if (!s_rate_supported(sample_rate_hz)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = s_channel_open();
     if (ret != ESP_OK) {
-        s_log_error("I2S enable (%s)", esp_err_to_name(ret));
-        i2s_del_channel(rx_handle);
         return ret;
     }
 
     s_log_info("Waiting for long press");
     while (!button_is_recording()) {
-        vTaskDelay(pdMS_TO_TICKS(50));
+        s_preroll_step(pdMS_TO_TICKS(50));
     }
     s_log_info("Recording started");
 
-    FILE *f = fopen(path, "wb");
-    if (f == NULL) {
+    // .fla/.flac selects lossless compression; FAT 8.3 names only allow .fla.
+    const bool write_flac = s_has_extension(path, "fla") || s_has_extension(path, "flac");
+    if (write_flac && MIC_OUTPUT_BITS == 32) {
+        s_log_error("FLAC needs 16/24-bit");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    mic_writer_t w = {
+        .dither_state = 0x9e3779b9,
+    };
+    s_filter_setup(&w.filter, sample_rate_hz);
+    // Written through the storage task, which also syncs it periodically.
+    w.f = storage_io_fopen(path, STORAGE_IO_PRIO_HIGH);
+    if (w.f == NULL) {
         s_log_error("Open failed %s (%d)", path, errno);
-        i2s_channel_disable(rx_handle);
-        i2s_del_channel(rx_handle);
         return ESP_FAIL;
     }
 
-    const bool write_wav = s_has_wav_extension(path);
+    const bool write_wav = s_has_extension(path, "wav");
     const bool stop_on_button = (seconds <= 0);
     if (!stop_on_button && seconds < 1) {
         seconds = 1;
     }
 
-    const size_t bytes_per_sample = 4;
-    const size_t samples_per_chunk = 512;
-    const int flush_interval_ms = 1000;
-    uint32_t next_flush_ms = flush_interval_ms;
-    const size_t chunk_bytes = samples_per_chunk * bytes_per_sample;
-    uint8_t *buffer = (uint8_t *)malloc(chunk_bytes);
-    if (buffer == NULL) {
-        s_log_error("Audio buffer alloc failed");
-        fclose(f);
-        i2s_channel_disable(rx_handle);
-        i2s_del_channel(rx_handle);
-        return ESP_ERR_NO_MEM;
+    const size_t out_bytes_per_sample = MIC_OUTPUT_BITS / 8;
+    if (sample_rate_hz != I2S_SAMPLE_RATE_HZ) {
+        w.resample = mic_resample_begin(I2S_SAMPLE_RATE_HZ, sample_rate_hz, MIC_CHANNELS);
+        if (w.resample == NULL) {
+            s_log_error("Resampler alloc failed");
+            fclose(w.f);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (write_flac) {
+        w.flac = mic_flac_begin(w.f, sample_rate_hz, MIC_OUTPUT_BITS, MIC_CHANNELS);
+        if (w.flac == NULL) {
+            s_log_error("FLAC encoder alloc failed");
+            mic_resample_end(w.resample);
+            fclose(w.f);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (MIC_SPECTRUM_FFT_SIZE > 0) {
+        s_spectrum_open(&w, path, sample_rate_hz);
+    }
+    if (MIC_SILENCE_ELIDE) {
+        s_silence_open(&w, path, sample_rate_hz);
     }
 
     size_t total_samples = stop_on_button ? SIZE_MAX : (size_t)I2S_SAMPLE_RATE_HZ * (size_t)seconds;
     size_t captured_samples = 0;
+    const uint32_t overrun_start = s_overrun_samples;
     if (write_wav) {
-        s_write_wav_header(f, I2S_SAMPLE_RATE_HZ, 32, 1, 0);
+        // Written once; the sizes are filled in on close or by mic_capture_recover().
+        s_write_wav_header(w.f, sample_rate_hz, MIC_OUTPUT_BITS, MIC_CHANNELS, WAV_SIZE_UNKNOWN);
+    }
+    if (s_preroll_count > 0) {
+        ESP_LOGI(TAG, "Pre-roll %u ms",
+                 (unsigned)(s_preroll_count * MIC_BLOCK_SAMPLES * 1000 / I2S_SAMPLE_RATE_HZ));
+    }
+    for (size_t i = 0; i < s_preroll_count; ++i) {
+        if (ret == ESP_OK) {
+            ret = s_write_block(&w, s_preroll[i], &captured_samples, total_samples);
+        } else {
+            s_block_release(s_preroll[i]);
+        }
     }
-    while (captured_samples < total_samples) {
+    s_preroll_count = 0;
+
+    int idle_ms = 0;
+    while (ret == ESP_OK && captured_samples < total_samples) {
         if (stop_on_button && !button_is_recording()) {
             s_log_info("Stop requested");
             break;
         }
-        size_t bytes_read = 0;
-        size_t samples_to_read = samples_per_chunk;
-        if (captured_samples + samples_to_read > total_samples) {
-            samples_to_read = total_samples - captured_samples;
+        mic_block_t *b = NULL;
+        if (xQueueReceive(s_full_blocks, &b, pdMS_TO_TICKS(50)) != pdTRUE) {
+            idle_ms += 50;
+            if (idle_ms >= 1000) {
+                s_log_error("I2S stalled");
+                ret = ESP_ERR_TIMEOUT;
+            }
+            continue;
         }
-        size_t bytes_to_read = samples_to_read * bytes_per_sample;
+        idle_ms = 0;
+        ret = s_write_block(&w, b, &captured_samples, total_samples);
+    }
+    // Overruns after the last block is claimed are outside the recording.
+    uint32_t overrun_end = s_overrun_samples;
+    if (ret == ESP_OK) {
+        // Audio received before the stop still belongs to this recording.
+        mic_block_t *b = NULL;
+        for (UBaseType_t n = uxQueueMessagesWaiting(s_full_blocks); n > 0 && ret == ESP_OK; --n) {
+            if (xQueueReceive(s_full_blocks, &b, 0) == pdTRUE) {
+                ret = s_write_block(&w, b, &captured_samples, total_samples);
+            }
+        }
+        b = s_take_partial_block();
+        overrun_end = s_overrun_samples;
+        if (ret == ESP_OK && b != NULL) {
+            ret = s_write_block(&w, b, &captured_samples, total_samples);
+        } else if (b != NULL) {
+            s_block_release(b);
+        }
+    }
+    const uint32_t overruns = overrun_end - overrun_start;
+    if (overruns > 0) {
+        ESP_LOGW(TAG, "Lost %u samples to buffer overruns", (unsigned)overruns);
+    }
 
-        ret = i2s_channel_read(rx_handle, buffer, bytes_to_read, &bytes_read, pdMS_TO_TICKS(1000));
-        if (ret != ESP_OK) {
-            s_log_error("I2S read failed (%s)", esp_err_to_name(ret));
-            break;
+    s_silence_elided_ms = 0;
+    if (w.silence != NULL) {
+        // Flushes the audio the gate still holds ahead of the encoder's end.
+        mic_silence_stats_t silence_stats;
+        esp_err_t silence_ret = mic_silence_end(w.silence, ret == ESP_OK ? s_store_gated : NULL, &w, &silence_stats);
+        if (ret == ESP_OK && silence_ret != ESP_OK) {
+            ret = silence_ret;
         }
-        if (bytes_read > 0) {
-            if (button_is_paused()) {
-                memset(buffer, 0, bytes_read);
-            } else {
-                int32_t *samples = (int32_t *)buffer;
-                size_t count = bytes_read / sizeof(int32_t);
-                for (size_t i = 0; i < count; ++i) {
-                    samples[i] = s_apply_gain(samples[i]);
-                }
-            }
-            fwrite(buffer, 1, bytes_read, f);
-            captured_samples += bytes_read / bytes_per_sample;
+        fclose(w.silence_f);
+        if (silence_stats.frames > 0) {
+            s_silence_elided_ms = (uint32_t)(silence_stats.elided_frames * 1000 / sample_rate_hz);
+            ESP_LOGI(TAG, "Silence %u of %u ms left out (%u%%) in %u spans, detector %lld us per s of audio",
+                     (unsigned)s_silence_elided_ms, (unsigned)(silence_stats.frames * 1000 / sample_rate_hz),
+                     (unsigned)(silence_stats.elided_frames * 100 / silence_stats.frames), (unsigned)silence_stats.spans,
+                     (long long)(silence_stats.detect_us * sample_rate_hz / (int64_t)silence_stats.frames));
         }
+    }
 
-        if (write_wav && (captured_samples * 1000 / I2S_SAMPLE_RATE_HZ) >= next_flush_ms) {
-            const uint32_t data_bytes = (uint32_t)(captured_samples * bytes_per_sample);
-            fflush(f);
-            fsync(fileno(f));
-            fseek(f, 0, SEEK_SET);
-            s_write_wav_header(f, I2S_SAMPLE_RATE_HZ, 32, 1, data_bytes);
-            fseek(f, 0, SEEK_END);
-            next_flush_ms += flush_interval_ms;
+    if (w.flac != NULL) {
+        mic_flac_stats_t stats;
+        esp_err_t flac_ret = mic_flac_end(w.flac, &stats);
+        if (flac_ret != ESP_OK) {
+            s_log_error("FLAC finish failed");
+            ret = flac_ret;
+        } else if (stats.samples > 0) {
+            // Size against plain PCM, and encoder CPU time per second of audio.
+            const uint64_t pcm_bytes = stats.samples * MIC_CHANNELS * out_bytes_per_sample;
+            const int64_t us_per_s = stats.encode_us * sample_rate_hz / (int64_t)stats.samples;
+            ESP_LOGI(TAG, "FLAC %llu -> %llu bytes (%llu%%), encode %lld us per s of audio",
+                     (unsigned long long)pcm_bytes, (unsigned long long)stats.bytes,
+                     (unsigned long long)(stats.bytes * 100 / pcm_bytes), (long long)us_per_s);
         }
     }
 
     if (write_wav) {
-        const uint32_t data_bytes = (uint32_t)(captured_samples * bytes_per_sample);
-        fseek(f, 0, SEEK_SET);
-        s_write_wav_header(f, I2S_SAMPLE_RATE_HZ, 32, 1, data_bytes);
+        const uint32_t data_bytes = (uint32_t)(w.frames * MIC_CHANNELS * out_bytes_per_sample);
+        fseek(w.f, 0, SEEK_SET);
+        s_write_wav_header(w.f, sample_rate_hz, MIC_OUTPUT_BITS, MIC_CHANNELS, data_bytes);
     }
 
-    free(buffer);
-    fclose(f);
-    i2s_channel_disable(rx_handle);
-    i2s_del_channel(rx_handle);
+    // Writes are queued, so a failure may only show once everything is on the card.
+    if (fclose(w.f) != 0 && ret == ESP_OK) {
+        s_log_error("Audio write failed (%d)", errno);
+        ret = ESP_FAIL;
+    }
+    mic_resample_end(w.resample);
+    if (w.spectrum != NULL) {
+        mic_spectrum_stats_t spectrum_stats;
+        mic_spectrum_end(w.spectrum, &spectrum_stats);
+        if (captured_samples > 0) {
+            ESP_LOGI(TAG, "Spectrum %u frames, %lld us per s of audio", (unsigned)spectrum_stats.frames,
+                     (long long)(spectrum_stats.analyze_us * I2S_SAMPLE_RATE_HZ / (int64_t)captured_samples));
+        }
+    }
+    if (w.spectrum_f != NULL) {
+        fclose(w.spectrum_f);
+    }
+
+    // Levels in dBFS of the 24-bit microphone range, before gain.
+    for (int c = 0; c < MIC_CHANNELS; ++c) {
+        const mic_pcm_level_t *lv = &w.levels[c];
+        const double full_scale = 8388608.0;
+        s_peak_dbfs[c] = lv->peak > 0 ? 20.0f * log10f(lv->peak / full_scale) : -INFINITY;
+        s_rms_dbfs[c] = lv->sum_sq > 0 ? 10.0f * log10f(lv->sum_sq / lv->count / (full_scale * full_scale)) : -INFINITY;
+        ESP_LOGI(TAG, "Channel %d: peak %.1f dBFS, RMS %.1f dBFS", c, s_peak_dbfs[c], s_rms_dbfs[c]);
+    }
+    s_filter_us_avg = w.filter_blocks > 0 ? (uint32_t)(w.filter_us / w.filter_blocks) : 0;
+    s_filter_us_max = w.filter_us_max;
+    if (w.filter_blocks > 0) {
+        ESP_LOGI(TAG, "Filter %d stages: %u us avg, %u us max per block", w.filter.stages,
+                 (unsigned)s_filter_us_avg, (unsigned)s_filter_us_max);
+    }
+    if (captured_samples > 0) {
+        // Decimation, filters and conversion; FLAC encoding is logged above.
+        ESP_LOGI(TAG, "Processing %lld us per s of audio",
+                 (long long)(w.process_us * I2S_SAMPLE_RATE_HZ / (int64_t)captured_samples));
+    }
 
     int captured_seconds = (int)(captured_samples / I2S_SAMPLE_RATE_HZ);
     if (out_seconds != NULL) {
         *out_seconds = captured_seconds;
     }
-    s_log_info("Captured %d sec to %s", captured_seconds, path);
+    s_log_info("Captured %d sec at %u Hz to %s", captured_seconds, (unsigned)sample_rate_hz, path);
     return ret;
 }
+
+// Finishes a WAV header left with streaming sizes, from the file size.
+static bool s_repair_wav(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    FILE *f = fopen(path, "r+b");
+    if (f == NULL) {
+        return false;
+    }
+    uint8_t h[WAV_HEADER_BYTES];
+    bool repaired = false;
+    if (fread(h, 1, sizeof(h), f) == sizeof(h) &&
+            memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "WAVE", 4) == 0 &&
+            memcmp(h + 36, "data", 4) == 0 && s_read_le32(h + 40) == WAV_SIZE_UNKNOWN) {
+        // FAT sizes fit in 32 bits even where off_t is a signed 32-bit type.
+        const uint32_t size = (uint32_t)st.st_size;
+        const uint16_t block_align = h[32] | (h[33] << 8);
+        uint32_t data_bytes = size - WAV_HEADER_BYTES;
+        if (block_align > 0) {
+            data_bytes -= data_bytes % block_align;
+        }
+        fseek(f, 4, SEEK_SET);
+        s_write_le32(f, 36 + data_bytes);
+        fseek(f, 40, SEEK_SET);
+        s_write_le32(f, data_bytes);
+        repaired = (fflush(f) == 0);
+    }
+    fclose(f);
+    return repaired;
+}
+
+esp_err_t mic_capture_recover(const char *dir, int *out_repaired)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return ESP_FAIL;
+    }
+    int repaired = 0;
+    char path[128];
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_type == DT_DIR || !s_has_extension(e->d_name, "wav")) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (s_repair_wav(path)) {
+            ESP_LOGW(TAG, "Recovered unfinished recording %s", path);
+            repaired++;
+        }
+    }
+    closedir(d);
+    if (out_repaired != NULL) {
+        *out_repaired = repaired;
+    }
+    return ESP_OK;
+}
@@ -3,10 +3,37 @@
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 
-// Blocking capture (existing behavior).
-esp_err_t mic_capture_to_file(const char *path, int seconds, int *out_seconds);
+// Starts the I2S channel and the mic task, which keeps the last
+// MIC_PREROLL_MS of audio while idle; every recording starts with it.
+// Optional: mic_capture_start() calls it on first use.
+esp_err_t mic_capture_init(void);
 
-// Async capture helpers.
-esp_err_t mic_capture_start(const char *path, int seconds);
+// Blocking capture; not for use once mic_capture_init() has started the task.
+// sample_rate_hz is the stored rate: the 48 kHz capture rate or an integer
+// fraction of it down to 4 kHz, decimated on the fly. Returns
+// ESP_ERR_INVALID_ARG for other rates.
+esp_err_t mic_capture_to_file(const char *path, int seconds, uint32_t sample_rate_hz, int *out_seconds);
+
+typedef struct {
+    uint32_t overrun_samples;  // Samples dropped since boot because no pool block was free
+    uint32_t free_blocks_min;  // Fewest free pool blocks seen; 0 means overruns were close or happened
+    int channels;              // 1: ICS-43434, 2: ICS-43434 (left) and contact mic (right)
+    float peak_dbfs[2];        // Per channel, last recording, before gain
+    float rms_dbfs[2];
+    uint32_t filter_us_avg;    // Filter chain time per capture block, last recording
+    uint32_t filter_us_max;
+    uint32_t silence_elided_ms; // Silence left out of the last recording, listed in its .SIL file
+} mic_capture_stats_t;
+
+// Reads the capture buffer counters and the levels of the last recording.
+void mic_capture_get_stats(mic_capture_stats_t *stats);
+
+// Async capture helpers; the mic task records, then returns to pre-roll.
+esp_err_t mic_capture_start(const char *path, int seconds, uint32_t sample_rate_hz);
 bool mic_capture_is_running(void);
 esp_err_t mic_capture_wait(int *out_seconds, TickType_t timeout);
+
+// Finishes WAV files in dir left unfinished by a reset or power loss during
+// recording; their sizes come from the file size. Run once per boot after
+// mounting. FLAC files need no repair: STREAMINFO allows unknown length.
+esp_err_t mic_capture_recover(const char *dir, int *out_repaired);
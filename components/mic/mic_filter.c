@@ -0,0 +1,160 @@
+#include "mic_filter.h"
+
+#include <math.h>
+#include <string.h>
+
+// Coefficients reach +-2; Q29 keeps the five products of a full-scale slot
+// within a 64-bit sum.
+#define FILTER_Q 29
+
+void mic_filter_init(mic_filter_t *f, int channels)
+{
+    memset(f, 0, sizeof(*f));
+    f->channels = channels;
+}
+
+static int32_t s_q(double v)
+{
+    return (int32_t)lround(v * (double)(1 << FILTER_Q));
+}
+
+esp_err_t mic_filter_add(mic_filter_t *f, mic_filter_type_t type, float freq_hz, float q,
+                         uint32_t sample_rate_hz)
+{
+    if (f->channels < 1 || f->channels > MIC_FILTER_MAX_CHANNELS || sample_rate_hz == 0 ||
+            freq_hz <= 0.0f || freq_hz >= sample_rate_hz / 2.0f || (type != MIC_FILTER_DC_BLOCK && q <= 0.0f)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (f->stages == MIC_FILTER_MAX_STAGES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Audio EQ cookbook forms, except the DC blocker.
+    const double w0 = 2.0 * M_PI * freq_hz / sample_rate_hz;
+    const double c = cos(w0);
+    const double alpha = sin(w0) / (2.0 * q);
+    double b0, b1, b2, a0, a1, a2;
+    switch (type) {
+    case MIC_FILTER_DC_BLOCK: {
+        // y = x - x1 + r * y1, scaled to unity gain at Nyquist.
+        const double r = exp(-w0);
+        b0 = (1.0 + r) / 2.0;
+        b1 = -b0;
+        b2 = 0.0;
+        a0 = 1.0;
+        a1 = -r;
+        a2 = 0.0;
+        break;
+    }
+    case MIC_FILTER_HIGHPASS:
+        b0 = (1.0 + c) / 2.0;
+        b1 = -(1.0 + c);
+        b2 = b0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * c;
+        a2 = 1.0 - alpha;
+        break;
+    case MIC_FILTER_LOWPASS:
+        b0 = (1.0 - c) / 2.0;
+        b1 = 1.0 - c;
+        b2 = b0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * c;
+        a2 = 1.0 - alpha;
+        break;
+    case MIC_FILTER_NOTCH:
+        b0 = 1.0;
+        b1 = -2.0 * c;
+        b2 = 1.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * c;
+        a2 = 1.0 - alpha;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mic_filter_coefs_t *k = &f->coefs[f->stages];
+    k->b0 = s_q(b0 / a0);
+    k->b1 = s_q(b1 / a0);
+    k->b2 = s_q(b2 / a0);
+    k->a1 = s_q(a1 / a0);
+    k->a2 = s_q(a2 / a0);
+    memset(f->state[f->stages], 0, sizeof(f->state[f->stages]));
+    f->stages++;
+    return ESP_OK;
+}
+
+// Direct form I with first-order error feedback: the bits dropped from one
+// output are added to the next, which keeps low-frequency poles from
+// amplifying rounding noise.
+static inline int32_t s_step(const mic_filter_coefs_t *k, mic_filter_state_t *s, int32_t x)
+{
+    const int64_t acc = (int64_t)k->b0 * x + (int64_t)k->b1 * s->x1 + (int64_t)k->b2 * s->x2 -
+                        (int64_t)k->a1 * s->y1 - (int64_t)k->a2 * s->y2 + s->err;
+    const int64_t y = acc >> FILTER_Q;
+    s->err = (uint32_t)acc & ((1u << FILTER_Q) - 1);
+    const int32_t out = y > INT32_MAX ? INT32_MAX : (y < INT32_MIN ? INT32_MIN : (int32_t)y);
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = out;
+    return out;
+}
+
+// Sets every stage to its steady state for a constant input at the mean of
+// the first block, the best estimate of the DC offset at hand, passing each
+// stage's DC output on to the next.
+static void s_prime(mic_filter_t *f, const int32_t *samples, size_t count)
+{
+    const size_t frames = count / f->channels;
+    for (int ch = 0; ch < f->channels; ++ch) {
+        int64_t sum = 0;
+        for (size_t n = 0; n < frames; ++n) {
+            sum += samples[n * f->channels + ch];
+        }
+        double x = (double)(sum / (int64_t)frames);
+        for (int i = 0; i < f->stages; ++i) {
+            const mic_filter_coefs_t *k = &f->coefs[i];
+            const double gain = (double)((int64_t)k->b0 + k->b1 + k->b2) /
+                                (double)((1LL << FILTER_Q) + k->a1 + k->a2);
+            const double y = x * gain;
+            mic_filter_state_t *s = &f->state[i][ch];
+            s->x1 = s->x2 = (int32_t)x;
+            s->y1 = s->y2 = (int32_t)lround(fmin(fmax(y, INT32_MIN), INT32_MAX));
+            x = s->y1;
+        }
+    }
+}
+
+void mic_filter_process(mic_filter_t *f, int32_t *samples, size_t count)
+{
+    if (f->stages == 0 || count < (size_t)f->channels) {
+        return;
+    }
+    if (!f->primed) {
+        s_prime(f, samples, count);
+        f->primed = true;
+    }
+    // Stage by stage, so each stage's coefficients stay in registers over the
+    // block; stereo runs both channels through one coefficient load.
+    for (int i = 0; i < f->stages; ++i) {
+        const mic_filter_coefs_t k = f->coefs[i];
+        if (f->channels == 2) {
+            mic_filter_state_t l = f->state[i][0];
+            mic_filter_state_t r = f->state[i][1];
+            for (size_t n = 0; n + 2 <= count; n += 2) {
+                samples[n] = s_step(&k, &l, samples[n]);
+                samples[n + 1] = s_step(&k, &r, samples[n + 1]);
+            }
+            f->state[i][0] = l;
+            f->state[i][1] = r;
+        } else {
+            mic_filter_state_t s = f->state[i][0];
+            for (size_t n = 0; n < count; ++n) {
+                samples[n] = s_step(&k, &s, samples[n]);
+            }
+            f->state[i][0] = s;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define MIC_FILTER_MAX_STAGES   4
+#define MIC_FILTER_MAX_CHANNELS 2
+
+typedef enum {
+    MIC_FILTER_DC_BLOCK,  // One pole and a zero at DC; freq_hz is the corner
+    MIC_FILTER_HIGHPASS,  // Second order; q 0.707 for Butterworth
+    MIC_FILTER_LOWPASS,
+    MIC_FILTER_NOTCH,     // Removes freq_hz, e.g. mains hum; bandwidth freq_hz / q
+} mic_filter_type_t;
+
+// Q29 direct form I coefficients (magnitudes reach 2), a0 normalised to 1.
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+} mic_filter_coefs_t;
+
+typedef struct {
+    int32_t x1, x2, y1, y2;
+    uint32_t err;  // Rounding residue fed into the next sample
+} mic_filter_state_t;
+
+// Biquad chain over raw 32-bit I2S slots. Caller-owned; no allocation.
+typedef struct {
+    int channels;
+    int stages;
+    bool primed;
+    mic_filter_coefs_t coefs[MIC_FILTER_MAX_STAGES];
+    mic_filter_state_t state[MIC_FILTER_MAX_STAGES][MIC_FILTER_MAX_CHANNELS];
+} mic_filter_t;
+
+// Empties the chain for 1 or 2 interleaved channels.
+void mic_filter_init(mic_filter_t *f, int channels);
+
+// Appends a stage, applied to every channel in the order added. freq_hz must
+// be below half of sample_rate_hz; q is ignored by MIC_FILTER_DC_BLOCK.
+// Returns ESP_ERR_INVALID_ARG for bad parameters or ESP_ERR_NO_MEM once
+// MIC_FILTER_MAX_STAGES are in use.
+esp_err_t mic_filter_add(mic_filter_t *f, mic_filter_type_t type, float freq_hz, float q,
+                         uint32_t sample_rate_hz);
+
+// Filters count slots in place (a multiple of the channel count). The first
+// call starts every stage in its steady state for the mean of its samples,
+// so a DC offset does not ring through the start of the recording. Output
+// clips at full scale.
+void mic_filter_process(mic_filter_t *f, int32_t *samples, size_t count);
@@ -0,0 +1,682 @@
+#include "mic_flac.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_md5.h"
+#include "esp_timer.h"
+
+// Encoder for the FLAC subset: mono or independent stereo, fixed block size, CONSTANT, VERBATIM,
+// FIXED and LPC subframes, partitioned Rice residuals. Every subframe choice
+// is costed with an upper bound of its size, and VERBATIM caps it, so a
+// frame never outgrows the frame buffer.
+
+#define FLAC_MAX_FIXED_ORDER     4
+#define FLAC_MAX_LPC_ORDER       8
+#define FLAC_MAX_PARTITION_ORDER 8
+#define FLAC_STREAMINFO_LEN      34
+#define FLAC_FRAME_OVERHEAD      24 // Frame header, subframe headers, padding, CRC-16
+#define FLAC_MAX_CHANNELS        2
+
+static const char *TAG = "mic_flac";
+
+typedef struct {
+    int order;  // Partition order
+    uint8_t k[1 << FLAC_MAX_PARTITION_ORDER];
+    uint64_t bits;
+} s_rice_plan_t;
+
+struct mic_flac {
+    FILE *f;
+    uint32_t sample_rate_hz;
+    int bits;
+    int channels;
+    size_t fill;            // Frames in block
+
+    uint32_t frame_number;
+    uint64_t samples;
+    uint64_t bytes;
+    uint32_t min_frame;
+    uint32_t max_frame;
+    int64_t encode_us;
+    md5_context_t md5;
+    int32_t *block;         // One MIC_FLAC_BLOCK_SIZE plane per channel
+    void *scratch;      // Windowed samples during analysis, then residuals
+    uint8_t *frame;
+    uint64_t sums[2 << FLAC_MAX_PARTITION_ORDER];
+    s_rice_plan_t plan;
+    s_rice_plan_t best_plan;
+};
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;
+    uint64_t acc;
+    int bits;
+} s_bits_t;
+
+static uint16_t s_crc16_table[256];
+
+// Appends the low n bits of v (n <= 32), most significant bit first.
+static inline void s_put(s_bits_t *bw, uint32_t v, int n)
+{
+    if (n == 0) {
+        return;
+    }
+    bw->acc = (bw->acc << n) | (v & (uint32_t)(((uint64_t)1 << n) - 1));
+    bw->bits += n;
+    while (bw->bits >= 8) {
+        bw->bits -= 8;
+        bw->buf[bw->pos++] = (uint8_t)(bw->acc >> bw->bits);
+    }
+}
+
+static void s_align(s_bits_t *bw)
+{
+    if (bw->bits) {
+        s_put(bw, 0, 8 - bw->bits);
+    }
+}
+
+// UTF-8 style coded frame number.
+static void s_put_utf8(s_bits_t *bw, uint32_t v)
+{
+    if (v < 0x80) {
+        s_put(bw, v, 8);
+        return;
+    }
+    const int n = v < 0x800 ? 2 : v < 0x10000 ? 3 : v < 0x200000 ? 4 : v < 0x4000000 ? 5 : 6;
+    s_put(bw, ((0xff << (8 - n)) & 0xff) | (v >> (6 * (n - 1))), 8);
+    for (int i = n - 2; i >= 0; --i) {
+        s_put(bw, 0x80 | ((v >> (6 * i)) & 0x3f), 8);
+    }
+}
+
+static uint8_t s_crc8(const uint8_t *p, size_t n)
+{
+    uint8_t c = 0;
+    for (size_t i = 0; i < n; ++i) {
+        c ^= p[i];
+        for (int b = 0; b < 8; ++b) {
+            c = (c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1);
+        }
+    }
+    return c;
+}
+
+static void s_crc16_init(void)
+{
+    for (int i = 0; i < 256; ++i) {
+        uint16_t c = i << 8;
+        for (int b = 0; b < 8; ++b) {
+            c = (c & 0x8000) ? (uint16_t)((c << 1) ^ 0x8005) : (uint16_t)(c << 1);
+        }
+        s_crc16_table[i] = c;
+    }
+}
+
+static uint16_t s_crc16(const uint8_t *p, size_t n)
+{
+    uint16_t c = 0;
+    for (size_t i = 0; i < n; ++i) {
+        c = (uint16_t)((c << 8) ^ s_crc16_table[(c >> 8) ^ p[i]]);
+    }
+    return c;
+}
+
+static inline uint32_t s_zigzag(int32_t r)
+{
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// Rice bits for n values summing to sum. Never below the real size, since
+// sum(u >> k) <= sum >> k.
+static inline uint64_t s_rice_bits(uint64_t sum, uint32_t n, int k)
+{
+    return (uint64_t)n * (k + 1) + (sum >> k);
+}
+
+static int s_rice_param(uint64_t sum, uint32_t n, int max_k)
+{
+    int k = 0;
+    while (k < max_k && ((uint64_t)n << (k + 1)) < sum) {
+        ++k;
+    }
+    if (k > 0 && s_rice_bits(sum, n, k - 1) <= s_rice_bits(sum, n, k)) {
+        --k;
+    }
+    return k;
+}
+
+// Picks the partition order and Rice parameters for res[pred_order..n).
+static void s_plan_rice(mic_flac_t *enc, const int32_t *res, uint32_t n, int pred_order, int param_bits,
+                        s_rice_plan_t *plan)
+{
+    const int max_k = (1 << param_bits) - 2;
+    int max_p = 0;
+    while (max_p < FLAC_MAX_PARTITION_ORDER && (n % (2u << max_p)) == 0 &&
+            (n >> (max_p + 1)) > (uint32_t)pred_order) {
+        ++max_p;
+    }
+
+    // Sums at the finest order, then merged pairwise for the coarser ones.
+    uint64_t *sums = enc->sums;
+    const uint32_t part = n >> max_p;
+    for (uint32_t p = 0; p < (1u << max_p); ++p) {
+        uint64_t sum = 0;
+        for (uint32_t i = (p == 0 ? (uint32_t)pred_order : p * part); i < (p + 1) * part; ++i) {
+            sum += s_zigzag(res[i]);
+        }
+        sums[(1u << max_p) + p] = sum;
+    }
+    for (int level = max_p - 1; level >= 0; --level) {
+        for (uint32_t p = 0; p < (1u << level); ++p) {
+            sums[(1u << level) + p] = sums[(2u << level) + 2 * p] + sums[(2u << level) + 2 * p + 1];
+        }
+    }
+
+    plan->bits = UINT64_MAX;
+    for (int level = 0; level <= max_p; ++level) {
+        const uint32_t len = n >> level;
+        uint64_t bits = 2 + 4;
+        for (uint32_t p = 0; p < (1u << level); ++p) {
+            const uint32_t count = len - (p == 0 ? pred_order : 0);
+            const uint64_t sum = sums[(1u << level) + p];
+            bits += param_bits + s_rice_bits(sum, count, s_rice_param(sum, count, max_k));
+        }
+        if (bits < plan->bits) {
+            plan->bits = bits;
+            plan->order = level;
+        }
+    }
+    const uint32_t len = n >> plan->order;
+    for (uint32_t p = 0; p < (1u << plan->order); ++p) {
+        const uint32_t count = len - (p == 0 ? pred_order : 0);
+        plan->k[p] = s_rice_param(sums[(1u << plan->order) + p], count, max_k);
+    }
+}
+
+static void s_write_residual(s_bits_t *bw, const int32_t *res, uint32_t n, int pred_order, int param_bits,
+                             const s_rice_plan_t *plan)
+{
+    s_put(bw, param_bits == 5 ? 1 : 0, 2);
+    s_put(bw, plan->order, 4);
+    const uint32_t len = n >> plan->order;
+    for (uint32_t p = 0; p < (1u << plan->order); ++p) {
+        const int k = plan->k[p];
+        s_put(bw, k, param_bits);
+        for (uint32_t i = (p == 0 ? (uint32_t)pred_order : p * len); i < (p + 1) * len; ++i) {
+            const uint32_t u = s_zigzag(res[i]);
+            uint32_t q = u >> k;
+            while (q > 24) {
+                s_put(bw, 0, 24);
+                q -= 24;
+            }
+            if (q + 1 + k <= 32) {
+                s_put(bw, (1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+            } else {
+                s_put(bw, 1, q + 1);
+                s_put(bw, u, k);
+            }
+        }
+    }
+}
+
+static void s_fixed_residual(const int32_t *x, uint32_t n, int order, int32_t *res)
+{
+    for (uint32_t i = order; i < n; ++i) {
+        switch (order) {
+        case 0:
+            res[i] = x[i];
+            break;
+        case 1:
+            res[i] = x[i] - x[i - 1];
+            break;
+        case 2:
+            res[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+            break;
+        case 3:
+            res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            break;
+        default:
+            res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+            break;
+        }
+    }
+}
+
+// Fixed predictor order with the smallest sum of absolute residuals.
+static int s_best_fixed_order(const int32_t *x, uint32_t n)
+{
+    uint64_t sum[FLAC_MAX_FIXED_ORDER + 1] = {0};
+    for (uint32_t i = FLAC_MAX_FIXED_ORDER; i < n; ++i) {
+        const int32_t e0 = x[i];
+        const int32_t e1 = e0 - x[i - 1];
+        const int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+        const int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+        const int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+        sum[0] += abs(e0);
+        sum[1] += abs(e1);
+        sum[2] += abs(e2);
+        sum[3] += abs(e3);
+        sum[4] += abs(e4);
+    }
+    int best = 0;
+    for (int o = 1; o <= FLAC_MAX_FIXED_ORDER; ++o) {
+        if (sum[o] < sum[best]) {
+            best = o;
+        }
+    }
+    return best;
+}
+
+// Welch windowed autocorrelation and Levinson-Durbin recursion; lpc[o - 1]
+// holds the predictor of order o.
+static bool s_lpc_analyse(const int32_t *x, uint32_t n, float *windowed, float lpc[][FLAC_MAX_LPC_ORDER])
+{
+    const float c = (n - 1) * 0.5f;
+    for (uint32_t i = 0; i < n; ++i) {
+        const float t = (i - c) / c;
+        windowed[i] = x[i] * (1.0f - t * t);
+    }
+    float r[FLAC_MAX_LPC_ORDER + 1];
+    for (int lag = 0; lag <= FLAC_MAX_LPC_ORDER; ++lag) {
+        float acc = 0;
+        for (uint32_t i = lag; i < n; ++i) {
+            acc += windowed[i] * windowed[i - lag];
+        }
+        r[lag] = acc;
+    }
+    if (r[0] <= 0) {
+        return false;
+    }
+    r[0] *= 1.0f + 1e-6f;
+
+    float a[FLAC_MAX_LPC_ORDER] = {0};
+    float err = r[0];
+    for (int i = 0; i < FLAC_MAX_LPC_ORDER; ++i) {
+        float k = -r[i + 1];
+        for (int j = 0; j < i; ++j) {
+            k -= a[j] * r[i - j];
+        }
+        k /= err;
+        a[i] = k;
+        for (int j = 0; j < i / 2; ++j) {
+            const float t = a[j];
+            a[j] += k * a[i - 1 - j];
+            a[i - 1 - j] += k * t;
+        }
+        if (i & 1) {
+            a[i / 2] += a[i / 2] * k;
+        }
+        err *= 1.0f - k * k;
+        for (int j = 0; j <= i; ++j) {
+            lpc[i][j] = -a[j];
+        }
+        if (err <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool s_quantize(const float *lp, int order, int precision, int32_t *q, int *shift)
+{
+    float cmax = 0;
+    for (int j = 0; j < order; ++j) {
+        cmax = fmaxf(cmax, fabsf(lp[j]));
+    }
+    if (cmax <= 0) {
+        return false;
+    }
+    int e;
+    frexpf(cmax, &e);
+    int s = precision - 1 - e;
+    if (s > 15) {
+        s = 15;
+    }
+    if (s < 0) {
+        return false;
+    }
+    const int32_t qmax = (1 << (precision - 1)) - 1;
+    float err = 0;
+    for (int j = 0; j < order; ++j) {
+        err += lp[j] * (float)(1 << s);
+        int32_t v = lroundf(err);
+        v = v > qmax ? qmax : (v < -qmax - 1 ? -qmax - 1 : v);
+        q[j] = v;
+        err -= v;
+    }
+    *shift = s;
+    return true;
+}
+
+static bool s_lpc_residual(const int32_t *x, uint32_t n, const int32_t *q, int order, int shift, int32_t *res)
+{
+    for (uint32_t i = order; i < n; ++i) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; ++j) {
+            sum += (int64_t)q[j] * x[i - 1 - j];
+        }
+        const int64_t r = x[i] - (sum >> shift);
+        if (r > (1 << 30) || r < -(1 << 30)) {
+            return false;
+        }
+        res[i] = (int32_t)r;
+    }
+    return true;
+}
+
+static void s_put_sample(s_bits_t *bw, int32_t v, int bits)
+{
+    s_put(bw, (uint32_t)v, bits);
+}
+
+typedef enum {
+    SUBFRAME_VERBATIM,
+    SUBFRAME_FIXED,
+    SUBFRAME_LPC,
+} s_subframe_type_t;
+
+static void s_write_subframe(mic_flac_t *enc, s_bits_t *bw, const int32_t *x, uint32_t n)
+{
+    const int bps = enc->bits;
+    const int param_bits = bps > 16 ? 5 : 4;
+    const int precision = bps > 16 ? 15 : 12;
+
+    bool constant = true;
+    for (uint32_t i = 1; i < n && constant; ++i) {
+        constant = x[i] == x[0];
+    }
+    if (constant) {
+        s_put(bw, 0, 8);
+        s_put_sample(bw, x[0], bps);
+        return;
+    }
+
+    s_subframe_type_t type = SUBFRAME_VERBATIM;
+    uint64_t best = 8 + (uint64_t)n * bps;
+    int order = 0;
+    int32_t q[FLAC_MAX_LPC_ORDER];
+    int shift = 0;
+    int32_t best_q[FLAC_MAX_LPC_ORDER];
+    int best_shift = 0;
+    int32_t *res = (int32_t *)enc->scratch;
+
+    // LPC analysis first, it uses the scratch buffer for the windowed block.
+    float lpc[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+    const bool have_lpc = n > 4 * FLAC_MAX_LPC_ORDER &&
+                          s_lpc_analyse(x, n, (float *)enc->scratch, lpc);
+
+    if (n > FLAC_MAX_FIXED_ORDER) {
+        const int o = s_best_fixed_order(x, n);
+        s_fixed_residual(x, n, o, res);
+        s_plan_rice(enc, res, n, o, param_bits, &enc->plan);
+        const uint64_t bits = 8 + (uint64_t)o * bps + enc->plan.bits;
+        if (bits < best) {
+            best = bits;
+            type = SUBFRAME_FIXED;
+            order = o;
+            enc->best_plan = enc->plan;
+        }
+    }
+    if (have_lpc) {
+        static const int lpc_orders[] = {4, FLAC_MAX_LPC_ORDER};
+        for (size_t c = 0; c < sizeof(lpc_orders) / sizeof(lpc_orders[0]); ++c) {
+            const int o = lpc_orders[c];
+            if (!s_quantize(lpc[o - 1], o, precision, q, &shift) ||
+                    !s_lpc_residual(x, n, q, o, shift, res)) {
+                continue;
+            }
+            s_plan_rice(enc, res, n, o, param_bits, &enc->plan);
+            const uint64_t bits = 8 + (uint64_t)o * bps + 4 + 5 + (uint64_t)o * precision + enc->plan.bits;
+            if (bits < best) {
+                best = bits;
+                type = SUBFRAME_LPC;
+                order = o;
+                memcpy(best_q, q, sizeof(q));
+                best_shift = shift;
+                enc->best_plan = enc->plan;
+            }
+        }
+    }
+
+    switch (type) {
+    case SUBFRAME_VERBATIM:
+        s_put(bw, 0x02, 8);
+        for (uint32_t i = 0; i < n; ++i) {
+            s_put_sample(bw, x[i], bps);
+        }
+        return;
+    case SUBFRAME_FIXED:
+        s_fixed_residual(x, n, order, res);
+        s_put(bw, (0x08 | order) << 1, 8);
+        break;
+    case SUBFRAME_LPC:
+        s_lpc_residual(x, n, best_q, order, best_shift, res);
+        s_put(bw, (0x20 | (order - 1)) << 1, 8);
+        break;
+    }
+    for (int i = 0; i < order; ++i) {
+        s_put_sample(bw, x[i], bps);
+    }
+    if (type == SUBFRAME_LPC) {
+        s_put(bw, precision - 1, 4);
+        s_put(bw, best_shift, 5);
+        for (int i = 0; i < order; ++i) {
+            s_put(bw, (uint32_t)best_q[i], precision);
+        }
+    }
+    s_write_residual(bw, res, n, order, param_bits, &enc->best_plan);
+}
+
+static int s_sample_rate_code(uint32_t hz)
+{
+    static const uint32_t rates[] = {
+        0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000,
+    };
+    for (int i = 1; i < (int)(sizeof(rates) / sizeof(rates[0])); ++i) {
+        if (rates[i] == hz) {
+            return i;
+        }
+    }
+    return 0; // From STREAMINFO
+}
+
+static void s_md5_block(mic_flac_t *enc, uint32_t n)
+{
+    // MD5 of the interleaved samples as little-endian bytes, as decoders check it.
+    const int bytes = enc->bits / 8;
+    uint8_t buf[64 * 3 * FLAC_MAX_CHANNELS];
+    for (uint32_t i = 0; i < n; i += 64) {
+        const uint32_t count = n - i < 64 ? n - i : 64;
+        uint8_t *p = buf;
+        for (uint32_t j = 0; j < count; ++j) {
+            for (int c = 0; c < enc->channels; ++c) {
+                const int32_t v = enc->block[c * MIC_FLAC_BLOCK_SIZE + i + j];
+                for (int b = 0; b < bytes; ++b) {
+                    *p++ = (uint8_t)(v >> (8 * b));
+                }
+            }
+        }
+        esp_rom_md5_update(&enc->md5, buf, p - buf);
+    }
+}
+
+static esp_err_t s_encode_frame(mic_flac_t *enc)
+{
+    const uint32_t n = enc->fill;
+    const int64_t start = esp_timer_get_time();
+    s_md5_block(enc, n);
+
+    s_bits_t bw = {.buf = enc->frame};
+    int bs_code = n == MIC_FLAC_BLOCK_SIZE ? 12 : (n <= 256 ? 6 : 7);
+    s_put(&bw, 0x3ffe, 14);
+    s_put(&bw, 0, 1);
+    s_put(&bw, 0, 1); // Fixed block size
+    s_put(&bw, bs_code, 4);
+    s_put(&bw, s_sample_rate_code(enc->sample_rate_hz), 4);
+    s_put(&bw, enc->channels - 1, 4); // Independent channels
+    s_put(&bw, enc->bits == 16 ? 4 : 6, 3);
+    s_put(&bw, 0, 1);
+    s_put_utf8(&bw, enc->frame_number);
+    if (bs_code == 6) {
+        s_put(&bw, n - 1, 8);
+    } else if (bs_code == 7) {
+        s_put(&bw, n - 1, 16);
+    }
+    s_put(&bw, s_crc8(bw.buf, bw.pos), 8);
+
+    for (int c = 0; c < enc->channels; ++c) {
+        s_write_subframe(enc, &bw, enc->block + c * MIC_FLAC_BLOCK_SIZE, n);
+    }
+    s_align(&bw);
+    s_put(&bw, s_crc16(bw.buf, bw.pos), 16);
+    enc->encode_us += esp_timer_get_time() - start;
+
+    if (fwrite(bw.buf, 1, bw.pos, enc->f) != bw.pos) {
+        return ESP_FAIL;
+    }
+    enc->bytes += bw.pos;
+    enc->samples += n;
+    enc->frame_number++;
+    enc->fill = 0;
+    if (enc->min_frame == 0 || bw.pos < enc->min_frame) {
+        enc->min_frame = bw.pos;
+    }
+    if (bw.pos > enc->max_frame) {
+        enc->max_frame = bw.pos;
+    }
+    return ESP_OK;
+}
+
+static void s_streaminfo(const mic_flac_t *enc, const uint8_t md5[16], uint8_t out[FLAC_STREAMINFO_LEN])
+{
+    s_bits_t bw = {.buf = out};
+    s_put(&bw, MIC_FLAC_BLOCK_SIZE, 16);
+    s_put(&bw, MIC_FLAC_BLOCK_SIZE, 16);
+    s_put(&bw, enc->min_frame, 24);
+    s_put(&bw, enc->max_frame, 24);
+    s_put(&bw, enc->sample_rate_hz, 20);
+    s_put(&bw, enc->channels - 1, 3);
+    s_put(&bw, enc->bits - 1, 5);
+    s_put(&bw, (uint32_t)(enc->samples >> 32), 4);
+    s_put(&bw, (uint32_t)enc->samples, 32);
+    memcpy(out + 18, md5, 16);
+}
+
+static void s_free(mic_flac_t *enc)
+{
+    free(enc->block);
+    free(enc->scratch);
+    free(enc->frame);
+    free(enc);
+}
+
+mic_flac_t *mic_flac_begin(FILE *f, uint32_t sample_rate_hz, int bits, int channels)
+{
+    if (f == NULL || (bits != 16 && bits != 24) || channels < 1 || channels > FLAC_MAX_CHANNELS ||
+            sample_rate_hz == 0 || sample_rate_hz >= (1u << 20)) {
+        return NULL;
+    }
+    mic_flac_t *enc = (mic_flac_t *)calloc(1, sizeof(*enc));
+    if (enc == NULL) {
+        return NULL;
+    }
+    enc->f = f;
+    enc->sample_rate_hz = sample_rate_hz;
+    enc->bits = bits;
+    enc->channels = channels;
+    enc->block = (int32_t *)malloc(channels * MIC_FLAC_BLOCK_SIZE * sizeof(int32_t));
+    enc->scratch = malloc(MIC_FLAC_BLOCK_SIZE * sizeof(int32_t));
+    enc->frame = (uint8_t *)malloc(channels * MIC_FLAC_BLOCK_SIZE * bits / 8 + FLAC_FRAME_OVERHEAD);
+    if (enc->block == NULL || enc->scratch == NULL || enc->frame == NULL) {
+        s_free(enc);
+        return NULL;
+    }
+    if (s_crc16_table[1] == 0) {
+        s_crc16_init();
+    }
+    esp_rom_md5_init(&enc->md5);
+
+    // Length, frame sizes and MD5 are left unknown until mic_flac_end().
+    const uint8_t header[8] = {'f', 'L', 'a', 'C', 0x80, 0, 0, FLAC_STREAMINFO_LEN};
+    const uint8_t md5[16] = {0};
+    uint8_t info[FLAC_STREAMINFO_LEN];
+    s_streaminfo(enc, md5, info);
+    if (fwrite(header, 1, sizeof(header), f) != sizeof(header) ||
+            fwrite(info, 1, sizeof(info), f) != sizeof(info)) {
+        s_free(enc);
+        return NULL;
+    }
+    enc->bytes = sizeof(header) + sizeof(info);
+    return enc;
+}
+
+esp_err_t mic_flac_write(mic_flac_t *enc, const int32_t *samples, size_t count)
+{
+    if (enc == NULL || (samples == NULL && count > 0) || count % enc->channels != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t frames = count / enc->channels;
+    while (frames > 0) {
+        size_t take = MIC_FLAC_BLOCK_SIZE - enc->fill;
+        if (take > frames) {
+            take = frames;
+        }
+        if (enc->channels == 1) {
+            memcpy(enc->block + enc->fill, samples, take * sizeof(int32_t));
+        } else {
+            // De-interleave into the channel planes.
+            int32_t *l = enc->block + enc->fill;
+            int32_t *r = l + MIC_FLAC_BLOCK_SIZE;
+            for (size_t i = 0; i < take; ++i) {
+                l[i] = samples[2 * i];
+                r[i] = samples[2 * i + 1];
+            }
+        }
+        enc->fill += take;
+        samples += take * enc->channels;
+        frames -= take;
+        if (enc->fill == MIC_FLAC_BLOCK_SIZE) {
+            esp_err_t ret = s_encode_frame(enc);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t mic_flac_end(mic_flac_t *enc, mic_flac_stats_t *stats)
+{
+    if (enc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    if (enc->fill > 0) {
+        ret = s_encode_frame(enc);
+    }
+    uint8_t md5[16];
+    esp_rom_md5_final(md5, &enc->md5);
+    uint8_t info[FLAC_STREAMINFO_LEN];
+    s_streaminfo(enc, md5, info);
+    if (ret == ESP_OK) {
+        if (fflush(enc->f) != 0 || fseek(enc->f, 8, SEEK_SET) != 0 ||
+                fwrite(info, 1, sizeof(info), enc->f) != sizeof(info) ||
+                fseek(enc->f, 0, SEEK_END) != 0) {
+            ESP_LOGE(TAG, "STREAMINFO update failed");
+            ret = ESP_FAIL;
+        }
+    }
+    if (stats != NULL) {
+        stats->samples = enc->samples;
+        stats->bytes = enc->bytes;
+        stats->encode_us = enc->encode_us;
+    }
+    s_free(enc);
+    return ret;
+}
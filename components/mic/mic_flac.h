@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+
+// Samples per FLAC frame; 256 ms at 16 kHz.
+#define MIC_FLAC_BLOCK_SIZE 4096
+
+typedef struct mic_flac mic_flac_t;
+
+typedef struct {
+    uint64_t samples;   // Samples encoded per channel
+    uint64_t bytes;     // File size, headers included
+    int64_t encode_us;  // Time spent encoding
+} mic_flac_stats_t;
+
+// Starts a FLAC stream of 16 or 24-bit samples with 1 or 2 channels in f,
+// which must be open for writing at its start. Stereo channels are coded
+// independently. Returns NULL for bad arguments or no memory.
+mic_flac_t *mic_flac_begin(FILE *f, uint32_t sample_rate_hz, int bits, int channels);
+
+// Adds right-justified samples (see mic_pcm_scale()), interleaved for stereo;
+// count is in samples, a multiple of the channel count. Full blocks are encoded
+// and written as they fill. Frames are self-contained, so a file cut short
+// by power loss still decodes up to its last complete frame.
+esp_err_t mic_flac_write(mic_flac_t *enc, const int32_t *samples, size_t count);
+
+// Encodes the last partial block, completes the STREAMINFO header (length,
+// frame sizes and MD5) and frees enc. f stays open. stats may be NULL.
+esp_err_t mic_flac_end(mic_flac_t *enc, mic_flac_stats_t *stats);
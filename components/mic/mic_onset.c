@@ -0,0 +1,102 @@
+#include "mic_onset.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#define ONSET_FULL_SCALE_DB 138.4738f  // 20 log10(2^23): 24-bit full scale
+#define ONSET_SILENCE_DB    -200.0f
+
+esp_err_t mic_onset_init(mic_onset_t *od, const mic_onset_config_t *cfg)
+{
+    if (cfg->sample_rate_hz == 0 || cfg->channels < 1 || cfg->channels > MIC_FILTER_MAX_CHANNELS ||
+            cfg->channel < 0 || cfg->channel >= cfg->channels || cfg->floor_tau_ms <= 0.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t window = (size_t)cfg->sample_rate_hz * cfg->window_ms / 1000;
+    if (window == 0 || window > MIC_ONSET_MAX_WINDOW) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(od, 0, sizeof(*od));
+    od->cfg = *cfg;
+    od->window = window;
+
+    mic_filter_init(&od->band, 1);
+    esp_err_t ret = ESP_OK;
+    if (cfg->band_low_hz > 0.0f) {
+        ret = mic_filter_add(&od->band, MIC_FILTER_HIGHPASS, cfg->band_low_hz, 0.7071f, cfg->sample_rate_hz);
+    }
+    if (ret == ESP_OK && cfg->band_high_hz > 0.0f) {
+        ret = mic_filter_add(&od->band, MIC_FILTER_LOWPASS, cfg->band_high_hz, 0.7071f, cfg->sample_rate_hz);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    od->alpha = fminf(1.0f, cfg->window_ms / cfg->floor_tau_ms);
+    mic_onset_reset(od);
+    return ESP_OK;
+}
+
+void mic_onset_reset(mic_onset_t *od)
+{
+    od->fill = 0;
+    od->have_floor = false;
+    od->armed = true;
+    od->level_db = ONSET_SILENCE_DB;
+}
+
+// Takes one window's level; true when it fires.
+static bool s_update(mic_onset_t *od, float db)
+{
+    od->level_db = db;
+    if (!od->have_floor) {
+        od->floor_db = db;
+        od->have_floor = true;
+        return false;
+    }
+    const float threshold = fmaxf(od->floor_db + od->cfg.rise_db, od->cfg.min_dbfs);
+    if (od->armed) {
+        if (db >= threshold) {
+            od->armed = false;
+            return true;
+        }
+        // The floor only learns while armed, so an event does not raise it.
+        od->floor_db += od->alpha * (db - od->floor_db);
+    } else if (db < threshold - od->cfg.hysteresis_db) {
+        od->armed = true;
+    }
+    return false;
+}
+
+bool mic_onset_process(mic_onset_t *od, const int32_t *samples, size_t count, size_t *at_frame)
+{
+    const int64_t start = esp_timer_get_time();
+    const int ch = od->cfg.channels;
+    const size_t frames = count / ch;
+    bool fired = false;
+    for (size_t f = 0; f < frames; ++f) {
+        od->scratch[od->fill++] = samples[f * ch + od->cfg.channel];
+        if (od->fill < od->window) {
+            continue;
+        }
+        if (od->band.stages > 0) {
+            mic_filter_process(&od->band, od->scratch, od->window);
+        }
+        int64_t sum_sq = 0;
+        for (size_t i = 0; i < od->window; ++i) {
+            const int32_t x = od->scratch[i] >> 8;
+            sum_sq += (int64_t)x * x;
+        }
+        const float ms = (float)sum_sq / od->window;
+        const float db = ms > 0.0f ? 10.0f * log10f(ms) - ONSET_FULL_SCALE_DB : ONSET_SILENCE_DB;
+        if (s_update(od, db) && !fired) {
+            fired = true;
+            *at_frame = f + 1;
+        }
+        od->fill = 0;
+    }
+    od->frames += frames;
+    od->busy_us += esp_timer_get_time() - start;
+    return fired;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "mic_filter.h"
+
+#define MIC_ONSET_MAX_WINDOW 1024  // Samples per envelope window
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    int channels;          // Interleaved channels in the stream
+    int channel;           // Channel watched
+    uint32_t window_ms;    // Envelope window; also the detection step
+    float rise_db;         // Window RMS over the noise floor that fires
+    float min_dbfs;        // Never fires below this RMS
+    float hysteresis_db;   // Re-arms once RMS falls this far below the firing threshold
+    float floor_tau_ms;    // Noise floor time constant while armed
+    float band_low_hz;     // Optional band limit of the detector; 0 disables
+    float band_high_hz;
+} mic_onset_config_t;
+
+// RMS envelope with an adaptive noise floor. Caller-owned; no allocation.
+typedef struct {
+    mic_onset_config_t cfg;
+    mic_filter_t band;
+    size_t window;         // Samples per window
+    size_t fill;
+    float floor_db;
+    float alpha;           // Noise floor step per window
+    float level_db;        // Last window
+    bool have_floor;
+    bool armed;
+    int64_t busy_us;
+    uint64_t frames;
+    int32_t scratch[MIC_ONSET_MAX_WINDOW];
+} mic_onset_t;
+
+// Sets up the detector; ESP_ERR_INVALID_ARG for a window over
+// MIC_ONSET_MAX_WINDOW samples or a band the rate cannot carry.
+esp_err_t mic_onset_init(mic_onset_t *od, const mic_onset_config_t *cfg);
+
+// Scans count raw 32-bit I2S slots (a multiple of the channel count).
+// Returns true when an onset fires, with *at_frame the frame just past the
+// window that fired, relative to samples. Later frames of the call are
+// still scanned for the envelope and floor but cannot fire again until the
+// level drops back by the hysteresis.
+bool mic_onset_process(mic_onset_t *od, const int32_t *samples, size_t count, size_t *at_frame);
+
+// Resets the envelope to armed with a fresh noise floor, e.g. after a
+// recording the detector did not see.
+void mic_onset_reset(mic_onset_t *od);
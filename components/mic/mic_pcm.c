@@ -0,0 +1,194 @@
+#include "mic_pcm.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// xorshift32; one step feeds both uniform terms of a TPDF sample.
+static inline uint32_t s_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static inline int32_t s_clip(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Slot to 24-bit scale; the low 8 bits of the slot carry no microphone data,
+// which keeps the gain product within 32 bits.
+static inline int32_t s_to24(int32_t x, int gain)
+{
+    return s_clip((x >> 8) * gain, -(1 << 23), (1 << 23) - 1);
+}
+
+// 24-bit scale to 16 bits: TPDF dither of +-1 output LSB, then round.
+static inline int32_t s_to16(int32_t x, int gain, uint32_t *state)
+{
+    const uint32_t r = s_rand(state);
+    const int32_t d = (int32_t)(r & 0xff) - (int32_t)((r >> 8) & 0xff);
+    return s_clip(((x >> 8) * gain + d + 128) >> 8, INT16_MIN, INT16_MAX);
+}
+
+static inline void s_store32(uint8_t *p, uint32_t w)
+{
+    memcpy(p, &w, sizeof(w));
+}
+
+// ga applies to even samples and gb to odd ones: the left and right slots
+// of interleaved stereo, or the same gain twice for mono.
+static size_t s_pack16(const int32_t *in, size_t count, int ga, int gb, uint32_t *state, uint8_t *out)
+{
+    size_t i = 0;
+    // Two samples per word store.
+    for (; i + 2 <= count; i += 2) {
+        const int32_t a = s_to16(in[i], ga, state);
+        const int32_t b = s_to16(in[i + 1], gb, state);
+        s_store32(out + i * 2, (uint16_t)a | ((uint32_t)b << 16));
+    }
+    for (; i < count; ++i) {
+        const int32_t a = s_to16(in[i], (i & 1) ? gb : ga, state);
+        out[i * 2] = a & 0xff;
+        out[i * 2 + 1] = (a >> 8) & 0xff;
+    }
+    return count * 2;
+}
+
+static size_t s_pack24(const int32_t *in, size_t count, int ga, int gb, uint8_t *out)
+{
+    size_t i = 0;
+    // Four samples in three word stores.
+    for (; i + 4 <= count; i += 4) {
+        const uint32_t s0 = s_to24(in[i], ga);
+        const uint32_t s1 = s_to24(in[i + 1], gb);
+        const uint32_t s2 = s_to24(in[i + 2], ga);
+        const uint32_t s3 = s_to24(in[i + 3], gb);
+        uint8_t *p = out + i * 3;
+        s_store32(p, (s0 & 0xffffff) | (s1 << 24));
+        s_store32(p + 4, ((s1 >> 8) & 0xffff) | (s2 << 16));
+        s_store32(p + 8, ((s2 >> 16) & 0xff) | (s3 << 8));
+    }
+    for (; i < count; ++i) {
+        const int32_t s = s_to24(in[i], (i & 1) ? gb : ga);
+        out[i * 3] = s & 0xff;
+        out[i * 3 + 1] = (s >> 8) & 0xff;
+        out[i * 3 + 2] = (s >> 16) & 0xff;
+    }
+    return count * 3;
+}
+
+// Clip limits instead of a 64-bit product; same results.
+static inline int32_t s_gain32(int32_t x, int gain, int32_t lo, int32_t hi)
+{
+    return x > hi ? INT32_MAX : (x < lo ? INT32_MIN : x * gain);
+}
+
+static size_t s_pack32(const int32_t *in, size_t count, int ga, int gb, uint8_t *out)
+{
+    const int32_t hi_a = INT32_MAX / ga, lo_a = INT32_MIN / ga;
+    const int32_t hi_b = INT32_MAX / gb, lo_b = INT32_MIN / gb;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        s_store32(out + i * 4, (uint32_t)s_gain32(in[i], ga, lo_a, hi_a));
+        s_store32(out + i * 4 + 4, (uint32_t)s_gain32(in[i + 1], gb, lo_b, hi_b));
+    }
+    if (i < count) {
+        s_store32(out + i * 4, (uint32_t)s_gain32(in[i], ga, lo_a, hi_a));
+    }
+    return count * 4;
+}
+
+// Checks channels and gains; picks the even and odd sample gains.
+static bool s_gains(int channels, const int *gains, int max_gain, int *ga, int *gb)
+{
+    if ((channels != 1 && channels != 2) || gains == NULL) {
+        return false;
+    }
+    *ga = gains[0];
+    *gb = gains[channels - 1];
+    return *ga >= 1 && *gb >= 1 && *ga <= max_gain && *gb <= max_gain;
+}
+
+size_t mic_pcm_pack(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                    uint32_t *dither_state, uint8_t *out)
+{
+    int ga, gb;
+    if (!s_gains(channels, gains, out_bits == 32 ? INT32_MAX : MIC_PCM_MAX_GAIN, &ga, &gb) ||
+            count % channels != 0) {
+        return 0;
+    }
+    switch (out_bits) {
+    case 16:
+        if (dither_state == NULL || *dither_state == 0) {
+            return 0;
+        }
+        return s_pack16(in, count, ga, gb, dither_state, out);
+    case 24:
+        return s_pack24(in, count, ga, gb, out);
+    case 32:
+        return s_pack32(in, count, ga, gb, out);
+    default:
+        return 0;
+    }
+}
+
+size_t mic_pcm_scale(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                     uint32_t *dither_state, int32_t *out)
+{
+    int ga, gb;
+    if (!s_gains(channels, gains, MIC_PCM_MAX_GAIN, &ga, &gb) || count % channels != 0) {
+        return 0;
+    }
+    if (out_bits == 16) {
+        if (dither_state == NULL || *dither_state == 0) {
+            return 0;
+        }
+        for (size_t i = 0; i + 2 <= count; i += 2) {
+            out[i] = s_to16(in[i], ga, dither_state);
+            out[i + 1] = s_to16(in[i + 1], gb, dither_state);
+        }
+        if (count & 1) {
+            out[count - 1] = s_to16(in[count - 1], ga, dither_state);
+        }
+        return count;
+    }
+    if (out_bits == 24) {
+        for (size_t i = 0; i + 2 <= count; i += 2) {
+            out[i] = s_to24(in[i], ga);
+            out[i + 1] = s_to24(in[i + 1], gb);
+        }
+        if (count & 1) {
+            out[count - 1] = s_to24(in[count - 1], ga);
+        }
+        return count;
+    }
+    return 0;
+}
+
+void mic_pcm_levels(const int32_t *in, size_t count, int channels, mic_pcm_level_t *levels)
+{
+    if (channels != 1 && channels != 2) {
+        return;
+    }
+    // Integer sums per call; a 24-bit square is below 2^46, so 2^17 samples fit.
+    int32_t peak[2] = {levels[0].peak, levels[channels - 1].peak};
+    uint64_t sum[2] = {0, 0};
+    for (size_t i = 0; i < count; ++i) {
+        const int c = (channels == 2) & i;
+        const int32_t v = in[i] >> 8;
+        const int32_t a = v < 0 ? -v : v;
+        if (a > peak[c]) {
+            peak[c] = a;
+        }
+        sum[c] += (uint64_t)((int64_t)v * v);
+    }
+    for (int c = 0; c < channels; ++c) {
+        levels[c].peak = peak[c];
+        levels[c].sum_sq += (double)sum[c];
+        levels[c].count += count / channels;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest gain mic_pcm_pack() takes for 16 and 24 bit output.
+#define MIC_PCM_MAX_GAIN 127
+
+// Peak and energy of one channel, in 24-bit microphone units before gain.
+typedef struct {
+    int32_t peak;
+    double sum_sq;
+    uint64_t count;
+} mic_pcm_level_t;
+
+// Converts 32-bit I2S slots holding 24 significant bits (ICS-43434) into
+// little-endian PCM of out_bits (16, 24 or 32) in one pass: integer gain,
+// TPDF dither where bits are dropped, clipping and packing.
+// channels is 1 or 2; stereo stays interleaved, each slot with its own entry
+// of gains[channels], and count (in samples, not frames) must be a multiple
+// of channels.
+// 24-bit output keeps every microphone bit, so it is not dithered; 32-bit
+// output keeps the raw slot times gain. out may be the same buffer as in.
+// dither_state is any non-zero value, carried across calls.
+// Returns the number of bytes written, or 0 for an unsupported format or gain.
+size_t mic_pcm_pack(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                    uint32_t *dither_state, uint8_t *out);
+
+// Same gain, dither and clipping as mic_pcm_pack(), but leaves right-justified
+// int32 samples of out_bits (16 or 24) for encoders. out may be in.
+// Returns count, or 0 for an unsupported format or gain.
+size_t mic_pcm_scale(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                     uint32_t *dither_state, int32_t *out);
+
+// Adds raw slots to per-channel levels (levels[channels], zeroed to start).
+// Up to 2^17 samples per call.
+void mic_pcm_levels(const int32_t *in, size_t count, int channels, mic_pcm_level_t *levels);
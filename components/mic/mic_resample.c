@@ -0,0 +1,189 @@
+#include "mic_resample.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESAMPLE_TAPS_PER_PHASE 24   // Taps per output phase; also multiplies per input frame
+#define RESAMPLE_KAISER_BETA    8.0  // About 80 dB stopband
+#define RESAMPLE_CHUNK_FRAMES   256  // Input frames copied into the delay line per pass
+#define RESAMPLE_MAX_CHANNELS   2
+
+// A polyphase decimator only computes the outputs it keeps: one dot product
+// of the whole filter per output, stepping factor input frames at a time.
+struct mic_resample {
+    int factor;
+    int channels;
+    int taps;
+    int phase;       // Input frames before the next output
+    bool primed;
+    int32_t *coefs;  // Q31, summing to 1
+    int32_t *line;   // taps - 1 frames of history, then the current chunk
+};
+
+// High word of a 32x32 product; one multiply-high instruction on Xtensa.
+static inline int32_t s_mulh(int32_t x, int32_t h)
+{
+    return (int32_t)(((int64_t)x * h) >> 32);
+}
+
+// Q31 coefficients are half scale in the high word; doubles it back.
+static inline int32_t s_out(int32_t acc)
+{
+    return acc > INT32_MAX / 2 ? INT32_MAX : (acc < INT32_MIN / 2 ? INT32_MIN : acc * 2);
+}
+
+static double s_bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        const double t = x / (2.0 * k);
+        term *= t * t;
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc with its cutoff at the output Nyquist frequency;
+// aliases then only fold into the top of the transition band.
+static void s_design(int32_t *coefs, int taps, int factor)
+{
+    const double fc = 0.5 / factor;
+    const double mid = (taps - 1) / 2.0;
+    const double i0_beta = s_bessel_i0(RESAMPLE_KAISER_BETA);
+    double sum = 0.0;
+    // First pass sums the taps for normalisation, the second quantises them.
+    for (int pass = 0; pass < 2; ++pass) {
+        int64_t qsum = 0;
+        for (int t = 0; t < taps; ++t) {
+            const double x = t - mid;
+            const double r = x / mid;
+            const double sinc = x == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+            const double v = sinc * s_bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1.0 - r * r)) / i0_beta;
+            if (pass == 0) {
+                sum += v;
+            } else {
+                coefs[t] = (int32_t)lround(v / sum * 2147483648.0);
+                qsum += coefs[t];
+            }
+        }
+        if (pass == 1) {
+            // Rounding residue into the centre taps, so DC passes at exactly unity gain.
+            const int64_t err = ((int64_t)1 << 31) - qsum;
+            coefs[taps / 2 - 1] += (int32_t)(err / 2);
+            coefs[taps / 2] += (int32_t)(err - err / 2);
+        }
+    }
+}
+
+// taps is a multiple of 4. Each high word rounds down by half a unit on
+// average; the accumulators start at taps / 4 each to cancel it.
+static inline int32_t s_dot1(const int32_t *x, const int32_t *h, int taps)
+{
+    int32_t a = taps / 4;
+    int32_t b = taps / 4;
+    for (int t = 0; t < taps; t += 4) {
+        a += s_mulh(x[t], h[t]) + s_mulh(x[t + 2], h[t + 2]);
+        b += s_mulh(x[t + 1], h[t + 1]) + s_mulh(x[t + 3], h[t + 3]);
+    }
+    return s_out(a + b);
+}
+
+// Interleaved stereo: both channels share each coefficient load.
+static inline void s_dot2(const int32_t *x, const int32_t *h, int taps, int32_t *out)
+{
+    int32_t l = taps / 2;
+    int32_t r = taps / 2;
+    for (int t = 0; t < taps; t += 4, x += 8) {
+        const int32_t h0 = h[t];
+        const int32_t h1 = h[t + 1];
+        const int32_t h2 = h[t + 2];
+        const int32_t h3 = h[t + 3];
+        l += s_mulh(x[0], h0) + s_mulh(x[2], h1) + s_mulh(x[4], h2) + s_mulh(x[6], h3);
+        r += s_mulh(x[1], h0) + s_mulh(x[3], h1) + s_mulh(x[5], h2) + s_mulh(x[7], h3);
+    }
+    out[0] = s_out(l);
+    out[1] = s_out(r);
+}
+
+mic_resample_t *mic_resample_begin(uint32_t in_rate_hz, uint32_t out_rate_hz, int channels)
+{
+    if (out_rate_hz == 0 || in_rate_hz % out_rate_hz != 0 || channels < 1 || channels > RESAMPLE_MAX_CHANNELS) {
+        return NULL;
+    }
+    const uint32_t factor = in_rate_hz / out_rate_hz;
+    if (factor < 2 || factor > MIC_RESAMPLE_MAX_FACTOR) {
+        return NULL;
+    }
+    mic_resample_t *rs = (mic_resample_t *)calloc(1, sizeof(*rs));
+    if (rs == NULL) {
+        return NULL;
+    }
+    rs->factor = (int)factor;
+    rs->channels = channels;
+    rs->taps = RESAMPLE_TAPS_PER_PHASE * rs->factor;
+    rs->phase = 0;
+    rs->coefs = (int32_t *)malloc(rs->taps * sizeof(int32_t));
+    rs->line = (int32_t *)calloc((rs->taps - 1 + RESAMPLE_CHUNK_FRAMES) * channels, sizeof(int32_t));
+    if (rs->coefs == NULL || rs->line == NULL) {
+        mic_resample_end(rs);
+        return NULL;
+    }
+    s_design(rs->coefs, rs->taps, rs->factor);
+    return rs;
+}
+
+size_t mic_resample_process(mic_resample_t *rs, int32_t *samples, size_t count)
+{
+    const int ch = rs->channels;
+    const size_t hist = (size_t)(rs->taps - 1) * ch;
+    const size_t frames = count / ch;
+    size_t in = 0;
+    size_t out = 0;
+    if (!rs->primed && frames > 0) {
+        // History repeats the first frame, so a DC offset does not start
+        // with a step.
+        for (size_t i = 0; i < hist; ++i) {
+            rs->line[i] = samples[i % ch];
+        }
+        rs->primed = true;
+    }
+    while (in < frames) {
+        size_t n = frames - in;
+        if (n > RESAMPLE_CHUNK_FRAMES) {
+            n = RESAMPLE_CHUNK_FRAMES;
+        }
+        // Outputs never overtake the input already copied, so they can
+        // overwrite it in place.
+        memcpy(rs->line + hist, samples + in * ch, n * ch * sizeof(int32_t));
+        size_t p = (size_t)rs->phase;
+        if (ch == 2) {
+            for (; p < n; p += rs->factor, ++out) {
+                s_dot2(rs->line + p * 2, rs->coefs, rs->taps, samples + out * 2);
+            }
+        } else {
+            for (; p < n; p += rs->factor, ++out) {
+                samples[out] = s_dot1(rs->line + p, rs->coefs, rs->taps);
+            }
+        }
+        rs->phase = (int)(p - n);
+        memmove(rs->line, rs->line + n * ch, hist * sizeof(int32_t));
+        in += n;
+    }
+    return out * ch;
+}
+
+void mic_resample_end(mic_resample_t *rs)
+{
+    if (rs == NULL) {
+        return;
+    }
+    free(rs->coefs);
+    free(rs->line);
+    free(rs);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest in_rate / out_rate mic_resample_begin() takes; 48 kHz to 4 kHz.
+#define MIC_RESAMPLE_MAX_FACTOR 12
+
+typedef struct mic_resample mic_resample_t;
+
+// Starts a decimator from in_rate_hz down to out_rate_hz, which must divide
+// it by an integer factor of 2 to MIC_RESAMPLE_MAX_FACTOR, for 1 or 2
+// interleaved channels. The linear-phase low-pass is flat within 0.1 dB up to
+// 0.41 * out_rate_hz, and aliases below 0.38 * out_rate_hz are at least 80 dB
+// down. Returns NULL for bad arguments or no memory.
+mic_resample_t *mic_resample_begin(uint32_t in_rate_hz, uint32_t out_rate_hz, int channels);
+
+// Filters count raw 32-bit I2S slots (a multiple of the channel count) in
+// place, leaving the output samples at the start of the buffer in the same
+// slot format. Filter history and output phase carry across calls, so any
+// block size works. Returns the number of output samples (not frames).
+size_t mic_resample_process(mic_resample_t *rs, int32_t *samples, size_t count);
+
+// Frees rs; NULL is ignored.
+void mic_resample_end(mic_resample_t *rs);
@@ -0,0 +1,233 @@
+#include "mic_silence.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+// Every frame passes through a ring of pre_ms plus one window. Each full
+// window is classified; kept windows flush the whole ring to the store, so
+// the pre_ms ahead of an onset goes out with it. While silent, frames
+// pushed out of the ring are counted into the current span instead.
+
+#define SILENCE_MAX_CHANNELS 2
+#define SILENCE_HEADER_LEN   12
+#define SILENCE_RECORD_LEN   20
+#define SILENCE_FULL_SCALE_DB 138.4738  // 20 log10(2^23): levels are in 24-bit units
+#define SILENCE_DIGITAL      INT16_MIN
+
+struct mic_silence {
+    FILE *f;
+    int channels;
+    size_t window;       // Frames per decision
+    size_t pre;          // Frames kept ahead of activity
+    size_t hang;         // Frames kept after it
+    size_t hang_left;
+    double threshold_ms; // Mean square that makes a window active
+    int64_t sum_sq[SILENCE_MAX_CHANNELS];
+    size_t fill;         // Frames of the current window
+    int32_t *ring;       // pre + window frames
+    size_t ring_frames;
+    size_t head;         // Oldest buffered frame
+    size_t count;        // Buffered frames
+    uint64_t stored;     // Frames passed to the store
+    uint64_t span;       // Frames of the pending span
+    double span_ms_sum;  // Mean squares of its silent windows
+    uint32_t span_windows;
+    int64_t store_us;    // Inside the store, left out of detect_us
+    mic_silence_stats_t stats;
+};
+
+static void s_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void s_put32(uint8_t *p, uint32_t v)
+{
+    s_put16(p, v & 0xffff);
+    s_put16(p + 2, v >> 16);
+}
+
+static void s_put64(uint8_t *p, uint64_t v)
+{
+    s_put32(p, (uint32_t)v);
+    s_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+// 0.01 dB of a full-scale slot, clamped to the int16 range.
+static int16_t s_centi_db(double ms)
+{
+    if (ms <= 0.0) {
+        return SILENCE_DIGITAL;
+    }
+    const double cdb = round(100.0 * (10.0 * log10(ms) - SILENCE_FULL_SCALE_DB));
+    return (int16_t)fmax(SILENCE_DIGITAL + 1, fmin(INT16_MAX, cdb));
+}
+
+static esp_err_t s_write_span(mic_silence_t *sil)
+{
+    if (sil->span == 0) {
+        return ESP_OK;
+    }
+    uint8_t rec[SILENCE_RECORD_LEN] = {0};
+    s_put64(rec, sil->stored);
+    s_put64(rec + 8, sil->span);
+    const double ms = sil->span_windows > 0 ? sil->span_ms_sum / sil->span_windows : 0.0;
+    s_put16(rec + 16, (uint16_t)s_centi_db(ms));
+    sil->stats.elided_frames += sil->span;
+    sil->stats.spans++;
+    sil->span = 0;
+    sil->span_ms_sum = 0.0;
+    sil->span_windows = 0;
+    return fwrite(rec, 1, sizeof(rec), sil->f) == sizeof(rec) ? ESP_OK : ESP_FAIL;
+}
+
+// Passes every buffered frame to store, oldest first.
+static esp_err_t s_flush(mic_silence_t *sil, mic_silence_store_t store, void *ctx)
+{
+    const int64_t start = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+    while (sil->count > 0 && ret == ESP_OK) {
+        size_t n = sil->ring_frames - sil->head;
+        if (n > sil->count) {
+            n = sil->count;
+        }
+        ret = store(ctx, sil->ring + sil->head * sil->channels, n * sil->channels);
+        sil->stored += n;
+        sil->head = (sil->head + n) % sil->ring_frames;
+        sil->count -= n;
+    }
+    sil->store_us += esp_timer_get_time() - start;
+    return ret;
+}
+
+// Classifies the window just filled and keeps or drops what it pushed out.
+static esp_err_t s_decide(mic_silence_t *sil, mic_silence_store_t store, void *ctx)
+{
+    int64_t loudest = 0;
+    for (int c = 0; c < sil->channels; ++c) {
+        if (sil->sum_sq[c] > loudest) {
+            loudest = sil->sum_sq[c];
+        }
+        sil->sum_sq[c] = 0;
+    }
+    sil->fill = 0;
+    const double ms = (double)loudest / sil->window;
+    if (ms >= sil->threshold_ms) {
+        sil->hang_left = sil->hang;
+    } else if (sil->hang_left > 0) {
+        sil->hang_left = sil->hang_left > sil->window ? sil->hang_left - sil->window : 0;
+    } else {
+        sil->span_ms_sum += ms;
+        sil->span_windows++;
+        if (sil->count > sil->pre) {
+            const size_t drop = sil->count - sil->pre;
+            sil->span += drop;
+            sil->head = (sil->head + drop) % sil->ring_frames;
+            sil->count -= drop;
+        }
+        return ESP_OK;
+    }
+    if (s_write_span(sil) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return s_flush(sil, store, ctx);
+}
+
+mic_silence_t *mic_silence_begin(FILE *f, uint32_t sample_rate_hz, int channels, const mic_silence_config_t *cfg)
+{
+    if (f == NULL || sample_rate_hz == 0 || channels < 1 || channels > SILENCE_MAX_CHANNELS) {
+        return NULL;
+    }
+    const size_t window = (size_t)sample_rate_hz * cfg->window_ms / 1000;
+    if (window == 0 || window > UINT16_MAX) {
+        return NULL;
+    }
+    mic_silence_t *sil = (mic_silence_t *)calloc(1, sizeof(*sil));
+    if (sil == NULL) {
+        return NULL;
+    }
+    sil->f = f;
+    sil->channels = channels;
+    sil->window = window;
+    sil->pre = (size_t)sample_rate_hz * cfg->pre_ms / 1000;
+    sil->hang = (size_t)sample_rate_hz * cfg->hang_ms / 1000;
+    const double threshold = pow(10.0, (cfg->threshold_dbfs + SILENCE_FULL_SCALE_DB) / 20.0);
+    sil->threshold_ms = threshold * threshold;
+    sil->ring_frames = sil->pre + window;
+    sil->ring = (int32_t *)malloc(sil->ring_frames * channels * sizeof(int32_t));
+    if (sil->ring == NULL) {
+        free(sil);
+        return NULL;
+    }
+
+    uint8_t header[SILENCE_HEADER_LEN] = {'M', 'S', 'I', 'L', MIC_SILENCE_VERSION, (uint8_t)channels};
+    s_put16(header + 6, (uint16_t)window);
+    s_put32(header + 8, sample_rate_hz);
+    if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+        mic_silence_end(sil, NULL, NULL, NULL);
+        return NULL;
+    }
+    return sil;
+}
+
+esp_err_t mic_silence_process(mic_silence_t *sil, const int32_t *samples, size_t count,
+                              mic_silence_store_t store, void *ctx)
+{
+    const int64_t start = esp_timer_get_time();
+    const int64_t store_start = sil->store_us;
+    const int ch = sil->channels;
+    size_t frames = count / ch;
+    sil->stats.frames += frames;
+    esp_err_t ret = ESP_OK;
+    while (frames > 0 && ret == ESP_OK) {
+        // Up to the end of the window and of the ring's contiguous space.
+        const size_t tail = (sil->head + sil->count) % sil->ring_frames;
+        size_t n = sil->window - sil->fill;
+        if (n > frames) {
+            n = frames;
+        }
+        if (n > sil->ring_frames - tail) {
+            n = sil->ring_frames - tail;
+        }
+        int32_t *dst = sil->ring + tail * ch;
+        memcpy(dst, samples, n * ch * sizeof(int32_t));
+        for (size_t i = 0; i < n * ch; i += ch) {
+            for (int c = 0; c < ch; ++c) {
+                const int32_t x = dst[i + c] >> 8;
+                sil->sum_sq[c] += (int64_t)x * x;
+            }
+        }
+        sil->count += n;
+        sil->fill += n;
+        samples += n * ch;
+        frames -= n;
+        if (sil->fill == sil->window) {
+            ret = s_decide(sil, store, ctx);
+        }
+    }
+    sil->stats.detect_us += esp_timer_get_time() - start - (sil->store_us - store_start);
+    return ret;
+}
+
+esp_err_t mic_silence_end(mic_silence_t *sil, mic_silence_store_t store, void *ctx, mic_silence_stats_t *stats)
+{
+    esp_err_t ret = ESP_OK;
+    if (store != NULL) {
+        // The partial window and the pre_ms before it are kept.
+        ret = s_write_span(sil);
+        if (ret == ESP_OK) {
+            ret = s_flush(sil, store, ctx);
+        }
+    }
+    if (stats != NULL) {
+        *stats = sil->stats;
+    }
+    free(sil->ring);
+    free(sil);
+    return ret;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+
+#define MIC_SILENCE_VERSION 1
+
+// Sidecar layout, little-endian:
+//   header: "MSIL", u8 version, u8 channels, u16 window in frames, u32 sample rate
+//   record per left-out span: u64 position, u64 frames, i16 level, u16 0
+// position counts frames of the stored audio; the span's frames belong
+// before that frame. level is the span's mean RMS on its loudest channel,
+// in 0.01 dB of a full-scale slot (-32768 for digital silence).
+
+typedef struct mic_silence mic_silence_t;
+
+typedef struct {
+    float threshold_dbfs;  // A window is active when any channel's RMS reaches this
+    uint32_t window_ms;
+    uint32_t hang_ms;      // Kept after the last active window
+    uint32_t pre_ms;       // Kept ahead of an active window
+} mic_silence_config_t;
+
+typedef struct {
+    uint64_t frames;         // Frames seen
+    uint64_t elided_frames;  // Frames left out
+    uint32_t spans;          // Records written
+    int64_t detect_us;       // Time spent classifying and buffering, storing excluded
+} mic_silence_stats_t;
+
+// Receives the frames to keep, in order; may change them in place.
+typedef esp_err_t (*mic_silence_store_t)(void *ctx, int32_t *samples, size_t count);
+
+// Starts a silence gate for an interleaved stream, with its markers going
+// to f, open for writing at its start. Returns NULL for bad arguments or no
+// memory.
+mic_silence_t *mic_silence_begin(FILE *f, uint32_t sample_rate_hz, int channels, const mic_silence_config_t *cfg);
+
+// Adds count raw 32-bit I2S slots (a multiple of the channel count). Kept
+// frames reach store up to pre_ms plus one window later; frames of silence
+// longer than hang_ms + pre_ms never do and are recorded as a span instead.
+// Returns the first error from store, or ESP_FAIL when a marker write fails.
+esp_err_t mic_silence_process(mic_silence_t *sil, const int32_t *samples, size_t count,
+                              mic_silence_store_t store, void *ctx);
+
+// Records a pending span, passes the buffered frames to store and frees sil.
+// With store NULL nothing more is written. f stays open. stats may be NULL.
+esp_err_t mic_silence_end(mic_silence_t *sil, mic_silence_store_t store, void *ctx, mic_silence_stats_t *stats);
@@ -0,0 +1,328 @@
+#include "mic_spectrum.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+// A real frame of N samples is transformed as N/2 complex points (even
+// samples real, odd imaginary) by a radix-4 decimation-in-frequency FFT,
+// with one radix-2 stage when N/2 is not a power of 4, then split into the
+// N/2 + 1 bins of the real spectrum.
+
+#define SPECTRUM_HEADER_LEN (16 + 2 * (MIC_SPECTRUM_BANDS + 1))
+#define SPECTRUM_RECORD_LEN (4 + 2 * MIC_SPECTRUM_BANDS)
+#define SPECTRUM_SILENCE   INT16_MIN
+
+typedef struct {
+    float re;
+    float im;
+} s_cpx_t;
+
+struct mic_spectrum {
+    FILE *f;
+    uint32_t sample_rate_hz;
+    int n;          // Real FFT size
+    int channels;
+    int channel;
+    size_t fill;    // Samples in frame
+    uint32_t frames;
+    int64_t analyze_us;
+    float window_power;  // Sum of squared window values
+    float *frame;   // Last n samples, full scale 1.0
+    float *window;
+    s_cpx_t *twiddle;  // exp(-2 pi i k / n), k < n
+    s_cpx_t *work;     // n / 2 complex points
+    uint16_t *slot;    // FFT output slot of each bin
+    float *power;      // n / 2 + 1 bins
+    uint16_t edges[MIC_SPECTRUM_BANDS + 1];
+};
+
+static void s_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void s_put32(uint8_t *p, uint32_t v)
+{
+    s_put16(p, v & 0xffff);
+    s_put16(p + 2, v >> 16);
+}
+
+// 0.01 dB, clamped to the int16 range.
+static int16_t s_centi_db(float power)
+{
+    if (power <= 0.0f) {
+        return SPECTRUM_SILENCE;
+    }
+    const float cdb = 1000.0f * log10f(power);
+    return cdb <= SPECTRUM_SILENCE ? SPECTRUM_SILENCE : (cdb >= INT16_MAX ? INT16_MAX : (int16_t)lrintf(cdb));
+}
+
+// One DIF pass over every sub-transform of length len: radix-4 butterflies
+// on quarters, each output but the first turned by its twiddle.
+static void s_radix4_pass(s_cpx_t *x, int m, int len, const s_cpx_t *tw, int tw_step)
+{
+    const int q = len / 4;
+    for (int base = 0; base < m; base += len) {
+        s_cpx_t *p = x + base;
+        for (int j = 0; j < q; ++j) {
+            const s_cpx_t a = p[j];
+            const s_cpx_t b = p[j + q];
+            const s_cpx_t c = p[j + 2 * q];
+            const s_cpx_t d = p[j + 3 * q];
+            const float t0r = a.re + c.re, t0i = a.im + c.im;
+            const float t1r = a.re - c.re, t1i = a.im - c.im;
+            const float t2r = b.re + d.re, t2i = b.im + d.im;
+            const float t3r = b.re - d.re, t3i = b.im - d.im;
+            // Forward transform: the quarter turn is -i.
+            const float y1r = t1r + t3i, y1i = t1i - t3r;
+            const float y2r = t0r - t2r, y2i = t0i - t2i;
+            const float y3r = t1r - t3i, y3i = t1i + t3r;
+            const s_cpx_t w1 = tw[j * tw_step];
+            const s_cpx_t w2 = tw[2 * j * tw_step];
+            const s_cpx_t w3 = tw[3 * j * tw_step];
+            p[j].re = t0r + t2r;
+            p[j].im = t0i + t2i;
+            p[j + q].re = y1r * w1.re - y1i * w1.im;
+            p[j + q].im = y1r * w1.im + y1i * w1.re;
+            p[j + 2 * q].re = y2r * w2.re - y2i * w2.im;
+            p[j + 2 * q].im = y2r * w2.im + y2i * w2.re;
+            p[j + 3 * q].re = y3r * w3.re - y3i * w3.im;
+            p[j + 3 * q].im = y3r * w3.im + y3i * w3.re;
+        }
+    }
+}
+
+// Last pass when m is not a power of 4; twiddles are all 1.
+static void s_radix2_pass(s_cpx_t *x, int m)
+{
+    for (int i = 0; i < m; i += 2) {
+        const s_cpx_t a = x[i];
+        const s_cpx_t b = x[i + 1];
+        x[i].re = a.re + b.re;
+        x[i].im = a.im + b.im;
+        x[i + 1].re = a.re - b.re;
+        x[i + 1].im = a.im - b.im;
+    }
+}
+
+// In-place FFT of m = n / 2 points, left in DIF output order.
+static void s_fft(mic_spectrum_t *sp)
+{
+    const int m = sp->n / 2;
+    int len = m;
+    // Twiddles of a length-len transform are every (n / len)th of the table.
+    for (; len >= 4; len /= 4) {
+        s_radix4_pass(sp->work, m, len, sp->twiddle, sp->n / len);
+    }
+    if (len == 2) {
+        s_radix2_pass(sp->work, m);
+    }
+}
+
+// Finds each bin among the DIF outputs. A pass of radix r over length len
+// leaves the sub-transform of bins congruent to q (mod r) in its qth part,
+// so slot digits read most significant first give bin digits least
+// significant first.
+static void s_fill_slots(uint16_t *slot_of_bin, int m)
+{
+    for (int slot = 0; slot < m; ++slot) {
+        int rest = slot;
+        int len = m;
+        int bin = 0;
+        int weight = 1;
+        while (len > 1) {
+            const int r = len >= 4 ? 4 : 2;
+            len /= r;
+            bin += (rest / len) * weight;
+            rest %= len;
+            weight *= r;
+        }
+        slot_of_bin[bin] = (uint16_t)slot;
+    }
+}
+
+// Power of the real spectrum from the half-size complex transform.
+static void s_real_power(mic_spectrum_t *sp)
+{
+    const int m = sp->n / 2;
+    const s_cpx_t *z = sp->work;
+    const uint16_t *slot = sp->slot;
+    const s_cpx_t z0 = z[slot[0]];
+    sp->power[0] = (z0.re + z0.im) * (z0.re + z0.im);
+    sp->power[m] = (z0.re - z0.im) * (z0.re - z0.im);
+    for (int k = 1; k < m; ++k) {
+        const s_cpx_t a = z[slot[k]];
+        const s_cpx_t b = z[slot[m - k]];
+        // Even part (a + conj b) / 2, odd part (a - conj b) / 2i, then
+        // X = even + w^k odd.
+        const float er = 0.5f * (a.re + b.re), ei = 0.5f * (a.im - b.im);
+        const float or_ = 0.5f * (a.im + b.im), oi = -0.5f * (a.re - b.re);
+        const s_cpx_t w = sp->twiddle[k];
+        const float xr = er + or_ * w.re - oi * w.im;
+        const float xi = ei + or_ * w.im + oi * w.re;
+        sp->power[k] = xr * xr + xi * xi;
+    }
+}
+
+static esp_err_t s_analyze(mic_spectrum_t *sp)
+{
+    const int n = sp->n;
+    const int m = n / 2;
+    float sum_sq = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        sum_sq += sp->frame[i] * sp->frame[i];
+    }
+    for (int i = 0; i < m; ++i) {
+        sp->work[i].re = sp->frame[2 * i] * sp->window[2 * i];
+        sp->work[i].im = sp->frame[2 * i + 1] * sp->window[2 * i + 1];
+    }
+    s_fft(sp);
+    s_real_power(sp);
+
+    // One-sided Parseval: bins inside (0, n/2) count twice.
+    const float scale = 1.0f / (n * sp->window_power);
+    int peak = 1;
+    for (int k = 2; k < m; ++k) {
+        if (sp->power[k] > sp->power[peak]) {
+            peak = k;
+        }
+    }
+    // Parabolic fit on log power around the peak bin.
+    float peak_bin = (float)peak;
+    if (peak > 0 && peak < m && sp->power[peak] > 0.0f) {
+        const float l = logf(sp->power[peak - 1] + 1e-30f);
+        const float c = logf(sp->power[peak]);
+        const float r = logf(sp->power[peak + 1] + 1e-30f);
+        const float den = l - 2.0f * c + r;
+        if (den < 0.0f) {
+            peak_bin += 0.5f * (l - r) / den;
+        }
+    }
+
+    uint8_t rec[SPECTRUM_RECORD_LEN];
+    s_put16(rec, (uint16_t)s_centi_db(sum_sq / n));
+    s_put16(rec + 2, (uint16_t)lrintf(peak_bin * sp->sample_rate_hz / n));
+    for (int b = 0; b < MIC_SPECTRUM_BANDS; ++b) {
+        float e = 0.0f;
+        for (int k = sp->edges[b]; k < sp->edges[b + 1]; ++k) {
+            e += (k == 0 || k == m) ? sp->power[k] : 2.0f * sp->power[k];
+        }
+        s_put16(rec + 4 + 2 * b, (uint16_t)s_centi_db(e * scale));
+    }
+    if (fwrite(rec, 1, sizeof(rec), sp->f) != sizeof(rec)) {
+        return ESP_FAIL;
+    }
+    sp->frames++;
+    return ESP_OK;
+}
+
+void mic_spectrum_end(mic_spectrum_t *sp, mic_spectrum_stats_t *stats)
+{
+    if (sp == NULL) {
+        return;
+    }
+    if (stats != NULL) {
+        stats->frames = sp->frames;
+        stats->analyze_us = sp->analyze_us;
+    }
+    free(sp->frame);
+    free(sp->window);
+    free(sp->twiddle);
+    free(sp->work);
+    free(sp->slot);
+    free(sp->power);
+    free(sp);
+}
+
+mic_spectrum_t *mic_spectrum_begin(FILE *f, uint32_t sample_rate_hz, int fft_size, int channels, int channel)
+{
+    if (f == NULL || sample_rate_hz == 0 || (fft_size != 512 && fft_size != 1024) ||
+            channels < 1 || channel < 0 || channel >= channels) {
+        return NULL;
+    }
+    mic_spectrum_t *sp = (mic_spectrum_t *)calloc(1, sizeof(*sp));
+    if (sp == NULL) {
+        return NULL;
+    }
+    const int n = fft_size;
+    sp->f = f;
+    sp->sample_rate_hz = sample_rate_hz;
+    sp->n = n;
+    sp->channels = channels;
+    sp->channel = channel;
+    sp->frame = (float *)malloc(n * sizeof(float));
+    sp->window = (float *)malloc(n * sizeof(float));
+    sp->twiddle = (s_cpx_t *)malloc(n * sizeof(s_cpx_t));
+    sp->work = (s_cpx_t *)malloc(n / 2 * sizeof(s_cpx_t));
+    sp->slot = (uint16_t *)malloc(n / 2 * sizeof(uint16_t));
+    sp->power = (float *)malloc((n / 2 + 1) * sizeof(float));
+    if (sp->frame == NULL || sp->window == NULL || sp->twiddle == NULL || sp->work == NULL ||
+            sp->slot == NULL || sp->power == NULL) {
+        mic_spectrum_end(sp, NULL);
+        return NULL;
+    }
+    // Periodic Hann, so overlapping frames at n / 2 sum to a constant.
+    double power = 0.0;
+    for (int i = 0; i < n; ++i) {
+        const double w = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+        sp->window[i] = (float)w;
+        power += w * w;
+    }
+    sp->window_power = (float)power;
+    for (int k = 0; k < n; ++k) {
+        sp->twiddle[k].re = (float)cos(2.0 * M_PI * k / n);
+        sp->twiddle[k].im = (float)-sin(2.0 * M_PI * k / n);
+    }
+    s_fill_slots(sp->slot, n / 2);
+    // Log-spaced bands from bin 1 to n / 2, at least one bin each; DC is left out.
+    const int top = n / 2 + 1;
+    sp->edges[0] = 1;
+    for (int b = 1; b <= MIC_SPECTRUM_BANDS; ++b) {
+        const int remaining = MIC_SPECTRUM_BANDS - b;
+        int e = (int)lround(pow((double)top, (double)b / MIC_SPECTRUM_BANDS));
+        if (e < sp->edges[b - 1] + 1) {
+            e = sp->edges[b - 1] + 1;
+        }
+        if (e > top - remaining) {
+            e = top - remaining;
+        }
+        sp->edges[b] = (uint16_t)e;
+    }
+
+    uint8_t header[SPECTRUM_HEADER_LEN] = {'M', 'S', 'P', 'C', MIC_SPECTRUM_VERSION, MIC_SPECTRUM_BANDS,
+                                           (uint8_t)channel, 0};
+    s_put32(header + 8, sample_rate_hz);
+    s_put16(header + 12, (uint16_t)n);
+    s_put16(header + 14, (uint16_t)(n / 2));
+    for (int b = 0; b <= MIC_SPECTRUM_BANDS; ++b) {
+        s_put16(header + 16 + 2 * b, sp->edges[b]);
+    }
+    if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+        mic_spectrum_end(sp, NULL);
+        return NULL;
+    }
+    return sp;
+}
+
+esp_err_t mic_spectrum_write(mic_spectrum_t *sp, const int32_t *samples, size_t count)
+{
+    const int64_t start = esp_timer_get_time();
+    const float to_unit = 1.0f / 2147483648.0f;
+    const int hop = sp->n / 2;
+    esp_err_t ret = ESP_OK;
+    for (size_t i = sp->channel; i < count && ret == ESP_OK; i += sp->channels) {
+        sp->frame[sp->fill++] = samples[i] * to_unit;
+        if (sp->fill == (size_t)sp->n) {
+            ret = s_analyze(sp);
+            memmove(sp->frame, sp->frame + hop, hop * sizeof(float));
+            sp->fill = hop;
+        }
+    }
+    sp->analyze_us += esp_timer_get_time() - start;
+    return ret;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+
+#define MIC_SPECTRUM_BANDS   16
+#define MIC_SPECTRUM_VERSION 1
+
+// Sidecar layout, little-endian:
+//   header: "MSPC", u8 version, u8 bands, u8 channel, u8 0, u32 sample rate,
+//           u16 FFT size, u16 hop, u16 band edges[bands + 1] in FFT bins
+//           (band b is bins edges[b] to edges[b + 1] - 1)
+//   record per hop: i16 RMS, u16 peak frequency in Hz, i16 band energy[bands]
+// Levels are in 0.01 dB of a full-scale slot (-32768 for silence). Band
+// energies are corrected for the window's power and sum to the frame's
+// mean square without DC, so a full-scale sine reads -3 dB in its band,
+// like its RMS.
+
+typedef struct mic_spectrum mic_spectrum_t;
+
+typedef struct {
+    uint32_t frames;     // Records written
+    int64_t analyze_us;  // Time spent windowing, transforming and reducing
+} mic_spectrum_stats_t;
+
+// Starts an analysis of one channel of the interleaved stream into f, open
+// for writing at its start: Hann-windowed FFTs of fft_size (512 or 1024)
+// samples every fft_size / 2. Returns NULL for bad arguments or no memory.
+mic_spectrum_t *mic_spectrum_begin(FILE *f, uint32_t sample_rate_hz, int fft_size, int channels, int channel);
+
+// Adds count raw 32-bit I2S slots (a multiple of the channel count) and
+// writes a record for every complete hop.
+esp_err_t mic_spectrum_write(mic_spectrum_t *sp, const int32_t *samples, size_t count);
+
+// Frees sp; a partial last frame is dropped. f stays open. stats may be NULL.
+void mic_spectrum_end(mic_spectrum_t *sp, mic_spectrum_stats_t *stats);
@@ -0,0 +1,190 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <complex.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mic_filter.h"
+
+#define TEST_RATE      16000
+#define TEST_FRAMES    16000    // One second
+#define TEST_AMPLITUDE 0.25     // Of a full-scale slot
+
+static void make_sine(int32_t *x, size_t frames, int channels, double freq_hz, int32_t offset)
+{
+    for (size_t i = 0; i < frames; i++) {
+        const double v = TEST_AMPLITUDE * sin(2.0 * M_PI * freq_hz * i / TEST_RATE);
+        for (int c = 0; c < channels; c++) {
+            x[i * channels + c] = (int32_t)lround(v * 2147483648.0) + offset;
+        }
+    }
+}
+
+// Least-squares amplitude of freq_hz in the second half of channel c,
+// relative to the input sine.
+static double fit_gain(const int32_t *y, size_t frames, int channels, int c, double freq_hz)
+{
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = frames / 2; i < frames; i++) {
+        const double w = 2.0 * M_PI * freq_hz * i / TEST_RATE;
+        const double s = sin(w);
+        const double k = cos(w);
+        const double v = y[i * channels + c] / 2147483648.0;
+        ss += s * s;
+        sc += s * k;
+        cc += k * k;
+        ys += v * s;
+        yc += v * k;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det;
+    const double b = (yc * ss - ys * sc) / det;
+    return sqrt(a * a + b * b) / TEST_AMPLITUDE;
+}
+
+// The same designs in double precision, straight from their transfer functions.
+static double ref_gain_db(mic_filter_type_t type, double f0, double q, double freq_hz)
+{
+    const double w0 = 2.0 * M_PI * f0 / TEST_RATE;
+    const double complex z1 = cexp(-I * 2.0 * M_PI * freq_hz / TEST_RATE);
+    const double complex z2 = z1 * z1;
+    const double alpha = sin(w0) / (2.0 * q);
+    const double c = cos(w0);
+    double complex h;
+    switch (type) {
+    case MIC_FILTER_DC_BLOCK: {
+        const double r = exp(-w0);
+        h = (1.0 + r) / 2.0 * (1.0 - z1) / (1.0 - r * z1);
+        break;
+    }
+    case MIC_FILTER_HIGHPASS:
+        h = (1.0 + c) / 2.0 * (1.0 - 2.0 * z1 + z2) / ((1.0 + alpha) - 2.0 * c * z1 + (1.0 - alpha) * z2);
+        break;
+    case MIC_FILTER_LOWPASS:
+        h = (1.0 - c) / 2.0 * (1.0 + 2.0 * z1 + z2) / ((1.0 + alpha) - 2.0 * c * z1 + (1.0 - alpha) * z2);
+        break;
+    default:
+        h = (1.0 - 2.0 * c * z1 + z2) / ((1.0 + alpha) - 2.0 * c * z1 + (1.0 - alpha) * z2);
+        break;
+    }
+    return 20 * log10(cabs(h));
+}
+
+static double measure_db(mic_filter_type_t type, double f0, double q, double freq_hz, int channels)
+{
+    static int32_t buf[TEST_FRAMES * 2];
+    mic_filter_t f;
+    mic_filter_init(&f, channels);
+    TEST_ESP_OK(mic_filter_add(&f, type, f0, q, TEST_RATE));
+    make_sine(buf, TEST_FRAMES, channels, freq_hz, 0);
+    // several blocks, the state carries over
+    for (size_t i = 0; i < TEST_FRAMES; i += 500) {
+        mic_filter_process(&f, buf + i * channels, 500 * channels);
+    }
+    double worst = fit_gain(buf, TEST_FRAMES, channels, 0, freq_hz);
+    for (int c = 1; c < channels; c++) {
+        TEST_ASSERT_EQUAL_DOUBLE(worst, fit_gain(buf, TEST_FRAMES, channels, c, freq_hz));
+    }
+    return 20 * log10(worst + 1e-12);
+}
+
+TEST_CASE("Filter stages follow their design response", "[mic][filter]")
+{
+    static const struct {
+        mic_filter_type_t type;
+        double f0;
+        double q;
+    } designs[] = {
+        {MIC_FILTER_DC_BLOCK, 20, 0},
+        {MIC_FILTER_HIGHPASS, 80, 0.707},
+        {MIC_FILTER_LOWPASS, 3000, 0.707},
+        {MIC_FILTER_NOTCH, 50, 10},
+    };
+    static const double freqs[] = {30, 45, 50, 55, 80, 160, 500, 1000, 2000, 3000, 4000, 6000, 7500};
+
+    for (size_t d = 0; d < sizeof(designs) / sizeof(designs[0]); d++) {
+        for (size_t i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++) {
+            const double ref = ref_gain_db(designs[d].type, designs[d].f0, designs[d].q, freqs[i]);
+            const double got = measure_db(designs[d].type, designs[d].f0, designs[d].q, freqs[i], 1 + (i & 1));
+            if (ref > -60) {
+                TEST_ASSERT_FLOAT_WITHIN(0.01, ref, got);
+            } else {
+                TEST_ASSERT_LESS_THAN(-55.0, got);
+            }
+        }
+    }
+    // the corners where they are specified
+    TEST_ASSERT_FLOAT_WITHIN(0.01, -3.01, measure_db(MIC_FILTER_HIGHPASS, 80, 0.707, 80, 1));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, -3.01, measure_db(MIC_FILTER_LOWPASS, 3000, 0.707, 3000, 1));
+    TEST_ASSERT_LESS_THAN(-40.0, measure_db(MIC_FILTER_NOTCH, 50, 10, 50, 1));
+}
+
+TEST_CASE("Filter chain starts without a step from a DC offset", "[mic][filter]")
+{
+    static int32_t with[TEST_FRAMES];
+    static int32_t without[TEST_FRAMES];
+    const int32_t offset = 1 << 28;  // an eighth of full scale, as a MEMS mic may show
+    for (int pass = 0; pass < 2; pass++) {
+        int32_t *buf = pass ? with : without;
+        mic_filter_t f;
+        mic_filter_init(&f, 1);
+        TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_DC_BLOCK, 20, 0, TEST_RATE));
+        TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_HIGHPASS, 80, 0.707, TEST_RATE));
+        make_sine(buf, TEST_FRAMES, 1, 1000, pass ? offset : 0);
+        mic_filter_process(&f, buf, 1600);
+        mic_filter_process(&f, buf + 1600, TEST_FRAMES - 1600);
+    }
+    // the offset is gone from the first sample on, not decaying from a step
+    for (size_t i = 0; i < TEST_FRAMES; i++) {
+        TEST_ASSERT_INT_WITHIN(offset / 10000, without[i], with[i]);
+    }
+}
+
+TEST_CASE("Filter keeps silence silent and clips at full scale", "[mic][filter]")
+{
+    static int32_t buf[TEST_FRAMES];
+    mic_filter_t f;
+    mic_filter_init(&f, 1);
+    TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_HIGHPASS, 80, 0.707, TEST_RATE));
+    TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_NOTCH, 50, 10, TEST_RATE));
+    memset(buf, 0, sizeof(buf));
+    mic_filter_process(&f, buf, TEST_FRAMES);
+    for (size_t i = 0; i < TEST_FRAMES; i++) {
+        TEST_ASSERT_EQUAL_INT32(0, buf[i]);
+    }
+
+    // a full-scale square wave overshoots in a high-pass, the output clips
+    for (size_t i = 0; i < TEST_FRAMES; i++) {
+        buf[i] = (i / 200) & 1 ? INT32_MIN : INT32_MAX;
+    }
+    mic_filter_init(&f, 1);
+    TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_HIGHPASS, 80, 2.0, TEST_RATE));
+    mic_filter_process(&f, buf, TEST_FRAMES);
+    int clipped = 0;
+    for (size_t i = 0; i < TEST_FRAMES; i++) {
+        clipped += buf[i] == INT32_MAX || buf[i] == INT32_MIN;
+    }
+    TEST_ASSERT_GREATER_THAN(0, clipped);
+}
+
+TEST_CASE("Filter rejects bad stages", "[mic][filter]")
+{
+    mic_filter_t f;
+    mic_filter_init(&f, 3);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_filter_add(&f, MIC_FILTER_LOWPASS, 1000, 0.7, TEST_RATE));
+    mic_filter_init(&f, 2);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_filter_add(&f, MIC_FILTER_LOWPASS, 8000, 0.7, TEST_RATE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_filter_add(&f, MIC_FILTER_LOWPASS, 0, 0.7, TEST_RATE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_filter_add(&f, MIC_FILTER_NOTCH, 50, 0, TEST_RATE));
+    for (int i = 0; i < MIC_FILTER_MAX_STAGES; i++) {
+        TEST_ESP_OK(mic_filter_add(&f, MIC_FILTER_DC_BLOCK, 20, 0, TEST_RATE));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, mic_filter_add(&f, MIC_FILTER_DC_BLOCK, 20, 0, TEST_RATE));
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,399 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_rom_md5.h"
+
+#include "mic_flac.h"
+
+// Decoder for the stream subset the encoder writes, checked against the
+// FLAC format: every field it does not produce is rejected.
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;  // In bits
+} bit_reader_t;
+
+static uint32_t get_bits(bit_reader_t *br, int n)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++) {
+        TEST_ASSERT_LESS_THAN(br->len * 8, br->pos);
+        v = (v << 1) | ((br->buf[br->pos / 8] >> (7 - br->pos % 8)) & 1);
+        br->pos++;
+    }
+    return v;
+}
+
+static int32_t get_signed(bit_reader_t *br, int n)
+{
+    const uint32_t v = get_bits(br, n);
+    return n < 32 && (v >> (n - 1)) ? (int32_t)(v - (1u << n)) : (int32_t)v;
+}
+
+static uint8_t crc8(const uint8_t *p, size_t n)
+{
+    uint8_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        c ^= p[i];
+        for (int b = 0; b < 8; b++) {
+            c = (c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1);
+        }
+    }
+    return c;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t n)
+{
+    uint16_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        c ^= (uint16_t)(p[i] << 8);
+        for (int b = 0; b < 8; b++) {
+            c = (c & 0x8000) ? (uint16_t)((c << 1) ^ 0x8005) : (uint16_t)(c << 1);
+        }
+    }
+    return c;
+}
+
+static void decode_residual(bit_reader_t *br, int32_t *res, uint32_t n, int order)
+{
+    const uint32_t method = get_bits(br, 2);
+    TEST_ASSERT_LESS_THAN(2, method);
+    const int param_bits = method ? 5 : 4;
+    const int partition_order = get_bits(br, 4);
+    const uint32_t len = n >> partition_order;
+    TEST_ASSERT_EQUAL(n, len << partition_order);
+    uint32_t i = order;
+    for (uint32_t p = 0; p < (1u << partition_order); p++) {
+        const int k = get_bits(br, param_bits);
+        const uint32_t end = (p + 1) * len;
+        if (k == (1 << param_bits) - 1) {
+            const int raw = get_bits(br, 5);
+            for (; i < end; i++) {
+                res[i] = raw ? get_signed(br, raw) : 0;
+            }
+            continue;
+        }
+        for (; i < end; i++) {
+            uint32_t q = 0;
+            while (get_bits(br, 1) == 0) {
+                q++;
+            }
+            const uint32_t u = (q << k) | get_bits(br, k);
+            res[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+        }
+    }
+}
+
+#define SEEN_CONSTANT (1 << 0)
+#define SEEN_VERBATIM (1 << 1)
+#define SEEN_FIXED    (1 << 2)
+#define SEEN_LPC      (1 << 3)
+
+static void decode_subframe(bit_reader_t *br, int32_t *x, uint32_t n, int bps, uint32_t *seen)
+{
+    TEST_ASSERT_EQUAL(0, get_bits(br, 1));
+    const uint32_t type = get_bits(br, 6);
+    TEST_ASSERT_EQUAL(0, get_bits(br, 1));  // no wasted bits
+
+    if (type == 0) {
+        *seen |= SEEN_CONSTANT;
+        const int32_t v = get_signed(br, bps);
+        for (uint32_t i = 0; i < n; i++) {
+            x[i] = v;
+        }
+        return;
+    }
+    if (type == 1) {
+        *seen |= SEEN_VERBATIM;
+        for (uint32_t i = 0; i < n; i++) {
+            x[i] = get_signed(br, bps);
+        }
+        return;
+    }
+
+    int order;
+    int32_t coefs[32];
+    int precision = 0;
+    int shift = 0;
+    if (type >= 8 && type <= 12) {
+        *seen |= SEEN_FIXED;
+        order = type - 8;
+    } else {
+        TEST_ASSERT_GREATER_OR_EQUAL(32, type);
+        *seen |= SEEN_LPC;
+        order = type - 31;
+    }
+    for (int i = 0; i < order; i++) {
+        x[i] = get_signed(br, bps);
+    }
+    if (type >= 32) {
+        precision = get_bits(br, 4) + 1;
+        TEST_ASSERT_LESS_THAN(16, precision);
+        shift = get_signed(br, 5);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, shift);
+        for (int i = 0; i < order; i++) {
+            coefs[i] = get_signed(br, precision);
+        }
+    }
+    decode_residual(br, x, n, order);
+
+    for (uint32_t i = order; i < n; i++) {
+        int64_t pred = 0;
+        if (type >= 32) {
+            for (int j = 0; j < order; j++) {
+                pred += (int64_t)coefs[j] * x[i - 1 - j];
+            }
+            pred >>= shift;
+        } else {
+            static const int fixed[5][4] = {{0}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+            for (int j = 0; j < order; j++) {
+                pred += (int64_t)fixed[order][j] * x[i - 1 - j];
+            }
+        }
+        x[i] = (int32_t)(x[i] + pred);
+    }
+}
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    int channels;
+    int bits;
+    uint64_t total;      // From STREAMINFO
+    uint8_t md5[16];
+    uint32_t frames;
+    uint64_t decoded;    // Samples per channel
+    uint32_t seen;       // SEEN_ subframe types
+} flac_info_t;
+
+// Decodes file into out (interleaved), at most max samples per channel.
+static void decode(const uint8_t *file, size_t len, int32_t *out, size_t max, flac_info_t *info)
+{
+    TEST_ASSERT_GREATER_THAN(42, len);
+    TEST_ASSERT_EQUAL_MEMORY("fLaC", file, 4);
+    TEST_ASSERT_EQUAL_HEX8(0x80, file[4]);  // last block, STREAMINFO
+    bit_reader_t br = {.buf = file, .len = len, .pos = 8 * 8};
+    TEST_ASSERT_EQUAL(MIC_FLAC_BLOCK_SIZE, get_bits(&br, 16));
+    TEST_ASSERT_EQUAL(MIC_FLAC_BLOCK_SIZE, get_bits(&br, 16));
+    const uint32_t min_frame = get_bits(&br, 24);
+    const uint32_t max_frame = get_bits(&br, 24);
+    memset(info, 0, sizeof(*info));
+    info->sample_rate_hz = get_bits(&br, 20);
+    info->channels = get_bits(&br, 3) + 1;
+    info->bits = get_bits(&br, 5) + 1;
+    info->total = (uint64_t)get_bits(&br, 4) << 32;
+    info->total |= get_bits(&br, 32);
+    memcpy(info->md5, file + 26, 16);
+
+    static const uint32_t rates[] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    static int32_t planes[2][MIC_FLAC_BLOCK_SIZE];
+    size_t pos = 42;
+    while (pos < len) {
+        const size_t start = pos;
+        br.pos = pos * 8;
+        TEST_ASSERT_EQUAL(0x3ffe, get_bits(&br, 14));
+        TEST_ASSERT_EQUAL(0, get_bits(&br, 1));
+        TEST_ASSERT_EQUAL(0, get_bits(&br, 1));  // fixed block size
+        const uint32_t bs_code = get_bits(&br, 4);
+        const uint32_t rate_code = get_bits(&br, 4);
+        TEST_ASSERT_EQUAL(info->channels - 1, get_bits(&br, 4));
+        TEST_ASSERT_EQUAL(info->bits == 16 ? 4 : 6, get_bits(&br, 3));
+        TEST_ASSERT_EQUAL(0, get_bits(&br, 1));
+        uint32_t number = get_bits(&br, 8);
+        if (number & 0x80) {
+            int more = 0;
+            while (number & (0x80 >> (more + 1))) {
+                more++;
+            }
+            number &= 0x3f >> more;
+            for (int i = 0; i < more; i++) {
+                const uint32_t b = get_bits(&br, 8);
+                TEST_ASSERT_EQUAL(0x80, b & 0xc0);
+                number = (number << 6) | (b & 0x3f);
+            }
+        }
+        TEST_ASSERT_EQUAL(info->frames, number);
+        uint32_t n = MIC_FLAC_BLOCK_SIZE;
+        if (bs_code == 6) {
+            n = get_bits(&br, 8) + 1;
+        } else if (bs_code == 7) {
+            n = get_bits(&br, 16) + 1;
+        } else {
+            TEST_ASSERT_EQUAL(12, bs_code);
+        }
+        TEST_ASSERT_LESS_THAN(12, rate_code);
+        if (rate_code != 0) {
+            TEST_ASSERT_EQUAL(info->sample_rate_hz, rates[rate_code]);
+        }
+        TEST_ASSERT_EQUAL(crc8(file + start, br.pos / 8 - start), get_bits(&br, 8));
+
+        for (int c = 0; c < info->channels; c++) {
+            decode_subframe(&br, planes[c], n, info->bits, &info->seen);
+        }
+        br.pos = (br.pos + 7) & ~(size_t)7;
+        const size_t crc_at = br.pos / 8;
+        TEST_ASSERT_EQUAL(crc16(file + start, crc_at - start), get_bits(&br, 16));
+        pos = br.pos / 8;
+        const uint32_t frame_len = pos - start;
+        TEST_ASSERT_LESS_OR_EQUAL(max_frame, frame_len);
+        TEST_ASSERT_GREATER_OR_EQUAL(min_frame, frame_len);
+
+        TEST_ASSERT_LESS_OR_EQUAL(max, info->decoded + n);
+        for (uint32_t i = 0; i < n; i++) {
+            for (int c = 0; c < info->channels; c++) {
+                out[(info->decoded + i) * info->channels + c] = planes[c][i];
+            }
+        }
+        info->decoded += n;
+        info->frames++;
+        TEST_ASSERT(n == MIC_FLAC_BLOCK_SIZE || pos == len);  // only the last block is short
+    }
+}
+
+static void md5_of(const int32_t *samples, size_t count, int bits, uint8_t digest[16])
+{
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t b[3];
+        for (int j = 0; j < bits / 8; j++) {
+            b[j] = (uint8_t)(samples[i] >> (8 * j));
+        }
+        esp_rom_md5_update(&ctx, b, bits / 8);
+    }
+    esp_rom_md5_final(digest, &ctx);
+}
+
+static uint8_t *read_back(FILE *f, size_t *len)
+{
+    TEST_ASSERT_EQUAL(0, fseek(f, 0, SEEK_END));
+    *len = ftell(f);
+    uint8_t *buf = malloc(*len);
+    TEST_ASSERT_NOT_NULL(buf);
+    rewind(f);
+    TEST_ASSERT_EQUAL(*len, fread(buf, 1, *len, f));
+    return buf;
+}
+
+// Sine with noise, then digital silence, then full-scale noise: CONSTANT,
+// VERBATIM and predicted subframes all show up.
+static void make_signal(int32_t *x, size_t frames, int channels, int bits)
+{
+    const int32_t max = (1 << (bits - 1)) - 1;
+    uint32_t seed = 42;
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            const int32_t noise = (int32_t)(seed % 2001) - 1000;
+            double v;
+            if (i >= 3 * MIC_FLAC_BLOCK_SIZE && i < 5 * MIC_FLAC_BLOCK_SIZE) {
+                v = 0;
+            } else if (i >= 6 * MIC_FLAC_BLOCK_SIZE && i < 7 * MIC_FLAC_BLOCK_SIZE) {
+                v = (int32_t)seed >> (32 - bits);
+            } else {
+                v = 0.7 * max * sin(i * 0.013 * (c + 1)) + noise * (bits == 24 ? 100 : 1);
+            }
+            v = v > max ? max : (v < -max - 1 ? -max - 1 : v);
+            x[i * channels + c] = (int32_t)v;
+        }
+    }
+}
+
+static void round_trip(uint32_t rate, int bits, int channels, size_t frames)
+{
+    const size_t count = frames * channels;
+    int32_t *in = malloc(count * sizeof(int32_t));
+    int32_t *out = malloc(count * sizeof(int32_t));
+    TEST_ASSERT_NOT_NULL(in);
+    TEST_ASSERT_NOT_NULL(out);
+    make_signal(in, frames, channels, bits);
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    mic_flac_t *enc = mic_flac_begin(f, rate, bits, channels);
+    TEST_ASSERT_NOT_NULL(enc);
+    // odd write sizes, blocks fill across calls
+    for (size_t done = 0, step = 1; done < count; step = step * 3 % 4999 + 1) {
+        const size_t n = step * channels > count - done ? count - done : step * channels;
+        TEST_ESP_OK(mic_flac_write(enc, in + done, n));
+        done += n;
+    }
+    mic_flac_stats_t stats;
+    TEST_ESP_OK(mic_flac_end(enc, &stats));
+    TEST_ASSERT_EQUAL(frames, stats.samples);
+
+    size_t len;
+    uint8_t *file = read_back(f, &len);
+    fclose(f);
+    TEST_ASSERT_EQUAL(len, stats.bytes);
+    printf("%u Hz %d-bit %dch: %u frames in %u bytes (%.1f%%)\n", (unsigned)rate, bits, channels,
+           (unsigned)frames, (unsigned)len, 100.0 * len / (count * bits / 8));
+    if (frames >= MIC_FLAC_BLOCK_SIZE) {
+        TEST_ASSERT_LESS_THAN(count * bits / 8, len);
+    }
+
+    flac_info_t info;
+    decode(file, len, out, frames, &info);
+    TEST_ASSERT_EQUAL(rate, info.sample_rate_hz);
+    TEST_ASSERT_EQUAL(channels, info.channels);
+    TEST_ASSERT_EQUAL(bits, info.bits);
+    TEST_ASSERT_EQUAL(frames, info.total);
+    TEST_ASSERT_EQUAL(frames, info.decoded);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(in, out, count);
+    uint8_t md5[16];
+    md5_of(in, count, bits, md5);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(md5, info.md5, 16);
+    if (bits == 16 && frames >= 8 * MIC_FLAC_BLOCK_SIZE) {
+        // each subframe type wins somewhere in the 16-bit signal
+        TEST_ASSERT_EQUAL_HEX32(SEEN_CONSTANT | SEEN_VERBATIM | SEEN_FIXED | SEEN_LPC, info.seen);
+    }
+
+    free(file);
+    free(out);
+    free(in);
+}
+
+TEST_CASE("FLAC round trip is lossless for 16-bit stereo", "[mic][flac]")
+{
+    round_trip(16000, 16, 2, 9 * MIC_FLAC_BLOCK_SIZE + 123);
+}
+
+TEST_CASE("FLAC round trip is lossless for 24-bit mono", "[mic][flac]")
+{
+    // 12 kHz has no frame header code, decoders take it from STREAMINFO
+    round_trip(12000, 24, 1, 8 * MIC_FLAC_BLOCK_SIZE + 4000);
+}
+
+TEST_CASE("FLAC round trip keeps a short single block", "[mic][flac]")
+{
+    round_trip(48000, 16, 1, 200);
+    round_trip(48000, 24, 2, 1);
+}
+
+TEST_CASE("FLAC rejects bad arguments", "[mic][flac]")
+{
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_NULL(mic_flac_begin(NULL, 16000, 16, 1));
+    TEST_ASSERT_NULL(mic_flac_begin(f, 16000, 20, 1));
+    TEST_ASSERT_NULL(mic_flac_begin(f, 16000, 16, 3));
+    TEST_ASSERT_NULL(mic_flac_begin(f, 0, 16, 1));
+    mic_flac_t *enc = mic_flac_begin(f, 16000, 16, 2);
+    TEST_ASSERT_NOT_NULL(enc);
+    const int32_t s[3] = {0};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_flac_write(enc, s, 3));
+    TEST_ESP_OK(mic_flac_end(enc, NULL));
+    fclose(f);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
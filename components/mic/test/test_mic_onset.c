@@ -0,0 +1,214 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mic_onset.h"
+
+#define TEST_RATE   16000
+#define TEST_WINDOW 160         // Frames of a 10 ms window
+#define TEST_BLOCK  480         // Frames per call, like a DMA buffer
+#define TEST_FRAMES (5 * TEST_RATE)
+
+static uint32_t s_seed;
+
+// A span of uniform noise or a sine at level_dbfs RMS, in the 24-bit
+// slots of the microphone, on channel c only.
+static void fill(int32_t *x, int channels, int c, size_t from, size_t to, double level_dbfs, double freq_hz)
+{
+    const double rms = pow(10.0, level_dbfs / 20.0) * (1 << 23);
+    for (size_t i = from; i < to; i++) {
+        double v;
+        if (freq_hz > 0) {
+            v = rms * sqrt(2.0) * sin(2.0 * M_PI * freq_hz * i / TEST_RATE);
+        } else {
+            s_seed = s_seed * 1664525u + 1013904223u;
+            v = rms * sqrt(3.0) * ((s_seed >> 8) / 8388608.0 - 1.0);
+        }
+        x[i * channels + c] = (int32_t)lround(v) * 256;
+    }
+}
+
+static mic_onset_config_t config(int channels, int channel)
+{
+    return (mic_onset_config_t) {
+        .sample_rate_hz = TEST_RATE,
+        .channels = channels,
+        .channel = channel,
+        .window_ms = 10,
+        .rise_db = 12.0f,
+        .min_dbfs = -70.0f,
+        .hysteresis_db = 6.0f,
+        .floor_tau_ms = 500.0f,
+    };
+}
+
+// Runs frames through od in blocks and collects the absolute frames it
+// fires at; returns how many.
+static int run(mic_onset_t *od, const int32_t *x, size_t frames, size_t *fired, int max)
+{
+    const int ch = od->cfg.channels;
+    int n = 0;
+    for (size_t i = 0; i < frames; i += TEST_BLOCK) {
+        const size_t len = frames - i < TEST_BLOCK ? frames - i : TEST_BLOCK;
+        size_t at = SIZE_MAX;
+        if (mic_onset_process(od, x + i * ch, len * ch, &at)) {
+            TEST_ASSERT_LESS_OR_EQUAL(len, at);
+            TEST_ASSERT_LESS_THAN(max, n);
+            fired[n++] = i + at;
+        }
+    }
+    return n;
+}
+
+TEST_CASE("Onset fires at the first window of a burst", "[mic][onset]")
+{
+    static int32_t x[TEST_FRAMES * 2];
+    static mic_onset_t od;
+    size_t fired[4];
+
+    // one second of quiet, half a second of a burst, quiet again
+    s_seed = 1;
+    memset(x, 0, sizeof(x));
+    fill(x, 2, 1, 0, TEST_RATE, -60, 0);
+    fill(x, 2, 1, TEST_RATE, TEST_RATE * 3 / 2, -20, 0);
+    fill(x, 2, 1, TEST_RATE * 3 / 2, TEST_FRAMES, -60, 0);
+    mic_onset_config_t cfg = config(2, 1);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(1, run(&od, x, TEST_FRAMES, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, -60.0, od.floor_db);
+    TEST_ASSERT_EQUAL(TEST_FRAMES, od.frames);
+
+    // a burst starting inside a window fires at the end of that window
+    s_seed = 1;
+    fill(x, 2, 1, 0, TEST_RATE, -60, 0);
+    fill(x, 2, 1, TEST_RATE + 50, TEST_RATE * 3 / 2, -20, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(1, run(&od, x, TEST_FRAMES, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+
+    // the other channel is not watched
+    cfg.channel = 0;
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(0, run(&od, x, TEST_FRAMES, fired, 4));
+}
+
+TEST_CASE("Onset re-arms only after the hysteresis", "[mic][onset]")
+{
+    static int32_t x[TEST_FRAMES];
+    static mic_onset_t od;
+    size_t fired[4];
+    const mic_onset_config_t cfg = config(1, 0);
+
+    // the burst dips to 10 dB above the floor, under the threshold but not
+    // by the hysteresis, and comes back
+    s_seed = 2;
+    fill(x, 1, 0, 0, TEST_RATE, -60, 0);
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -20, 0);
+    fill(x, 1, 0, 2 * TEST_RATE, 3 * TEST_RATE, -50, 0);
+    fill(x, 1, 0, 3 * TEST_RATE, 4 * TEST_RATE, -20, 0);
+    fill(x, 1, 0, 4 * TEST_RATE, TEST_FRAMES, -60, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(1, run(&od, x, TEST_FRAMES, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+
+    // back to the floor in between, it fires twice
+    fill(x, 1, 0, 2 * TEST_RATE, 3 * TEST_RATE, -60, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(2, run(&od, x, TEST_FRAMES, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+    TEST_ASSERT_EQUAL(3 * TEST_RATE + TEST_WINDOW, fired[1]);
+}
+
+TEST_CASE("Onset does not fire below min_dbfs", "[mic][onset]")
+{
+    static int32_t x[2 * TEST_RATE];
+    static mic_onset_t od;
+    size_t fired[4];
+    mic_onset_config_t cfg = config(1, 0);
+    cfg.min_dbfs = -50.0f;
+
+    // 40 dB over a very quiet floor, but under min_dbfs
+    s_seed = 3;
+    fill(x, 1, 0, 0, TEST_RATE, -100, 0);
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -60, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(0, run(&od, x, 2 * TEST_RATE, fired, 4));
+
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -45, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(1, run(&od, x, 2 * TEST_RATE, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+}
+
+TEST_CASE("Onset band limit ignores rumble", "[mic][onset]")
+{
+    static int32_t x[2 * TEST_RATE];
+    static mic_onset_t od;
+    size_t fired[4];
+    mic_onset_config_t cfg = config(1, 0);
+    cfg.band_low_hz = 300.0f;
+    cfg.band_high_hz = 4000.0f;
+
+    s_seed = 4;
+    fill(x, 1, 0, 0, TEST_RATE, -60, 0);
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -30, 50);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(0, run(&od, x, 2 * TEST_RATE, fired, 4));
+
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -30, 1000);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(1, run(&od, x, 2 * TEST_RATE, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_RATE + TEST_WINDOW, fired[0]);
+}
+
+TEST_CASE("Onset reset learns a fresh floor", "[mic][onset]")
+{
+    static int32_t x[2 * TEST_RATE];
+    static mic_onset_t od;
+    size_t fired[4];
+    const mic_onset_config_t cfg = config(1, 0);
+
+    s_seed = 5;
+    fill(x, 1, 0, 0, TEST_RATE, -60, 0);
+    fill(x, 1, 0, TEST_RATE, 2 * TEST_RATE, -20, 0);
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(0, run(&od, x, TEST_RATE, fired, 4));
+
+    // the first window after a reset only sets the floor, even a loud one
+    mic_onset_reset(&od);
+    TEST_ASSERT_EQUAL(0, run(&od, x + TEST_RATE, TEST_RATE, fired, 4));
+    TEST_ASSERT_FLOAT_WITHIN(1.0, -20.0, od.floor_db);
+
+    // without the reset the same frames fire
+    TEST_ESP_OK(mic_onset_init(&od, &cfg));
+    TEST_ASSERT_EQUAL(0, run(&od, x, TEST_RATE, fired, 4));
+    TEST_ASSERT_EQUAL(1, run(&od, x + TEST_RATE, TEST_RATE, fired, 4));
+    TEST_ASSERT_EQUAL(TEST_WINDOW, fired[0]);
+}
+
+TEST_CASE("Onset rejects bad configurations", "[mic][onset]")
+{
+    static mic_onset_t od;
+    mic_onset_config_t cfg = config(2, 2);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_onset_init(&od, &cfg));
+    cfg = config(3, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_onset_init(&od, &cfg));
+    cfg = config(1, 0);
+    cfg.window_ms = 100;    // 1600 samples
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_onset_init(&od, &cfg));
+    cfg = config(1, 0);
+    cfg.floor_tau_ms = 0.0f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_onset_init(&od, &cfg));
+    cfg = config(1, 0);
+    cfg.band_high_hz = 8000.0f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mic_onset_init(&od, &cfg));
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
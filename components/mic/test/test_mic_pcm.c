@@ -0,0 +1,257 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "mic_pcm.h"
+
+#define TEST_SAMPLES 1001
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int64_t clip(int64_t v, int64_t lo, int64_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// One sample at a time in 64 bits, the conversion mic_pcm.h describes.
+static int32_t ref_sample(int32_t slot, int gain, int out_bits, uint32_t *dither)
+{
+    if (out_bits == 32) {
+        return (int32_t)clip((int64_t)slot * gain, INT32_MIN, INT32_MAX);
+    }
+    const int64_t v = (int64_t)(slot >> 8) * gain;
+    if (out_bits == 24) {
+        return (int32_t)clip(v, -(1 << 23), (1 << 23) - 1);
+    }
+    // TPDF: difference of two uniform bytes, +-1 LSB of the 16-bit output
+    const uint32_t r = xorshift(dither);
+    const int64_t d = (int64_t)(r & 0xff) - (int64_t)((r >> 8) & 0xff);
+    return (int32_t)clip((v + d + 128) >> 8, INT16_MIN, INT16_MAX);
+}
+
+static size_t ref_pack(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                       uint32_t *dither, uint8_t *out)
+{
+    const int bytes = out_bits / 8;
+    for (size_t i = 0; i < count; i++) {
+        const int32_t v = ref_sample(in[i], gains[i % channels], out_bits, dither);
+        for (int b = 0; b < bytes; b++) {
+            out[i * bytes + b] = (uint8_t)((uint32_t)v >> (8 * b));
+        }
+    }
+    return count * bytes;
+}
+
+// Random slots with the extremes mixed in, low byte not always zero.
+static void fill_slots(int32_t *in, size_t count, uint32_t seed)
+{
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t r = xorshift(&seed);
+        switch (r % 8) {
+        case 0:
+            in[i] = INT32_MAX;
+            break;
+        case 1:
+            in[i] = INT32_MIN;
+            break;
+        case 2:
+            in[i] = (int32_t)(r >> 12) - (1 << 19);  // quiet, near zero
+            break;
+        default:
+            in[i] = (int32_t)xorshift(&seed);
+            break;
+        }
+    }
+}
+
+TEST_CASE("PCM pack matches the scalar reference", "[mic][pcm]")
+{
+    static int32_t in[TEST_SAMPLES];
+    static uint8_t out[TEST_SAMPLES * 4 + 1];  // one guard byte
+    static uint8_t ref[TEST_SAMPLES * 4];
+    static const int bits[] = {16, 24, 32};
+    static const size_t counts[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 100, TEST_SAMPLES - 1, TEST_SAMPLES};
+    static const int gains[][2] = {{1, 1}, {4, 4}, {1, 127}, {127, 3}};
+
+    fill_slots(in, TEST_SAMPLES, 1);
+    for (size_t b = 0; b < sizeof(bits) / sizeof(bits[0]); b++) {
+        for (int channels = 1; channels <= 2; channels++) {
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+                for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); g++) {
+                    const size_t count = counts[c];
+                    if (count % channels != 0) {
+                        continue;
+                    }
+                    uint32_t dither = 0x12345678;
+                    uint32_t ref_dither = dither;
+                    memset(out, 0xAA, sizeof(out));
+                    const size_t n = mic_pcm_pack(in, count, channels, gains[g], bits[b], &dither, out);
+                    TEST_ASSERT_EQUAL(ref_pack(in, count, channels, gains[g], bits[b], &ref_dither, ref), n);
+                    TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, out, n);
+                    TEST_ASSERT_EQUAL_HEX8(0xAA, out[n]);
+                    TEST_ASSERT_EQUAL_HEX32(ref_dither, dither);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("PCM scale matches the scalar reference", "[mic][pcm]")
+{
+    static int32_t in[TEST_SAMPLES];
+    static int32_t out[TEST_SAMPLES];
+    static const int gains[2] = {3, 127};
+
+    fill_slots(in, TEST_SAMPLES, 2);
+    for (int out_bits = 16; out_bits <= 24; out_bits += 8) {
+        for (int channels = 1; channels <= 2; channels++) {
+            const size_t count = channels == 1 ? TEST_SAMPLES : TEST_SAMPLES - 1;
+            uint32_t dither = 99;
+            uint32_t ref_dither = dither;
+            TEST_ASSERT_EQUAL(count, mic_pcm_scale(in, count, channels, gains, out_bits, &dither, out));
+            for (size_t i = 0; i < count; i++) {
+                TEST_ASSERT_EQUAL_INT32(ref_sample(in[i], gains[i % channels], out_bits, &ref_dither), out[i]);
+            }
+            TEST_ASSERT_EQUAL_HEX32(ref_dither, dither);
+        }
+    }
+}
+
+TEST_CASE("PCM pack and scale work in place", "[mic][pcm]")
+{
+    static int32_t in[TEST_SAMPLES];
+    static int32_t buf[TEST_SAMPLES];
+    static uint8_t ref[TEST_SAMPLES * 4];
+    static const int gains[2] = {5, 9};
+
+    fill_slots(in, TEST_SAMPLES, 3);
+    for (int out_bits = 16; out_bits <= 32; out_bits += 8) {
+        uint32_t dither = 7;
+        uint32_t ref_dither = dither;
+        memcpy(buf, in, sizeof(buf));
+        const size_t n = mic_pcm_pack(buf, TEST_SAMPLES - 1, 2, gains, out_bits, &dither, (uint8_t *)buf);
+        TEST_ASSERT_EQUAL(ref_pack(in, TEST_SAMPLES - 1, 2, gains, out_bits, &ref_dither, ref), n);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, buf, n);
+    }
+
+    uint32_t dither = 7;
+    uint32_t ref_dither = dither;
+    memcpy(buf, in, sizeof(buf));
+    TEST_ASSERT_EQUAL(TEST_SAMPLES, mic_pcm_scale(buf, TEST_SAMPLES, 1, gains, 16, &dither, buf));
+    for (size_t i = 0; i < TEST_SAMPLES; i++) {
+        TEST_ASSERT_EQUAL_INT32(ref_sample(in[i], gains[0], 16, &ref_dither), buf[i]);
+    }
+}
+
+TEST_CASE("PCM pack rejects unsupported formats", "[mic][pcm]")
+{
+    int32_t in[4] = {0};
+    uint8_t out[16];
+    uint32_t dither = 1;
+    uint32_t no_dither = 0;
+    const int ok[2] = {1, 1};
+    const int zero[2] = {0, 1};
+    const int loud[2] = {1, MIC_PCM_MAX_GAIN + 1};
+
+    TEST_ASSERT_EQUAL(8, mic_pcm_pack(in, 4, 2, ok, 16, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 2, ok, 20, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 3, ok, 16, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 3, 2, ok, 16, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 2, zero, 16, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 2, loud, 24, &dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 2, ok, 16, &no_dither, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_pack(in, 4, 2, ok, 16, NULL, out));
+    // 32-bit output takes any gain, 24-bit needs no dither
+    TEST_ASSERT_EQUAL(16, mic_pcm_pack(in, 4, 2, loud, 32, NULL, out));
+    TEST_ASSERT_EQUAL(12, mic_pcm_pack(in, 4, 2, ok, 24, NULL, out));
+    TEST_ASSERT_EQUAL(0, mic_pcm_scale(in, 4, 2, ok, 32, &dither, in));
+}
+
+TEST_CASE("PCM levels track peak and energy per channel", "[mic][pcm]")
+{
+    static int32_t in[TEST_SAMPLES - 1];
+    fill_slots(in, TEST_SAMPLES - 1, 4);
+    mic_pcm_level_t levels[2] = {0};
+    // two calls, the levels carry over
+    mic_pcm_levels(in, 500, 2, levels);
+    mic_pcm_levels(in + 500, TEST_SAMPLES - 501, 2, levels);
+
+    for (int c = 0; c < 2; c++) {
+        int32_t peak = 0;
+        double sum_sq = 0;
+        for (size_t i = c; i < TEST_SAMPLES - 1; i += 2) {
+            const int32_t v = in[i] >> 8;
+            peak = abs(v) > peak ? abs(v) : peak;
+            sum_sq += (double)v * v;
+        }
+        TEST_ASSERT_EQUAL_INT32(peak, levels[c].peak);
+        TEST_ASSERT_EQUAL_DOUBLE(sum_sq, levels[c].sum_sq);
+        TEST_ASSERT_EQUAL(TEST_SAMPLES / 2, levels[c].count);
+    }
+}
+
+typedef size_t (*pack_fn)(const int32_t *in, size_t count, int channels, const int *gains, int out_bits,
+                          uint32_t *dither_state, uint8_t *out);
+
+// Samples per microsecond over rounds passes of the block, the best of 5;
+// pack NULL times mic_pcm_scale().
+static double samples_per_us(pack_fn pack, const int32_t *in, size_t count, int channels, int out_bits, void *out)
+{
+    static const int gains[2] = {4, 4};
+    const int rounds = 10;
+    uint32_t dither = 1;
+    int64_t best_us = INT64_MAX;
+    for (int i = 0; i < 5; i++) {
+        const int64_t t0 = esp_timer_get_time();
+        for (int r = 0; r < rounds; r++) {
+            if (pack != NULL) {
+                pack(in, count, channels, gains, out_bits, &dither, out);
+            } else {
+                mic_pcm_scale(in, count, channels, gains, out_bits, &dither, out);
+            }
+        }
+        const int64_t us = esp_timer_get_time() - t0;
+        best_us = us < best_us ? us : best_us;
+    }
+    return (double)count * rounds / (best_us > 0 ? best_us : 1);
+}
+
+TEST_CASE("PCM conversion performance", "[mic][pcm]")
+{
+    // one pool block of stereo, 4096 frames, written or encoded as a unit
+    const size_t count = 2 * 4096;
+    static int32_t in[2 * 4096];
+    static int32_t out[2 * 4096];
+    fill_slots(in, count, 5);
+
+    for (int out_bits = 16; out_bits <= 32; out_bits += 8) {
+        for (int channels = 1; channels <= 2; channels++) {
+            const char *name = channels == 1 ? "mono" : "stereo";
+            printf("pack  %d-bit %-6s %7.1f samples/us, scalar reference %7.1f samples/us\n", out_bits, name,
+                   samples_per_us(mic_pcm_pack, in, count, channels, out_bits, out),
+                   samples_per_us(ref_pack, in, count, channels, out_bits, out));
+            if (out_bits < 32) {
+                // encoders take 16 or 24 bits
+                printf("scale %d-bit %-6s %7.1f samples/us\n", out_bits, name,
+                       samples_per_us(NULL, in, count, channels, out_bits, out));
+            }
+        }
+    }
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,214 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+
+#include "mic_resample.h"
+
+#define TEST_IN_RATE   48000
+#define TEST_FRAMES    48000    // One second of input
+#define TEST_AMPLITUDE 0.5      // Of a full-scale slot
+
+static const uint32_t s_out_rates[] = {24000, 16000, 8000, 4000};
+
+// Slots of a sine, 24 significant bits like the microphone.
+static void make_sine(int32_t *x, size_t frames, int channels, double freq_hz)
+{
+    for (size_t i = 0; i < frames; i++) {
+        const double v = TEST_AMPLITUDE * sin(2.0 * M_PI * freq_hz * i / TEST_IN_RATE);
+        for (int c = 0; c < channels; c++) {
+            x[i * channels + c] = (int32_t)lround(v * (1 << 23)) * 256;
+        }
+    }
+}
+
+// Least-squares amplitude of freq_hz in channel c of out, past the filter's
+// start-up, relative to the input sine.
+static double fit_gain(const int32_t *out, size_t frames, int channels, int c, double freq_hz, uint32_t rate)
+{
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = frames / 4; i < frames; i++) {
+        const double w = 2.0 * M_PI * freq_hz * i / rate;
+        const double s = sin(w);
+        const double k = cos(w);
+        const double y = out[i * channels + c] / 2147483648.0;
+        ss += s * s;
+        sc += s * k;
+        cc += k * k;
+        ys += y * s;
+        yc += y * k;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det;
+    const double b = (yc * ss - ys * sc) / det;
+    return sqrt(a * a + b * b) / TEST_AMPLITUDE;
+}
+
+// RMS of channel c past the start-up, relative to the input sine's.
+static double rms_gain(const int32_t *out, size_t frames, int channels, int c)
+{
+    double sum = 0;
+    for (size_t i = frames / 4; i < frames; i++) {
+        const double y = out[i * channels + c] / 2147483648.0;
+        sum += y * y;
+    }
+    return sqrt(sum / (frames - frames / 4)) / (TEST_AMPLITUDE / sqrt(2.0));
+}
+
+// Runs a sine through a fresh decimator; returns the output frames.
+static size_t run(int32_t *buf, uint32_t out_rate, int channels, double freq_hz)
+{
+    make_sine(buf, TEST_FRAMES, channels, freq_hz);
+    mic_resample_t *rs = mic_resample_begin(TEST_IN_RATE, out_rate, channels);
+    TEST_ASSERT_NOT_NULL(rs);
+    const size_t n = mic_resample_process(rs, buf, TEST_FRAMES * channels);
+    mic_resample_end(rs);
+    TEST_ASSERT_EQUAL(TEST_FRAMES / (TEST_IN_RATE / out_rate) * channels, n);
+    return n / channels;
+}
+
+TEST_CASE("Resampler passband is flat to 0.41 of the output rate", "[mic][resample]")
+{
+    static int32_t buf[TEST_FRAMES * 2];
+    for (size_t r = 0; r < sizeof(s_out_rates) / sizeof(s_out_rates[0]); r++) {
+        const uint32_t out_rate = s_out_rates[r];
+        double worst_db = 0;
+        for (int step = 1; step <= 10; step++) {
+            const double freq = 0.041 * step * out_rate;
+            for (int channels = 1; channels <= 2; channels++) {
+                const size_t frames = run(buf, out_rate, channels, freq);
+                for (int c = 0; c < channels; c++) {
+                    const double db = 20 * log10(fit_gain(buf, frames, channels, c, freq, out_rate));
+                    worst_db = fabs(db) > fabs(worst_db) ? db : worst_db;
+                }
+            }
+        }
+        printf("%u Hz: passband within %.3f dB\n", (unsigned)out_rate, worst_db);
+        TEST_ASSERT_FLOAT_WITHIN(0.1, 0.0, worst_db);
+    }
+}
+
+TEST_CASE("Resampler keeps aliases below 0.38 of the output rate 80 dB down", "[mic][resample]")
+{
+    static int32_t buf[TEST_FRAMES * 2];
+    for (size_t r = 0; r < sizeof(s_out_rates) / sizeof(s_out_rates[0]); r++) {
+        const uint32_t out_rate = s_out_rates[r];
+        double worst_db = -200;
+        // every input frequency whose alias lands at 0.05 to 0.38 of the output rate
+        for (uint32_t k = 1; k * out_rate < TEST_IN_RATE / 2 + out_rate / 2; k++) {
+            for (int step = 1; step <= 8; step++) {
+                const double alias = 0.0475 * step * out_rate;
+                const double freqs[2] = {k * out_rate - alias, k * out_rate + alias};
+                for (int i = 0; i < 2; i++) {
+                    if (freqs[i] >= TEST_IN_RATE / 2) {
+                        continue;
+                    }
+                    const size_t frames = run(buf, out_rate, 1, freqs[i]);
+                    const double db = 20 * log10(rms_gain(buf, frames, 1, 0) + 1e-12);
+                    worst_db = db > worst_db ? db : worst_db;
+                }
+            }
+        }
+        printf("%u Hz: aliases at most %.1f dB\n", (unsigned)out_rate, worst_db);
+        TEST_ASSERT_LESS_THAN(-80.0, worst_db);
+    }
+}
+
+TEST_CASE("Resampler output does not depend on the block size", "[mic][resample]")
+{
+    static int32_t whole[TEST_FRAMES * 2];
+    static int32_t parts[TEST_FRAMES * 2];
+    for (int channels = 1; channels <= 2; channels++) {
+        make_sine(whole, TEST_FRAMES, channels, 1234.5);
+        memcpy(parts, whole, sizeof(whole));
+
+        mic_resample_t *rs = mic_resample_begin(TEST_IN_RATE, 16000, channels);
+        TEST_ASSERT_NOT_NULL(rs);
+        const size_t n = mic_resample_process(rs, whole, TEST_FRAMES * channels);
+        mic_resample_end(rs);
+
+        // blocks in place, the output packed behind the input still to come
+        rs = mic_resample_begin(TEST_IN_RATE, 16000, channels);
+        TEST_ASSERT_NOT_NULL(rs);
+        size_t in = 0;
+        size_t out = 0;
+        for (size_t step = 1; in < TEST_FRAMES; step = step * 7 % 1000 + 1) {
+            const size_t frames = step > TEST_FRAMES - in ? TEST_FRAMES - in : step;
+            const size_t got = mic_resample_process(rs, parts + in * channels, frames * channels);
+            memmove(parts + out, parts + in * channels, got * sizeof(int32_t));
+            in += frames;
+            out += got;
+        }
+        mic_resample_end(rs);
+        TEST_ASSERT_EQUAL(n, out);
+        TEST_ASSERT_EQUAL_INT32_ARRAY(whole, parts, n);
+    }
+}
+
+TEST_CASE("Resampler passes DC at unity gain", "[mic][resample]")
+{
+    static int32_t buf[4800];
+    for (size_t i = 0; i < 4800; i++) {
+        buf[i] = 0x123456 * 256;
+    }
+    mic_resample_t *rs = mic_resample_begin(TEST_IN_RATE, 16000, 1);
+    TEST_ASSERT_NOT_NULL(rs);
+    const size_t n = mic_resample_process(rs, buf, 4800);
+    mic_resample_end(rs);
+    TEST_ASSERT_EQUAL(1600, n);
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_INT_WITHIN(256, 0x123456 * 256, buf[i]);
+    }
+}
+
+TEST_CASE("Resampler rejects unsupported rates", "[mic][resample]")
+{
+    TEST_ASSERT_NULL(mic_resample_begin(48000, 48000, 1));
+    TEST_ASSERT_NULL(mic_resample_begin(48000, 44100, 1));
+    TEST_ASSERT_NULL(mic_resample_begin(48000, 3000, 1));
+    TEST_ASSERT_NULL(mic_resample_begin(48000, 0, 1));
+    TEST_ASSERT_NULL(mic_resample_begin(48000, 16000, 3));
+    mic_resample_end(NULL);
+}
+
+TEST_CASE("Resampler performance", "[mic][resample]")
+{
+    // one second of capture, in pool blocks of 4096 frames as the mic task
+    // hands them over; only the filtering is timed
+    const size_t block = 4096;
+    static int32_t src[TEST_FRAMES * 2];
+    static int32_t buf[4096 * 2];
+    static const uint32_t rates[] = {16000, 8000};
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (int channels = 1; channels <= 2; channels++) {
+            make_sine(src, TEST_FRAMES, channels, 1000.0);
+            int64_t best_us = INT64_MAX;
+            for (int i = 0; i < 5; i++) {
+                mic_resample_t *rs = mic_resample_begin(TEST_IN_RATE, rates[r], channels);
+                TEST_ASSERT_NOT_NULL(rs);
+                int64_t us = 0;
+                for (size_t at = 0; at < TEST_FRAMES; at += block) {
+                    const size_t frames = block < TEST_FRAMES - at ? block : TEST_FRAMES - at;
+                    memcpy(buf, src + at * channels, frames * channels * sizeof(int32_t));
+                    const int64_t t0 = esp_timer_get_time();
+                    mic_resample_process(rs, buf, frames * channels);
+                    us += esp_timer_get_time() - t0;
+                }
+                mic_resample_end(rs);
+                best_us = us < best_us ? us : best_us;
+            }
+            printf("48000 -> %5u Hz %-6s %7.1f input samples/us, %6lld us per s of audio\n", (unsigned)rates[r],
+                   channels == 1 ? "mono" : "stereo", (double)TEST_FRAMES * channels / (best_us > 0 ? best_us : 1),
+                   (long long)best_us);
+        }
+    }
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
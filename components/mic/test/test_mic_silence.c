@@ -0,0 +1,263 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mic_silence.h"
+
+#define TEST_RATE   16000
+#define TEST_FRAMES (6 * TEST_RATE)
+#define HEADER_LEN  12
+#define RECORD_LEN  20
+
+typedef struct {
+    int32_t *samples;
+    size_t count;
+    size_t fail_after;  // Slots accepted before the store fails
+} store_t;
+
+typedef struct {
+    uint64_t position;
+    uint64_t frames;
+    int16_t level;
+} span_t;
+
+static const mic_silence_config_t s_config = {
+    .threshold_dbfs = -50.0f,
+    .window_ms = 20,
+    .hang_ms = 100,
+    .pre_ms = 60,
+};
+
+static uint32_t s_seed;
+
+static esp_err_t s_store(void *ctx, int32_t *samples, size_t count)
+{
+    store_t *st = (store_t *)ctx;
+    if (st->count + count > st->fail_after) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(st->samples + st->count, samples, count * sizeof(int32_t));
+    st->count += count;
+    return ESP_OK;
+}
+
+// Uniform noise at level_dbfs RMS in the 24-bit slots of the microphone,
+// on channel c only.
+static void fill(int32_t *x, int channels, int c, size_t from, size_t to, double level_dbfs)
+{
+    const double amplitude = pow(10.0, level_dbfs / 20.0) * sqrt(3.0) * (1 << 23);
+    for (size_t i = from; i < to; i++) {
+        s_seed = s_seed * 1664525u + 1013904223u;
+        x[i * channels + c] = (int32_t)lround(amplitude * ((s_seed >> 8) / 8388608.0 - 1.0)) * 256;
+    }
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+// Gates frames of x in blocks of varying size; returns the spans, with
+// the kept slots in st.
+static int run(const int32_t *x, size_t frames, int channels, store_t *st, span_t *spans, int max,
+               mic_silence_stats_t *stats)
+{
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    mic_silence_t *sil = mic_silence_begin(f, TEST_RATE, channels, &s_config);
+    TEST_ASSERT_NOT_NULL(sil);
+    size_t step = 1;
+    for (size_t i = 0; i < frames; i += step, step = step * 13 % 997 + 1) {
+        const size_t n = step > frames - i ? frames - i : step;
+        TEST_ESP_OK(mic_silence_process(sil, x + i * channels, n * channels, s_store, st));
+    }
+    TEST_ESP_OK(mic_silence_end(sil, s_store, st, stats));
+
+    uint8_t header[HEADER_LEN];
+    rewind(f);
+    TEST_ASSERT_EQUAL(HEADER_LEN, fread(header, 1, HEADER_LEN, f));
+    TEST_ASSERT_EQUAL_MEMORY("MSIL", header, 4);
+    TEST_ASSERT_EQUAL(MIC_SILENCE_VERSION, header[4]);
+    TEST_ASSERT_EQUAL(channels, header[5]);
+    TEST_ASSERT_EQUAL(TEST_RATE * s_config.window_ms / 1000, header[6] | header[7] << 8);
+    TEST_ASSERT_EQUAL(TEST_RATE, header[8] | header[9] << 8 | header[10] << 16 | header[11] << 24);
+    int n = 0;
+    uint8_t rec[RECORD_LEN];
+    while (fread(rec, 1, RECORD_LEN, f) == RECORD_LEN) {
+        TEST_ASSERT_LESS_THAN(max, n);
+        spans[n].position = get64(rec);
+        spans[n].frames = get64(rec + 8);
+        spans[n].level = (int16_t)(rec[16] | rec[17] << 8);
+        n++;
+    }
+    TEST_ASSERT_TRUE(feof(f));
+    fclose(f);
+    TEST_ASSERT_EQUAL(n, stats->spans);
+    return n;
+}
+
+// Puts the spans back as zeros; checks the timeline adds up and returns
+// the restored slots.
+static int32_t *restore(const store_t *st, int channels, const span_t *spans, int n, size_t frames)
+{
+    int32_t *out = calloc(frames * channels, sizeof(int32_t));
+    TEST_ASSERT_NOT_NULL(out);
+    const size_t stored = st->count / channels;
+    size_t from = 0;
+    size_t at = 0;
+    for (int i = 0; i <= n; i++) {
+        const size_t position = i < n ? spans[i].position : stored;
+        TEST_ASSERT_GREATER_OR_EQUAL(from, position);
+        TEST_ASSERT_LESS_OR_EQUAL(stored, position);
+        TEST_ASSERT_LESS_OR_EQUAL(frames, at + position - from);
+        memcpy(out + at * channels, st->samples + from * channels, (position - from) * channels * sizeof(int32_t));
+        at += position - from;
+        from = position;
+        if (i < n) {
+            TEST_ASSERT_GREATER_THAN(0, spans[i].frames);
+            at += spans[i].frames;
+        }
+    }
+    TEST_ASSERT_EQUAL(frames, at);
+    return out;
+}
+
+TEST_CASE("Silence gate leaves out digital silence and restores exactly", "[mic][silence]")
+{
+    static int32_t x[TEST_FRAMES * 2];
+    static int32_t kept[TEST_FRAMES * 2];
+    span_t spans[8];
+    mic_silence_stats_t stats;
+
+    // silence, 1 s of sound, silence, 40 ms of sound, silence to the end
+    s_seed = 1;
+    memset(x, 0, sizeof(x));
+    fill(x, 2, 1, TEST_RATE + 123, 2 * TEST_RATE, -20);
+    fill(x, 2, 0, 4 * TEST_RATE, 4 * TEST_RATE + 640, -30);
+    store_t st = {kept, 0, SIZE_MAX};
+    const int n = run(x, TEST_FRAMES, 2, &st, spans, 8, &stats);
+    TEST_ASSERT_EQUAL(3, n);
+    TEST_ASSERT_EQUAL(TEST_FRAMES, stats.frames);
+    TEST_ASSERT_EQUAL(TEST_FRAMES, st.count / 2 + stats.elided_frames);
+
+    int32_t *out = restore(&st, 2, spans, n, TEST_FRAMES);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(x, out, TEST_FRAMES * 2);
+    free(out);
+
+    // pre_ms ahead of the sound and hang_ms after it are kept
+    const size_t pre = TEST_RATE * s_config.pre_ms / 1000;
+    const size_t hang = TEST_RATE * s_config.hang_ms / 1000;
+    size_t start = 0;
+    for (int i = 0; i < n; i++) {
+        start += spans[i].position - (i ? spans[i - 1].position : 0);
+        const size_t end = start + spans[i].frames;
+        TEST_ASSERT_EQUAL(INT16_MIN, spans[i].level);
+        if (i == 0) {
+            TEST_ASSERT_EQUAL(0, start);
+            TEST_ASSERT_LESS_OR_EQUAL(TEST_RATE + 123 - pre, end);
+        } else if (i == 1) {
+            TEST_ASSERT_GREATER_OR_EQUAL(2 * TEST_RATE + hang, start);
+            TEST_ASSERT_LESS_OR_EQUAL(4 * TEST_RATE - pre, end);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(4 * TEST_RATE + 640 + hang, start);
+            TEST_ASSERT_LESS_OR_EQUAL(TEST_FRAMES - pre, end);
+        }
+        start = end;
+    }
+}
+
+TEST_CASE("Silence gate records the level of quiet spans", "[mic][silence]")
+{
+    static int32_t x[TEST_FRAMES];
+    static int32_t kept[TEST_FRAMES];
+    span_t spans[8];
+    mic_silence_stats_t stats;
+
+    s_seed = 2;
+    fill(x, 1, 0, 0, TEST_FRAMES, -70);
+    fill(x, 1, 0, 3 * TEST_RATE, 3 * TEST_RATE + 3200, -20);
+    store_t st = {kept, 0, SIZE_MAX};
+    const int n = run(x, TEST_FRAMES, 1, &st, spans, 8, &stats);
+    TEST_ASSERT_EQUAL(2, n);
+    TEST_ASSERT_EQUAL(TEST_FRAMES, st.count + stats.elided_frames);
+
+    // the kept frames are the input's, in place on the timeline
+    int32_t *out = restore(&st, 1, spans, n, TEST_FRAMES);
+    size_t at = 0;
+    for (int i = 0; i <= n; i++) {
+        const size_t position = i < n ? spans[i].position : st.count;
+        const size_t before = at;
+        at += position - (i ? spans[i - 1].position : 0);
+        if (at > before) {
+            TEST_ASSERT_EQUAL_INT32_ARRAY(x + before, out + before, at - before);
+        }
+        if (i < n) {
+            TEST_ASSERT_INT_WITHIN(50, -7000, spans[i].level);
+            at += spans[i].frames;
+        }
+    }
+    free(out);
+}
+
+TEST_CASE("Silence gate keeps sound without spans", "[mic][silence]")
+{
+    static int32_t x[TEST_FRAMES];
+    static int32_t kept[TEST_FRAMES];
+    span_t spans[8];
+    mic_silence_stats_t stats;
+
+    s_seed = 3;
+    fill(x, 1, 0, 0, TEST_FRAMES, -40);
+    store_t st = {kept, 0, SIZE_MAX};
+    TEST_ASSERT_EQUAL(0, run(x, TEST_FRAMES, 1, &st, spans, 8, &stats));
+    TEST_ASSERT_EQUAL(0, stats.elided_frames);
+    TEST_ASSERT_EQUAL(TEST_FRAMES, st.count);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(x, kept, TEST_FRAMES);
+}
+
+TEST_CASE("Silence gate passes store errors on", "[mic][silence]")
+{
+    static int32_t x[TEST_FRAMES];
+    static int32_t kept[TEST_FRAMES];
+    s_seed = 4;
+    fill(x, 1, 0, 0, TEST_FRAMES, -40);
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    mic_silence_t *sil = mic_silence_begin(f, TEST_RATE, 1, &s_config);
+    TEST_ASSERT_NOT_NULL(sil);
+    store_t st = {kept, 0, TEST_RATE};
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < TEST_FRAMES && ret == ESP_OK; i += 500) {
+        ret = mic_silence_process(sil, x + i, 500, s_store, &st);
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, ret);
+    TEST_ESP_OK(mic_silence_end(sil, NULL, NULL, NULL));
+    fclose(f);
+}
+
+TEST_CASE("Silence gate rejects bad arguments", "[mic][silence]")
+{
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    mic_silence_config_t cfg = s_config;
+    TEST_ASSERT_NULL(mic_silence_begin(NULL, TEST_RATE, 1, &cfg));
+    TEST_ASSERT_NULL(mic_silence_begin(f, 0, 1, &cfg));
+    TEST_ASSERT_NULL(mic_silence_begin(f, TEST_RATE, 3, &cfg));
+    cfg.window_ms = 0;
+    TEST_ASSERT_NULL(mic_silence_begin(f, TEST_RATE, 1, &cfg));
+    fclose(f);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,325 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mic_spectrum.h"
+
+#define TEST_RATE    16000
+#define TEST_FRAMES  16000      // One second
+#define HEADER_LEN   (16 + 2 * (MIC_SPECTRUM_BANDS + 1))
+#define RECORD_LEN   (4 + 2 * MIC_SPECTRUM_BANDS)
+
+typedef struct {
+    uint16_t fft_size;
+    uint16_t hop;
+    uint16_t edges[MIC_SPECTRUM_BANDS + 1];
+    int records;
+    const uint8_t *record;  // First record
+} sidecar_t;
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// Runs count interleaved slots through an analysis in blocks of block
+// samples and returns the sidecar, parsed into sc.
+static uint8_t *analyse(const int32_t *samples, size_t count, int fft_size, int channels, int channel,
+                        size_t block, sidecar_t *sc)
+{
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    mic_spectrum_t *sp = mic_spectrum_begin(f, TEST_RATE, fft_size, channels, channel);
+    TEST_ASSERT_NOT_NULL(sp);
+    for (size_t i = 0; i < count; i += block) {
+        TEST_ESP_OK(mic_spectrum_write(sp, samples + i, block < count - i ? block : count - i));
+    }
+    mic_spectrum_stats_t stats;
+    mic_spectrum_end(sp, &stats);
+
+    TEST_ASSERT_EQUAL(0, fseek(f, 0, SEEK_END));
+    const long len = ftell(f);
+    uint8_t *buf = malloc(len);
+    TEST_ASSERT_NOT_NULL(buf);
+    rewind(f);
+    TEST_ASSERT_EQUAL(len, fread(buf, 1, len, f));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL_MEMORY("MSPC", buf, 4);
+    TEST_ASSERT_EQUAL(MIC_SPECTRUM_VERSION, buf[4]);
+    TEST_ASSERT_EQUAL(MIC_SPECTRUM_BANDS, buf[5]);
+    TEST_ASSERT_EQUAL(channel, buf[6]);
+    TEST_ASSERT_EQUAL(TEST_RATE, get16(buf + 8) | (get16(buf + 10) << 16));
+    sc->fft_size = get16(buf + 12);
+    sc->hop = get16(buf + 14);
+    TEST_ASSERT_EQUAL(fft_size, sc->fft_size);
+    TEST_ASSERT_EQUAL(fft_size / 2, sc->hop);
+    for (int b = 0; b <= MIC_SPECTRUM_BANDS; b++) {
+        sc->edges[b] = get16(buf + 16 + 2 * b);
+        if (b > 0) {
+            TEST_ASSERT_GREATER_THAN(sc->edges[b - 1], sc->edges[b]);
+        }
+    }
+    TEST_ASSERT_EQUAL(1, sc->edges[0]);
+    TEST_ASSERT_EQUAL(fft_size / 2 + 1, sc->edges[MIC_SPECTRUM_BANDS]);
+
+    // a record per complete hop, a partial frame is dropped
+    const size_t frames = count / channels;
+    sc->records = frames < (size_t)fft_size ? 0 : (frames - fft_size) / sc->hop + 1;
+    TEST_ASSERT_EQUAL(HEADER_LEN + sc->records * RECORD_LEN, len);
+    TEST_ASSERT_EQUAL(sc->records, stats.frames);
+    sc->record = buf + HEADER_LEN;
+    return buf;
+}
+
+static void make_sine(int32_t *x, size_t frames, int channels, int channel, double amplitude, double freq_hz)
+{
+    memset(x, 0, frames * channels * sizeof(int32_t));
+    for (size_t i = 0; i < frames; i++) {
+        x[i * channels + channel] = (int32_t)lround(amplitude * 2147483647.0 * sin(2.0 * M_PI * freq_hz * i / TEST_RATE));
+    }
+}
+
+// 0.01 dB as the sidecar stores it, in double precision.
+static double ref_cdb(double power)
+{
+    return power > 0 ? fmax(1000.0 * log10(power), INT16_MIN) : INT16_MIN;
+}
+
+// One record recomputed from the frame of n samples at x (every channels-th
+// slot) in double precision: RMS, band energies and the peak frequency, by a
+// direct DFT of the same Hann-windowed frame. Returns the peak's margin over
+// the next strongest bin in dB, for telling a real peak from a tie.
+static double ref_record(const int32_t *x, int channels, int n, const uint16_t *edges, double *rms_cdb,
+                         double *band_cdb, double *peak_hz)
+{
+    static double frame[1024];
+    static double cs[1024];
+    static double sn[1024];
+    static double power[513];
+    const int m = n / 2;
+    double sum_sq = 0;
+    double window_power = 0;
+    for (int i = 0; i < n; i++) {
+        const double v = x[i * channels] / 2147483648.0;
+        const double w = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+        sum_sq += v * v;
+        window_power += w * w;
+        frame[i] = v * w;
+        cs[i] = cos(2.0 * M_PI * i / n);
+        sn[i] = sin(2.0 * M_PI * i / n);
+    }
+    for (int k = 0; k <= m; k++) {
+        double re = 0;
+        double im = 0;
+        for (int i = 0; i < n; i++) {
+            const int j = (int)((long)k * i % n);
+            re += frame[i] * cs[j];
+            im -= frame[i] * sn[j];
+        }
+        power[k] = re * re + im * im;
+    }
+    *rms_cdb = ref_cdb(sum_sq / n);
+    for (int b = 0; b < MIC_SPECTRUM_BANDS; b++) {
+        double e = 0;
+        for (int k = edges[b]; k < edges[b + 1]; k++) {
+            e += (k == 0 || k == m) ? power[k] : 2 * power[k];
+        }
+        band_cdb[b] = ref_cdb(e / (n * window_power));
+    }
+    int peak = 1;
+    for (int k = 2; k < m; k++) {
+        if (power[k] > power[peak]) {
+            peak = k;
+        }
+    }
+    double next = 0;
+    for (int k = 1; k < m; k++) {
+        if (k != peak && power[k] > next) {
+            next = power[k];
+        }
+    }
+    double bin = peak;
+    if (power[peak] > 0) {
+        const double l = log(power[peak - 1] + 1e-30);
+        const double c = log(power[peak]);
+        const double r = log(power[peak + 1] + 1e-30);
+        const double den = l - 2 * c + r;
+        if (den < 0) {
+            bin += 0.5 * (l - r) / den;
+        }
+    }
+    *peak_hz = bin * TEST_RATE / n;
+    return power[peak] > 0 ? 10 * log10(power[peak] / (next + 1e-300)) : 0;
+}
+
+TEST_CASE("Spectrum of a sine reads its level and frequency", "[mic][spectrum]")
+{
+    static int32_t buf[TEST_FRAMES];
+    const double amplitude = 0.5;
+    const double rms_cdb = 2000 * log10(amplitude / sqrt(2.0));  // -9.03 dB
+    for (int fft_size = 512; fft_size <= 1024; fft_size *= 2) {
+        for (double freq = 250; freq < TEST_RATE / 2; freq *= 2.3) {
+            make_sine(buf, TEST_FRAMES, 1, 0, amplitude, freq);
+            sidecar_t sc;
+            uint8_t *file = analyse(buf, TEST_FRAMES, fft_size, 1, 0, 1000, &sc);
+            const int bin = (int)lround(freq * fft_size / TEST_RATE);
+            int band = 0;
+            while (sc.edges[band + 1] <= bin) {
+                band++;
+            }
+            for (int r = 0; r < sc.records; r++) {
+                const uint8_t *rec = sc.record + r * RECORD_LEN;
+                TEST_ASSERT_INT_WITHIN(5, rms_cdb, (int16_t)get16(rec));
+                TEST_ASSERT_INT_WITHIN(TEST_RATE / fft_size / 10 + 1, freq, get16(rec + 2));
+                // bands sum to the mean square, and the sine sits in its own band
+                double sum = 0;
+                for (int b = 0; b < MIC_SPECTRUM_BANDS; b++) {
+                    const int16_t e = (int16_t)get16(rec + 4 + 2 * b);
+                    sum += pow(10, e / 1000.0);
+                    if (abs(b - band) > 1) {
+                        TEST_ASSERT_LESS_THAN(rms_cdb - 5000, e);
+                    }
+                }
+                TEST_ASSERT_FLOAT_WITHIN(5, rms_cdb, 1000 * log10(sum));
+                TEST_ASSERT_GREATER_THAN(rms_cdb - 100, (int16_t)get16(rec + 4 + 2 * band));
+            }
+            free(file);
+        }
+    }
+}
+
+TEST_CASE("Spectrum records match a double-precision DFT", "[mic][spectrum]")
+{
+    static int32_t buf[TEST_FRAMES * 2];
+    static const char *const names[] = {"tone", "tone between bins", "two tones", "noise", "low tone in noise",
+                                        "low noise"};
+    uint32_t seed = 1;
+    for (size_t sig = 0; sig < sizeof(names) / sizeof(names[0]); sig++) {
+        // stereo, the analysed channel 1 holds the signal in 24-bit slots
+        memset(buf, 0, sizeof(buf));
+        for (size_t i = 0; i < TEST_FRAMES; i++) {
+            const double t = (double)i / TEST_RATE;
+            seed = seed * 1664525u + 1013904223u;
+            const double noise = (seed >> 8) / 8388608.0 - 1.0;
+            double v = 0;
+            switch (sig) {
+            case 0:
+                v = 0.9 * sin(2.0 * M_PI * 1000 * t);
+                break;
+            case 1:
+                v = 0.3 * sin(2.0 * M_PI * 1234.5 * t);
+                break;
+            case 2:
+                v = 0.4 * sin(2.0 * M_PI * 300 * t) + 0.01 * sin(2.0 * M_PI * 5000 * t);
+                break;
+            case 3:
+                v = 0.5 * noise;
+                break;
+            case 4:
+                v = 1e-4 * sin(2.0 * M_PI * 2500 * t) + 3e-6 * noise;  // -83 dBFS tone
+                break;
+            default:
+                v = 3e-6 * noise;  // about -115 dBFS, a few LSB of 24 bits
+                break;
+            }
+            buf[i * 2 + 1] = (int32_t)lround(v * (1 << 23)) * 256;
+            buf[i * 2] = (int32_t)(seed ^ 0x5555);  // ignored channel
+        }
+        for (int fft_size = 512; fft_size <= 1024; fft_size *= 2) {
+            sidecar_t sc;
+            uint8_t *file = analyse(buf, TEST_FRAMES * 2, fft_size, 2, 1, 4000, &sc);
+            double worst_rms = 0;
+            double worst_band = 0;
+            double worst_peak = 0;
+            for (int r = 0; r < sc.records; r++) {
+                const uint8_t *rec = sc.record + r * RECORD_LEN;
+                double rms;
+                double bands[MIC_SPECTRUM_BANDS];
+                double peak_hz;
+                const double margin_db = ref_record(buf + (size_t)r * sc.hop * 2 + 1, 2, fft_size, sc.edges, &rms,
+                                                    bands, &peak_hz);
+                // RMS and band energies within 0.03 dB; bands more than 100 dB
+                // under the frame, where the float FFT's rounding noise
+                // dominates, only have to stay that far down
+                worst_rms = fmax(worst_rms, fabs(rms - (int16_t)get16(rec)));
+                TEST_ASSERT_FLOAT_WITHIN(3, rms, (int16_t)get16(rec));
+                for (int b = 0; b < MIC_SPECTRUM_BANDS; b++) {
+                    const int16_t got = (int16_t)get16(rec + 4 + 2 * b);
+                    if (bands[b] > rms - 10000) {
+                        worst_band = fmax(worst_band, fabs(bands[b] - got));
+                        TEST_ASSERT_FLOAT_WITHIN(3, bands[b], got);
+                    } else {
+                        TEST_ASSERT_LESS_THAN(rms - 9000, got);
+                    }
+                }
+                // the peak within 1 Hz, unless two bins tie within 0.1 dB
+                if (margin_db > 0.1) {
+                    worst_peak = fmax(worst_peak, fabs(peak_hz - get16(rec + 2)));
+                    TEST_ASSERT_FLOAT_WITHIN(1.0, peak_hz, get16(rec + 2));
+                }
+            }
+            printf("%-18s %4d: %d records, RMS within %.2f dB, bands within %.2f dB, peak within %.2f Hz\n",
+                   names[sig], fft_size, sc.records, worst_rms / 100, worst_band / 100, worst_peak);
+            free(file);
+        }
+    }
+}
+
+TEST_CASE("Spectrum analyses the configured channel", "[mic][spectrum]")
+{
+    static int32_t buf[TEST_FRAMES * 2];
+    make_sine(buf, TEST_FRAMES, 2, 1, 0.25, 1000);
+    sidecar_t sc;
+    uint8_t *file = analyse(buf, TEST_FRAMES * 2, 512, 2, 1, 2 * 333, &sc);
+    TEST_ASSERT_INT_WITHIN(5, 2000 * log10(0.25 / sqrt(2.0)), (int16_t)get16(sc.record));
+    free(file);
+
+    // the other channel is silent
+    file = analyse(buf, TEST_FRAMES * 2, 512, 2, 0, 2 * 333, &sc);
+    for (int r = 0; r < sc.records; r++) {
+        const uint8_t *rec = sc.record + r * RECORD_LEN;
+        TEST_ASSERT_EQUAL(INT16_MIN, (int16_t)get16(rec));
+        for (int b = 0; b < MIC_SPECTRUM_BANDS; b++) {
+            TEST_ASSERT_EQUAL(INT16_MIN, (int16_t)get16(rec + 4 + 2 * b));
+        }
+    }
+    free(file);
+}
+
+TEST_CASE("Spectrum records do not depend on the block size", "[mic][spectrum]")
+{
+    static int32_t buf[TEST_FRAMES];
+    for (size_t i = 0; i < TEST_FRAMES; i++) {
+        buf[i] = (int32_t)(i * 2654435761u);  // white-ish noise
+    }
+    sidecar_t a;
+    sidecar_t b;
+    uint8_t *whole = analyse(buf, TEST_FRAMES, 1024, 1, 0, TEST_FRAMES, &a);
+    uint8_t *parts = analyse(buf, TEST_FRAMES, 1024, 1, 0, 77, &b);
+    TEST_ASSERT_EQUAL(a.records, b.records);
+    TEST_ASSERT_EQUAL_MEMORY(whole, parts, HEADER_LEN + a.records * RECORD_LEN);
+    free(whole);
+    free(parts);
+}
+
+TEST_CASE("Spectrum rejects bad arguments", "[mic][spectrum]")
+{
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_NULL(mic_spectrum_begin(NULL, TEST_RATE, 512, 1, 0));
+    TEST_ASSERT_NULL(mic_spectrum_begin(f, TEST_RATE, 256, 1, 0));
+    TEST_ASSERT_NULL(mic_spectrum_begin(f, TEST_RATE, 512, 2, 2));
+    TEST_ASSERT_NULL(mic_spectrum_begin(f, 0, 512, 1, 0));
+    mic_spectrum_end(NULL, NULL);
+    fclose(f);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
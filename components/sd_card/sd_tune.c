@@ -0,0 +1,392 @@
+#include "sd_tune.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/sdmmc_host.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "soc/soc_caps.h"
+
+#ifdef SOC_SDMMC_DELAY_PHASE_NUM
+#define SD_TUNE_PHASES      SOC_SDMMC_DELAY_PHASE_NUM
+#elif defined(SD_CARD_SIM_PHASES)
+#define SD_TUNE_PHASES      SD_CARD_SIM_PHASES  // Linux target, see sim/
+#else
+#define SD_TUNE_PHASES      1
+#endif
+#define SD_TUNE_SECTORS     16                  // Per transfer: 8 KB
+#define SD_TUNE_WINDOWS     8                   // Places on the card looked at for test data
+#define SD_TUNE_ROUNDS      8                   // Reads per point
+#define SD_TUNE_SAFE_KHZ    SDMMC_FREQ_DEFAULT  // Also where runtime CRC errors fall back to
+#define SD_TUNE_POLLS       10                  // CMD13 polls before a failed command is given up
+#define SD_TUNE_NVS_NS      "sd_tune"
+#define SD_TUNE_VERSION     1
+
+// Card states in the R1 response
+#define SD_TUNE_STATE_TRAN  4
+#define SD_TUNE_STATE_DATA  5
+#define SD_TUNE_STATE_RCV   6
+#define SD_TUNE_STATE_PRG   7
+
+static const char *TAG = "sd_tune";
+
+// Fastest first; High Speed mode above SDMMC_FREQ_DEFAULT.
+static const uint32_t s_freqs_khz[] = {SDMMC_FREQ_HIGHSPEED, SDMMC_FREQ_26M, SDMMC_FREQ_DEFAULT};
+
+typedef struct {
+    uint8_t version;
+    uint8_t phase;
+    uint8_t phases_ok;
+    uint8_t fell_back;
+    uint32_t freq_khz;
+} sd_tune_record_t;
+
+static sdmmc_card_t *s_card;
+static esp_err_t (*s_do_transaction)(int slot, sdmmc_command_t *cmd);
+static char s_key[16];      // NVS key from the card's manufacturer ID and serial number
+static sd_tune_info_t s_info;
+static volatile bool s_save_pending;  // A runtime fallback not yet in NVS
+
+static bool s_load(sd_tune_record_t *rec)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(SD_TUNE_NVS_NS, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t size = sizeof(*rec);
+    esp_err_t ret = nvs_get_blob(nvs, s_key, rec, &size);
+    nvs_close(nvs);
+    if (ret != ESP_OK || size != sizeof(*rec) || rec->version != SD_TUNE_VERSION || rec->phase >= SD_TUNE_PHASES) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(s_freqs_khz) / sizeof(s_freqs_khz[0]); ++i) {
+        if (rec->freq_khz == s_freqs_khz[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void s_save(const sd_tune_record_t *rec)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(SD_TUNE_NVS_NS, NVS_READWRITE, &nvs);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(nvs, s_key, rec, sizeof(*rec));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Saving the bus setting failed (%s)", esp_err_to_name(ret));
+    }
+}
+
+// Re-initialises the card from the probing clock on one data line, as
+// after slot init. The phase is set explicitly because card init only
+// applies phases other than 0.
+static esp_err_t s_init_at(const sdmmc_host_t *host, sdmmc_card_t *card, uint32_t freq_khz, int phase)
+{
+    sdmmc_host_t h = *host;
+    h.max_freq_khz = freq_khz;
+    h.input_delay_phase = (sdmmc_delay_phase_t)phase;
+    h.set_bus_width(h.slot, 1);
+    h.set_card_clk(h.slot, SDMMC_FREQ_PROBING);
+    esp_err_t ret = sdmmc_card_init(&h, card);
+    if (ret == ESP_OK && h.set_input_delay != NULL) {
+        h.set_input_delay(h.slot, (sdmmc_delay_phase_t)phase);
+    }
+    return ret;
+}
+
+// Bytes that differ from the one before. The data lines toggle there, and
+// only there does a badly placed sampling edge show.
+static size_t s_transitions(const uint8_t *data, size_t bytes)
+{
+    size_t n = 0;
+    for (size_t i = 1; i < bytes; ++i) {
+        n += data[i] != data[i - 1];
+    }
+    return n;
+}
+
+// Picks the test sectors and reads them into ref at the safe clock: of
+// sector 0 and seven points across the card, the window with the most
+// varied data, as flat sectors hardly toggle the data lines. That window is
+// read once more and must match. ESP_ERR_NOT_FOUND when every window is
+// close to flat, as on a freshly formatted card.
+static esp_err_t s_reference(sdmmc_card_t *card, uint8_t *ref, uint8_t *scratch, size_t *start)
+{
+    const size_t bytes = SD_TUNE_SECTORS * (size_t)card->csd.sector_size;
+    const size_t last = (size_t)card->csd.capacity - SD_TUNE_SECTORS;
+    size_t best = 0;
+    for (size_t i = 0; i < SD_TUNE_WINDOWS; ++i) {
+        const size_t sector = i == 0 ? 0 : (size_t)((uint64_t)last * i / (SD_TUNE_WINDOWS - 1));
+        esp_err_t ret = sdmmc_read_sectors(card, scratch, sector, SD_TUNE_SECTORS);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        const size_t n = s_transitions(scratch, bytes);
+        if (n > best) {
+            best = n;
+            *start = sector;
+            memcpy(ref, scratch, bytes);
+        }
+    }
+    if (best < bytes / 8) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t ret = sdmmc_read_sectors(card, scratch, *start, SD_TUNE_SECTORS);
+    if (ret == ESP_OK && memcmp(ref, scratch, bytes) != 0) {
+        ret = ESP_ERR_INVALID_CRC;
+    }
+    return ret;
+}
+
+// Reads the test sectors SD_TUNE_ROUNDS times as one multi-block transfer
+// each. Any error, CRC or otherwise, or a mismatch with ref fails the point.
+static bool s_stress(sdmmc_card_t *card, size_t start, const uint8_t *ref, uint8_t *scratch)
+{
+    const size_t bytes = SD_TUNE_SECTORS * (size_t)card->csd.sector_size;
+    for (int round = 0; round < SD_TUNE_ROUNDS; ++round) {
+        memset(scratch, 0, bytes);
+        if (sdmmc_read_sectors(card, scratch, start, SD_TUNE_SECTORS) != ESP_OK ||
+                memcmp(scratch, ref, bytes) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Middle of the longest run of passing phases (they wrap around: 0 and the
+// last are neighbours), if it leaves a passing phase on each side; -1 when
+// no phase has that margin. With all phases passing, the driver default 0.
+static int s_pick_phase(uint8_t ok)
+{
+    const uint8_t all = (uint8_t)((1u << SD_TUNE_PHASES) - 1);
+    if (ok == all) {
+        return 0;
+    }
+    int best = -1;
+    int best_len = 0;
+    for (int p = 0; p < SD_TUNE_PHASES; ++p) {
+        const int prev = (p + SD_TUNE_PHASES - 1) % SD_TUNE_PHASES;
+        if (!(ok & (1u << p)) || (ok & (1u << prev))) {
+            continue;  // Not the start of a run
+        }
+        int len = 0;
+        while (ok & (1u << ((p + len) % SD_TUNE_PHASES))) {
+            len++;
+        }
+        if (len > best_len) {
+            best_len = len;
+            best = (p + len / 2) % SD_TUNE_PHASES;
+        }
+    }
+    return best_len >= 3 ? best : -1;
+}
+
+// Tries every clock and phase, fastest first, and leaves the card at the
+// first clock with a phase to spare, checked once more after re-init.
+static esp_err_t s_sweep(const sdmmc_host_t *host, sdmmc_card_t *card, size_t start,
+                         const uint8_t *ref, uint8_t *scratch, sd_tune_record_t *rec)
+{
+    for (size_t i = 0; i < sizeof(s_freqs_khz) / sizeof(s_freqs_khz[0]); ++i) {
+        const uint32_t khz = s_freqs_khz[i];
+        uint8_t ok = 0;
+        bool supported = true;
+        for (int p = 0; p < SD_TUNE_PHASES && supported; ++p) {
+            if (s_init_at(host, card, khz, p) != ESP_OK) {
+                continue;
+            }
+            supported = khz <= (uint32_t)card->max_freq_khz;
+            if (supported && s_stress(card, start, ref, scratch)) {
+                ok |= 1u << p;
+            }
+        }
+        if (!supported) {
+            ESP_LOGI(TAG, "%" PRIu32 " kHz: needs High Speed, which the card lacks", khz);
+            continue;
+        }
+        int phase = s_pick_phase(ok);
+        if (phase < 0 && khz == SD_TUNE_SAFE_KHZ && ok != 0) {
+            phase = (ok & 1) ? 0 : __builtin_ctz(ok);  // Nothing slower to go to
+            ESP_LOGW(TAG, "%" PRIu32 " kHz passes without a phase to spare", khz);
+        }
+        ESP_LOGI(TAG, "%" PRIu32 " kHz: phases passing 0x%x%s", khz, ok, phase < 0 ? ", no margin" : "");
+        if (phase < 0) {
+            continue;
+        }
+        if (s_init_at(host, card, khz, phase) == ESP_OK && s_stress(card, start, ref, scratch)) {
+            *rec = (sd_tune_record_t) {
+                .version = SD_TUNE_VERSION,
+                .phase = (uint8_t)phase,
+                .phases_ok = ok,
+                .freq_khz = khz,
+            };
+            return ESP_OK;
+        }
+    }
+    return ESP_FAIL;
+}
+
+// Asks the card for its state with CMD13 after a failed command, ending a
+// transfer it is still in with CMD12. True once it is back in the transfer
+// state, where repeating the command is safe.
+static bool s_card_ready(int slot)
+{
+    for (int i = 0; i < SD_TUNE_POLLS; ++i) {
+        sdmmc_command_t status = {
+            .opcode = MMC_SEND_STATUS,
+            .arg = MMC_ARG_RCA(s_card->rca),
+            .flags = SCF_CMD_AC | SCF_RSP_R1,
+        };
+        if (s_do_transaction(slot, &status) != ESP_OK || status.error != ESP_OK) {
+            return false;
+        }
+        const uint32_t state = MMC_R1_CURRENT_STATE(status.response);
+        if (state == SD_TUNE_STATE_TRAN) {
+            return true;
+        }
+        if (state == SD_TUNE_STATE_DATA || state == SD_TUNE_STATE_RCV) {
+            sdmmc_command_t stop = {
+                .opcode = MMC_STOP_TRANSMISSION,
+                .flags = SCF_CMD_AC | SCF_RSP_R1B,
+            };
+            if (s_do_transaction(slot, &stop) != ESP_OK) {
+                return false;
+            }
+        } else if (state == SD_TUNE_STATE_PRG) {
+            vTaskDelay(1);
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Moves the card to the safe setting after a CRC error, for good. This runs
+// inside whichever task's transfer failed (FATFS, USB MSC), so NVS is left
+// to sd_tune_save_fallback(). The command is repeated only once CMD13 shows
+// the card ready for it; otherwise its error goes back to the caller.
+static esp_err_t s_do_transaction_checked(int slot, sdmmc_command_t *cmd)
+{
+    esp_err_t ret = s_do_transaction(slot, cmd);
+    if (ret != ESP_ERR_INVALID_CRC && cmd->error != ESP_ERR_INVALID_CRC) {
+        return ret;
+    }
+    s_info.crc_errors++;
+    if (s_info.freq_khz == SD_TUNE_SAFE_KHZ && s_info.phase == 0) {
+        return ret;
+    }
+    ESP_LOGW(TAG, "CRC error (cmd %" PRIu32 ") at %" PRIu32 " kHz, phase %u; falling back to %u kHz, phase 0",
+             cmd->opcode, s_info.freq_khz, s_info.phase, SD_TUNE_SAFE_KHZ);
+    s_card->host.set_card_clk(slot, SD_TUNE_SAFE_KHZ);
+    if (s_card->host.set_input_delay != NULL) {
+        s_card->host.set_input_delay(slot, SDMMC_DELAY_PHASE_0);
+    }
+    s_info.freq_khz = SD_TUNE_SAFE_KHZ;
+    s_info.phase = 0;
+    s_info.fell_back = true;
+    s_save_pending = true;
+    if (!s_card_ready(slot)) {
+        ESP_LOGW(TAG, "Card not ready after the CRC error; cmd %" PRIu32 " not repeated", cmd->opcode);
+        return ret;
+    }
+    cmd->error = ESP_OK;
+    return s_do_transaction(slot, cmd);
+}
+
+esp_err_t sd_tune_apply(const sdmmc_host_t *host, sdmmc_card_t *card)
+{
+    const int64_t start_us = esp_timer_get_time();
+    snprintf(s_key, sizeof(s_key), "%02x%08" PRIx32, card->cid.mfg_id & 0xff, (uint32_t)card->cid.serial);
+    memset(&s_info, 0, sizeof(s_info));
+    s_save_pending = false;
+
+    const size_t bytes = SD_TUNE_SECTORS * (size_t)card->csd.sector_size;
+    uint8_t *ref = heap_caps_malloc(bytes, MALLOC_CAP_DMA);
+    uint8_t *scratch = heap_caps_malloc(bytes, MALLOC_CAP_DMA);
+    size_t start = 0;
+    sd_tune_record_t rec;
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    // Test data is read at the slowest clock, at the first phase that reads it.
+    for (int p = 0; p < SD_TUNE_PHASES && ref != NULL && scratch != NULL; ++p) {
+        ret = s_init_at(host, card, SD_TUNE_SAFE_KHZ, p);
+        if (ret == ESP_OK) {
+            ret = s_reference(card, ref, scratch, &start);
+        }
+        if (ret == ESP_OK || ret == ESP_ERR_NOT_FOUND) {
+            break;
+        }
+    }
+    if (ret == ESP_OK) {
+        if (s_load(&rec) && s_init_at(host, card, rec.freq_khz, rec.phase) == ESP_OK &&
+                s_stress(card, start, ref, scratch)) {
+            s_info.from_nvs = true;
+        } else {
+            ESP_LOGI(TAG, "Tuning card %s", s_key);
+            ret = s_sweep(host, card, start, ref, scratch, &rec);
+            if (ret == ESP_OK) {
+                s_save(&rec);
+            }
+        }
+    }
+    heap_caps_free(ref);
+    heap_caps_free(scratch);
+
+    if (ret == ESP_OK) {
+        s_info.freq_khz = rec.freq_khz;
+        s_info.phase = rec.phase;
+        s_info.phases_ok = rec.phases_ok;
+        s_info.fell_back = rec.fell_back;
+    } else {
+        // Whatever failed, the card has to work for recording.
+        if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "No varied data on the card to test with; using %u kHz, phase 0", SD_TUNE_SAFE_KHZ);
+        } else {
+            ESP_LOGW(TAG, "No setting passed (%s); using %u kHz, phase 0", esp_err_to_name(ret), SD_TUNE_SAFE_KHZ);
+        }
+        ret = s_init_at(host, card, SD_TUNE_SAFE_KHZ, 0);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        s_info.freq_khz = SD_TUNE_SAFE_KHZ;
+    }
+    ESP_LOGI(TAG, "Card %s: %" PRIu32 " kHz (%d kHz real), phase %u, %s in %lld ms", s_key, s_info.freq_khz,
+             card->real_freq_khz, s_info.phase, s_info.from_nvs ? "stored" : "tuned",
+             (long long)((esp_timer_get_time() - start_us) / 1000));
+
+    s_card = card;
+    s_do_transaction = card->host.do_transaction;
+    card->host.do_transaction = s_do_transaction_checked;
+    return ESP_OK;
+}
+
+void sd_tune_save_fallback(void)
+{
+    if (!s_save_pending) {
+        return;
+    }
+    s_save_pending = false;
+    const sd_tune_record_t rec = {
+        .version = SD_TUNE_VERSION,
+        .phases_ok = s_info.phases_ok,
+        .fell_back = 1,
+        .freq_khz = SD_TUNE_SAFE_KHZ,
+    };
+    s_save(&rec);
+}
+
+void sd_tune_get_info(sd_tune_info_t *info)
+{
+    *info = s_info;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdmmc_cmd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t freq_khz;     // Card clock in use
+    uint8_t phase;         // Input delay phase in use
+    uint8_t phases_ok;     // Bit per phase that passed at freq_khz when tuned
+    bool from_nvs;         // Restored for this card instead of tuned now
+    bool fell_back;        // CRC errors forced the safe setting at runtime
+    uint32_t crc_errors;   // Seen at runtime since sd_tune_apply()
+} sd_tune_info_t;
+
+// Picks the card clock and sampling phase for card, which host has just
+// initialised at Default Speed. A setting stored for this card (by CID) is
+// checked and reused; otherwise every High Speed and Default Speed clock is
+// tried at every input delay phase with repeated multi-block reads compared
+// against a read at Default Speed, and the fastest one with a passing phase
+// on each side is kept and stored in NVS. Nothing is written to the card.
+// Without varied data on the card to read, it stays at Default Speed.
+// The card is re-initialised at each point, so call this before mounting.
+// Afterwards a CRC error drops the card to 20 MHz, phase 0, for good, and
+// the failed command is repeated once CMD13 shows the card ready for it.
+// Returns an error only when the card no longer initialises at all.
+esp_err_t sd_tune_apply(const sdmmc_host_t *host, sdmmc_card_t *card);
+
+// Stores a runtime fallback in NVS, so the card starts at 20 MHz on later
+// boots. Does nothing without one. Call it from a task while the card is
+// idle; the fallback itself happens inside card transfers and leaves NVS
+// alone.
+void sd_tune_save_fallback(void);
+
+void sd_tune_get_info(sd_tune_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
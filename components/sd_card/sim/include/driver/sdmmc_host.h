@@ -0,0 +1,5 @@
+#pragma once
+
+// Linux target: the simulated host lives in sd_card_sim.c.
+#include "sdmmc_cmd.h"
+#include "sd_card_sim.h"
@@ -0,0 +1,51 @@
+#pragma once
+
+// Simulated SD card for host tests, only built for IDF_TARGET=linux.
+//
+// The card answers multi-block reads and writes, CMD12 and CMD13 through a
+// host whose clock and input delay phase are tracked. At a clock and phase
+// the configuration marks as failing, reads come back with a CRC error or,
+// if so configured, with a flipped bit and no error, and writes fail their
+// CRC.
+// A transfer that fails leaves the card in its data or receive state until
+// CMD12, as a real card would be.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdmmc_cmd.h"
+
+#define SD_CARD_SIM_SECTORS 4096    // 2 MB of 512-byte sectors
+#define SD_CARD_SIM_PHASES  4       // Input delay phases, as on the ESP32-S3
+
+typedef struct {
+    uint8_t phases_ok[3];   // Bit per phase that reads cleanly at 40, 26 and 20 MHz
+    uint8_t flip_every;     // Every nth failing read flips a bit and reports no error; 0 never
+    bool high_speed;        // Card supports High Speed mode
+    bool init_checks_bus;   // Card init fails where reads would
+    bool status_timeout;    // CMD13 gets no answer
+} sd_card_sim_config_t;
+
+typedef struct {
+    uint32_t freq_khz;      // Card clock now
+    int phase;              // Input delay phase now
+    uint32_t inits;
+    uint32_t reads;         // Multi-block read commands
+    uint32_t writes;        // Multi-block write commands
+    uint32_t stops;         // CMD12
+    uint32_t status_polls;  // CMD13
+} sd_card_sim_stats_t;
+
+// Points the host's callbacks at the simulated slot, at Default Speed.
+void sd_card_sim_host_init(sdmmc_host_t *host);
+
+// Takes effect at once, also for a card already initialised. Keeps the
+// contents, clears the statistics and leaves the card in the transfer state.
+void sd_card_sim_set_config(const sd_card_sim_config_t *cfg);
+
+// The card's contents, SD_CARD_SIM_SECTORS sectors, for the test to fill
+// and check.
+uint8_t *sd_card_sim_media(void);
+
+void sd_card_sim_get_stats(sd_card_sim_stats_t *stats);
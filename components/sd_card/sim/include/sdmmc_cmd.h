@@ -0,0 +1,94 @@
+#pragma once
+
+// The part of the sdmmc API that sd_tune uses, for the linux target, where
+// the sdmmc components are not built. Names and layouts follow ESP-IDF's
+// sd_protocol_types.h, sd_protocol_defs.h and sdmmc_cmd.h; the card behind
+// them is simulated in sd_card_sim.c.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define SDMMC_FREQ_DEFAULT      20000
+#define SDMMC_FREQ_HIGHSPEED    40000
+#define SDMMC_FREQ_PROBING      400
+#define SDMMC_FREQ_26M          26000
+
+#define MMC_STOP_TRANSMISSION   12
+#define MMC_SEND_STATUS         13
+#define MMC_READ_BLOCK_MULTIPLE 18
+#define MMC_WRITE_BLOCK_MULTIPLE 25
+
+#define SCF_ITSDONE     0x0001
+#define SCF_CMD(flags)  ((flags) & 0x00f0)
+#define SCF_CMD_AC      0x0000
+#define SCF_CMD_ADTC    0x0010
+#define SCF_CMD_READ    0x0040
+#define SCF_RSP_BSY     0x0100
+#define SCF_RSP_136     0x0200
+#define SCF_RSP_CRC     0x0400
+#define SCF_RSP_IDX     0x0800
+#define SCF_RSP_PRESENT 0x1000
+#define SCF_RSP_R1      (SCF_RSP_PRESENT | SCF_RSP_CRC | SCF_RSP_IDX)
+#define SCF_RSP_R1B     (SCF_RSP_PRESENT | SCF_RSP_CRC | SCF_RSP_IDX | SCF_RSP_BSY)
+
+#define MMC_ARG_RCA(rca)            ((rca) << 16)
+#define MMC_R1_CURRENT_STATE(resp)  (((resp)[0] >> 9) & 0xf)
+
+typedef enum {
+    SDMMC_DELAY_PHASE_0,
+    SDMMC_DELAY_PHASE_1,
+    SDMMC_DELAY_PHASE_2,
+    SDMMC_DELAY_PHASE_3,
+} sdmmc_delay_phase_t;
+
+typedef uint32_t sdmmc_response_t[4];
+
+typedef struct {
+    uint32_t opcode;
+    uint32_t arg;
+    sdmmc_response_t response;
+    void *data;
+    size_t datalen;
+    size_t blklen;
+    int flags;
+    esp_err_t error;
+    uint32_t timeout_ms;
+} sdmmc_command_t;
+
+typedef struct {
+    int slot;
+    int max_freq_khz;
+    sdmmc_delay_phase_t input_delay_phase;
+    esp_err_t (*set_bus_width)(int slot, size_t width);
+    esp_err_t (*set_card_clk)(int slot, uint32_t freq_khz);
+    esp_err_t (*set_input_delay)(int slot, sdmmc_delay_phase_t delay_phase);
+    esp_err_t (*do_transaction)(int slot, sdmmc_command_t *cmdinfo);
+} sdmmc_host_t;
+
+typedef struct {
+    int mfg_id;
+    int oem_id;
+    char name[8];
+    int revision;
+    int serial;
+} sdmmc_cid_t;
+
+typedef struct {
+    int capacity;
+    int sector_size;
+} sdmmc_csd_t;
+
+typedef struct {
+    sdmmc_host_t host;
+    uint16_t rca;
+    sdmmc_cid_t cid;
+    sdmmc_csd_t csd;
+    int max_freq_khz;
+    int real_freq_khz;
+} sdmmc_card_t;
+
+esp_err_t sdmmc_card_init(const sdmmc_host_t *host, sdmmc_card_t *out_card);
+esp_err_t sdmmc_read_sectors(sdmmc_card_t *card, void *dst, size_t start_sector, size_t sector_count);
+esp_err_t sdmmc_write_sectors(sdmmc_card_t *card, const void *src, size_t start_sector, size_t sector_count);
@@ -0,0 +1,212 @@
+#include "sd_card_sim.h"
+
+#include <string.h>
+
+#define SIM_SECTOR_SIZE 512
+#define SIM_RCA         0x1234
+
+// Card states in the R1 response
+#define SIM_STATE_TRAN  4
+#define SIM_STATE_DATA  5
+#define SIM_STATE_RCV   6
+#define SIM_STATE_PRG   7
+#define SIM_READY_FOR_DATA (1u << 8)
+
+static uint8_t s_media[SD_CARD_SIM_SECTORS * SIM_SECTOR_SIZE];
+static sd_card_sim_config_t s_cfg;
+static sd_card_sim_stats_t s_stats;
+static uint32_t s_state = SIM_STATE_TRAN;
+static uint32_t s_bad_reads;
+
+// Whether the data at the current clock and phase is sampled wrongly. The
+// probing clock always works.
+static bool s_bus_bad(void)
+{
+    int i;
+    if (s_stats.freq_khz >= SDMMC_FREQ_HIGHSPEED) {
+        i = 0;
+    } else if (s_stats.freq_khz >= SDMMC_FREQ_26M) {
+        i = 1;
+    } else if (s_stats.freq_khz >= SDMMC_FREQ_DEFAULT) {
+        i = 2;
+    } else {
+        return false;
+    }
+    return !(s_cfg.phases_ok[i] & (1u << s_stats.phase));
+}
+
+static esp_err_t s_set_bus_width(int slot, size_t width)
+{
+    return ESP_OK;
+}
+
+static esp_err_t s_set_card_clk(int slot, uint32_t freq_khz)
+{
+    s_stats.freq_khz = freq_khz;
+    return ESP_OK;
+}
+
+static esp_err_t s_set_input_delay(int slot, sdmmc_delay_phase_t delay_phase)
+{
+    s_stats.phase = delay_phase;
+    return ESP_OK;
+}
+
+static esp_err_t s_transfer(sdmmc_command_t *cmd, bool write)
+{
+    const size_t start = cmd->arg;
+    const size_t count = cmd->datalen / SIM_SECTOR_SIZE;
+    if (s_state != SIM_STATE_TRAN) {
+        return ESP_ERR_TIMEOUT;  // Illegal in this state: no response
+    }
+    if (start + count > SD_CARD_SIM_SECTORS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *media = s_media + start * SIM_SECTOR_SIZE;
+    if (write) {
+        if (s_bus_bad()) {
+            s_state = SIM_STATE_RCV;
+            return ESP_ERR_INVALID_CRC;
+        }
+        memcpy(media, cmd->data, cmd->datalen);
+        return ESP_OK;
+    }
+    memcpy(cmd->data, media, cmd->datalen);
+    if (s_bus_bad()) {
+        s_bad_reads++;
+        if (s_cfg.flip_every == 0 || s_bad_reads % s_cfg.flip_every != 0) {
+            s_state = SIM_STATE_DATA;
+            return ESP_ERR_INVALID_CRC;
+        }
+        ((uint8_t *)cmd->data)[s_bad_reads * 7919 % cmd->datalen] ^= 0x10;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t s_do_transaction(int slot, sdmmc_command_t *cmd)
+{
+    cmd->error = ESP_OK;
+    switch (cmd->opcode) {
+    case MMC_READ_BLOCK_MULTIPLE:
+        s_stats.reads++;
+        cmd->error = s_transfer(cmd, false);
+        break;
+    case MMC_WRITE_BLOCK_MULTIPLE:
+        s_stats.writes++;
+        cmd->error = s_transfer(cmd, true);
+        break;
+    case MMC_STOP_TRANSMISSION:
+        s_stats.stops++;
+        if (s_state == SIM_STATE_DATA) {
+            s_state = SIM_STATE_TRAN;
+        } else if (s_state == SIM_STATE_RCV) {
+            s_state = SIM_STATE_PRG;
+        }
+        break;
+    case MMC_SEND_STATUS:
+        s_stats.status_polls++;
+        if (s_cfg.status_timeout) {
+            cmd->error = ESP_ERR_TIMEOUT;
+        } else if (s_bus_bad()) {
+            cmd->error = ESP_ERR_INVALID_CRC;
+        } else {
+            cmd->response[0] = s_state << 9 | (s_state == SIM_STATE_TRAN ? SIM_READY_FOR_DATA : 0);
+            if (s_state == SIM_STATE_PRG) {
+                s_state = SIM_STATE_TRAN;  // Programming is done by the next poll
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return cmd->error;
+}
+
+void sd_card_sim_host_init(sdmmc_host_t *host)
+{
+    *host = (sdmmc_host_t) {
+        .slot = 1,
+        .max_freq_khz = SDMMC_FREQ_DEFAULT,
+        .set_bus_width = s_set_bus_width,
+        .set_card_clk = s_set_card_clk,
+        .set_input_delay = s_set_input_delay,
+        .do_transaction = s_do_transaction,
+    };
+}
+
+void sd_card_sim_set_config(const sd_card_sim_config_t *cfg)
+{
+    const uint32_t freq_khz = s_stats.freq_khz;
+    const int phase = s_stats.phase;
+    s_cfg = *cfg;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.freq_khz = freq_khz;
+    s_stats.phase = phase;
+    s_state = SIM_STATE_TRAN;
+    s_bad_reads = 0;
+}
+
+uint8_t *sd_card_sim_media(void)
+{
+    return s_media;
+}
+
+void sd_card_sim_get_stats(sd_card_sim_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+// As in ESP-IDF, the card comes up at the probing clock, moves to the
+// fastest clock both the host and the card allow, and takes the host's
+// input delay phase only when it is not 0.
+esp_err_t sdmmc_card_init(const sdmmc_host_t *host, sdmmc_card_t *out_card)
+{
+    s_stats.inits++;
+    s_state = SIM_STATE_TRAN;
+    memset(out_card, 0, sizeof(*out_card));
+    out_card->host = *host;
+    host->set_card_clk(host->slot, SDMMC_FREQ_PROBING);
+
+    out_card->rca = SIM_RCA;
+    out_card->cid.mfg_id = 0x1b;
+    out_card->cid.serial = 0x12345678;
+    out_card->csd.capacity = SD_CARD_SIM_SECTORS;
+    out_card->csd.sector_size = SIM_SECTOR_SIZE;
+    out_card->max_freq_khz = s_cfg.high_speed ? SDMMC_FREQ_HIGHSPEED : SDMMC_FREQ_DEFAULT;
+
+    int freq_khz = host->max_freq_khz;
+    if (freq_khz > out_card->max_freq_khz) {
+        freq_khz = out_card->max_freq_khz;
+    }
+    host->set_card_clk(host->slot, freq_khz);
+    out_card->real_freq_khz = freq_khz;
+    if (host->input_delay_phase != SDMMC_DELAY_PHASE_0 && host->set_input_delay != NULL) {
+        host->set_input_delay(host->slot, host->input_delay_phase);
+    }
+    return s_cfg.init_checks_bus && s_bus_bad() ? ESP_ERR_INVALID_CRC : ESP_OK;
+}
+
+static esp_err_t s_rw_sectors(sdmmc_card_t *card, uint32_t opcode, void *data, size_t start_sector,
+                              size_t sector_count)
+{
+    sdmmc_command_t cmd = {
+        .opcode = opcode,
+        .arg = start_sector,
+        .data = data,
+        .datalen = sector_count * SIM_SECTOR_SIZE,
+        .blklen = SIM_SECTOR_SIZE,
+        .flags = SCF_CMD_ADTC | SCF_RSP_R1 | (opcode == MMC_READ_BLOCK_MULTIPLE ? SCF_CMD_READ : 0),
+    };
+    const esp_err_t ret = card->host.do_transaction(card->host.slot, &cmd);
+    return ret != ESP_OK ? ret : cmd.error;
+}
+
+esp_err_t sdmmc_read_sectors(sdmmc_card_t *card, void *dst, size_t start_sector, size_t sector_count)
+{
+    return s_rw_sectors(card, MMC_READ_BLOCK_MULTIPLE, dst, start_sector, sector_count);
+}
+
+esp_err_t sdmmc_write_sectors(sdmmc_card_t *card, const void *src, size_t start_sector, size_t sector_count)
+{
+    return s_rw_sectors(card, MMC_WRITE_BLOCK_MULTIPLE, (void *)src, start_sector, sector_count);
+}
@@ -0,0 +1,210 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "nvs_flash.h"
+
+#include "sd_card_sim.h"
+#include "sd_tune.h"
+
+#define TEST_BYTES (SD_CARD_SIM_SECTORS * 512)
+
+static sdmmc_host_t s_host;
+static sdmmc_card_t s_card;
+static uint8_t s_contents[TEST_BYTES];
+
+static sd_card_sim_config_t sim_config(uint8_t ok_40m, uint8_t ok_26m, uint8_t ok_20m)
+{
+    return (sd_card_sim_config_t) {
+        .phases_ok = {ok_40m, ok_26m, ok_20m},
+        .flip_every = 4,
+        .high_speed = true,
+    };
+}
+
+// A card holding recorded data, and no tuning stored for it.
+static void new_card(void)
+{
+    uint8_t *media = sd_card_sim_media();
+    uint32_t x = 0x9e3779b9;
+    for (size_t i = 0; i < TEST_BYTES; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        media[i] = (uint8_t)x;
+    }
+    memcpy(s_contents, media, TEST_BYTES);
+    TEST_ESP_OK(nvs_flash_erase());
+    TEST_ESP_OK(nvs_flash_init());
+}
+
+// Card init at Default Speed and tuning, as at start-up.
+static void boot(const sd_card_sim_config_t *cfg, sd_tune_info_t *info, sd_card_sim_stats_t *stats)
+{
+    sd_card_sim_set_config(cfg);
+    sd_card_sim_host_init(&s_host);
+    TEST_ESP_OK(sdmmc_card_init(&s_host, &s_card));
+    TEST_ESP_OK(sd_tune_apply(&s_host, &s_card));
+    sd_tune_get_info(info);
+    sd_card_sim_get_stats(stats);
+    printf("%u kHz, phase %u, phases ok 0x%x, %s, %u inits, %u reads\n", (unsigned)info->freq_khz,
+           info->phase, info->phases_ok, info->from_nvs ? "stored" : "tuned", (unsigned)stats->inits,
+           (unsigned)stats->reads);
+    // the bus is left where the info says, and the card was only read
+    TEST_ASSERT_EQUAL(info->freq_khz, stats->freq_khz);
+    TEST_ASSERT_EQUAL(info->phase, stats->phase);
+    TEST_ASSERT_EQUAL(0, stats->writes);
+    TEST_ASSERT_EQUAL_MEMORY(s_contents, sd_card_sim_media(), TEST_BYTES);
+}
+
+TEST_CASE("Tuning keeps the middle of the passing phases and reuses it", "[sd][tune]")
+{
+    sd_tune_info_t info;
+    sd_card_sim_stats_t stats;
+    new_card();
+    const sd_card_sim_config_t cfg = sim_config(0x0e, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_HIGHSPEED, info.freq_khz);
+    TEST_ASSERT_EQUAL(2, info.phase);
+    TEST_ASSERT_EQUAL_HEX8(0x0e, info.phases_ok);
+    TEST_ASSERT_FALSE(info.from_nvs);
+
+    // the next boot checks the stored point once instead of sweeping
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_TRUE(info.from_nvs);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_HIGHSPEED, info.freq_khz);
+    TEST_ASSERT_EQUAL(2, info.phase);
+    TEST_ASSERT_LESS_OR_EQUAL(3, stats.inits);
+
+    // a stored point that stopped passing is tuned again
+    const sd_card_sim_config_t worse = sim_config(0x00, 0x0f, 0x0f);
+    boot(&worse, &info, &stats);
+    TEST_ASSERT_FALSE(info.from_nvs);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_26M, info.freq_khz);
+    TEST_ASSERT_EQUAL(0, info.phase);
+}
+
+TEST_CASE("Tuning wants a passing phase on each side", "[sd][tune]")
+{
+    static const struct {
+        uint8_t ok[3];
+        bool high_speed;
+        bool init_checks_bus;
+        uint32_t freq_khz;
+        uint8_t phase;
+    } cases[] = {
+        {{0x03, 0x0f, 0x0f}, true, false, SDMMC_FREQ_26M, 0},       // two phases at 40 MHz are not enough
+        {{0x0b, 0x0f, 0x0f}, true, false, SDMMC_FREQ_HIGHSPEED, 0}, // 3, 0, 1 wrap around
+        {{0x0e, 0x0f, 0x0f}, true, true, SDMMC_FREQ_HIGHSPEED, 2},  // init fails at phase 0
+        {{0x0f, 0x0f, 0x0f}, false, false, SDMMC_FREQ_DEFAULT, 0},  // no High Speed
+        {{0x00, 0x00, 0x06}, true, false, SDMMC_FREQ_DEFAULT, 1},   // 20 MHz without margin
+        {{0x00, 0x00, 0x00}, true, false, SDMMC_FREQ_DEFAULT, 0},   // nothing passes
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        sd_tune_info_t info;
+        sd_card_sim_stats_t stats;
+        new_card();
+        sd_card_sim_config_t cfg = sim_config(cases[i].ok[0], cases[i].ok[1], cases[i].ok[2]);
+        cfg.high_speed = cases[i].high_speed;
+        cfg.init_checks_bus = cases[i].init_checks_bus;
+        boot(&cfg, &info, &stats);
+        TEST_ASSERT_EQUAL(cases[i].freq_khz, info.freq_khz);
+        TEST_ASSERT_EQUAL(cases[i].phase, info.phase);
+    }
+}
+
+TEST_CASE("Tuning skips a card without varied data", "[sd][tune]")
+{
+    sd_tune_info_t info;
+    sd_card_sim_stats_t stats;
+    new_card();
+    memset(sd_card_sim_media(), 0, TEST_BYTES);
+    memset(s_contents, 0, TEST_BYTES);
+    const sd_card_sim_config_t cfg = sim_config(0x0f, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_DEFAULT, info.freq_khz);
+    TEST_ASSERT_EQUAL(0, info.phase);
+    // nothing stored either
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_FALSE(info.from_nvs);
+}
+
+TEST_CASE("CRC errors fall back, retry after CMD13 and are saved later", "[sd][tune]")
+{
+    static uint8_t buf[64 * 512];
+    sd_tune_info_t info;
+    sd_card_sim_stats_t stats;
+    new_card();
+    sd_card_sim_config_t cfg = sim_config(0x0e, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_HIGHSPEED, info.freq_khz);
+
+    // 40 MHz goes bad: the read fails its CRC and leaves the card sending
+    cfg = sim_config(0x00, 0x0f, 0x0f);
+    cfg.flip_every = 0;
+    sd_card_sim_set_config(&cfg);
+    TEST_ESP_OK(sdmmc_read_sectors(&s_card, buf, 100, 64));
+    TEST_ASSERT_EQUAL_MEMORY(s_contents + 100 * 512, buf, sizeof(buf));
+    sd_card_sim_get_stats(&stats);
+    sd_tune_get_info(&info);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_DEFAULT, stats.freq_khz);
+    TEST_ASSERT_EQUAL(0, stats.phase);
+    TEST_ASSERT_EQUAL(2, stats.reads);
+    TEST_ASSERT_EQUAL(1, stats.stops);
+    TEST_ASSERT_GREATER_OR_EQUAL(2, stats.status_polls);
+    TEST_ASSERT_TRUE(info.fell_back);
+    TEST_ASSERT_EQUAL(1, info.crc_errors);
+
+    // NVS is not written from inside the transfer
+    cfg = sim_config(0x0e, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_TRUE(info.from_nvs);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_HIGHSPEED, info.freq_khz);
+
+    // a write that fails leaves the card receiving, then programming
+    cfg = sim_config(0x00, 0x0f, 0x0f);
+    sd_card_sim_set_config(&cfg);
+    memset(buf, 0x5a, sizeof(buf));
+    TEST_ESP_OK(sdmmc_write_sectors(&s_card, buf, 200, 64));
+    memcpy(s_contents + 200 * 512, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_MEMORY(s_contents, sd_card_sim_media(), TEST_BYTES);
+    sd_card_sim_get_stats(&stats);
+    TEST_ASSERT_EQUAL(2, stats.writes);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_DEFAULT, stats.freq_khz);
+
+    // saved from task context, later boots keep 20 MHz
+    sd_tune_save_fallback();
+    cfg = sim_config(0x0e, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+    TEST_ASSERT_TRUE(info.from_nvs);
+    TEST_ASSERT_TRUE(info.fell_back);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_DEFAULT, info.freq_khz);
+}
+
+TEST_CASE("A command is not repeated when CMD13 gets no answer", "[sd][tune]")
+{
+    static uint8_t buf[16 * 512];
+    sd_tune_info_t info;
+    sd_card_sim_stats_t stats;
+    new_card();
+    sd_card_sim_config_t cfg = sim_config(0x0e, 0x0f, 0x0f);
+    boot(&cfg, &info, &stats);
+
+    cfg = sim_config(0x00, 0x0f, 0x0f);
+    cfg.flip_every = 0;
+    cfg.status_timeout = true;
+    sd_card_sim_set_config(&cfg);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, sdmmc_read_sectors(&s_card, buf, 0, 16));
+    sd_card_sim_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.reads);
+    TEST_ASSERT_EQUAL(SDMMC_FREQ_DEFAULT, stats.freq_khz);
+    sd_tune_get_info(&info);
+    TEST_ASSERT_TRUE(info.fell_back);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,506 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // fopencookie()
+#endif
+#include "storage_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define STORAGE_IO_POOL_CHUNKS  16   // 512 KB in PSRAM
+#define STORAGE_IO_POOL_MIN     4    // Whole pool without PSRAM
+#define STORAGE_IO_WAIT_MS      5000 // A producer gives up waiting for a free chunk
+#define STORAGE_IO_TASK_PRIO    6    // Above the mic and camera tasks
+#define STORAGE_IO_TASK_STACK   4096
+
+static const char *TAG = "storage";
+
+typedef struct storage_stream storage_stream_t;
+
+typedef struct {
+    storage_stream_t *stream;
+    uint8_t *data;
+    uint32_t offset;    // File offset of data[0]
+    uint32_t len;
+    int64_t queued_us;
+    bool close;         // Closes the stream once its earlier chunks are written
+} storage_chunk_t;
+
+struct storage_stream {
+    int fd;
+    storage_io_prio_t prio;
+    SemaphoreHandle_t lock;    // Producer against the writer's sync round
+    SemaphoreHandle_t closed;
+    storage_chunk_t *fill;     // Being filled by the producer
+    int64_t fill_us;           // When fill got its first byte
+    storage_chunk_t close_op;
+    uint32_t pos;              // Producer's file position
+    uint32_t size;
+    uint32_t fd_pos;           // Writer's file position
+    volatile int error;        // First errno of a failed write
+    bool dirty;                // Written since the last fsync
+    int64_t latency_us;        // Sum over all writes
+    storage_io_stream_stats_t stats;
+};
+
+static TaskHandle_t s_task = NULL;
+static QueueHandle_t s_free = NULL;
+static QueueHandle_t s_queue[2];     // Per storage_io_prio_t
+static SemaphoreHandle_t s_streams_lock = NULL;
+static storage_stream_t *s_streams[STORAGE_IO_MAX_STREAMS];
+static storage_chunk_t *s_chunks = NULL;
+static int s_high_reserve = 0;       // Free chunks low streams leave alone
+static uint32_t s_in_flight = 0;
+static uint32_t s_in_flight_max = 0;
+static uint32_t s_queued_max = 0;
+static uint32_t s_syncs = 0;
+
+static void s_fail(storage_stream_t *s, int err)
+{
+    if (s->error == 0) {
+        ESP_LOGE(TAG, "%s: write failed (%d)", s->stats.name, err);
+        s->error = err;
+    }
+}
+
+// Waits for a free chunk; low streams leave the reserve to high ones, so a
+// video burst cannot hold up audio.
+static storage_chunk_t *s_chunk_take(storage_stream_t *s)
+{
+    const int64_t start = esp_timer_get_time();
+    storage_chunk_t *c = NULL;
+    while (true) {
+        if (s->prio == STORAGE_IO_PRIO_HIGH || uxQueueMessagesWaiting(s_free) > (UBaseType_t)s_high_reserve) {
+            if (xQueueReceive(s_free, &c, 0) == pdTRUE) {
+                break;
+            }
+        }
+        if (esp_timer_get_time() - start >= (int64_t)STORAGE_IO_WAIT_MS * 1000) {
+            break;
+        }
+        vTaskDelay(1);
+    }
+    const uint32_t waited = (uint32_t)(esp_timer_get_time() - start);
+    if (waited > s->stats.wait_us_max) {
+        s->stats.wait_us_max = waited;
+    }
+    return c;
+}
+
+// Hands the stream's fill chunk to the writer. Called with s->lock held.
+static void s_submit(storage_stream_t *s)
+{
+    storage_chunk_t *c = s->fill;
+    s->fill = NULL;
+    c->queued_us = esp_timer_get_time();
+    xQueueSend(s_queue[s->prio], &c, portMAX_DELAY);
+    const uint32_t queued = uxQueueMessagesWaiting(s_queue[0]) + uxQueueMessagesWaiting(s_queue[1]);
+    if (queued > s_queued_max) {
+        s_queued_max = queued;
+    }
+    xTaskNotifyGive(s_task);
+}
+
+static ssize_t s_cookie_write(void *cookie, const char *buf, size_t size)
+{
+    storage_stream_t *s = (storage_stream_t *)cookie;
+    if (s->error != 0) {
+        errno = s->error;
+        return -1;
+    }
+    const size_t total = size;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    while (size > 0) {
+        if (s->fill != NULL && s->fill->offset + s->fill->len != s->pos) {
+            s_submit(s);  // After a seek
+        }
+        if (s->fill == NULL) {
+            xSemaphoreGive(s->lock);
+            storage_chunk_t *c = s_chunk_take(s);
+            xSemaphoreTake(s->lock, portMAX_DELAY);
+            if (c == NULL) {
+                // The bytes are lost, so the file is short: fclose() reports it.
+                s_fail(s, ETIMEDOUT);
+                xSemaphoreGive(s->lock);
+                errno = ETIMEDOUT;
+                return total - size > 0 ? (ssize_t)(total - size) : -1;
+            }
+            c->stream = s;
+            c->offset = s->pos;
+            c->len = 0;
+            c->close = false;
+            s->fill = c;
+            s->fill_us = esp_timer_get_time();
+        }
+        // Chunks end on chunk boundaries, so writes stay aligned after a
+        // seek or a partial chunk written by the sync round.
+        storage_chunk_t *c = s->fill;
+        const uint32_t cap = STORAGE_IO_CHUNK_BYTES - c->offset % STORAGE_IO_CHUNK_BYTES;
+        size_t n = cap - c->len;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(c->data + c->len, buf, n);
+        c->len += n;
+        s->pos += n;
+        buf += n;
+        size -= n;
+        const uint32_t in_flight = __atomic_add_fetch(&s_in_flight, n, __ATOMIC_RELAXED);
+        if (in_flight > s_in_flight_max) {
+            s_in_flight_max = in_flight;
+        }
+        if (c->len == cap) {
+            s_submit(s);
+        }
+    }
+    if (s->pos > s->size) {
+        s->size = s->pos;
+    }
+    xSemaphoreGive(s->lock);
+    return total;
+}
+
+// Only moves the producer's position; the writer seeks when a chunk needs it.
+static int s_cookie_seek(void *cookie, off_t *offset, int whence)
+{
+    storage_stream_t *s = (storage_stream_t *)cookie;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    int64_t base = 0;
+    if (whence == SEEK_CUR) {
+        base = s->pos;
+    } else if (whence == SEEK_END) {
+        base = s->size;
+    }
+    const int64_t pos = base + *offset;
+    int ret = 0;
+    if (pos < 0 || pos > UINT32_MAX - STORAGE_IO_CHUNK_BYTES) {
+        errno = EINVAL;
+        ret = -1;
+    } else {
+        s->pos = (uint32_t)pos;
+        *offset = (off_t)pos;
+    }
+    xSemaphoreGive(s->lock);
+    return ret;
+}
+
+// Queues the rest and waits for the writer to sync and close the file.
+static int s_cookie_close(void *cookie)
+{
+    storage_stream_t *s = (storage_stream_t *)cookie;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    if (s->fill != NULL) {
+        s_submit(s);
+    }
+    xSemaphoreGive(s->lock);
+    storage_chunk_t *c = &s->close_op;
+    c->stream = s;
+    c->close = true;
+    c->queued_us = esp_timer_get_time();
+    xQueueSend(s_queue[s->prio], &c, portMAX_DELAY);
+    xTaskNotifyGive(s_task);
+    xSemaphoreTake(s->closed, portMAX_DELAY);
+
+    const int err = s->error;
+    vSemaphoreDelete(s->lock);
+    vSemaphoreDelete(s->closed);
+    free(s);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static bool s_register(storage_stream_t *s)
+{
+    bool ok = false;
+    xSemaphoreTake(s_streams_lock, portMAX_DELAY);
+    for (int i = 0; i < STORAGE_IO_MAX_STREAMS && !ok; ++i) {
+        if (s_streams[i] == NULL) {
+            s_streams[i] = s;
+            ok = true;
+        }
+    }
+    xSemaphoreGive(s_streams_lock);
+    return ok;
+}
+
+static void s_unregister(storage_stream_t *s)
+{
+    xSemaphoreTake(s_streams_lock, portMAX_DELAY);
+    for (int i = 0; i < STORAGE_IO_MAX_STREAMS; ++i) {
+        if (s_streams[i] == s) {
+            s_streams[i] = NULL;
+        }
+    }
+    xSemaphoreGive(s_streams_lock);
+}
+
+static void s_close_stream(storage_stream_t *s)
+{
+    if (s->dirty && fsync(s->fd) != 0) {
+        s_fail(s, errno);
+    }
+    if (close(s->fd) != 0) {
+        s_fail(s, errno);
+    }
+    const storage_io_stream_stats_t *st = &s->stats;
+    ESP_LOGI(TAG, "%s: %llu bytes in %u writes, latency %u us avg, %u us max, producer waited %u us max",
+             st->name, (unsigned long long)st->bytes, (unsigned)st->writes, (unsigned)st->latency_us_avg,
+             (unsigned)st->latency_us_max, (unsigned)st->wait_us_max);
+    s_unregister(s);
+    xSemaphoreGive(s->closed);
+}
+
+// Writes one chunk, or closes its stream, and frees it.
+static void s_run(storage_chunk_t *c)
+{
+    storage_stream_t *s = c->stream;
+    if (c->close) {
+        s_close_stream(s);
+        return;
+    }
+    if (s->error == 0) {
+        if (s->fd_pos != c->offset && lseek(s->fd, c->offset, SEEK_SET) < 0) {
+            s_fail(s, errno);
+        } else {
+            const ssize_t n = write(s->fd, c->data, c->len);
+            if (n != (ssize_t)c->len) {
+                s_fail(s, n < 0 ? errno : ENOSPC);
+            } else {
+                s->fd_pos = c->offset + c->len;
+                s->dirty = true;
+            }
+        }
+    }
+    storage_io_stream_stats_t *st = &s->stats;
+    const uint32_t latency = (uint32_t)(esp_timer_get_time() - c->queued_us);
+    s->latency_us += latency;
+    st->bytes += c->len;
+    st->writes++;
+    st->latency_us_avg = (uint32_t)(s->latency_us / st->writes);
+    if (latency > st->latency_us_max) {
+        st->latency_us_max = latency;
+    }
+    __atomic_sub_fetch(&s_in_flight, c->len, __ATOMIC_RELAXED);
+    xQueueSend(s_free, &c, 0);
+}
+
+// Writes up to max queued chunks, high priority first, rechecked after
+// every write. Stops at until_us, so a steady stream cannot hold off syncs.
+static void s_drain(UBaseType_t max, int64_t until_us)
+{
+    storage_chunk_t *c = NULL;
+    for (UBaseType_t i = 0; i < max && esp_timer_get_time() < until_us; ++i) {
+        if (xQueueReceive(s_queue[STORAGE_IO_PRIO_HIGH], &c, 0) != pdTRUE &&
+                xQueueReceive(s_queue[STORAGE_IO_PRIO_LOW], &c, 0) != pdTRUE) {
+            break;
+        }
+        s_run(c);
+    }
+}
+
+// The global durability policy: chunks filling for a whole period are
+// written as they are, then every file written to is synced.
+static void s_sync_round(void)
+{
+    const int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_streams_lock, portMAX_DELAY);
+    for (int i = 0; i < STORAGE_IO_MAX_STREAMS; ++i) {
+        storage_stream_t *s = s_streams[i];
+        if (s == NULL) {
+            continue;
+        }
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        if (s->fill != NULL && s->fill->len > 0 && now - s->fill_us >= (int64_t)STORAGE_IO_SYNC_MS * 1000) {
+            s_submit(s);
+        }
+        xSemaphoreGive(s->lock);
+    }
+    xSemaphoreGive(s_streams_lock);
+    // Everything queued so far, however long it takes.
+    s_drain(uxQueueMessagesWaiting(s_queue[0]) + uxQueueMessagesWaiting(s_queue[1]), INT64_MAX);
+
+    // Only this task closes streams, so the entries stay valid.
+    for (int i = 0; i < STORAGE_IO_MAX_STREAMS; ++i) {
+        storage_stream_t *s = s_streams[i];
+        if (s != NULL && s->dirty) {
+            if (fsync(s->fd) != 0) {
+                s_fail(s, errno);
+            }
+            s->dirty = false;
+        }
+    }
+    s_syncs++;
+}
+
+static void s_writer_task(void *arg)
+{
+    (void)arg;
+    int64_t next_sync_us = esp_timer_get_time() + (int64_t)STORAGE_IO_SYNC_MS * 1000;
+    while (true) {
+        const int64_t left_us = next_sync_us - esp_timer_get_time();
+        ulTaskNotifyTake(pdTRUE, left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) + 1 : 0);
+        s_drain(UINT32_MAX, next_sync_us);
+        if (esp_timer_get_time() >= next_sync_us) {
+            s_sync_round();
+            next_sync_us = esp_timer_get_time() + (int64_t)STORAGE_IO_SYNC_MS * 1000;
+        }
+    }
+}
+
+// Frees whatever a failed storage_io_init() got, so the next call starts over.
+static void s_release(uint8_t *mem)
+{
+    free(mem);
+    free(s_chunks);
+    s_chunks = NULL;
+    for (int i = 0; i < 2; ++i) {
+        if (s_queue[i] != NULL) {
+            vQueueDelete(s_queue[i]);
+            s_queue[i] = NULL;
+        }
+    }
+    if (s_free != NULL) {
+        vQueueDelete(s_free);
+        s_free = NULL;
+    }
+    if (s_streams_lock != NULL) {
+        vSemaphoreDelete(s_streams_lock);
+        s_streams_lock = NULL;
+    }
+}
+
+esp_err_t storage_io_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+    int pool = STORAGE_IO_POOL_CHUNKS;
+    uint8_t *mem = (uint8_t *)heap_caps_malloc(pool * STORAGE_IO_CHUNK_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (mem == NULL) {
+        pool = STORAGE_IO_POOL_MIN;
+        mem = (uint8_t *)malloc(pool * STORAGE_IO_CHUNK_BYTES);
+    }
+    s_chunks = (storage_chunk_t *)calloc(pool, sizeof(storage_chunk_t));
+    s_free = xQueueCreate(pool, sizeof(storage_chunk_t *));
+    // Room for every chunk plus a close per stream, so queueing never blocks.
+    s_queue[STORAGE_IO_PRIO_HIGH] = xQueueCreate(pool + STORAGE_IO_MAX_STREAMS, sizeof(storage_chunk_t *));
+    s_queue[STORAGE_IO_PRIO_LOW] = xQueueCreate(pool + STORAGE_IO_MAX_STREAMS, sizeof(storage_chunk_t *));
+    s_streams_lock = xSemaphoreCreateMutex();
+    if (mem == NULL || s_chunks == NULL || s_free == NULL || s_queue[0] == NULL || s_queue[1] == NULL ||
+            s_streams_lock == NULL) {
+        ESP_LOGE(TAG, "Chunk pool alloc failed");
+        s_release(mem);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < pool; ++i) {
+        storage_chunk_t *c = &s_chunks[i];
+        c->data = mem + (size_t)i * STORAGE_IO_CHUNK_BYTES;
+        xQueueSend(s_free, &c, 0);
+    }
+    // With PSRAM 4 chunks: one being filled for each of the audio file and
+    // its two sidecars, which only fill a chunk slowly, and one to queue.
+    s_high_reserve = pool / 4;
+    if (xTaskCreate(s_writer_task, "storage_io", STORAGE_IO_TASK_STACK, NULL, STORAGE_IO_TASK_PRIO,
+                    &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Writer task create failed");
+        s_task = NULL;
+        s_release(mem);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d chunks of %u KB, %d kept for high priority", pool,
+             (unsigned)(STORAGE_IO_CHUNK_BYTES / 1024), s_high_reserve);
+    return ESP_OK;
+}
+
+FILE *storage_io_fopen(const char *path, storage_io_prio_t prio)
+{
+    if (storage_io_init() != ESP_OK) {
+        // Still recorded, only without the chunking and the shared syncs.
+        ESP_LOGW(TAG, "%s: writing directly", path);
+        return fopen(path, "w");
+    }
+    storage_stream_t *s = (storage_stream_t *)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    s->fd = -1;
+    s->prio = prio;
+    s->stats.prio = prio;
+    const char *slash = strrchr(path, '/');
+    strlcpy(s->stats.name, slash != NULL ? slash + 1 : path, sizeof(s->stats.name));
+    s->lock = xSemaphoreCreateMutex();
+    s->closed = xSemaphoreCreateBinary();
+    int err = ENOMEM;
+    if (s->lock != NULL && s->closed != NULL) {
+        s->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        err = errno;
+    }
+    if (s->fd >= 0 && !s_register(s)) {
+        err = EMFILE;
+        close(s->fd);
+        s->fd = -1;
+    }
+    FILE *f = NULL;
+    if (s->fd >= 0) {
+        const cookie_io_functions_t io = {
+            .write = s_cookie_write,
+            .seek = s_cookie_seek,
+            .close = s_cookie_close,
+        };
+        f = fopencookie(s, "w", io);
+        if (f == NULL) {
+            err = errno;
+            s_unregister(s);
+            close(s->fd);
+        }
+    }
+    if (f == NULL) {
+        if (s->lock != NULL) {
+            vSemaphoreDelete(s->lock);
+        }
+        if (s->closed != NULL) {
+            vSemaphoreDelete(s->closed);
+        }
+        free(s);
+        errno = err;
+        return NULL;
+    }
+    // Chunks do the buffering.
+    setvbuf(f, NULL, _IONBF, 0);
+    return f;
+}
+
+void storage_io_get_stats(storage_io_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (s_task == NULL) {
+        return;
+    }
+    stats->queued = uxQueueMessagesWaiting(s_queue[0]) + uxQueueMessagesWaiting(s_queue[1]);
+    stats->queued_max = s_queued_max;
+    stats->in_flight_bytes = s_in_flight;
+    stats->in_flight_bytes_max = s_in_flight_max;
+    stats->syncs = s_syncs;
+    xSemaphoreTake(s_streams_lock, portMAX_DELAY);
+    for (int i = 0; i < STORAGE_IO_MAX_STREAMS; ++i) {
+        if (s_streams[i] != NULL) {
+            stats->stream[stats->streams++] = s_streams[i]->stats;
+        }
+    }
+    xSemaphoreGive(s_streams_lock);
+}
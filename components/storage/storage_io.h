@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+
+// One writer task owns the SD card for all recordings. Producers write to
+// FILE streams from storage_io_fopen() as usual; the bytes are collected
+// into STORAGE_IO_CHUNK_BYTES chunks at chunk-aligned file offsets and
+// written by the writer task, which also syncs every open file on one
+// schedule. fflush() and fsync() are not needed on these streams.
+
+#define STORAGE_IO_CHUNK_BYTES  (32 * 1024) // Write size and alignment; a FAT cluster multiple
+#define STORAGE_IO_SYNC_MS      1000 // Sync period; at most twice this is lost on power failure
+#define STORAGE_IO_MAX_STREAMS  8
+
+typedef enum {
+    STORAGE_IO_PRIO_HIGH,  // Audio and anything written from the audio task: written first and
+                           // never kept from buffers by low streams
+    STORAGE_IO_PRIO_LOW,   // Video and its metadata file
+} storage_io_prio_t;
+
+typedef struct {
+    char name[16];              // File name without the directory
+    storage_io_prio_t prio;
+    uint64_t bytes;             // Written to the card
+    uint32_t writes;
+    uint32_t latency_us_avg;    // From a chunk being queued to its write returning
+    uint32_t latency_us_max;
+    uint32_t wait_us_max;       // Longest a producer waited for a free chunk
+} storage_io_stream_stats_t;
+
+typedef struct {
+    uint32_t queued;            // Chunks waiting for the writer
+    uint32_t queued_max;
+    uint32_t in_flight_bytes;   // Accepted from producers, not yet written
+    uint32_t in_flight_bytes_max;
+    uint32_t syncs;             // Sync rounds since boot
+    int streams;
+    storage_io_stream_stats_t stream[STORAGE_IO_MAX_STREAMS];  // Open streams
+} storage_io_stats_t;
+
+// Allocates the chunk pool and starts the writer task. Optional:
+// storage_io_fopen() calls it on first use. A failure frees everything it
+// got, so it can be called again later.
+esp_err_t storage_io_init(void);
+
+// Creates or truncates path for writing through the writer task. Seeks are
+// allowed, reads are not. fclose() waits until everything is on the card
+// and returns EOF if any write failed. Returns NULL with errno set. Without
+// the writer task (storage_io_init() failing) this is a plain fopen(path, "w").
+FILE *storage_io_fopen(const char *path, storage_io_prio_t prio);
+
+// Reads the queue counters since boot and the counters of open streams.
+void storage_io_get_stats(storage_io_stats_t *stats);
@@ -0,0 +1,150 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "storage_io.h"
+
+#define TEST_PATH "/tmp/storage_io_test.bin"
+
+// Byte i of a test pattern, not a multiple of the chunk size in period.
+static uint8_t pattern(uint32_t i)
+{
+    return (uint8_t)(i * 7 + i / 251);
+}
+
+static uint8_t *read_file(const char *path, long *len)
+{
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len > 0 ? *len : 1);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL(*len, fread(buf, 1, *len, f));
+    fclose(f);
+    return buf;
+}
+
+// Waits until the writer has written bytes of the only open stream. A
+// partly filled chunk goes out once it is STORAGE_IO_SYNC_MS old, checked
+// by the next sync round, so it can take two periods and the write itself.
+static storage_io_stream_stats_t wait_written(uint64_t bytes)
+{
+    storage_io_stats_t stats;
+    for (int i = 0; i <= 3 * STORAGE_IO_SYNC_MS / 10; i++) {
+        storage_io_get_stats(&stats);
+        TEST_ASSERT_EQUAL(1, stats.streams);
+        if (stats.stream[0].bytes >= bytes) {
+            return stats.stream[0];
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_FAIL_MESSAGE("Timed out waiting for the writer");
+    return stats.stream[0];
+}
+
+TEST_CASE("Storage writes stay on chunk boundaries", "[storage]")
+{
+    TEST_ESP_OK(storage_io_init());
+    FILE *f = storage_io_fopen(TEST_PATH, STORAGE_IO_PRIO_LOW);
+    TEST_ASSERT_NOT_NULL(f);
+
+    // odd write sizes are collected into whole chunks
+    const uint32_t len = 2 * STORAGE_IO_CHUNK_BYTES + 1000;
+    uint8_t *data = malloc(len);
+    TEST_ASSERT_NOT_NULL(data);
+    for (uint32_t i = 0; i < len; i++) {
+        data[i] = pattern(i);
+    }
+    for (uint32_t pos = 0; pos < len;) {
+        uint32_t n = 1 + (pos * 13) % 4001;
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        TEST_ASSERT_EQUAL(n, fwrite(data + pos, 1, n, f));
+        pos += n;
+    }
+    storage_io_stream_stats_t st = wait_written(2 * STORAGE_IO_CHUNK_BYTES);
+    TEST_ASSERT_EQUAL(2, st.writes);
+    TEST_ASSERT_EQUAL(2 * STORAGE_IO_CHUNK_BYTES, st.bytes);
+
+    // after a seek the next chunk ends on the following boundary
+    TEST_ASSERT_EQUAL(0, fseek(f, 3 * STORAGE_IO_CHUNK_BYTES - 100, SEEK_SET));
+    TEST_ASSERT_EQUAL(200, fwrite(data, 1, 200, f));
+    st = wait_written(2 * STORAGE_IO_CHUNK_BYTES + 1100);
+    TEST_ASSERT_EQUAL(4, st.writes);
+    TEST_ASSERT_EQUAL(2 * STORAGE_IO_CHUNK_BYTES + 1100, st.bytes);
+
+    TEST_ASSERT_EQUAL(0, fclose(f));
+    long file_len = 0;
+    uint8_t *back = read_file(TEST_PATH, &file_len);
+    TEST_ASSERT_EQUAL(3 * STORAGE_IO_CHUNK_BYTES + 100, file_len);
+    TEST_ASSERT_EQUAL_MEMORY(data, back, len);
+    TEST_ASSERT_EQUAL_MEMORY(data, back + 3 * STORAGE_IO_CHUNK_BYTES - 100, 200);
+    free(back);
+    free(data);
+    remove(TEST_PATH);
+}
+
+TEST_CASE("Storage rewrites a header after seeking back", "[storage]")
+{
+    FILE *f = storage_io_fopen(TEST_PATH, STORAGE_IO_PRIO_HIGH);
+    TEST_ASSERT_NOT_NULL(f);
+
+    // the WAV writer's pattern: placeholder header, data, then the real header
+    uint8_t header[44] = {0};
+    TEST_ASSERT_EQUAL(sizeof(header), fwrite(header, 1, sizeof(header), f));
+    const uint32_t len = STORAGE_IO_CHUNK_BYTES + 5000;
+    for (uint32_t i = 0; i < len; i++) {
+        const uint8_t b = pattern(i);
+        TEST_ASSERT_EQUAL(1, fwrite(&b, 1, 1, f));
+    }
+    TEST_ASSERT_EQUAL(sizeof(header) + len, ftell(f));
+    for (size_t i = 0; i < sizeof(header); i++) {
+        header[i] = (uint8_t)(0xA0 + i);
+    }
+    TEST_ASSERT_EQUAL(0, fseek(f, 0, SEEK_SET));
+    TEST_ASSERT_EQUAL(sizeof(header), fwrite(header, 1, sizeof(header), f));
+    TEST_ASSERT_EQUAL(0, fclose(f));
+
+    long file_len = 0;
+    uint8_t *back = read_file(TEST_PATH, &file_len);
+    TEST_ASSERT_EQUAL(sizeof(header) + len, file_len);
+    TEST_ASSERT_EQUAL_MEMORY(header, back, sizeof(header));
+    for (uint32_t i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL_HEX8(pattern(i), back[sizeof(header) + i]);
+    }
+    free(back);
+    remove(TEST_PATH);
+}
+
+TEST_CASE("Storage reports a failed card write at fclose", "[storage]")
+{
+    // every write to /dev/full fails with ENOSPC, after fwrite() has returned
+    FILE *f = storage_io_fopen("/dev/full", STORAGE_IO_PRIO_LOW);
+    TEST_ASSERT_NOT_NULL(f);
+    static uint8_t data[1000];
+    TEST_ASSERT_EQUAL(sizeof(data), fwrite(data, 1, sizeof(data), f));
+    errno = 0;
+    TEST_ASSERT_EQUAL(EOF, fclose(f));
+    TEST_ASSERT_EQUAL(ENOSPC, errno);
+
+    // later streams are not affected
+    f = storage_io_fopen(TEST_PATH, STORAGE_IO_PRIO_LOW);
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(sizeof(data), fwrite(data, 1, sizeof(data), f));
+    TEST_ASSERT_EQUAL(0, fclose(f));
+    remove(TEST_PATH);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
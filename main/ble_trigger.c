@@ -6,7 +6,6 @@
 
 #include "esp_log.h"
 #include "esp_timer.h"
-#include "nvs_flash.h"
 #include "sdkconfig.h"
 #include "button.h"
 #include "freertos/FreeRTOS.h"
@@ -169,17 +168,8 @@ static void s_ble_host_task(void *param)
 void ble_trigger_init(void)
 {
 #if CONFIG_BT_NIMBLE_ENABLED
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        nvs_flash_erase();
-        err = nvs_flash_init();
-    }
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "NVS init failed (%s)", esp_err_to_name(err));
-        return;
-    }
-
-    err = nimble_port_init();
+    // NVS is initialized by app_main before any component uses it
+    esp_err_t err = nimble_port_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NimBLE init failed (%s)", esp_err_to_name(err));
         return;
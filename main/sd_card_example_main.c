@@ -18,17 +18,20 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "nvs_flash.h"
 #include "button.h"
 #include "ble_trigger.h"
 #include "mic_capture.h"
 #include "oled_ssd1306.h"
 #include "camera_ov2640.h"
+#include "storage_io.h"
 #include "tinyusb.h"
 #include "tinyusb_default_config.h"
 #include "tinyusb_msc.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include "sd_test_io.h"
+#include "sd_tune.h"
 #if SOC_SDMMC_IO_POWER_EXTERNAL
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
 #endif
@@ -38,6 +41,8 @@
 static const char *TAG = "example";
 
 #define MOUNT_POINT "/sdcard"
+#define MIC_FILE_EXT "FLA" // FLA: lossless compressed, WAV: plain PCM
+#define MIC_SAMPLE_RATE_HZ 16000 // Stored rate: 48000 for full contact mic bandwidth, 8000 to save space
 #define EXAMPLE_IS_UHS1    (CONFIG_EXAMPLE_SDMMC_SPEED_UHS_I_SDR50 || CONFIG_EXAMPLE_SDMMC_SPEED_UHS_I_DDR50)
 
 #define OLED_I2C_SDA       41
@@ -186,7 +191,9 @@ static esp_err_t s_storage_init_sdmmc(sdmmc_card_t **card)
     sdmmc_card_t *sd_card = NULL;
 
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-#if CONFIG_EXAMPLE_SDMMC_SPEED_HS
+#if CONFIG_EXAMPLE_SDMMC_AUTO_TUNE
+    // Starts at Default Speed; sd_tune_apply() picks the clock.
+#elif CONFIG_EXAMPLE_SDMMC_SPEED_HS
     host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
 #elif CONFIG_EXAMPLE_SDMMC_SPEED_UHS_I_SDR50
     host.slot = SDMMC_HOST_SLOT_0;
@@ -249,6 +256,12 @@ static esp_err_t s_storage_init_sdmmc(sdmmc_card_t **card)
         vTaskDelay(pdMS_TO_TICKS(3000));
     }
 
+#if CONFIG_EXAMPLE_SDMMC_AUTO_TUNE
+    ret = sd_tune_apply(&host, sd_card);
+    if (ret != ESP_OK) {
+        goto clean;
+    }
+#endif
     sdmmc_card_print_info(stdout, sd_card);
     *card = sd_card;
     return ESP_OK;
@@ -321,10 +334,25 @@ static void s_usb_stop(void)
 }
 
 
+// Initializes NVS, used by the camera state and the BLE stack.
+static esp_err_t s_nvs_init(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    return err;
+}
+
 // Initializes peripherals and handles record/USB switching loop.
 void app_main(void)
 {
     esp_err_t ret;
+    ret = s_nvs_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "NVS init failed (%s)", esp_err_to_name(ret));
+    }
     camera_app_log_i2c_levels();
 
     ret = i2c_bus_init(I2C_NUM_1, OLED_I2C_SDA, OLED_I2C_SCL, I2C_SHARED_FREQ_HZ);
@@ -342,6 +370,10 @@ void app_main(void)
     }
     button_init();
     ble_trigger_init();
+    // Mic runs from boot so recordings start with pre-roll instead of I2S start-up.
+    if (mic_capture_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Mic init failed");
+    }
 
     sdmmc_card_t *card = NULL;
     ret = s_storage_init_sdmmc(&card);
@@ -349,6 +381,11 @@ void app_main(void)
         ESP_LOGE(TAG, "Failed to init SD card (%s)", esp_err_to_name(ret));
         return;
     }
+    // Before the first recording, where camera and mic open files at once.
+    ret = storage_io_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Storage writer init failed (%s), files are written directly", esp_err_to_name(ret));
+    }
 
     tinyusb_msc_storage_config_t storage_cfg = {
         .mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB,
@@ -377,6 +414,7 @@ void app_main(void)
     ESP_ERROR_CHECK(s_switch_mount(TINYUSB_MSC_STORAGE_MOUNT_USB));
 
     uint32_t file_index = 1;
+    bool recovered = false;
     while (true) {
         while (!button_is_recording()) {
             vTaskDelay(pdMS_TO_TICKS(50));
@@ -397,11 +435,11 @@ void app_main(void)
         bool use_index_name = true;
         if (ble_trigger_get_timestamp(timestamp, sizeof(timestamp))) {
             // 8.3-safe names using YYMMDDHH (hour resolution) for both media types.
-            snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/%s.WAV", timestamp);
+            snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/%s." MIC_FILE_EXT, timestamp);
             snprintf(video_path, sizeof(video_path), MOUNT_POINT"/%s.MJP", timestamp);
             use_index_name = false;
         } else {
-            snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/mic_%04u.wav", (unsigned)file_index);
+            snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/mic_%04u." MIC_FILE_EXT, (unsigned)file_index);
             // Use 8.3-compatible name to avoid FATFS EINVAL when LFN is disabled.
             snprintf(video_path, sizeof(video_path), MOUNT_POINT"/VID%04u.MJP", (unsigned)file_index);
         }
@@ -409,6 +447,11 @@ void app_main(void)
         if (!s_wait_for_mount(MOUNT_POINT, 2000)) {
             ESP_LOGE(TAG, "Mount not ready for %s", MOUNT_POINT);
         }
+        if (!recovered) {
+            // Recordings cut short by the last reset still carry streaming headers.
+            mic_capture_recover(MOUNT_POINT, NULL);
+            recovered = true;
+        }
 
         if (camera_app_is_ready() && !camera_app_is_recording()) {
             esp_err_t cam_ret = camera_app_start_record(video_path);
@@ -420,13 +463,13 @@ void app_main(void)
             }
         }
         int captured_seconds = 0;
-        ret = mic_capture_start(mic_path, 0);
+        ret = mic_capture_start(mic_path, 0, MIC_SAMPLE_RATE_HZ);
         if (ret != ESP_OK) {
             if (!use_index_name) {
                 ESP_LOGW(TAG, "Timestamped mic name failed (%s); using index", esp_err_to_name(ret));
-                snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/mic_%04u.wav", (unsigned)file_index);
+                snprintf(mic_path, sizeof(mic_path), MOUNT_POINT"/mic_%04u." MIC_FILE_EXT, (unsigned)file_index);
                 use_index_name = true;
-                ret = mic_capture_start(mic_path, 0);
+                ret = mic_capture_start(mic_path, 0, MIC_SAMPLE_RATE_HZ);
             }
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "Mic capture start failed");
@@ -453,6 +496,19 @@ void app_main(void)
 
         ESP_LOGI(TAG, "Exposing SD card over USB");
         camera_app_wait_for_stop();
+        storage_io_stats_t io;
+        storage_io_get_stats(&io);
+        ESP_LOGI(TAG, "Storage queue max %u chunks, %u KB in flight max, %u syncs",
+                 (unsigned)io.queued_max, (unsigned)(io.in_flight_bytes_max / 1024), (unsigned)io.syncs);
+#if CONFIG_EXAMPLE_SDMMC_AUTO_TUNE
+        sd_tune_info_t tune;
+        sd_tune_get_info(&tune);
+        if (tune.crc_errors > 0) {
+            ESP_LOGW(TAG, "SD CRC errors since boot: %u; card now at %u kHz",
+                     (unsigned)tune.crc_errors, (unsigned)tune.freq_khz);
+        }
+        sd_tune_save_fallback();
+#endif
         ESP_ERROR_CHECK(s_switch_mount(TINYUSB_MSC_STORAGE_MOUNT_USB));
         ESP_ERROR_CHECK(s_usb_start());
     }
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Restores the full timeline of a recording made with MIC_SILENCE_ELIDE.
+
+Reads the audio (WAV, or FLAC through the `flac` command line tool) and its
+.SIL markers, and writes a WAV with every left-out span put back as silence,
+or with --noise as white noise at the span's recorded level.
+
+    python tools/mic_restore.py MIC_0001.FLA mic_0001_full.wav
+"""
+import argparse
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import wave
+
+HEADER = struct.Struct('<4sBBHI')
+RECORD = struct.Struct('<QQhH')
+CHUNK_FRAMES = 65536
+
+
+def read_markers(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, channels, window, rate = HEADER.unpack_from(data)
+    if magic != b'MSIL' or version != 1:
+        sys.exit(f'{path}: not a version 1 silence marker file')
+    spans = []
+    # A record cut short by power loss is ignored.
+    for off in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        position, frames, level, _ = RECORD.unpack_from(data, off)
+        spans.append((position, frames, level))
+    return rate, channels, spans
+
+
+def sidecar_path(audio_path):
+    base = os.path.splitext(audio_path)[0]
+    for ext in ('.SIL', '.sil'):
+        if os.path.exists(base + ext):
+            return base + ext
+    sys.exit(f'No .SIL file next to {audio_path}')
+
+
+def open_audio(path, tmp_dir):
+    if os.path.splitext(path)[1].lower() in ('.fla', '.flac'):
+        decoded = os.path.join(tmp_dir, 'decoded.wav')
+        subprocess.run(['flac', '-d', '-s', '-f', '-o', decoded, path], check=True)
+        return wave.open(decoded, 'rb')
+    return wave.open(path, 'rb')
+
+
+def fill(out, frames, level, channels, width, noise, gain):
+    """Writes frames of silence, or noise at level (0.01 dB of a 24-bit full scale slot, before gain)."""
+    if not noise or level == -32768:
+        zero = bytes(CHUNK_FRAMES * channels * width)
+        while frames > 0:
+            n = min(frames, CHUNK_FRAMES)
+            out.writeframes(zero[:n * channels * width])
+            frames -= n
+        return
+    full_scale = 1 << (8 * width - 1)
+    rms = 10 ** (level / 2000) * gain * full_scale
+    top = full_scale - 1
+    while frames > 0:
+        n = min(frames, CHUNK_FRAMES)
+        chunk = bytearray()
+        for _ in range(n * channels):
+            s = max(-top, min(top, int(random.gauss(0, rms))))
+            chunk += s.to_bytes(width, 'little', signed=True)
+        out.writeframes(bytes(chunk))
+        frames -= n
+
+
+def restore(src, output, spans, noise, gain):
+    """Copies src to output with the spans put back; returns the stored and restored frame counts."""
+    channels = src.getnchannels()
+    width = src.getsampwidth()
+    position = 0
+    restored = 0
+    with wave.open(output, 'wb') as out:
+        out.setnchannels(channels)
+        out.setsampwidth(width)
+        out.setframerate(src.getframerate())
+        for span_at, span_frames, level in spans + [(src.getnframes(), 0, 0)]:
+            while position < span_at:
+                data = src.readframes(min(span_at - position, CHUNK_FRAMES))
+                if not data:
+                    sys.exit(f'Audio ends at frame {position}, before a marker at {span_at}')
+                out.writeframes(data)
+                position += len(data) // (channels * width)
+            fill(out, span_frames, level, channels, width, noise, gain)
+            restored += span_frames
+    return position, restored
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('audio', help='recording (.WAV or .FLA) with a .SIL file of the same name')
+    parser.add_argument('output', nargs='?', help='restored WAV (default: <audio>_full.wav)')
+    parser.add_argument('--noise', action='store_true', help='fill spans with noise at their level')
+    parser.add_argument('--gain', type=float, default=4.0, help='recording gain, for --noise (MIC_GAIN_MULT)')
+    args = parser.parse_args()
+
+    rate, channels, spans = read_markers(sidecar_path(args.audio))
+    output = args.output or os.path.splitext(args.audio)[0] + '_full.wav'
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        src = open_audio(args.audio, tmp_dir)
+        if src.getframerate() != rate or src.getnchannels() != channels:
+            sys.exit(f'{args.audio} does not match its markers ({rate} Hz, {channels} channels)')
+        position, restored = restore(src, output, spans, args.noise, args.gain)
+        src.close()
+    total = position + restored
+    print(f'{output}: {total / rate:.1f} s, {restored / rate:.1f} s restored in {len(spans)} spans '
+          f'({100 * restored / max(total, 1):.0f}%)')
+
+
+if __name__ == '__main__':
+    main()
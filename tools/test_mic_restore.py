@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Tests for mic_restore.py.
+
+    python -m unittest discover -s tools
+"""
+import os
+import struct
+import tempfile
+import unittest
+import wave
+
+import mic_restore
+
+RATE = 16000
+CHANNELS = 2
+WIDTH = 3
+
+
+def write_wav(path, frames):
+    """Writes frames (lists of per-channel ints) as a 24-bit WAV."""
+    with wave.open(path, 'wb') as w:
+        w.setnchannels(CHANNELS)
+        w.setsampwidth(WIDTH)
+        w.setframerate(RATE)
+        w.writeframes(b''.join(s.to_bytes(WIDTH, 'little', signed=True) for f in frames for s in f))
+
+
+def read_wav(path):
+    with wave.open(path, 'rb') as w:
+        data = w.readframes(w.getnframes())
+        step = CHANNELS * WIDTH
+        return [[int.from_bytes(data[i + c * WIDTH:i + (c + 1) * WIDTH], 'little', signed=True)
+                 for c in range(CHANNELS)] for i in range(0, len(data), step)]
+
+
+def write_markers(path, spans, tail=b''):
+    with open(path, 'wb') as f:
+        f.write(mic_restore.HEADER.pack(b'MSIL', 1, CHANNELS, 320, RATE))
+        for position, frames, level in spans:
+            f.write(mic_restore.RECORD.pack(position, frames, level, 0))
+        f.write(tail)
+
+
+class RestoreTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.audio = os.path.join(self.tmp.name, 'MIC_0001.WAV')
+        self.output = os.path.join(self.tmp.name, 'full.wav')
+        self.stored = [[i + 1, -(i + 1)] for i in range(1000)]
+        write_wav(self.audio, self.stored)
+
+    def tearDown(self):
+        self.tmp.cleanup()
+
+    def restore(self, spans, noise=False):
+        write_markers(os.path.splitext(self.audio)[0] + '.SIL', spans)
+        rate, channels, read = mic_restore.read_markers(mic_restore.sidecar_path(self.audio))
+        self.assertEqual((RATE, CHANNELS, spans), (rate, channels, read))
+        with wave.open(self.audio, 'rb') as src:
+            return mic_restore.restore(src, self.output, read, noise, 4.0)
+
+    def test_timeline_is_stored_frames_plus_spans(self):
+        # at the start, in between, back to back and at the end
+        spans = [(0, 300, -32768), (250, 7, -32768), (600, 1234, -6000), (600, 1, -32768), (1000, 99, -32768)]
+        position, restored = self.restore(spans)
+        self.assertEqual((1000, 300 + 7 + 1234 + 1 + 99), (position, restored))
+        out = read_wav(self.output)
+        self.assertEqual(len(self.stored) + restored, len(out))
+
+        # the stored frames land where the markers put them, silence in between
+        expected = []
+        at = 0
+        for span_at, frames, _ in spans + [(len(self.stored), 0, 0)]:
+            expected += self.stored[at:span_at] + [[0, 0]] * frames
+            at = span_at
+        self.assertEqual(expected, out)
+
+    def test_noise_fills_spans_at_their_level(self):
+        position, restored = self.restore([(500, 20000, -6000)], noise=True)
+        out = read_wav(self.output)
+        self.assertEqual(1000 + 20000, len(out))
+        self.assertEqual(self.stored[:500], out[:500])
+        self.assertEqual(self.stored[500:], out[20500:])
+        # -60 dB of a 24-bit slot, times the gain of 4
+        span = [s for f in out[500:20500] for s in f]
+        rms = (sum(s * s for s in span) / len(span)) ** 0.5
+        self.assertAlmostEqual(10 ** (-60 / 20) * 4 * (1 << 23), rms, delta=rms * 0.05)
+
+    def test_no_spans_copies_the_audio(self):
+        self.assertEqual((1000, 0), self.restore([]))
+        self.assertEqual(self.stored, read_wav(self.output))
+
+    def test_cut_record_is_ignored(self):
+        path = os.path.join(self.tmp.name, 'cut.SIL')
+        write_markers(path, [(10, 20, -32768)], tail=struct.pack('<Q', 30))
+        self.assertEqual((RATE, CHANNELS, [(10, 20, -32768)]), mic_restore.read_markers(path))
+
+    def test_marker_past_the_audio_fails(self):
+        with self.assertRaises(SystemExit):
+            self.restore([(1001, 5, -32768)])
+
+
+if __name__ == '__main__':
+    unittest.main()